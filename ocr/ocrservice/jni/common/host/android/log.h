@@ -0,0 +1,51 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Stand-in for the NDK logging header in host builds. Messages go to
+ * stderr, prefixed with their tag. Like the NDK headers, this also makes the
+ * fixed-width integer types available.
+ */
+
+#ifndef COMMON_HOST_ANDROID_LOG_H_
+#define COMMON_HOST_ANDROID_LOG_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  ANDROID_LOG_VERBOSE = 2,
+  ANDROID_LOG_DEBUG,
+  ANDROID_LOG_INFO,
+  ANDROID_LOG_WARN,
+  ANDROID_LOG_ERROR
+};
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+  va_list args;
+  int n;
+
+  (void) prio;
+  fprintf(stderr, "%s: ", tag);
+  va_start(args, fmt);
+  n = vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+
+  return n;
+}
+
+#endif /* COMMON_HOST_ANDROID_LOG_H_ */
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Plain C stand-in for the NEON intrinsics header in host builds, so that
+ * the NEON kernels can be run and compared against the scalar ones without
+ * an ARM device. Only the intrinsics the kernels use are provided. Each one
+ * follows the lane semantics of the ARM reference: narrowing truncates,
+ * saturating ops clamp, compares set all bits of a lane and multiply
+ * accumulate rounds the product before adding.
+ *
+ * This checks the kernels' arithmetic, not code generation; a device or
+ * emulator run of an NDK build is still needed for that.
+ */
+
+#ifndef COMMON_HOST_NEON_ARM_NEON_H_
+#define COMMON_HOST_NEON_ARM_NEON_H_
+
+#include <stdint.h>
+#include <string.h>
+
+typedef float float32_t;
+
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint8_t v[16]; } uint8x16_t;
+typedef struct { uint8x16_t val[2]; } uint8x16x2_t;
+typedef struct { uint16_t v[4]; } uint16x4_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { int16_t v[4]; } int16x4_t;
+typedef struct { int16_t v[8]; } int16x8_t;
+typedef struct { uint32_t v[2]; } uint32x2_t;
+typedef struct { uint32_t v[4]; } uint32x4_t;
+typedef struct { int32_t v[4]; } int32x4_t;
+typedef struct { uint64_t v[1]; } uint64x1_t;
+typedef struct { float32_t v[2]; } float32x2_t;
+typedef struct { float32_t v[4]; } float32x4_t;
+
+/* Loads, stores and lane access */
+
+static inline uint8x16_t vld1q_u8(const uint8_t *p) {
+  uint8x16_t r;
+  memcpy(r.v, p, sizeof(r.v));
+  return r;
+}
+
+static inline void vst1q_u8(uint8_t *p, uint8x16_t a) {
+  memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint8x16x2_t vld2q_u8(const uint8_t *p) {
+  uint8x16x2_t r;
+  for (int i = 0; i < 16; i++) {
+    r.val[0].v[i] = p[2 * i];
+    r.val[1].v[i] = p[2 * i + 1];
+  }
+  return r;
+}
+
+static inline int16x4_t vld1_s16(const int16_t *p) {
+  int16x4_t r;
+  memcpy(r.v, p, sizeof(r.v));
+  return r;
+}
+
+static inline void vst1q_s16(int16_t *p, int16x8_t a) {
+  memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline float32x4_t vld1q_f32(const float32_t *p) {
+  float32x4_t r;
+  memcpy(r.v, p, sizeof(r.v));
+  return r;
+}
+
+static inline void vst1q_f32(float32_t *p, float32x4_t a) {
+  memcpy(p, a.v, sizeof(a.v));
+}
+
+#define vget_lane_u64(a, lane) ((a).v[lane])
+#define vget_lane_f32(a, lane) ((a).v[lane])
+
+static inline uint8x8_t vget_low_u8(uint8x16_t a) {
+  uint8x8_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline uint8x8_t vget_high_u8(uint8x16_t a) {
+  uint8x8_t r;
+  memcpy(r.v, a.v + 8, sizeof(r.v));
+  return r;
+}
+
+static inline uint16x4_t vget_low_u16(uint16x8_t a) {
+  uint16x4_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline float32x2_t vget_low_f32(float32x4_t a) {
+  float32x2_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline float32x2_t vget_high_f32(float32x4_t a) {
+  float32x2_t r;
+  memcpy(r.v, a.v + 2, sizeof(r.v));
+  return r;
+}
+
+static inline uint8x16_t vcombine_u8(uint8x8_t lo, uint8x8_t hi) {
+  uint8x16_t r;
+  memcpy(r.v, lo.v, sizeof(lo.v));
+  memcpy(r.v + 8, hi.v, sizeof(hi.v));
+  return r;
+}
+
+static inline uint16x8_t vcombine_u16(uint16x4_t lo, uint16x4_t hi) {
+  uint16x8_t r;
+  memcpy(r.v, lo.v, sizeof(lo.v));
+  memcpy(r.v + 4, hi.v, sizeof(hi.v));
+  return r;
+}
+
+/* Broadcasts and reinterpretation */
+
+static inline uint8x16_t vdupq_n_u8(uint8_t x) {
+  uint8x16_t r;
+  for (int i = 0; i < 16; i++) r.v[i] = x;
+  return r;
+}
+
+static inline uint16x8_t vdupq_n_u16(uint16_t x) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = x;
+  return r;
+}
+
+static inline uint32x2_t vdup_n_u32(uint32_t x) {
+  uint32x2_t r;
+  r.v[0] = r.v[1] = x;
+  return r;
+}
+
+static inline float32x4_t vdupq_n_f32(float32_t x) {
+  float32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = x;
+  return r;
+}
+
+static inline int16x8_t vreinterpretq_s16_u16(uint16x8_t a) {
+  int16x8_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline uint16x8_t vreinterpretq_u16_s16(int16x8_t a) {
+  uint16x8_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline uint8x8_t vreinterpret_u8_u32(uint32x2_t a) {
+  uint8x8_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+static inline uint64x1_t vreinterpret_u64_u8(uint8x8_t a) {
+  uint64x1_t r;
+  memcpy(r.v, a.v, sizeof(r.v));
+  return r;
+}
+
+/* Integer arithmetic */
+
+static inline uint8x16_t vaddq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = (uint8_t) (a.v[i] + b.v[i]);
+  return a;
+}
+
+static inline uint8x16_t vsubq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = (uint8_t) (a.v[i] - b.v[i]);
+  return a;
+}
+
+static inline uint8x16_t vqaddq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) {
+    const int s = a.v[i] + b.v[i];
+    a.v[i] = (uint8_t) (s > 255 ? 255 : s);
+  }
+  return a;
+}
+
+static inline uint8x16_t vqsubq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) {
+    const int d = a.v[i] - b.v[i];
+    a.v[i] = (uint8_t) (d < 0 ? 0 : d);
+  }
+  return a;
+}
+
+static inline uint16x8_t vaddq_u16(uint16x8_t a, uint16x8_t b) {
+  for (int i = 0; i < 8; i++) a.v[i] = (uint16_t) (a.v[i] + b.v[i]);
+  return a;
+}
+
+static inline int16x8_t vaddq_s16(int16x8_t a, int16x8_t b) {
+  for (int i = 0; i < 8; i++) a.v[i] = (int16_t) (a.v[i] + b.v[i]);
+  return a;
+}
+
+static inline uint16x8_t vaddl_u8(uint8x8_t a, uint8x8_t b) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) (a.v[i] + b.v[i]);
+  return r;
+}
+
+static inline uint16x8_t vsubl_u8(uint8x8_t a, uint8x8_t b) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) (a.v[i] - b.v[i]);
+  return r;
+}
+
+static inline uint16x8_t vpaddlq_u8(uint8x16_t a) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) (a.v[2 * i] + a.v[2 * i + 1]);
+  return r;
+}
+
+static inline uint16x8_t vpadalq_u8(uint16x8_t acc, uint8x16_t a) {
+  for (int i = 0; i < 8; i++) {
+    acc.v[i] = (uint16_t) (acc.v[i] + a.v[2 * i] + a.v[2 * i + 1]);
+  }
+  return acc;
+}
+
+static inline uint32x4_t vpaddlq_u16(uint16x8_t a) {
+  uint32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = (uint32_t) a.v[2 * i] + a.v[2 * i + 1];
+  return r;
+}
+
+/* Shifts, widening and narrowing */
+
+static inline int16x8_t vshrq_n_s16(int16x8_t a, const int n) {
+  for (int i = 0; i < 8; i++) a.v[i] = (int16_t) (a.v[i] >> n);
+  return a;
+}
+
+static inline uint16x8_t vshrq_n_u16(uint16x8_t a, const int n) {
+  for (int i = 0; i < 8; i++) a.v[i] = (uint16_t) (a.v[i] >> n);
+  return a;
+}
+
+static inline uint16x8_t vshlq_n_u16(uint16x8_t a, const int n) {
+  for (int i = 0; i < 8; i++) a.v[i] = (uint16_t) (a.v[i] << n);
+  return a;
+}
+
+static inline uint16x8_t vshll_n_u8(uint8x8_t a, const int n) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) (a.v[i] << n);
+  return r;
+}
+
+static inline uint8x8_t vshrn_n_u16(uint16x8_t a, const int n) {
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint8_t) (a.v[i] >> n);
+  return r;
+}
+
+static inline uint16x4_t vshrn_n_u32(uint32x4_t a, const int n) {
+  uint16x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = (uint16_t) (a.v[i] >> n);
+  return r;
+}
+
+static inline uint8x8_t vmovn_u16(uint16x8_t a) {
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = (uint8_t) a.v[i];
+  return r;
+}
+
+static inline uint16x8_t vmovl_u8(uint8x8_t a) {
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) r.v[i] = a.v[i];
+  return r;
+}
+
+static inline uint32x4_t vmovl_u16(uint16x4_t a) {
+  uint32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i];
+  return r;
+}
+
+static inline int32x4_t vmovl_s16(int16x4_t a) {
+  int32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i];
+  return r;
+}
+
+/* Bitwise ops and compares; true lanes have every bit set */
+
+static inline uint8x16_t vandq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] &= b.v[i];
+  return a;
+}
+
+static inline uint8x16_t vorrq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] |= b.v[i];
+  return a;
+}
+
+static inline uint8x8_t vorr_u8(uint8x8_t a, uint8x8_t b) {
+  for (int i = 0; i < 8; i++) a.v[i] |= b.v[i];
+  return a;
+}
+
+static inline uint8x16_t vcgtq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = a.v[i] > b.v[i] ? 0xff : 0;
+  return a;
+}
+
+static inline uint8x16_t vcltq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = a.v[i] < b.v[i] ? 0xff : 0;
+  return a;
+}
+
+static inline uint8x16_t vcgeq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = a.v[i] >= b.v[i] ? 0xff : 0;
+  return a;
+}
+
+static inline uint8x16_t vceqq_u8(uint8x16_t a, uint8x16_t b) {
+  for (int i = 0; i < 16; i++) a.v[i] = a.v[i] == b.v[i] ? 0xff : 0;
+  return a;
+}
+
+/* Floating point */
+
+static inline float32x4_t vcvtq_f32_u32(uint32x4_t a) {
+  float32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = (float32_t) a.v[i];
+  return r;
+}
+
+static inline float32x4_t vcvtq_f32_s32(int32x4_t a) {
+  float32x4_t r;
+  for (int i = 0; i < 4; i++) r.v[i] = (float32_t) a.v[i];
+  return r;
+}
+
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b) {
+  for (int i = 0; i < 4; i++) a.v[i] += b.v[i];
+  return a;
+}
+
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b) {
+  for (int i = 0; i < 4; i++) a.v[i] -= b.v[i];
+  return a;
+}
+
+static inline float32x2_t vadd_f32(float32x2_t a, float32x2_t b) {
+  a.v[0] += b.v[0];
+  a.v[1] += b.v[1];
+  return a;
+}
+
+static inline float32x2_t vpadd_f32(float32x2_t a, float32x2_t b) {
+  float32x2_t r;
+  r.v[0] = a.v[0] + a.v[1];
+  r.v[1] = b.v[0] + b.v[1];
+  return r;
+}
+
+static inline float32x4_t vmulq_n_f32(float32x4_t a, float32_t b) {
+  for (int i = 0; i < 4; i++) a.v[i] *= b;
+  return a;
+}
+
+static inline float32x4_t vmlaq_f32(float32x4_t acc, float32x4_t a, float32x4_t b) {
+  for (int i = 0; i < 4; i++) {
+    const volatile float32_t product = a.v[i] * b.v[i];
+    acc.v[i] += product;
+  }
+  return acc;
+}
+
+#endif /* COMMON_HOST_NEON_ARM_NEON_H_ */
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Stand-in for the NDK cpufeatures header in host builds that use the
+ * reference arm_neon.h next to it. NEON is always reported as present.
+ */
+
+#ifndef COMMON_HOST_NEON_CPU_FEATURES_H_
+#define COMMON_HOST_NEON_CPU_FEATURES_H_
+
+#include <stdint.h>
+
+enum {
+  ANDROID_CPU_ARM_FEATURE_ARMv7 = (1 << 0),
+  ANDROID_CPU_ARM_FEATURE_VFPv3 = (1 << 1),
+  ANDROID_CPU_ARM_FEATURE_NEON = (1 << 2)
+};
+
+static inline uint64_t android_getCpuFeatures(void) {
+  return ANDROID_CPU_ARM_FEATURE_ARMv7 | ANDROID_CPU_ARM_FEATURE_VFPv3 |
+      ANDROID_CPU_ARM_FEATURE_NEON;
+}
+
+#endif /* COMMON_HOST_NEON_CPU_FEATURES_H_ */
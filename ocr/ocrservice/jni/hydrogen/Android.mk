@@ -7,12 +7,22 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := libhydrogen
 
 LOCAL_SRC_FILES += \
+  src/arena.cpp \
+  src/batchdetector.cpp \
+  src/boxgrid.cpp \
   src/clusterer.cpp \
+  src/conncomp.cpp \
+  src/edgekernels.cpp \
+  src/grayhist.cpp \
   src/hydrogentextdetector.cpp \
   src/thresholder.cpp \
+  src/threadpool.cpp \
   src/utilities.cpp \
   src/validator.cpp
 
+LOCAL_SRC_FILES += \
+  ../imageutils/similar.cpp
+
 LOCAL_SRC_FILES += \
   jni/hydrogentextdetector.cpp \
   jni/thresholder.cpp \
@@ -20,11 +30,19 @@ LOCAL_SRC_FILES += \
 
 LOCAL_C_INCLUDES += \
   $(LOCAL_PATH)/src \
-  $(LOCAL_PATH)/include/leptonica
+  $(LOCAL_PATH)/include/leptonica \
+  $(LOCAL_PATH)/../common \
+  $(LOCAL_PATH)/../imageutils
 
 LOCAL_LDLIBS += \
   -llog
 
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+  LOCAL_CFLAGS += -DHAVE_ARMEABI_V7A=1 -mfloat-abi=softfp -mfpu=neon
+  LOCAL_C_INCLUDES += $(NDK_ROOT)/sources/cpufeatures
+  LOCAL_STATIC_LIBRARIES += cpufeatures
+endif
+
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_PRELINK_MODULE := false
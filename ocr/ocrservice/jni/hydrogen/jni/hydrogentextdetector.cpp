@@ -63,6 +63,30 @@ float getFloatField(JNIEnv *env, jclass &clazz, jobject &obj, const char *field)
   return (float) env->GetFloatField(obj, fieldID);
 }
 
+void setBoolField(JNIEnv *env, jclass &clazz, jobject &obj, const char *field, bool value) {
+  jfieldID fieldID = env->GetFieldID(clazz, field, "Z");
+
+  env->SetBooleanField(obj, fieldID, value ? JNI_TRUE : JNI_FALSE);
+}
+
+void setIntField(JNIEnv *env, jclass &clazz, jobject &obj, const char *field, int value) {
+  jfieldID fieldID = env->GetFieldID(clazz, field, "I");
+
+  env->SetIntField(obj, fieldID, (jint) value);
+}
+
+void setFloatArrayField(JNIEnv *env, jclass &clazz, jobject &obj, const char *field,
+                        const float *values, int count) {
+  jfieldID fieldID = env->GetFieldID(clazz, field, "[F");
+  jfloatArray array = (jfloatArray) env->GetObjectField(obj, fieldID);
+
+  if (array != NULL) {
+    count = L_MIN(count, env->GetArrayLength(array));
+    env->SetFloatArrayRegion(array, 0, count, (const jfloat *) values);
+    env->DeleteLocalRef(array);
+  }
+}
+
 void getStringField(JNIEnv *env, jclass &clazz, jobject &obj, const char *field,
                     char *dst) {
   jfieldID fieldID = env->GetFieldID(clazz, field, "Ljava/lang/String;");
@@ -94,6 +118,17 @@ void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetParam
   getStringField(env, paramClass, params, "out_dir", myParams->out_dir);
 
   myParams->debug = getBoolField(env, paramClass, params, "debug");
+  myParams->num_threads = getIntField(env, paramClass, params, "num_threads");
+  myParams->parallel_passes = getBoolField(env, paramClass, params, "parallel_passes");
+
+  myParams->streaming = getBoolField(env, paramClass, params, "streaming");
+  myParams->stream_tile_diff = getIntField(env, paramClass, params, "stream_tile_diff");
+  myParams->stream_max_reuse = getIntField(env, paramClass, params, "stream_max_reuse");
+
+  myParams->coarse_reduction = getIntField(env, paramClass, params, "coarse_reduction");
+  myParams->coarse_margin = getIntField(env, paramClass, params, "coarse_margin");
+  myParams->coarse_min_area = getIntField(env, paramClass, params, "coarse_min_area");
+
   myParams->edge_tile_x = getIntField(env, paramClass, params, "edge_tile_x");
   myParams->edge_tile_y = getIntField(env, paramClass, params, "edge_tile_y");
   myParams->edge_thresh = getIntField(env, paramClass, params, "edge_thresh");
@@ -106,11 +141,15 @@ void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetParam
   myParams->skew_sweep_reduction = getIntField(env, paramClass, params, "skew_sweep_reduction");
   myParams->skew_search_reduction = getIntField(env, paramClass, params, "skew_search_reduction");
   myParams->skew_search_min_delta = getFloatField(env, paramClass, params, "skew_search_min_delta");
+  myParams->skew_reuse_max_diff = getIntField(env, paramClass, params, "skew_reuse_max_diff");
+  myParams->skew_reuse_max_count = getIntField(env, paramClass, params, "skew_reuse_max_count");
+  myParams->skew_rotate_region = getBoolField(env, paramClass, params, "skew_rotate_region");
 
   myParams->single_min_aspect = getFloatField(env, paramClass, params, "single_min_aspect");
   myParams->single_max_aspect = getFloatField(env, paramClass, params, "single_max_aspect");
   myParams->single_min_area = getIntField(env, paramClass, params, "single_min_area");
   myParams->single_min_density = getFloatField(env, paramClass, params, "single_min_density");
+  myParams->single_confidence = getBoolField(env, paramClass, params, "single_confidence");
 
   myParams->pair_h_ratio = getFloatField(env, paramClass, params, "pair_h_ratio");
   myParams->pair_d_ratio = getFloatField(env, paramClass, params, "pair_d_ratio");
@@ -193,17 +232,21 @@ jfloatArray Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeG
 
   HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
   NUMA *confs = ptr->GetTextConfs();
-  l_int32 count = numaGetCount(confs);
+  l_int32 count = confs ? numaGetCount(confs) : 0;
   jfloatArray ret = env->NewFloatArray(count);
   l_float32 nval;
-  jfloat jval;
 
-  if (ret != NULL) {
+  // Copy into the array with a single JNI call
+  if (ret != NULL && count > 0) {
+    jfloat *values = new jfloat[count];
+
     for (int i = 0; i < count; i++) {
       numaGetFValue(confs, i, &nval);
-      jval = (jfloat) nval;
-      env->SetFloatArrayRegion(ret, i, 1, &jval);
+      values[i] = (jfloat) nval;
     }
+
+    env->SetFloatArrayRegion(ret, 0, count, values);
+    delete[] values;
   }
 
   numaDestroy(&confs);
@@ -211,6 +254,52 @@ jfloatArray Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeG
   return ret;
 }
 
+jint Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeExportResults(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr,
+    jobject buffer,
+    jint flags) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+  l_uint8 *bytes = (l_uint8 *) env->GetDirectBufferAddress(buffer);
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+
+  if (bytes == NULL || capacity < 0) {
+    return -1;
+  }
+
+  return (jint) ptr->ExportResults(bytes, (l_int32) L_MIN(capacity, 0x7fffffff), flags);
+}
+
+void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeGetStats(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr,
+    jobject stats) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+  const HydrogenTextDetector::DetectorStats *myStats = ptr->GetStats();
+
+  jclass statsClass = env->GetObjectClass(stats);
+
+  setFloatArrayField(env, statsClass, stats, "wall_ms", myStats->wall_ms,
+                     HydrogenTextDetector::NUM_STAGES);
+  setFloatArrayField(env, statsClass, stats, "cpu_ms", myStats->cpu_ms,
+                     HydrogenTextDetector::NUM_STAGES);
+
+  setIntField(env, statsClass, stats, "edge_tiles_changed", myStats->edge_tiles_changed);
+  setBoolField(env, statsClass, stats, "reused_areas", myStats->reused_areas);
+  setIntField(env, statsClass, stats, "extracted_regions", myStats->extracted_regions);
+  setIntField(env, statsClass, stats, "components", myStats->components);
+  setIntField(env, statsClass, stats, "pairs_removed", myStats->pairs_removed);
+  setIntField(env, statsClass, stats, "clusters", myStats->clusters);
+  setIntField(env, statsClass, stats, "fragments_merged", myStats->fragments_merged);
+  setIntField(env, statsClass, stats, "bytes_allocated", myStats->bytes_allocated);
+}
+
 jint Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeGetSourceImage(
     JNIEnv *env,
     jclass clazz,
@@ -235,6 +324,106 @@ void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetSourc
   ptr->SetSourceImage(pix);
 }
 
+void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetSourceLuminance(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr,
+    jbyteArray data,
+    jint width,
+    jint height,
+    jint stride) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+
+  // Pin the frame rather than copying it; it is only read once
+  void *bytes = env->GetPrimitiveArrayCritical(data, NULL);
+
+  if (bytes == NULL) {
+    return;
+  }
+
+  ptr->SetSourceLuminance((const l_uint8 *) bytes, width, height, stride);
+
+  env->ReleasePrimitiveArrayCritical(data, bytes, JNI_ABORT);
+}
+
+void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetRegionsOfInterest(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr,
+    jintArray rois) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+
+  if (rois == NULL) {
+    ptr->SetRegionsOfInterest(NULL);
+    return;
+  }
+
+  jsize count = env->GetArrayLength(rois) / 4;
+  jint *values = env->GetIntArrayElements(rois, NULL);
+
+  if (values == NULL) {
+    return;
+  }
+
+  BOXA *boxa = boxaCreate(count);
+
+  for (int i = 0; i < count; i++) {
+    BOX *box = boxCreate(values[4 * i], values[4 * i + 1], values[4 * i + 2], values[4 * i + 3]);
+
+    if (box) {
+      boxaAddBox(boxa, box, L_INSERT);
+    }
+  }
+
+  env->ReleaseIntArrayElements(rois, values, JNI_ABORT);
+
+  ptr->SetRegionsOfInterest(boxa);
+  boxaDestroy(&boxa);
+}
+
+void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeSetMotion(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr,
+    jfloat dx,
+    jfloat dy,
+    jfloatArray areaDeltas) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+
+  if (areaDeltas == NULL) {
+    ptr->SetMotion(dx, dy, NULL, 0);
+    return;
+  }
+
+  jsize count = env->GetArrayLength(areaDeltas) / 2;
+  jfloat *deltas = env->GetFloatArrayElements(areaDeltas, NULL);
+
+  if (deltas == NULL) {
+    return;
+  }
+
+  ptr->SetMotion(dx, dy, (l_float32 *) deltas, count);
+
+  env->ReleaseFloatArrayElements(areaDeltas, deltas, JNI_ABORT);
+}
+
+void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeResetStream(
+    JNIEnv *env,
+    jclass clazz,
+    jint nativePtr) {
+  if (DEBUG_MODE) LOGV(__FUNCTION__);
+
+  HydrogenTextDetector *ptr = (HydrogenTextDetector *) nativePtr;
+
+  ptr->ResetStream();
+}
+
 void Java_com_googlecode_eyesfree_textdetect_HydrogenTextDetector_nativeDetectText(
     JNIEnv *env,
     jclass clazz,
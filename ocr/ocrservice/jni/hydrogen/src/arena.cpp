@@ -0,0 +1,229 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "leptonica.h"
+#include "arena.h"
+
+/* Alignment of every allocation, enough for any scalar or SIMD load */
+#define ARENA_ALIGN 16
+
+/* Block header size, rounded up so that block data stays aligned */
+#define ARENA_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+static ArenaBlock *CreateBlock(size_t size) {
+  ArenaBlock *block;
+
+  if ((block = (ArenaBlock *) malloc(ARENA_HEADER + size)) == NULL)
+    return NULL;
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+static void DestroyBlocks(ArenaBlock *block) {
+  ArenaBlock *next;
+
+  while (block) {
+    next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+/*!
+ *  arenaCreate()
+ *
+ *      Input:  block_size (bytes to reserve up front)
+ *      Return: arena, or null on error
+ */
+Arena *arenaCreate(size_t block_size) {
+  Arena *arena;
+
+  PROCNAME("arenaCreate");
+
+  if ((arena = (Arena *) calloc(1, sizeof(Arena))) == NULL)
+    return (Arena *) ERROR_PTR("arena not made", procName, NULL);
+
+  arena->block_size = L_MAX(ARENA_ALIGN, block_size);
+
+  if ((arena->blocks = CreateBlock(arena->block_size)) == NULL) {
+    free(arena);
+    return (Arena *) ERROR_PTR("block not made", procName, NULL);
+  }
+
+  return arena;
+}
+
+void arenaDestroy(Arena **parena) {
+  if (!parena || !*parena)
+    return;
+
+  DestroyBlocks((*parena)->blocks);
+  free(*parena);
+
+  *parena = NULL;
+}
+
+/*!
+ *  arenaReset()
+ *
+ *      Input:  arena
+ *
+ *  Notes:
+ *      (1) Invalidates every allocation made since the last reset.
+ *      (2) If the last call overflowed into extra blocks, they are replaced
+ *          with a single block large enough for the peak usage, so a
+ *          steady workload stops calling malloc after its first frames.
+ */
+void arenaReset(Arena *arena) {
+  ArenaBlock *block;
+
+  if (!arena)
+    return;
+
+  if (arena->blocks && arena->blocks->next) {
+    if ((block = CreateBlock(L_MAX(arena->block_size, arena->peak))) != NULL) {
+      DestroyBlocks(arena->blocks);
+      arena->blocks = block;
+    }
+  }
+
+  for (block = arena->blocks; block; block = block->next) {
+    block->used = 0;
+  }
+
+  arena->used = 0;
+}
+
+/*!
+ *  arenaAlloc()
+ *
+ *      Input:  arena (can be null)
+ *              size (bytes)
+ *      Return: uninitialized memory, or null on error
+ *
+ *  Notes:
+ *      (1) With a null arena this is plain malloc(), and the memory must be
+ *          released with arenaFree().
+ */
+void *arenaAlloc(Arena *arena, size_t size) {
+  l_uint8 *ptr;
+  ArenaBlock *block;
+
+  PROCNAME("arenaAlloc");
+
+  if (!arena)
+    return malloc(L_MAX(1, size));
+
+  size = (L_MAX(1, size) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  /* Only the newest block has room; older ones are full */
+  block = arena->blocks;
+  if (!block || block->size - block->used < size) {
+    if ((block = CreateBlock(L_MAX(arena->block_size, size))) == NULL)
+      return ERROR_PTR("block not made", procName, NULL);
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  ptr = (l_uint8 *) block + ARENA_HEADER + block->used;
+  block->used += size;
+
+  arena->used += size;
+  arena->peak = L_MAX(arena->peak, arena->used);
+
+  return ptr;
+}
+
+void *arenaCalloc(Arena *arena, size_t n, size_t size) {
+  void *ptr;
+
+  if (!arena)
+    return calloc(L_MAX(1, n), L_MAX(1, size));
+
+  if ((ptr = arenaAlloc(arena, n * size)) != NULL)
+    memset(ptr, 0, n * size);
+
+  return ptr;
+}
+
+/*!
+ *  arenaRealloc()
+ *
+ *      Input:  arena (can be null)
+ *              ptr (previous allocation from this arena)
+ *              oldsize (size of the previous allocation)
+ *              newsize
+ *      Return: memory holding the first min(oldsize, newsize) bytes of ptr,
+ *              or null on error
+ *
+ *  Notes:
+ *      (1) The newest allocation grows in place when its block has room.
+ *          Otherwise the contents are copied and the old space is only
+ *          reclaimed by the next reset.
+ */
+void *arenaRealloc(Arena *arena, void *ptr, size_t oldsize, size_t newsize) {
+  size_t oldalloc, newalloc;
+  l_uint8 *end;
+  void *ptrd;
+  ArenaBlock *block;
+
+  if (!arena)
+    return realloc(ptr, L_MAX(1, newsize));
+  if (!ptr)
+    return arenaAlloc(arena, newsize);
+
+  oldalloc = (L_MAX(1, oldsize) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+  newalloc = (L_MAX(1, newsize) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  block = arena->blocks;
+  end = (l_uint8 *) block + ARENA_HEADER + block->used;
+
+  if ((l_uint8 *) ptr + oldalloc == end && block->used - oldalloc + newalloc <= block->size) {
+    block->used = block->used - oldalloc + newalloc;
+    arena->used = arena->used - oldalloc + newalloc;
+    arena->peak = L_MAX(arena->peak, arena->used);
+
+    return ptr;
+  }
+
+  if ((ptrd = arenaAlloc(arena, newsize)) != NULL)
+    memcpy(ptrd, ptr, L_MIN(oldsize, newsize));
+
+  return ptrd;
+}
+
+/*!
+ *  arenaFree()
+ *
+ *      Input:  arena (can be null)
+ *              ptr
+ *
+ *  Notes:
+ *      (1) Frees ptr when it came from the heap. Arena memory is left for
+ *          arenaReset().
+ */
+void arenaFree(Arena *arena, void *ptr) {
+  if (!arena)
+    free(ptr);
+}
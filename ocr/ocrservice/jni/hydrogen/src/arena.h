@@ -0,0 +1,59 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_ARENA_H_
+#define HYDROGEN_ARENA_H_
+
+#include <cstddef>
+
+#include "leptonica.h"
+
+/* Bump allocator for scratch memory that lives for one detection call.
+ * Allocations are never freed individually; arenaReset() releases them all
+ * at once and keeps the memory for the next call.
+ *
+ * An arena may only be used by one thread at a time.
+ */
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t used;
+};
+
+struct Arena {
+  ArenaBlock *blocks;
+  size_t block_size;
+
+  /* Bytes handed out since the last reset, and the most ever handed out */
+  size_t used;
+  size_t peak;
+};
+
+Arena *arenaCreate(size_t block_size);
+
+void arenaDestroy(Arena **parena);
+
+void arenaReset(Arena *arena);
+
+void *arenaAlloc(Arena *arena, size_t size);
+
+void *arenaCalloc(Arena *arena, size_t n, size_t size);
+
+void *arenaRealloc(Arena *arena, void *ptr, size_t oldsize, size_t newsize);
+
+void arenaFree(Arena *arena, void *ptr);
+
+#endif /* HYDROGEN_ARENA_H_ */
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+
+#include "leptonica.h"
+#include "batchdetector.h"
+#include "hydrogentextdetector.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+BatchTextDetector::BatchTextDetector(l_int32 num_workers) {
+  num_workers_ = L_MAX(1, num_workers);
+  pool_ = new ThreadPool(num_workers_);
+  detectors_ = (HydrogenTextDetector **) malloc(num_workers_ * sizeof(HydrogenTextDetector *));
+  ranges_ = (WorkRange *) malloc(num_workers_ * sizeof(WorkRange));
+
+  for (int i = 0; i < num_workers_; i++) {
+    detectors_[i] = new HydrogenTextDetector();
+    pthread_mutex_init(&ranges_[i].mutex, NULL);
+    ranges_[i].begin = 0;
+    ranges_[i].end = 0;
+  }
+
+  load_ = NULL;
+  load_arg_ = NULL;
+  result_ = NULL;
+  result_arg_ = NULL;
+  pthread_mutex_init(&result_mutex_, NULL);
+}
+
+BatchTextDetector::~BatchTextDetector() {
+  delete pool_;
+
+  for (int i = 0; i < num_workers_; i++) {
+    delete detectors_[i];
+    pthread_mutex_destroy(&ranges_[i].mutex);
+  }
+
+  free(detectors_);
+  free(ranges_);
+  pthread_mutex_destroy(&result_mutex_);
+}
+
+HydrogenTextDetector::TextDetectorParameters *BatchTextDetector::GetMutableParameters() {
+  return &parameters_;
+}
+
+l_int32 BatchTextDetector::GetNumWorkers() {
+  return num_workers_;
+}
+
+void BatchTextDetector::Run(l_int32 count, LoadFunction load, void *load_arg,
+                            ResultFunction result, void *result_arg) {
+  HydrogenTextDetector::TextDetectorParameters *params;
+
+  if (count <= 0 || !load || !result)
+    return;
+
+  load_ = load;
+  load_arg_ = load_arg;
+  result_ = result;
+  result_arg_ = result_arg;
+
+  // Split the batch into contiguous ranges, one per worker
+  for (int i = 0; i < num_workers_; i++) {
+    params = detectors_[i]->GetMutableParameters();
+    *params = parameters_;
+    params->num_threads = 1;
+    params->parallel_passes = false;
+
+    // Batch images are unrelated, so nothing carries over between them
+    params->streaming = false;
+    params->skew_reuse_max_diff = -1;
+
+    ranges_[i].begin = (l_int32) ((l_float64) count * i / num_workers_);
+    ranges_[i].end = (l_int32) ((l_float64) count * (i + 1) / num_workers_);
+  }
+
+  pool_->ParallelFor(num_workers_, WorkerTask, this);
+
+  load_ = NULL;
+  load_arg_ = NULL;
+  result_ = NULL;
+  result_arg_ = NULL;
+}
+
+void BatchTextDetector::WorkerTask(void *arg, l_int32 worker) {
+  BatchTextDetector *batch = (BatchTextDetector *) arg;
+  l_int32 index;
+
+  while (batch->ClaimIndex(worker, &index)) {
+    batch->ProcessImage(worker, index);
+  }
+}
+
+bool BatchTextDetector::ClaimIndex(l_int32 worker, l_int32 *pindex) {
+  WorkRange *range = &ranges_[worker];
+
+  while (true) {
+    pthread_mutex_lock(&range->mutex);
+    if (range->begin < range->end) {
+      *pindex = range->begin++;
+      pthread_mutex_unlock(&range->mutex);
+      return true;
+    }
+    pthread_mutex_unlock(&range->mutex);
+
+    if (!Steal(worker))
+      return false;
+  }
+}
+
+bool BatchTextDetector::Steal(l_int32 worker) {
+  l_int32 i, victim, size, max_size, mid, end;
+  WorkRange *range;
+
+  // Pick the worker with the most unclaimed images
+  victim = -1;
+  max_size = 0;
+  for (i = 0; i < num_workers_; i++) {
+    if (i == worker)
+      continue;
+
+    range = &ranges_[i];
+    pthread_mutex_lock(&range->mutex);
+    size = range->end - range->begin;
+    pthread_mutex_unlock(&range->mutex);
+
+    if (size > max_size) {
+      max_size = size;
+      victim = i;
+    }
+  }
+
+  // Ranges only shrink while a batch runs, so an empty scan means every
+  // image has been claimed. A range stolen mid-scan is still processed by
+  // its thief, which only costs this worker an early exit.
+  if (victim < 0)
+    return false;
+
+  range = &ranges_[victim];
+  pthread_mutex_lock(&range->mutex);
+  size = range->end - range->begin;
+  mid = range->end - (size + 1) / 2;
+  end = range->end;
+  if (size > 0)
+    range->end = mid;
+  pthread_mutex_unlock(&range->mutex);
+
+  // Lost a race for the victim's last images; scan again
+  if (size <= 0)
+    return true;
+
+  range = &ranges_[worker];
+  pthread_mutex_lock(&range->mutex);
+  range->begin = mid;
+  range->end = end;
+  pthread_mutex_unlock(&range->mutex);
+
+  return true;
+}
+
+void BatchTextDetector::ProcessImage(l_int32 worker, l_int32 index) {
+  l_float64 start;
+  PIX *pix;
+  Result result;
+  HydrogenTextDetector *detector = detectors_[worker];
+
+  result.index = index;
+  result.worker = worker;
+  result.ok = false;
+  result.areas = NULL;
+  result.confs = NULL;
+  result.skew_angle = 0.0;
+  result.detect_ms = 0.0;
+  result.stats = NULL;
+
+  start = getWallTimeMs();
+  pix = load_(load_arg_, index);
+  result.load_ms = (l_float32) (getWallTimeMs() - start);
+
+  if (pix) {
+    start = getWallTimeMs();
+    detector->SetSourceImage(pix);
+    detector->DetectText();
+    result.detect_ms = (l_float32) (getWallTimeMs() - start);
+    result.stats = detector->GetStats();
+
+    result.ok = true;
+    result.areas = detector->GetTextAreas();
+    result.confs = detector->GetTextConfs();
+    result.skew_angle = detector->GetSkewAngle();
+
+    pixDestroy(&pix);
+  }
+
+  pthread_mutex_lock(&result_mutex_);
+  result_(result_arg_, &result);
+  pthread_mutex_unlock(&result_mutex_);
+
+  pixaDestroy(&result.areas);
+  numaDestroy(&result.confs);
+  detector->Clear();
+}
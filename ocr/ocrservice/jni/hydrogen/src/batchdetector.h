@@ -0,0 +1,123 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_BATCHDETECTOR_H_
+#define HYDROGEN_BATCHDETECTOR_H_
+
+#include <pthread.h>
+
+#include "leptonica.h"
+#include "hydrogentextdetector.h"
+
+class ThreadPool;
+
+/**
+ * Runs text detection over a batch of independent images. Every worker owns
+ * a HydrogenTextDetector, claims images from its own range of the batch and
+ * steals half of another worker's range when its own runs out, so uneven
+ * documents balance without a shared queue.
+ *
+ * Images are loaded by the worker that claims them, so no more than one
+ * image per worker is held in memory at a time.
+ */
+class BatchTextDetector {
+public:
+  // Result for one image. The areas and confs are only valid during the
+  // result callback; take clones to keep them.
+  struct Result {
+    // Index of the image within the batch
+    l_int32 index;
+
+    // False if the image could not be loaded
+    bool ok;
+
+    PIXA *areas;
+    NUMA *confs;
+    l_float32 skew_angle;
+
+    // Wall time spent loading the image and detecting text, in milliseconds
+    l_float32 load_ms;
+    l_float32 detect_ms;
+
+    // Per-stage breakdown of the detection, or NULL if the image could not
+    // be loaded
+    const HydrogenTextDetector::DetectorStats *stats;
+
+    // Worker that processed the image
+    l_int32 worker;
+  };
+
+  // Returns the image at index, or NULL if it can't be loaded. Called from
+  // worker threads, possibly concurrently.
+  typedef PIX *(*LoadFunction)(void *arg, l_int32 index);
+
+  // Receives each result as it completes. Calls are serialized, but arrive
+  // in completion order rather than batch order.
+  typedef void (*ResultFunction)(void *arg, const Result *result);
+
+  // Creates a detector with num_workers workers, including the calling
+  // thread.
+  explicit BatchTextDetector(l_int32 num_workers);
+
+  ~BatchTextDetector();
+
+  // Parameters applied to every worker's detector. Each worker runs its
+  // detector serially and without streaming, since the workers already
+  // keep every thread busy and batch images are unrelated.
+  HydrogenTextDetector::TextDetectorParameters *GetMutableParameters();
+
+  l_int32 GetNumWorkers();
+
+  // Detects text in images [0, count) and blocks until all results have
+  // been delivered.
+  void Run(l_int32 count, LoadFunction load, void *load_arg, ResultFunction result,
+           void *result_arg);
+
+private:
+  // Range of batch indices owned by one worker
+  struct WorkRange {
+    pthread_mutex_t mutex;
+    l_int32 begin;
+    l_int32 end;
+  };
+
+  static void WorkerTask(void *arg, l_int32 worker);
+
+  // Claims the next index for worker, stealing if needed. Returns false
+  // once the whole batch has been claimed.
+  bool ClaimIndex(l_int32 worker, l_int32 *pindex);
+
+  // Moves the back half of the largest other range to worker's range.
+  bool Steal(l_int32 worker);
+
+  void ProcessImage(l_int32 worker, l_int32 index);
+
+  HydrogenTextDetector::TextDetectorParameters parameters_;
+
+  l_int32 num_workers_;
+  ThreadPool *pool_;
+  HydrogenTextDetector **detectors_;
+  WorkRange *ranges_;
+
+  // Current batch
+  LoadFunction load_;
+  void *load_arg_;
+  ResultFunction result_;
+  void *result_arg_;
+  pthread_mutex_t result_mutex_;
+};
+
+#endif /* HYDROGEN_BATCHDETECTOR_H_ */
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+
+#include "leptonica.h"
+#include "boxgrid.h"
+
+/* Minimum cell dimension, in pixels */
+#define MIN_CELL_SIZE 8
+
+/* Upper bound on grid cells per indexed box */
+#define MAX_CELLS_PER_BOX 4
+
+static int CompareIndices(const void *a, const void *b) {
+  return *(const l_int32 *) a - *(const l_int32 *) b;
+}
+
+/*!
+ *  boxGridCreate()
+ *
+ *      Input:  pixa (boxes to index)
+ *              arena (<optional> memory for the grid; can be null)
+ *      Return: grid, or null on error
+ *
+ *  Notes:
+ *      (1) Cells are twice the mean box size, grown if needed to keep the
+ *          total number of cells proportional to the number of boxes.
+ */
+BoxGrid *boxGridCreate(PIXA *pixa, Arena *arena) {
+  l_int32 i, n, cx, cy, cx0, cx1, cy0, cy1, extent_w, extent_h, total;
+  l_int32 *cursor;
+  l_float32 sum_w, sum_h;
+  BoxGrid *grid;
+
+  PROCNAME("boxGridCreate");
+
+  if (!pixa)
+    return (BoxGrid *) ERROR_PTR("pixa not defined", procName, NULL);
+
+  n = pixaGetCount(pixa);
+
+  grid = (BoxGrid *) arenaCalloc(arena, 1, sizeof(BoxGrid));
+  grid->arena = arena;
+  grid->n = n;
+  grid->x = (l_int32 *) arenaAlloc(arena, L_MAX(1, n) * sizeof(l_int32));
+  grid->y = (l_int32 *) arenaAlloc(arena, L_MAX(1, n) * sizeof(l_int32));
+  grid->w = (l_int32 *) arenaAlloc(arena, L_MAX(1, n) * sizeof(l_int32));
+  grid->h = (l_int32 *) arenaAlloc(arena, L_MAX(1, n) * sizeof(l_int32));
+  grid->stamp = (l_int32 *) arenaCalloc(arena, L_MAX(1, n), sizeof(l_int32));
+
+  extent_w = extent_h = 1;
+  sum_w = sum_h = 0.0;
+
+  for (i = 0; i < n; i++) {
+    pixaGetBoxGeometry(pixa, i, &grid->x[i], &grid->y[i], &grid->w[i], &grid->h[i]);
+
+    extent_w = L_MAX(extent_w, grid->x[i] + grid->w[i] + 1);
+    extent_h = L_MAX(extent_h, grid->y[i] + grid->h[i] + 1);
+    grid->max_h = L_MAX(grid->max_h, grid->h[i]);
+    sum_w += grid->w[i];
+    sum_h += grid->h[i];
+  }
+
+  grid->cell_w = L_MAX(MIN_CELL_SIZE, (l_int32) (2 * sum_w / L_MAX(1, n)));
+  grid->cell_h = L_MAX(MIN_CELL_SIZE, (l_int32) (2 * sum_h / L_MAX(1, n)));
+
+  /* Keep the grid from outgrowing the number of boxes */
+  while (((extent_w + grid->cell_w - 1) / grid->cell_w) *
+         ((extent_h + grid->cell_h - 1) / grid->cell_h) > MAX_CELLS_PER_BOX * n + 1) {
+    grid->cell_w *= 2;
+    grid->cell_h *= 2;
+  }
+
+  grid->nx = (extent_w + grid->cell_w - 1) / grid->cell_w;
+  grid->ny = (extent_h + grid->cell_h - 1) / grid->cell_h;
+  grid->cell_start = (l_int32 *) arenaCalloc(arena, grid->nx * grid->ny + 1, sizeof(l_int32));
+
+  /* Count entries per cell, then fill cells in order of box index */
+  for (i = 0; i < n; i++) {
+    cx0 = L_MAX(0, grid->x[i]) / grid->cell_w;
+    cx1 = L_MAX(0, grid->x[i] + grid->w[i]) / grid->cell_w;
+    cy0 = L_MAX(0, grid->y[i]) / grid->cell_h;
+    cy1 = L_MAX(0, grid->y[i] + grid->h[i]) / grid->cell_h;
+
+    for (cy = cy0; cy <= cy1; cy++)
+      for (cx = cx0; cx <= cx1; cx++)
+        grid->cell_start[cy * grid->nx + cx + 1]++;
+  }
+
+  total = grid->nx * grid->ny;
+  for (i = 0; i < total; i++) {
+    grid->cell_start[i + 1] += grid->cell_start[i];
+  }
+
+  cursor = (l_int32 *) arenaAlloc(arena, L_MAX(1, total) * sizeof(l_int32));
+  for (i = 0; i < total; i++) {
+    cursor[i] = grid->cell_start[i];
+  }
+
+  grid->cell_items = (l_int32 *) arenaAlloc(arena, L_MAX(1, grid->cell_start[total]) *
+                                                     sizeof(l_int32));
+  for (i = 0; i < n; i++) {
+    cx0 = L_MAX(0, grid->x[i]) / grid->cell_w;
+    cx1 = L_MAX(0, grid->x[i] + grid->w[i]) / grid->cell_w;
+    cy0 = L_MAX(0, grid->y[i]) / grid->cell_h;
+    cy1 = L_MAX(0, grid->y[i] + grid->h[i]) / grid->cell_h;
+
+    for (cy = cy0; cy <= cy1; cy++)
+      for (cx = cx0; cx <= cx1; cx++)
+        grid->cell_items[cursor[cy * grid->nx + cx]++] = i;
+  }
+
+  arenaFree(arena, cursor);
+
+  return grid;
+}
+
+void boxGridDestroy(BoxGrid **pgrid) {
+  BoxGrid *grid;
+
+  if (!pgrid || !*pgrid)
+    return;
+
+  grid = *pgrid;
+  arenaFree(grid->arena, grid->x);
+  arenaFree(grid->arena, grid->y);
+  arenaFree(grid->arena, grid->w);
+  arenaFree(grid->arena, grid->h);
+  arenaFree(grid->arena, grid->stamp);
+  arenaFree(grid->arena, grid->cell_start);
+  arenaFree(grid->arena, grid->cell_items);
+  arenaFree(grid->arena, grid);
+
+  *pgrid = NULL;
+}
+
+/*!
+ *  boxGridGetBox()
+ *
+ *      Input:  grid
+ *              index
+ *              box (<return> caller-owned box to fill with the geometry)
+ */
+void boxGridGetBox(BoxGrid *grid, l_int32 index, BOX *box) {
+  box->x = grid->x[index];
+  box->y = grid->y[index];
+  box->w = grid->w[index];
+  box->h = grid->h[index];
+  box->refcount = 1;
+}
+
+/*!
+ *  boxGridQuery()
+ *
+ *      Input:  grid
+ *              left, top, right, bottom (inclusive query rectangle)
+ *              indices (<return> array of at least grid->n entries)
+ *      Return: number of boxes found
+ *
+ *  Notes:
+ *      (1) Returns every box with x <= right, x + w >= left, y <= bottom
+ *          and y + h >= top, in increasing index order.
+ */
+l_int32 boxGridQuery(BoxGrid *grid, l_int32 left, l_int32 top, l_int32 right, l_int32 bottom,
+                     l_int32 *indices) {
+  l_int32 cx, cy, cx0, cx1, cy0, cy1, cell, k, i, count;
+
+  if (grid->n == 0 || right < 0 || bottom < 0 || right < left || bottom < top)
+    return 0;
+
+  cx0 = L_MAX(0, left) / grid->cell_w;
+  cx1 = L_MIN(grid->nx - 1, right / grid->cell_w);
+  cy0 = L_MAX(0, top) / grid->cell_h;
+  cy1 = L_MIN(grid->ny - 1, bottom / grid->cell_h);
+
+  grid->query++;
+  count = 0;
+
+  for (cy = cy0; cy <= cy1; cy++) {
+    for (cx = cx0; cx <= cx1; cx++) {
+      cell = cy * grid->nx + cx;
+
+      for (k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++) {
+        i = grid->cell_items[k];
+
+        if (grid->stamp[i] == grid->query)
+          continue;
+
+        grid->stamp[i] = grid->query;
+
+        if (grid->x[i] <= right && grid->x[i] + grid->w[i] >= left &&
+            grid->y[i] <= bottom && grid->y[i] + grid->h[i] >= top) {
+          indices[count++] = i;
+        }
+      }
+    }
+  }
+
+  qsort(indices, count, sizeof(l_int32), CompareIndices);
+
+  return count;
+}
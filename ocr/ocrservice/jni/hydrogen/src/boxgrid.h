@@ -0,0 +1,59 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_BOXGRID_H_
+#define HYDROGEN_BOXGRID_H_
+
+#include "leptonica.h"
+#include "arena.h"
+
+/* Uniform grid over a set of boxes for neighbor queries. Box geometry is
+ * stored as flat arrays indexed like the source PIXA, and every box is
+ * registered in each cell it overlaps.
+ */
+struct BoxGrid {
+  l_int32 n;
+  l_int32 *x;
+  l_int32 *y;
+  l_int32 *w;
+  l_int32 *h;
+  l_int32 max_h;
+
+  l_int32 cell_w;
+  l_int32 cell_h;
+  l_int32 nx;
+  l_int32 ny;
+  l_int32 *cell_start;
+  l_int32 *cell_items;
+
+  /* Per-box query stamp, used to report each box once per query */
+  l_int32 *stamp;
+  l_int32 query;
+
+  /* Arena holding the grid, or null if it is on the heap */
+  Arena *arena;
+};
+
+BoxGrid *boxGridCreate(PIXA *pixa, Arena *arena);
+
+void boxGridDestroy(BoxGrid **pgrid);
+
+void boxGridGetBox(BoxGrid *grid, l_int32 index, BOX *box);
+
+l_int32 boxGridQuery(BoxGrid *grid, l_int32 left, l_int32 top, l_int32 right, l_int32 bottom,
+                     l_int32 *indices);
+
+#endif /* HYDROGEN_BOXGRID_H_ */
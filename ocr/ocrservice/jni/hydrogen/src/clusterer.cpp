@@ -16,23 +16,25 @@
 
 #include <malloc.h>
 #include "leptonica.h"
+#include "arena.h"
+#include "boxgrid.h"
 #include "clusterer.h"
+#include "conncomp.h"
 #include "validator.h"
 
 /* Type of connected components: 4 is up/down/left/right. 8 includes diagonals */
 #define CONN_COMP 8
 
-l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, PIXA **ppixa, NUMA **pconfs,
-                          HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 h, iszero;
-  l_int32 x, y, xstart, ystart;
+l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, l_int32 val, PIXA **ppixa, NUMA **pconfs,
+                          Arena *arena, HydrogenTextDetector::TextDetectorParameters &params) {
+  l_int32 i, iszero;
   l_float32 singleton_conf;
-  PIX *pixt1, *pixt2, *pixt3, *pixt4, *pixt5;
+  PIX *pixt;
   PIXA *pixa, *pixasort;
-  NUMA *confs, *confsort;
+  NUMA *confs, *confsort, *naindex;
   BOX *box;
-  BOXA *boxa;
-  L_STACK *lstack, *auxstack;
+  CCComp *comp;
+  CCLabels *ccl;
 
   PROCNAME("pixConnCompValidPixa");
 
@@ -48,74 +50,46 @@ l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, PIXA **ppixa, NUMA **pconfs,
   pixa = pixaCreate(0);
   confs = numaCreate(0);
 
-  pixZero(pix, &iszero);
+  /* Skip the scan when there are no ON components to find */
+  iszero = 0;
+  if (val)
+    pixZero(pix, &iszero);
   if (iszero) {
     *ppixa = pixa;
+    *pconfs = confs;
     return 0;
   }
 
-  if ((pixt1 = pixCopy(NULL, pix)) == NULL)
-    return ERROR_INT("pixt1 not made", procName, 1);
-  if ((pixt2 = pixCopy(NULL, pix)) == NULL)
-    return ERROR_INT("pixt2 not made", procName, 1);
-
-  h = pixGetHeight(pix);
-  if ((lstack = lstackCreate(h)) == NULL)
-    return ERROR_INT("lstack not made", procName, 1);
-  if ((auxstack = lstackCreate(0)) == NULL)
-    return ERROR_INT("auxstack not made", procName, 1);
-  lstack->auxstack = auxstack;
-  if ((boxa = boxaCreate(0)) == NULL)
-    return ERROR_INT("boxa not made", procName, 1);
-
-  xstart = 0;
-  ystart = 0;
-  while (1) {
-    if (!nextOnPixelInRaster(pixt1, xstart, ystart, &x, &y))
-      break;
+  /* Label every component in one pass; pix is left untouched, so both
+   * polarities can be read from the same edge map */
+  if ((ccl = ccLabelsCreate(pix, val, CONN_COMP, arena)) == NULL)
+    return ERROR_INT("ccl not made", procName, 1);
 
-    if ((box = pixSeedfillBB(pixt1, lstack, x, y, CONN_COMP)) == NULL)
-      return ERROR_INT("box not made", procName, 1);
-
-    /* Save the c.c. and remove from pixt2 as well */
-    pixt3 = pixClipRectangle(pixt1, box, NULL);
-    pixt4 = pixClipRectangle(pixt2, box, NULL);
-    pixt5 = pixClipRectangle(pix8, box, NULL);
-    pixXor(pixt3, pixt3, pixt4);
-    pixRasterop(pixt2, box->x, box->y, box->w, box->h, PIX_SRC ^ PIX_DST, pixt3, 0, 0);
-    pixDestroy(&pixt4);
-
-    if (ValidateSingleton(pixt3, box, pixt5, &singleton_conf, params)) {
-      boxaAddBox(boxa, box, L_INSERT);
-      pixaAddPix(pixa, pixt3, L_INSERT);
-      numaAddNumber(confs, singleton_conf);
-    } else {
-      boxDestroy(&box);
-      pixDestroy(&pixt3);
-    }
+  /* Validate from the labeled geometry; masks are only built for survivors */
+  for (i = 0; i < ccl->num_comps; i++) {
+    comp = &ccl->comps[i];
 
-    pixDestroy(&pixt5);
+    if (!ValidateSingleton(ccl, comp, pix8, &singleton_conf, params))
+      continue;
+
+    box = boxCreate(comp->x, comp->y, comp->w, comp->h);
+    pixt = ccLabelsGetMask(ccl, i);
 
-    xstart = x;
-    ystart = y;
+    pixaAddPix(pixa, pixt, L_INSERT);
+    pixaAddBox(pixa, box, L_INSERT);
+    numaAddNumber(confs, singleton_conf);
   }
 
-  /* Remove old boxa of pixa and replace with a clone copy */
-  boxaDestroy(&pixa->boxa);
-  pixa->boxa = boxaCopy(boxa, L_CLONE);
+  ccLabelsDestroy(&ccl);
 
   /* Sort pixa, then destroy old pixa */
-  NUMA *naindex;
   if ((pixasort = pixaSort(pixa, L_SORT_BY_X, L_SORT_INCREASING, &naindex, L_CLONE)) == NULL)
     return ERROR_INT("pixasort not made", procName, 1);
   confsort = numaSortByIndex(confs, naindex);
 
-  /* Cleanup, freeing the fillsegs on each stack */
-  lstackDestroy(&lstack, TRUE);
-  pixDestroy(&pixt1);
-  pixDestroy(&pixt2);
-  boxaDestroy(&boxa);
   pixaDestroy(&pixa);
+  numaDestroy(&confs);
+  numaDestroy(&naindex);
 
   *ppixa = pixasort;
   *pconfs = confsort;
@@ -126,9 +100,9 @@ l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, PIXA **ppixa, NUMA **pconfs,
 l_int32 MergePix(PIXA *pixad, l_int32 d_idx, PIXA *pixas, l_int32 s_idx) {
   l_int32 op;
   l_int32 x, y, w, h;
+  l_int32 sx, sy, sw, sh;
   l_int32 dx, dy, dw, dh;
   PIX *pixd, *pixs, *pixmerge;
-  BOX *boxd, *boxs, *boxmerge;
 
   PROCNAME("pixMergePix");
 
@@ -136,47 +110,50 @@ l_int32 MergePix(PIXA *pixad, l_int32 d_idx, PIXA *pixas, l_int32 s_idx) {
     return ERROR_INT("pixad not defined", procName, 1);
   if (!pixas)
     return ERROR_INT("pixas not defined", procName, 1);
+  if (pixaGetBoxGeometry(pixas, s_idx, &sx, &sy, &sw, &sh))
+    return ERROR_INT("s_idx not valid", procName, 1);
+  if (pixaGetBoxGeometry(pixad, d_idx, &dx, &dy, &dw, &dh))
+    return ERROR_INT("d_idx not valid", procName, 1);
 
-  boxd = pixaGetBox(pixad, d_idx, L_CLONE);
-  boxs = pixaGetBox(pixas, s_idx, L_CLONE);
-  boxmerge = boxBoundingRegion(boxd, boxs);
+  /* If the source lies inside the destination, paint it in place. Cluster
+   * pix are only referenced by their pixa at this point.
+   */
+  if (sx >= dx && sy >= dy && sx + sw <= dx + dw && sy + sh <= dy + dh) {
+    pixd = pixaGetPix(pixad, d_idx, L_CLONE);
+    pixs = pixaGetPix(pixas, s_idx, L_CLONE);
+    pixRasterop(pixd, sx - dx, sy - dy, sw, sh, PIX_PAINT, pixs, 0, 0);
+    pixDestroy(&pixs);
+    pixDestroy(&pixd);
 
-  boxGetGeometry(boxmerge, &x, &y, &w, &h);
+    return 0;
+  }
+
+  x = L_MIN(sx, dx);
+  y = L_MIN(sy, dy);
+  w = L_MAX(sx + sw, dx + dw) - x;
+  h = L_MAX(sy + sh, dy + dh) - y;
   pixmerge = pixCreate(w, h, 1);
 
   op = PIX_SRC | PIX_DST;
 
   pixs = pixaGetPix(pixas, s_idx, L_CLONE);
-
-  if (!pixs)
-    return ERROR_INT("s_idx not valid", procName, 1);
-
-  boxGetGeometry(boxs, &dx, &dy, &dw, &dh);
-  pixRasterop(pixmerge, dx - x, dy - y, dw, dh, op, pixs, 0, 0);
+  pixRasterop(pixmerge, sx - x, sy - y, sw, sh, op, pixs, 0, 0);
   pixDestroy(&pixs);
-  boxDestroy(&boxs);
 
   pixd = pixaGetPix(pixad, d_idx, L_CLONE);
-
-  if (!pixd)
-    return ERROR_INT("d_idx not valid", procName, 1);
-
-  boxGetGeometry(boxd, &dx, &dy, &dw, &dh);
   pixRasterop(pixmerge, dx - x, dy - y, dw, dh, op, pixd, 0, 0);
   pixDestroy(&pixd);
-  boxDestroy(&boxd);
 
-  pixaReplacePix(pixad, d_idx, pixmerge, boxmerge);
+  pixaReplacePix(pixad, d_idx, pixmerge, boxCreate(x, y, w, h));
 
   return 0;
 }
 
 l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remove) {
   l_uint8 setj;
-  l_int32 i, j, real_j, contains, n, count, num_clusters, initj;
+  l_int32 i, j, real_j, n, count, num_clusters, initj;
   l_int32 xi, yi, wi, hi;
   l_int32 xj, yj, wj, hj;
-  BOX *boxi, *boxj;
   PIXA *pixasort;
   NUMA *numa;
 
@@ -207,7 +184,6 @@ l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remov
 
   for (i = 0; i < num_clusters; i++) {
     pixaGetBoxGeometry(clusters, i, &xi, &yi, &wi, &hi);
-    boxi = pixaGetBox(clusters, i, L_CLONE);
 
     setj = 0;
 
@@ -233,20 +209,13 @@ l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remov
       if (yj > yi + hi)
         break;
 
-      boxj = pixaGetBox(pixasort, j, L_CLONE);
-
-      boxIntersects(boxi, boxj, &contains);
-
-      if (contains) {
+      /* Same test as boxIntersects(), without cloning either box */
+      if (xj < xi + wi && xi < xj + wj && yj < yi + hi && yi < yj + hj) {
         MergePix(clusters, i, pixasort, j);
         //remove[real_j] = 0; // TODO eliminates duplicates
         count++;
       }
-
-      boxDestroy(&boxj);
     }
-
-    boxDestroy(&boxi);
   }
 
   pixaDestroy(&pixasort);
@@ -255,12 +224,14 @@ l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remov
   return count;
 }
 
-l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
+l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, Arena *arena,
                            HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 i, j, n, count;
+  l_int32 i, j, k, n, count, num_candidates, max_h, max_dist;
+  l_int32 *candidates;
   l_float32 pair_conf;
   l_uint8 *has_partner;
-  BOX *b1, *b2;
+  BOX b1, b2;
+  BoxGrid *grid;
 
   PROCNAME("pixRemoveInvalidPairs");
 
@@ -276,39 +247,48 @@ l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
     return 0;
   }
 
-  has_partner = (l_uint8 *) calloc(n, sizeof(l_uint8));
+  if ((grid = boxGridCreate(pixa, arena)) == NULL)
+    return ERROR_INT("grid not made", procName, -1);
+
+  has_partner = (l_uint8 *) arenaCalloc(arena, n, sizeof(l_uint8));
+  candidates = (l_int32 *) arenaAlloc(arena, n * sizeof(l_int32));
   count = 0;
 
   for (i = 0; i < n; i++) {
     if (remove[i])
       continue;
 
-    b1 = pixaGetBox(pixa, i, L_CLONE);
+    boxGridGetBox(grid, i, &b1);
+
+    /* ValidatePair() bounds the taller height by the height ratio and the
+     * horizontal gap by that height, and requires vertical overlap. Only
+     * boxes within those bounds need to be checked.
+     */
+    max_h = (l_int32) (b1.h + params.pair_h_ratio * (b1.h + 1.0)) + 1;
+    max_dist = (l_int32) (params.pair_h_dist_ratio * max_h) + 1;
+    num_candidates = boxGridQuery(grid, b1.x - max_dist, b1.y, b1.x + b1.w + max_dist,
+                                  b1.y + b1.h, candidates);
 
     /* Search right for a partner for i */
-    for (j = i + 1; j < n; j++) {
-      if (remove[j])
+    for (k = 0; k < num_candidates; k++) {
+      j = candidates[k];
+
+      if (j <= i || remove[j])
         continue;
 
-      b2 = pixaGetBox(pixa, j, L_CLONE);
+      boxGridGetBox(grid, j, &b2);
 
       /* Check whether this is a valid pair */
-      if (!ValidatePair(b1, b2, &pair_conf, params)) {
-        boxDestroy(&b2);
+      if (!ValidatePair(&b1, &b2, &pair_conf, params))
         continue;
-      }
 
       // We don't need to adjust confidence values here, since we'll
       // generate cluster pairs and use those later.
 
-      boxDestroy(&b2);
-
       has_partner[i] = 1;
       has_partner[j] = 1;
       break;
     }
-
-    boxDestroy(&b1);
   }
 
   for (i = 0; i < n; i++) {
@@ -319,7 +299,9 @@ l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
     }
   }
 
-  free(has_partner);
+  arenaFree(arena, candidates);
+  arenaFree(arena, has_partner);
+  boxGridDestroy(&grid);
 
   return count;
 }
@@ -327,14 +309,17 @@ l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
 // Clustering pass
 
 l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, l_int32 **pleft,
-                                l_int32 **pright, HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 n, i, j;
+                                l_int32 **pright, Arena *arena,
+                                HydrogenTextDetector::TextDetectorParameters &params) {
+  l_int32 n, i, j, k, num_candidates;
   l_int32 xi, yi, wi, hi, maxd;
-  l_int32 xj, yj, wj, hj;
+  l_int32 xj, yj, hj;
   l_int32 dx, dy, d, mind, minj;
-  l_int32 *left, *right;
+  l_int32 top, bottom, right;
+  l_int32 *left, *right_partner, *candidates;
   l_float32 clusterpair_conf, minconf;
-  BOX *b1, *b2;
+  BOX b1, b2;
+  BoxGrid *grid;
   bool too_far;
 
   PROCNAME("GenerateClusterPartners");
@@ -359,13 +344,17 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
   if (!remove)
     return ERROR_INT("remove not defined", procName, -1);
 
-  left = (l_int32 *) malloc(n * sizeof(l_int32));
-  right = (l_int32 *) malloc(n * sizeof(l_int32));
+  if ((grid = boxGridCreate(pixa, arena)) == NULL)
+    return ERROR_INT("grid not made", procName, -1);
+
+  left = (l_int32 *) arenaAlloc(arena, n * sizeof(l_int32));
+  right_partner = (l_int32 *) arenaAlloc(arena, n * sizeof(l_int32));
+  candidates = (l_int32 *) arenaAlloc(arena, n * sizeof(l_int32));
 
   /* Initialize left and right arrays */
   for (i = 0; i < n; i++) {
     left[i] = -2;
-    right[i] = -2;
+    right_partner[i] = -2;
   }
 
   /* For each component, check all possible neighbors to find the most likely
@@ -377,27 +366,42 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
     if (remove[i])
       continue;
 
-    pixaGetBoxGeometry(pixa, i, &xi, &yi, &wi, &hi);
-    b1 = pixaGetBox(pixa, i, L_CLONE);
+    boxGridGetBox(grid, i, &b1);
+    xi = b1.x;
+    yi = b1.y;
+    wi = b1.w;
+    hi = b1.h;
     mind = -1;
     minj = -1;
     maxd = L_MAX(wi, hi);
     minconf = 0.0;
 
+    /* ValidateClusterPair() rejects boxes beyond the spacing limit and
+     * boxes that do not share enough of a vertical edge, so only query the
+     * region that can still pass.
+     */
+    right = xi + wi + params.cluster_width_spacing * maxd;
+    bottom = yi + (l_int32) (hi * params.cluster_shared_edge) + 1;
+    top = yi;
+    if (params.cluster_shared_edge > 1.0)
+      top -= (l_int32) (grid->max_h * (params.cluster_shared_edge - 1.0)) + 1;
+    num_candidates = boxGridQuery(grid, xi, top, right, bottom, candidates);
+
     /* Search for closest right neighbor */
-    for (j = i + 1; j < n; j++) {
-      if (remove[j])
+    for (k = 0; k < num_candidates; k++) {
+      j = candidates[k];
+
+      if (j <= i || remove[j])
         continue;
 
-      pixaGetBoxGeometry(pixa, j, &xj, &yj, &wj, &hj);
-      b2 = pixaGetBox(pixa, j, L_CLONE);
+      boxGridGetBox(grid, j, &b2);
 
-      if (!ValidateClusterPair(b1, b2, &too_far, &clusterpair_conf, params)) {
-        if (too_far)
-          break;
-        else
-          continue;
-      }
+      if (!ValidateClusterPair(&b1, &b2, &too_far, &clusterpair_conf, params))
+        continue;
+
+      xj = b2.x;
+      yj = b2.y;
+      hj = b2.h;
 
       /* calculate spacing between i and j */
       dx = xj - (xi + wi);
@@ -422,11 +426,11 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
       // TODO(alanv): Insertion fudges the partner confidence value
       if (j >= 0) {
         left[i] = j;
-        right[j] = i;
+        right_partner[j] = i;
       }
 
       left[minj] = i;
-      right[i] = minj;
+      right_partner[i] = minj;
 
       // Adjust confidence to reflect partner confidence
       l_float32 conf;
@@ -436,21 +440,26 @@ l_int32 GenerateClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *rem
     }
   }
 
+  arenaFree(arena, candidates);
+  boxGridDestroy(&grid);
+
   *pleft = left;
-  *pright = right;
+  *pright = right_partner;
 
   return 0;
 }
 
 l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, l_int32 *left, l_int32 *right,
-                             PIXA **ppixad, NUMA **pclusterconfs, HydrogenTextDetector::TextDetectorParameters &params) {
-  l_int32 n, count, i, j, temp;
+                             PIXA **ppixad, NUMA **pclusterconfs, Arena *arena,
+                             HydrogenTextDetector::TextDetectorParameters &params) {
+  l_int32 n, count, i, j, temp, num_members;
+  l_int32 *members;
   l_uint32 x, y, w, h;
   l_int32 xi, yi, wi, hi;
   l_int32 xj, yj, wj, hj;
   PIXA *pixad, *pixa_cluster;
-  NUMA *confd, *numa_cluster;
-  PIX *pix, *pixd, *pix_cluster;
+  NUMA *confd;
+  PIX *pix, *pixd;
   BOX *box, *boxd;
 
   PROCNAME("ClusterValidComponents");
@@ -484,6 +493,10 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
 
   count = 0;
 
+  /* One cluster is built at a time, so its pixa and member list are reused */
+  pixa_cluster = pixaCreate(0);
+  members = (l_int32 *) arenaAlloc(arena, n * sizeof(l_int32));
+
   /* Starting from the first component, generate a cluster by traveling
    * left and right as far as possible. Ignore components that have no
    * neighbors.
@@ -496,8 +509,8 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
     if (left[i] < 0 && right[i] < 0)
       continue;
 
-    pixa_cluster = pixaCreate(1);
-    numa_cluster = numaCreate(1);
+    pixaClear(pixa_cluster);
+    num_members = 0;
 
     /* We don't need to destroy this pix and box since pixa_cluster
      * takes ownership with L_INSERT.
@@ -506,7 +519,7 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
     box = pixaGetBox(pixa, i, L_CLONE);
     pixaAddPix(pixa_cluster, pix, L_INSERT);
     pixaAddBox(pixa_cluster, box, L_INSERT);
-    numaAddNumber(numa_cluster, i);
+    members[num_members++] = i;
 
     boxGetGeometry(box, &xi, &yi, &wi, &hi);
     x = xi;
@@ -522,7 +535,7 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
       box = pixaGetBox(pixa, j, L_CLONE);
       pixaAddPix(pixa_cluster, pix, L_INSERT);
       pixaAddBox(pixa_cluster, box, L_INSERT);
-      numaAddNumber(numa_cluster, j);
+      members[num_members++] = j;
 
       boxGetGeometry(box, &xj, &yj, &wj, &hj);
       x = L_MIN(x, (l_uint32) xj);
@@ -544,7 +557,7 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
       box = pixaGetBox(pixa, j, L_CLONE);
       pixaAddPix(pixa_cluster, pix, L_INSERT);
       pixaAddBox(pixa_cluster, box, L_INSERT);
-      numaAddNumber(numa_cluster, j);
+      members[num_members++] = j;
 
       boxGetGeometry(box, &xj, &yj, &wj, &hj);
       x = L_MIN(x, (l_uint32) xj);
@@ -562,13 +575,12 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
     h = h - y;
 
     boxd = boxCreate(x, y, w, h);
-    pix_cluster = pixClipRectangle(pix8, boxd, NULL);
 
     l_float32 temp_conf;
     l_float32 cluster_conf;
 
     /* If pixa seems valid, collapse its components to a single pix */
-    if (ValidateCluster(pix_cluster, pixa_cluster, boxd, &cluster_conf, params)) {
+    if (ValidateCluster(pix8, pixa_cluster, boxd, &cluster_conf, params)) {
       l_int32 num_comps = pixaGetCount(pixa_cluster);
       l_float32 avg_conf = 0.0;
 
@@ -594,25 +606,19 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
 
       count++;
     } else {
-      l_int32 num_nums = numaGetCount(numa_cluster);
-
       // Otherwise, mark its components as removed
-      for (int i = 0; i < num_nums; i++) {
-        if (!numaGetIValue(numa_cluster, i, &temp)) {
-          remove[temp] = 1;
-        }
+      for (int i = 0; i < num_members; i++) {
+        remove[members[i]] = 1;
       }
 
       boxDestroy(&boxd);
     }
-
-    pixDestroy(&pix_cluster);
-    pixaDestroy(&pixa_cluster);
-    numaDestroy(&numa_cluster);
   }
 
-  free(left);
-  free(right);
+  pixaDestroy(&pixa_cluster);
+  arenaFree(arena, members);
+  arenaFree(arena, left);
+  arenaFree(arena, right);
 
   PIXA *pixasort;
   NUMA *confsort;
@@ -633,15 +639,17 @@ l_int32 MergeClusterPartners(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove
 }
 
 l_int32 ClusterValidComponents(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, PIXA **ppixad,
-                               NUMA **pclusterconfs, HydrogenTextDetector::TextDetectorParameters &params) {
+                               NUMA **pclusterconfs, Arena *arena,
+                               HydrogenTextDetector::TextDetectorParameters &params) {
   l_int32 *left, *right;
   PIXA *pixad;
   NUMA *clusterconfs;
 
-  if (GenerateClusterPartners(pix8, pixa, confs, remove, &left, &right, params))
+  if (GenerateClusterPartners(pix8, pixa, confs, remove, &left, &right, arena, params))
     return -1;
 
-  int count = MergeClusterPartners(pix8, pixa, confs, remove, left, right, &pixad, &clusterconfs, params);
+  int count = MergeClusterPartners(pix8, pixa, confs, remove, left, right, &pixad, &clusterconfs, arena,
+                                   params);
 
   *ppixad = pixad;
   *pclusterconfs = clusterconfs;
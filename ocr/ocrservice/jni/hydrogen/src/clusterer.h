@@ -18,18 +18,19 @@
 #define HYDROGEN_CLUSTERER_H_
 
 #include "leptonica.h"
+#include "arena.h"
 #include "hydrogentextdetector.h"
 
-l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, PIXA **ppixa, NUMA **pconfs,
-                          HydrogenTextDetector::TextDetectorParameters &params);
+l_int32 ConnCompValidPixa(PIX *pix8, PIX *pix, l_int32 val, PIXA **ppixa, NUMA **pconfs,
+                          Arena *arena, HydrogenTextDetector::TextDetectorParameters &params);
 
 l_int32 MergePix(PIXA *pixad, l_int32 i, PIXA *pixas, l_int32 j);
 
-l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove,
+l_int32 RemoveInvalidPairs(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, Arena *arena,
                            HydrogenTextDetector::TextDetectorParameters &params);
 
 l_int32 ClusterValidComponents(PIX *pix8, PIXA *pixa, NUMA *confs, l_uint8 *remove, PIXA **ppixad, NUMA **pconfs,
-                               HydrogenTextDetector::TextDetectorParameters &params);
+                               Arena *arena, HydrogenTextDetector::TextDetectorParameters &params);
 
 l_int32 MergePairFragments(PIX *pix8, PIXA *clusters, PIXA *pixa, l_uint8 *remove);
 
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+
+#include "leptonica.h"
+#include "conncomp.h"
+
+static l_int32 FindRoot(l_int32 *parent, l_int32 i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+
+  return i;
+}
+
+/* Always keeps the lower run index as the root, so that every root is the
+ * first run of its component in raster order.
+ */
+static void UnionRuns(l_int32 *parent, l_int32 a, l_int32 b) {
+  a = FindRoot(parent, a);
+  b = FindRoot(parent, b);
+
+  if (a < b) {
+    parent[b] = a;
+  } else if (b < a) {
+    parent[a] = b;
+  }
+}
+
+/* Returns the first pixel at or after x whose value is val, or w if none */
+static l_int32 NextPixelWithValue(l_uint32 *line, l_int32 x, l_int32 w, l_uint32 val) {
+  l_int32 wi;
+  l_uint32 word;
+
+  while (x < w) {
+    wi = x >> 5;
+    word = val ? line[wi] : ~line[wi];
+    word &= 0xffffffff >> (x & 31);
+
+    if (word) {
+      x = (wi << 5) + __builtin_clz(word);
+      return L_MIN(x, w);
+    }
+
+    x = (wi + 1) << 5;
+  }
+
+  return w;
+}
+
+/* Returns the number of runs of pixels with value val in a raster line */
+static l_int32 CountLineRuns(l_uint32 *line, l_int32 w, l_uint32 val) {
+  l_int32 wi, nwords, count;
+  l_uint32 word, prev;
+
+  nwords = (w + 31) >> 5;
+  count = 0;
+  prev = 0;
+
+  for (wi = 0; wi < nwords; wi++) {
+    word = val ? line[wi] : ~line[wi];
+    if (wi == nwords - 1 && (w & 31))
+      word &= 0xffffffff << (32 - (w & 31));
+
+    /* A run starts at each pixel whose left neighbor has another value */
+    count += __builtin_popcount(word & ~((word >> 1) | (prev << 31)));
+    prev = word & 1;
+  }
+
+  return count;
+}
+
+/* Sets pixels x0 through x1 (inclusive) in a 1 bpp raster line */
+static void SetLineRun(l_uint32 *line, l_int32 x0, l_int32 x1) {
+  l_int32 w0 = x0 >> 5;
+  l_int32 w1 = x1 >> 5;
+  l_uint32 m0 = 0xffffffff >> (x0 & 31);
+  l_uint32 m1 = 0xffffffff << (31 - (x1 & 31));
+
+  if (w0 == w1) {
+    line[w0] |= m0 & m1;
+    return;
+  }
+
+  line[w0] |= m0;
+  for (l_int32 i = w0 + 1; i < w1; i++) {
+    line[i] = 0xffffffff;
+  }
+  line[w1] |= m1;
+}
+
+/*!
+ *  ccLabelsCreate()
+ *
+ *      Input:  pixs (1 bpp)
+ *              val (1 to label ON pixels, 0 to label OFF pixels)
+ *              connectivity (4 or 8)
+ *              arena (<optional> scratch and result memory; can be null)
+ *      Return: ccl, or null on error
+ *
+ *  Notes:
+ *      (1) Labels all components in a single raster scan by extracting
+ *          runs and joining overlapping runs on adjacent lines with
+ *          union-find. pixs is not modified.
+ *      (2) Runs are counted a word at a time beforehand, so the run
+ *          arrays are allocated once and never grow.
+ *      (3) With val = 0, the result is the same as labeling the inverse of
+ *          pixs, so both polarities can be read from one image.
+ *      (4) With an arena, the result is only valid until the arena is
+ *          reset.
+ */
+CCLabels *ccLabelsCreate(PIX *pixs, l_int32 val, l_int32 connectivity, Arena *arena) {
+  l_int32 w, h, d, wpl, x, xend, y, i, j, n, nalloc, adj;
+  l_int32 prev_start, prev_end, cur_start, root, num_comps;
+  l_int32 *parent, *label, *cursor;
+  l_uint32 *data, *line;
+  CCRun *runs, *grouped;
+  CCComp *comps, *comp;
+  CCLabels *ccl;
+
+  PROCNAME("ccLabelsCreate");
+
+  if (!pixs)
+    return (CCLabels *) ERROR_PTR("pixs not defined", procName, NULL);
+  pixGetDimensions(pixs, &w, &h, &d);
+  if (d != 1)
+    return (CCLabels *) ERROR_PTR("pixs not 1 bpp", procName, NULL);
+  if (val != 0 && val != 1)
+    return (CCLabels *) ERROR_PTR("val not 0 or 1", procName, NULL);
+  if (connectivity != 4 && connectivity != 8)
+    return (CCLabels *) ERROR_PTR("connectivity not 4 or 8", procName, NULL);
+
+  data = pixGetData(pixs);
+  wpl = pixGetWpl(pixs);
+
+  /* Diagonal neighbors touch when runs are one pixel apart */
+  adj = (connectivity == 8) ? 1 : 0;
+
+  /* Count the runs first so the run arrays never have to grow */
+  nalloc = 0;
+  for (y = 0; y < h; y++) {
+    nalloc += CountLineRuns(data + y * wpl, w, val);
+  }
+  nalloc = L_MAX(1, nalloc);
+
+  n = 0;
+  runs = (CCRun *) arenaAlloc(arena, nalloc * sizeof(CCRun));
+  parent = (l_int32 *) arenaAlloc(arena, nalloc * sizeof(l_int32));
+
+  prev_start = prev_end = 0;
+
+  for (y = 0; y < h; y++) {
+    line = data + y * wpl;
+    cur_start = n;
+
+    /* Extract runs on this line */
+    x = NextPixelWithValue(line, 0, w, val);
+    while (x < w) {
+      xend = NextPixelWithValue(line, x, w, !val);
+
+      runs[n].y = y;
+      runs[n].xstart = x;
+      runs[n].xend = xend - 1;
+      parent[n] = n;
+      n++;
+
+      x = NextPixelWithValue(line, xend, w, val);
+    }
+
+    /* Join runs that touch runs on the previous line */
+    i = prev_start;
+    j = cur_start;
+    while (i < prev_end && j < n) {
+      if (runs[i].xend + adj < runs[j].xstart) {
+        i++;
+      } else if (runs[j].xend + adj < runs[i].xstart) {
+        j++;
+      } else {
+        UnionRuns(parent, i, j);
+
+        if (runs[i].xend < runs[j].xend)
+          i++;
+        else
+          j++;
+      }
+    }
+
+    prev_start = cur_start;
+    prev_end = n;
+  }
+
+  /* Number components in order of their first run */
+  label = (l_int32 *) arenaAlloc(arena, L_MAX(1, n) * sizeof(l_int32));
+  num_comps = 0;
+  for (i = 0; i < n; i++) {
+    root = FindRoot(parent, i);
+    label[i] = (root == i) ? num_comps++ : label[root];
+  }
+
+  /* Accumulate bounding boxes and areas; w and h hold max x and y for now */
+  comps = (CCComp *) arenaCalloc(arena, L_MAX(1, num_comps), sizeof(CCComp));
+  for (i = 0; i < n; i++) {
+    comp = &comps[label[i]];
+
+    if (comp->run_count == 0) {
+      comp->x = runs[i].xstart;
+      comp->y = runs[i].y;
+      comp->w = runs[i].xend;
+    } else {
+      comp->x = L_MIN(comp->x, runs[i].xstart);
+      comp->w = L_MAX(comp->w, runs[i].xend);
+    }
+
+    comp->h = runs[i].y;
+    comp->area += runs[i].xend - runs[i].xstart + 1;
+    comp->run_count++;
+  }
+
+  j = 0;
+  cursor = (l_int32 *) arenaAlloc(arena, L_MAX(1, num_comps) * sizeof(l_int32));
+  for (i = 0; i < num_comps; i++) {
+    comp = &comps[i];
+    comp->w = comp->w - comp->x + 1;
+    comp->h = comp->h - comp->y + 1;
+    comp->run_start = j;
+    cursor[i] = j;
+    j += comp->run_count;
+  }
+
+  /* Group runs by component, preserving raster order within each */
+  grouped = (CCRun *) arenaAlloc(arena, L_MAX(1, n) * sizeof(CCRun));
+  for (i = 0; i < n; i++) {
+    grouped[cursor[label[i]]++] = runs[i];
+  }
+
+  arenaFree(arena, cursor);
+  arenaFree(arena, label);
+  arenaFree(arena, parent);
+  arenaFree(arena, runs);
+
+  ccl = (CCLabels *) arenaAlloc(arena, sizeof(CCLabels));
+  ccl->runs = grouped;
+  ccl->num_runs = n;
+  ccl->comps = comps;
+  ccl->num_comps = num_comps;
+  ccl->arena = arena;
+
+  return ccl;
+}
+
+void ccLabelsDestroy(CCLabels **pccl) {
+  Arena *arena;
+
+  if (!pccl || !*pccl)
+    return;
+
+  arena = (*pccl)->arena;
+  arenaFree(arena, (*pccl)->runs);
+  arenaFree(arena, (*pccl)->comps);
+  arenaFree(arena, *pccl);
+
+  *pccl = NULL;
+}
+
+/*!
+ *  ccLabelsGetMask()
+ *
+ *      Input:  ccl
+ *              index (component index)
+ *      Return: 1 bpp mask of the component, sized to its bounding box,
+ *              or null on error
+ */
+PIX *ccLabelsGetMask(CCLabels *ccl, l_int32 index) {
+  l_int32 wpl;
+  l_uint32 *data;
+  CCComp *comp;
+  CCRun *run;
+  PIX *pixd;
+
+  PROCNAME("ccLabelsGetMask");
+
+  if (!ccl)
+    return (PIX *) ERROR_PTR("ccl not defined", procName, NULL);
+  if (index < 0 || index >= ccl->num_comps)
+    return (PIX *) ERROR_PTR("index not valid", procName, NULL);
+
+  comp = &ccl->comps[index];
+
+  if ((pixd = pixCreate(comp->w, comp->h, 1)) == NULL)
+    return (PIX *) ERROR_PTR("pixd not made", procName, NULL);
+
+  data = pixGetData(pixd);
+  wpl = pixGetWpl(pixd);
+
+  for (l_int32 i = 0; i < comp->run_count; i++) {
+    run = &ccl->runs[comp->run_start + i];
+    SetLineRun(data + (run->y - comp->y) * wpl, run->xstart - comp->x, run->xend - comp->x);
+  }
+
+  return pixd;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_CONNCOMP_H_
+#define HYDROGEN_CONNCOMP_H_
+
+#include "leptonica.h"
+#include "arena.h"
+
+/* Horizontal run of labeled pixels, xstart and xend inclusive */
+struct CCRun {
+  l_int32 y;
+  l_int32 xstart;
+  l_int32 xend;
+};
+
+/* Connected component, described by its runs within CCLabels */
+struct CCComp {
+  l_int32 x;
+  l_int32 y;
+  l_int32 w;
+  l_int32 h;
+  l_int32 area;
+  l_int32 run_start;
+  l_int32 run_count;
+};
+
+/* Run-based connected component labeling of a 1 bpp image. Runs are grouped
+ * by component and kept in raster order within each component. Components
+ * are ordered by their first pixel in raster order, which matches the order
+ * in which repeated nextOnPixelInRaster() and pixSeedfillBB() calls find them.
+ */
+struct CCLabels {
+  CCRun *runs;
+  l_int32 num_runs;
+  CCComp *comps;
+  l_int32 num_comps;
+
+  /* Arena holding runs and comps, or null if they are on the heap */
+  Arena *arena;
+};
+
+CCLabels *ccLabelsCreate(PIX *pixs, l_int32 val, l_int32 connectivity, Arena *arena);
+
+void ccLabelsDestroy(CCLabels **pccl);
+
+PIX *ccLabelsGetMask(CCLabels *ccl, l_int32 index);
+
+#endif /* HYDROGEN_CONNCOMP_H_ */
@@ -0,0 +1,517 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__i386__) || defined(__x86_64__)
+#define EDGE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#ifdef HAVE_ARMEABI_V7A
+#include <cpu-features.h>
+#include <arm_neon.h>
+#endif
+
+#include "leptonica.h"
+#include "edgekernels.h"
+
+static l_int32 edge_kernels_level = -1;
+
+/*---------------------------------------------------------------------*
+ *                            Scalar kernels                           *
+ *---------------------------------------------------------------------*/
+
+/* Sobel magnitude for the 3x3 window whose left column is k */
+static inline l_int32 SobelMagnitude(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2,
+                                     l_int32 k) {
+  l_int32 gx = r0[k] + (r1[k] << 1) + r2[k] - r0[k + 2] - (r1[k + 2] << 1) - r2[k + 2];
+  l_int32 gy = r0[k] + (r0[k + 1] << 1) + r0[k + 2] - r2[k] - (r2[k + 1] << 1) - r2[k + 2];
+
+  return L_ABS(gx) + L_ABS(gy);
+}
+
+/* Thresholds pixels start through n - 1 into lined, which must already
+ * hold any bits for pixels before start.
+ */
+static void SobelThreshTail(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2,
+                            l_int32 start, l_int32 n, l_int32 thresh, l_uint32 *lined) {
+  l_int32 k;
+
+  for (k = start; k < n; k++) {
+    if ((k & 31) == 0)
+      lined[k >> 5] = 0;
+
+    if (L_MIN(255, SobelMagnitude(r0, r1, r2, k)) >= thresh)
+      lined[k >> 5] |= 0x80000000 >> (k & 31);
+  }
+}
+
+static void AbsDiffStatsTail(const l_uint8 *data, l_int32 start, l_int32 n, l_int32 *pmax,
+                             l_int32 *ptotal) {
+  l_int32 k, vald;
+
+  for (k = start; k < n; k++) {
+    vald = L_ABS(data[k] - data[k + 4]);
+
+    if (vald > *pmax)
+      *pmax = vald;
+
+    *ptotal += vald;
+  }
+}
+
+#ifdef EDGE_KERNELS_X86
+
+/* Reverses bit order, so that bit k of a movemask lands on pixel k of a
+ * packed 1 bpp word.
+ */
+static inline l_uint32 ReverseBits(l_uint32 v) {
+  v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+  v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+  v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+  v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+
+  return (v >> 16) | (v << 16);
+}
+
+#ifdef __SSE2__
+
+/*---------------------------------------------------------------------*
+ *                             SSE2 kernels                            *
+ *---------------------------------------------------------------------*/
+
+static inline __m128i AbsSSE2(__m128i v) {
+  return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+/* Sobel magnitudes for 8 pixels, given the widened window columns */
+static inline __m128i SobelMagnitudeSSE2(__m128i a0, __m128i a1, __m128i a2, __m128i b0,
+                                         __m128i b2, __m128i c0, __m128i c1, __m128i c2) {
+  __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a0, c0), _mm_add_epi16(b0, b0)),
+                             _mm_add_epi16(_mm_add_epi16(a2, c2), _mm_add_epi16(b2, b2)));
+  __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a0, a2), _mm_add_epi16(a1, a1)),
+                             _mm_add_epi16(_mm_add_epi16(c0, c2), _mm_add_epi16(c1, c1)));
+
+  return _mm_add_epi16(AbsSSE2(gx), AbsSSE2(gy));
+}
+
+/* Returns a 16-bit mask with bit k set if pixel k passes */
+static inline l_uint32 SobelThresh16SSE2(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2,
+                                         __m128i thresh1) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i a0 = _mm_loadu_si128((const __m128i *) r0);
+  __m128i a1 = _mm_loadu_si128((const __m128i *) (r0 + 1));
+  __m128i a2 = _mm_loadu_si128((const __m128i *) (r0 + 2));
+  __m128i b0 = _mm_loadu_si128((const __m128i *) r1);
+  __m128i b2 = _mm_loadu_si128((const __m128i *) (r1 + 2));
+  __m128i c0 = _mm_loadu_si128((const __m128i *) r2);
+  __m128i c1 = _mm_loadu_si128((const __m128i *) (r2 + 1));
+  __m128i c2 = _mm_loadu_si128((const __m128i *) (r2 + 2));
+
+  __m128i lo = SobelMagnitudeSSE2(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero),
+                                  _mm_unpacklo_epi8(a2, zero), _mm_unpacklo_epi8(b0, zero),
+                                  _mm_unpacklo_epi8(b2, zero), _mm_unpacklo_epi8(c0, zero),
+                                  _mm_unpacklo_epi8(c1, zero), _mm_unpacklo_epi8(c2, zero));
+  __m128i hi = SobelMagnitudeSSE2(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero),
+                                  _mm_unpackhi_epi8(a2, zero), _mm_unpackhi_epi8(b0, zero),
+                                  _mm_unpackhi_epi8(b2, zero), _mm_unpackhi_epi8(c0, zero),
+                                  _mm_unpackhi_epi8(c1, zero), _mm_unpackhi_epi8(c2, zero));
+
+  return _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpgt_epi16(lo, thresh1),
+                                           _mm_cmpgt_epi16(hi, thresh1)));
+}
+
+static void SobelThreshLineSSE2(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2, l_int32 n,
+                                l_int32 thresh, l_uint32 *lined) {
+  l_int32 k;
+  l_uint32 bits;
+  __m128i thresh1 = _mm_set1_epi16(thresh - 1);
+
+  for (k = 0; k + 32 <= n; k += 32) {
+    bits = SobelThresh16SSE2(r0 + k, r1 + k, r2 + k, thresh1);
+    bits |= SobelThresh16SSE2(r0 + k + 16, r1 + k + 16, r2 + k + 16, thresh1) << 16;
+    lined[k >> 5] = ReverseBits(bits);
+  }
+
+  SobelThreshTail(r0, r1, r2, k, n, thresh, lined);
+}
+
+static void AbsDiffStatsSSE2(const l_uint8 *data, l_int32 n, l_int32 *pmax, l_int32 *ptotal) {
+  l_int32 k;
+  l_uint8 lanes[16];
+  __m128i a, b, diff;
+  __m128i zero = _mm_setzero_si128();
+  __m128i vmax = zero;
+  __m128i vsum = zero;
+
+  for (k = 0; k + 16 <= n; k += 16) {
+    a = _mm_loadu_si128((const __m128i *) (data + k));
+    b = _mm_loadu_si128((const __m128i *) (data + k + 4));
+    diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    vmax = _mm_max_epu8(vmax, diff);
+    vsum = _mm_add_epi64(vsum, _mm_sad_epu8(diff, zero));
+  }
+
+  _mm_storeu_si128((__m128i *) lanes, vmax);
+  for (l_int32 i = 0; i < 16; i++) {
+    *pmax = L_MAX(*pmax, lanes[i]);
+  }
+
+  *ptotal += _mm_cvtsi128_si32(vsum) + _mm_cvtsi128_si32(_mm_srli_si128(vsum, 8));
+
+  AbsDiffStatsTail(data, k, n, pmax, ptotal);
+}
+
+#endif /* __SSE2__ */
+
+/*---------------------------------------------------------------------*
+ *                             AVX2 kernels                            *
+ *---------------------------------------------------------------------*/
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static inline AVX2_TARGET __m256i LoadWidenedAVX2(const l_uint8 *p) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+}
+
+/* Sobel magnitudes for 16 pixels */
+static inline AVX2_TARGET __m256i SobelMagnitudeAVX2(const l_uint8 *r0, const l_uint8 *r1,
+                                                     const l_uint8 *r2) {
+  __m256i a0 = LoadWidenedAVX2(r0);
+  __m256i a1 = LoadWidenedAVX2(r0 + 1);
+  __m256i a2 = LoadWidenedAVX2(r0 + 2);
+  __m256i b0 = LoadWidenedAVX2(r1);
+  __m256i b2 = LoadWidenedAVX2(r1 + 2);
+  __m256i c0 = LoadWidenedAVX2(r2);
+  __m256i c1 = LoadWidenedAVX2(r2 + 1);
+  __m256i c2 = LoadWidenedAVX2(r2 + 2);
+
+  __m256i gx = _mm256_sub_epi16(
+      _mm256_add_epi16(_mm256_add_epi16(a0, c0), _mm256_add_epi16(b0, b0)),
+      _mm256_add_epi16(_mm256_add_epi16(a2, c2), _mm256_add_epi16(b2, b2)));
+  __m256i gy = _mm256_sub_epi16(
+      _mm256_add_epi16(_mm256_add_epi16(a0, a2), _mm256_add_epi16(a1, a1)),
+      _mm256_add_epi16(_mm256_add_epi16(c0, c2), _mm256_add_epi16(c1, c1)));
+
+  return _mm256_add_epi16(_mm256_abs_epi16(gx), _mm256_abs_epi16(gy));
+}
+
+static AVX2_TARGET void SobelThreshLineAVX2(const l_uint8 *r0, const l_uint8 *r1,
+                                            const l_uint8 *r2, l_int32 n, l_int32 thresh,
+                                            l_uint32 *lined) {
+  l_int32 k;
+  __m256i lo, hi, packed;
+  __m256i thresh1 = _mm256_set1_epi16(thresh - 1);
+
+  for (k = 0; k + 32 <= n; k += 32) {
+    lo = _mm256_cmpgt_epi16(SobelMagnitudeAVX2(r0 + k, r1 + k, r2 + k), thresh1);
+    hi = _mm256_cmpgt_epi16(SobelMagnitudeAVX2(r0 + k + 16, r1 + k + 16, r2 + k + 16), thresh1);
+
+    /* Packing interleaves 128-bit lanes; put pixels back in order */
+    packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xd8);
+    lined[k >> 5] = ReverseBits(_mm256_movemask_epi8(packed));
+  }
+
+  SobelThreshTail(r0, r1, r2, k, n, thresh, lined);
+}
+
+static AVX2_TARGET void AbsDiffStatsAVX2(const l_uint8 *data, l_int32 n, l_int32 *pmax,
+                                         l_int32 *ptotal) {
+  l_int32 k;
+  l_uint8 lanes[32];
+  __m128i sum;
+  __m256i a, b, diff;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i vmax = zero;
+  __m256i vsum = zero;
+
+  for (k = 0; k + 32 <= n; k += 32) {
+    a = _mm256_loadu_si256((const __m256i *) (data + k));
+    b = _mm256_loadu_si256((const __m256i *) (data + k + 4));
+    diff = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+    vmax = _mm256_max_epu8(vmax, diff);
+    vsum = _mm256_add_epi64(vsum, _mm256_sad_epu8(diff, zero));
+  }
+
+  _mm256_storeu_si256((__m256i *) lanes, vmax);
+  for (l_int32 i = 0; i < 32; i++) {
+    *pmax = L_MAX(*pmax, lanes[i]);
+  }
+
+  sum = _mm_add_epi64(_mm256_castsi256_si128(vsum), _mm256_extracti128_si256(vsum, 1));
+  *ptotal += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+
+  AbsDiffStatsTail(data, k, n, pmax, ptotal);
+}
+
+#endif /* EDGE_KERNELS_X86 */
+
+#ifdef HAVE_ARMEABI_V7A
+
+/*---------------------------------------------------------------------*
+ *                             NEON kernels                            *
+ *---------------------------------------------------------------------*/
+
+static inline int16x8_t SobelMagnitudeNEON(uint8x8_t a0, uint8x8_t a1, uint8x8_t a2, uint8x8_t b0,
+                                           uint8x8_t b2, uint8x8_t c0, uint8x8_t c1,
+                                           uint8x8_t c2) {
+  /* Column and row sums fit in 16 bits unsigned; differences fit signed */
+  uint16x8_t left = vaddq_u16(vaddl_u8(a0, c0), vshll_n_u8(b0, 1));
+  uint16x8_t right = vaddq_u16(vaddl_u8(a2, c2), vshll_n_u8(b2, 1));
+  uint16x8_t top = vaddq_u16(vaddl_u8(a0, a2), vshll_n_u8(a1, 1));
+  uint16x8_t bottom = vaddq_u16(vaddl_u8(c0, c2), vshll_n_u8(c1, 1));
+  int16x8_t gx = vsubq_s16(vreinterpretq_s16_u16(left), vreinterpretq_s16_u16(right));
+  int16x8_t gy = vsubq_s16(vreinterpretq_s16_u16(top), vreinterpretq_s16_u16(bottom));
+
+  return vaddq_s16(vabsq_s16(gx), vabsq_s16(gy));
+}
+
+/* Returns a 16-bit mask with pixel 0 in the high bit */
+static inline l_uint32 SobelThresh16NEON(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2,
+                                         int16x8_t thresh1) {
+  static const l_uint8 kWeights[16] = { 128, 64, 32, 16, 8, 4, 2, 1,
+                                        128, 64, 32, 16, 8, 4, 2, 1 };
+  uint8x16_t a0 = vld1q_u8(r0);
+  uint8x16_t a1 = vld1q_u8(r0 + 1);
+  uint8x16_t a2 = vld1q_u8(r0 + 2);
+  uint8x16_t b0 = vld1q_u8(r1);
+  uint8x16_t b2 = vld1q_u8(r1 + 2);
+  uint8x16_t c0 = vld1q_u8(r2);
+  uint8x16_t c1 = vld1q_u8(r2 + 1);
+  uint8x16_t c2 = vld1q_u8(r2 + 2);
+
+  int16x8_t lo = SobelMagnitudeNEON(vget_low_u8(a0), vget_low_u8(a1), vget_low_u8(a2),
+                                    vget_low_u8(b0), vget_low_u8(b2), vget_low_u8(c0),
+                                    vget_low_u8(c1), vget_low_u8(c2));
+  int16x8_t hi = SobelMagnitudeNEON(vget_high_u8(a0), vget_high_u8(a1), vget_high_u8(a2),
+                                    vget_high_u8(b0), vget_high_u8(b2), vget_high_u8(c0),
+                                    vget_high_u8(c1), vget_high_u8(c2));
+
+  uint8x16_t mask = vcombine_u8(vmovn_u16(vcgtq_s16(lo, thresh1)),
+                                vmovn_u16(vcgtq_s16(hi, thresh1)));
+  uint8x16_t bits = vandq_u8(mask, vld1q_u8(kWeights));
+
+  /* Each half holds distinct bits, so pairwise sums never carry */
+  uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+  sum = vpadd_u8(sum, sum);
+  sum = vpadd_u8(sum, sum);
+
+  return (vget_lane_u8(sum, 0) << 8) | vget_lane_u8(sum, 1);
+}
+
+static void SobelThreshLineNEON(const l_uint8 *r0, const l_uint8 *r1, const l_uint8 *r2, l_int32 n,
+                                l_int32 thresh, l_uint32 *lined) {
+  l_int32 k;
+  int16x8_t thresh1 = vdupq_n_s16(thresh - 1);
+
+  for (k = 0; k + 32 <= n; k += 32) {
+    lined[k >> 5] = (SobelThresh16NEON(r0 + k, r1 + k, r2 + k, thresh1) << 16) |
+        SobelThresh16NEON(r0 + k + 16, r1 + k + 16, r2 + k + 16, thresh1);
+  }
+
+  SobelThreshTail(r0, r1, r2, k, n, thresh, lined);
+}
+
+static void AbsDiffStatsNEON(const l_uint8 *data, l_int32 n, l_int32 *pmax, l_int32 *ptotal) {
+  l_int32 k;
+  uint8x16_t diff;
+  uint8x16_t vmax = vdupq_n_u8(0);
+  uint32x4_t vsum = vdupq_n_u32(0);
+  uint8x8_t max8;
+  uint64x2_t sum64;
+
+  for (k = 0; k + 16 <= n; k += 16) {
+    diff = vabdq_u8(vld1q_u8(data + k), vld1q_u8(data + k + 4));
+    vmax = vmaxq_u8(vmax, diff);
+    vsum = vpadalq_u16(vsum, vpaddlq_u8(diff));
+  }
+
+  max8 = vpmax_u8(vget_low_u8(vmax), vget_high_u8(vmax));
+  max8 = vpmax_u8(max8, max8);
+  max8 = vpmax_u8(max8, max8);
+  max8 = vpmax_u8(max8, max8);
+  *pmax = L_MAX(*pmax, vget_lane_u8(max8, 0));
+
+  sum64 = vpaddlq_u32(vsum);
+  *ptotal += (l_int32) (vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1));
+
+  AbsDiffStatsTail(data, k, n, pmax, ptotal);
+}
+
+#endif /* HAVE_ARMEABI_V7A */
+
+/*---------------------------------------------------------------------*
+ *                               Dispatch                              *
+ *---------------------------------------------------------------------*/
+
+/*!
+ *  edgeKernelsLevelSupported()
+ *
+ *      Input:  level (EDGE_KERNELS_*)
+ *      Return: 1 if this build and CPU can run level, 0 otherwise
+ */
+l_int32 edgeKernelsLevelSupported(l_int32 level) {
+  switch (level) {
+    case EDGE_KERNELS_SCALAR:
+      return 1;
+#if defined(EDGE_KERNELS_X86) && defined(__SSE2__)
+    case EDGE_KERNELS_SSE2:
+      return __builtin_cpu_supports("sse2") ? 1 : 0;
+#endif
+#ifdef EDGE_KERNELS_X86
+    case EDGE_KERNELS_AVX2:
+      return __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case EDGE_KERNELS_NEON:
+      return (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) ? 1 : 0;
+#endif
+    default:
+      return 0;
+  }
+}
+
+/*!
+ *  edgeKernelsGetLevel()
+ *
+ *      Return: level used by the edge kernels
+ *
+ *  Notes:
+ *      (1) Defaults to the best level supported by the CPU. Detection is
+ *          idempotent, so concurrent first calls are harmless.
+ */
+l_int32 edgeKernelsGetLevel() {
+  l_int32 level;
+
+  if (edge_kernels_level < 0) {
+    level = EDGE_KERNELS_NEON;
+    while (!edgeKernelsLevelSupported(level)) {
+      level--;
+    }
+
+    edge_kernels_level = level;
+  }
+
+  return edge_kernels_level;
+}
+
+/*!
+ *  edgeKernelsSetLevel()
+ *
+ *      Input:  level (EDGE_KERNELS_*)
+ *      Return: 0 if OK, 1 if level is not supported
+ *
+ *  Notes:
+ *      (1) Intended for benchmarks and for checking the vector kernels
+ *          against EDGE_KERNELS_SCALAR. Not safe to call while other
+ *          threads are running the kernels.
+ */
+l_int32 edgeKernelsSetLevel(l_int32 level) {
+  PROCNAME("edgeKernelsSetLevel");
+
+  if (!edgeKernelsLevelSupported(level))
+    return ERROR_INT("level not supported", procName, 1);
+
+  edge_kernels_level = level;
+
+  return 0;
+}
+
+/*!
+ *  edgeSobelThreshLine()
+ *
+ *      Input:  row0, row1, row2 (three consecutive 8 bpp lines, in pixel
+ *                                order, each with at least n + 2 pixels)
+ *              n (number of output pixels)
+ *              thresh (minimum clipped Sobel magnitude)
+ *              lined (1 bpp destination line)
+ *
+ *  Notes:
+ *      (1) Output pixel k is set if the clipped Sobel magnitude of the 3x3
+ *          window with left column k is at least thresh. Bits after n in
+ *          the last destination word are cleared.
+ */
+void edgeSobelThreshLine(const l_uint8 *row0, const l_uint8 *row1, const l_uint8 *row2, l_int32 n,
+                         l_int32 thresh, l_uint32 *lined) {
+  l_int32 k;
+
+  /* Magnitudes are clipped to 255, so nothing passes a higher threshold */
+  if (thresh > 255) {
+    for (k = 0; k < (n + 31) >> 5; k++) {
+      lined[k] = 0;
+    }
+
+    return;
+  }
+
+  thresh = L_MAX(0, thresh);
+
+  switch (edgeKernelsGetLevel()) {
+#if defined(EDGE_KERNELS_X86) && defined(__SSE2__)
+    case EDGE_KERNELS_SSE2:
+      SobelThreshLineSSE2(row0, row1, row2, n, thresh, lined);
+      break;
+#endif
+#ifdef EDGE_KERNELS_X86
+    case EDGE_KERNELS_AVX2:
+      SobelThreshLineAVX2(row0, row1, row2, n, thresh, lined);
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case EDGE_KERNELS_NEON:
+      SobelThreshLineNEON(row0, row1, row2, n, thresh, lined);
+      break;
+#endif
+    default:
+      SobelThreshTail(row0, row1, row2, 0, n, thresh, lined);
+      break;
+  }
+}
+
+/*!
+ *  edgeAbsDiffStats()
+ *
+ *      Input:  data (at least n + 4 bytes)
+ *              n (number of differences)
+ *              &max (<return> updated with the largest difference)
+ *              &total (<return> updated with the sum of differences)
+ *
+ *  Notes:
+ *      (1) Accumulates |data[k] - data[k + 4]| for k in [0, n). Since
+ *          leptonica only swaps bytes within 32-bit words, this can run
+ *          directly on raster data when n is a multiple of 4.
+ */
+void edgeAbsDiffStats(const l_uint8 *data, l_int32 n, l_int32 *pmax, l_int32 *ptotal) {
+  switch (edgeKernelsGetLevel()) {
+#if defined(EDGE_KERNELS_X86) && defined(__SSE2__)
+    case EDGE_KERNELS_SSE2:
+      AbsDiffStatsSSE2(data, n, pmax, ptotal);
+      break;
+#endif
+#ifdef EDGE_KERNELS_X86
+    case EDGE_KERNELS_AVX2:
+      AbsDiffStatsAVX2(data, n, pmax, ptotal);
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case EDGE_KERNELS_NEON:
+      AbsDiffStatsNEON(data, n, pmax, ptotal);
+      break;
+#endif
+    default:
+      AbsDiffStatsTail(data, 0, n, pmax, ptotal);
+      break;
+  }
+}
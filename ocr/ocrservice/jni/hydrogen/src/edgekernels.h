@@ -0,0 +1,44 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_EDGEKERNELS_H_
+#define HYDROGEN_EDGEKERNELS_H_
+
+#include "leptonica.h"
+
+/* Instruction set levels for the edge kernels. Every level produces
+ * identical output, so forcing EDGE_KERNELS_SCALAR gives a reference to
+ * check the vector paths against.
+ */
+enum {
+  EDGE_KERNELS_SCALAR = 0,
+  EDGE_KERNELS_SSE2 = 1,
+  EDGE_KERNELS_AVX2 = 2,
+  EDGE_KERNELS_NEON = 3
+};
+
+l_int32 edgeKernelsGetLevel();
+
+l_int32 edgeKernelsSetLevel(l_int32 level);
+
+l_int32 edgeKernelsLevelSupported(l_int32 level);
+
+void edgeSobelThreshLine(const l_uint8 *row0, const l_uint8 *row1, const l_uint8 *row2, l_int32 n,
+                         l_int32 thresh, l_uint32 *lined);
+
+void edgeAbsDiffStats(const l_uint8 *data, l_int32 n, l_int32 *pmax, l_int32 *ptotal);
+
+#endif /* HYDROGEN_EDGEKERNELS_H_ */
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "leptonica.h"
+#include "grayhist.h"
+
+/* Adds 8 bpp pixels to histograms, with cellx mapping each column to the
+ * histogram it belongs to within the row.
+ */
+static void AddLine(l_uint32 *line, l_int32 w, const l_int32 *cellx, l_uint32 *hist) {
+  for (l_int32 x = 0; x < w; x++) {
+    hist[cellx[x] + GET_DATA_BYTE(line, x)]++;
+  }
+}
+
+/*!
+ *  grayHistGridCreate()
+ *
+ *      Input:  pixs (8 bpp, no colormap)
+ *              nx, ny (number of cells across and down)
+ *      Return: grid, or null on error
+ */
+GrayHistGrid *grayHistGridCreate(PIX *pixs, l_int32 nx, l_int32 ny) {
+  l_int32 w, h, d, wpl, x, y, cy, row_stride;
+  l_int32 *cellx;
+  l_uint32 *data;
+  GrayHistGrid *grid;
+
+  PROCNAME("grayHistGridCreate");
+
+  if (!pixs)
+    return (GrayHistGrid *) ERROR_PTR("pixs not defined", procName, NULL);
+  pixGetDimensions(pixs, &w, &h, &d);
+  if (d != 8 || pixGetColormap(pixs))
+    return (GrayHistGrid *) ERROR_PTR("pixs not 8 bpp without colormap", procName, NULL);
+  if (nx < 1 || ny < 1 || nx > w || ny > h)
+    return (GrayHistGrid *) ERROR_PTR("invalid grid size", procName, NULL);
+
+  data = pixGetData(pixs);
+  wpl = pixGetWpl(pixs);
+
+  grid = (GrayHistGrid *) malloc(sizeof(GrayHistGrid));
+  grid->nx = nx;
+  grid->ny = ny;
+  grid->cell_w = w / nx;
+  grid->cell_h = h / ny;
+
+  row_stride = nx * GRAY_HIST_BINS;
+  grid->hist = (l_uint32 *) calloc(ny * row_stride, sizeof(l_uint32));
+
+  cellx = (l_int32 *) malloc(w * sizeof(l_int32));
+  for (x = 0; x < w; x++) {
+    cellx[x] = L_MIN(x / grid->cell_w, nx - 1) * GRAY_HIST_BINS;
+  }
+
+  for (y = 0; y < h; y++) {
+    cy = L_MIN(y / grid->cell_h, ny - 1);
+    AddLine(data + y * wpl, w, cellx, grid->hist + cy * row_stride);
+  }
+
+  free(cellx);
+
+  return grid;
+}
+
+void grayHistGridDestroy(GrayHistGrid **pgrid) {
+  if (!pgrid || !*pgrid)
+    return;
+
+  free((*pgrid)->hist);
+  free(*pgrid);
+
+  *pgrid = NULL;
+}
+
+/*!
+ *  grayHistGridGetRegion()
+ *
+ *      Input:  grid
+ *              x0, y0, x1, y1 (inclusive range of cells)
+ *              hist (<return> GRAY_HIST_BINS counts)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Regions of more than one cell are summed cell by cell.
+ */
+l_int32 grayHistGridGetRegion(GrayHistGrid *grid, l_int32 x0, l_int32 y0, l_int32 x1, l_int32 y1,
+                              l_uint32 *hist) {
+  l_int32 x, y, b;
+  const l_uint32 *cell;
+
+  PROCNAME("grayHistGridGetRegion");
+
+  if (!grid)
+    return ERROR_INT("grid not defined", procName, 1);
+  if (!hist)
+    return ERROR_INT("hist not defined", procName, 1);
+  if (x0 < 0 || y0 < 0 || x1 >= grid->nx || y1 >= grid->ny || x0 > x1 || y0 > y1)
+    return ERROR_INT("invalid region", procName, 1);
+
+  memset(hist, 0, GRAY_HIST_BINS * sizeof(l_uint32));
+
+  for (y = y0; y <= y1; y++) {
+    for (x = x0; x <= x1; x++) {
+      cell = grid->hist + (y * grid->nx + x) * GRAY_HIST_BINS;
+
+      for (b = 0; b < GRAY_HIST_BINS; b++) {
+        hist[b] += cell[b];
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*!
+ *  pixGetGrayHistogramArray()
+ *
+ *      Input:  pixs (any depth; cmapped ok)
+ *              hist (<return> GRAY_HIST_BINS counts)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Same counts as pixGetGrayHistogram() with factor 1, without
+ *          allocating for the common 8 bpp case.
+ */
+l_int32 pixGetGrayHistogramArray(PIX *pixs, l_uint32 *hist) {
+  l_int32 i, w, h, d, wpl, n;
+  l_float32 val;
+  l_uint32 *data;
+  NUMA *na;
+
+  PROCNAME("pixGetGrayHistogramArray");
+
+  if (!pixs)
+    return ERROR_INT("pixs not defined", procName, 1);
+  if (!hist)
+    return ERROR_INT("hist not defined", procName, 1);
+
+  memset(hist, 0, GRAY_HIST_BINS * sizeof(l_uint32));
+  pixGetDimensions(pixs, &w, &h, &d);
+
+  if (d == 8 && !pixGetColormap(pixs)) {
+    data = pixGetData(pixs);
+    wpl = pixGetWpl(pixs);
+
+    for (i = 0; i < h; i++) {
+      l_uint32 *line = data + i * wpl;
+
+      for (l_int32 x = 0; x < w; x++) {
+        hist[GET_DATA_BYTE(line, x)]++;
+      }
+    }
+
+    return 0;
+  }
+
+  if ((na = pixGetGrayHistogram(pixs, 1)) == NULL)
+    return ERROR_INT("na not made", procName, 1);
+
+  n = L_MIN(GRAY_HIST_BINS, numaGetCount(na));
+  for (i = 0; i < n; i++) {
+    numaGetFValue(na, i, &val);
+    hist[i] = (l_uint32) val;
+  }
+
+  numaDestroy(&na);
+
+  return 0;
+}
+
+/*!
+ *  histGetFisherThresh()
+ *
+ *      Input:  hist (GRAY_HIST_BINS counts)
+ *              scorefract (fraction of the max Otsu score, used to determine
+ *                          the range over which the histogram min is searched)
+ *              &pfdr (<optional return> Fisher's Discriminant Rate value)
+ *              &pthresh (<optional return> Otsu threshold value)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Evaluates the Otsu split of numaSplitDistribution() and the
+ *          variance of numaGetHistogramStats() directly on the counts, in
+ *          the same float arithmetic, so no NUMA is allocated. The score
+ *          of each split is kept on the stack.
+ */
+l_int32 histGetFisherThresh(const l_uint32 *hist, l_float32 scorefract, l_float32 *pfdr,
+                            l_int32 *pthresh) {
+  l_int32 i, n, maxindex, minrange, maxrange, bestsplit;
+  l_float32 sum, moment, var, mean, val, minval, norm, fract, score, maxscore, minscore;
+  l_float32 num1, num2, ave1, ave2, num1prev, num2prev, ave1prev, ave2prev;
+  l_float32 between, within, fdr;
+  l_float32 scores[GRAY_HIST_BINS], aves1[GRAY_HIST_BINS], aves2[GRAY_HIST_BINS];
+  l_float32 nums1[GRAY_HIST_BINS];
+
+  PROCNAME("histGetFisherThresh");
+
+  if (!hist)
+    return ERROR_INT("hist not defined", procName, 1);
+  if (!pfdr && !pthresh)
+    return ERROR_INT("neither &pfdr nor &pthresh defined", procName, 1);
+
+  n = GRAY_HIST_BINS;
+
+  sum = moment = var = 0.0;
+  for (i = 0; i < n; i++) {
+    val = (l_float32) hist[i];
+    sum += val;
+    moment += i * val;
+    var += i * i * val;
+  }
+
+  if (sum <= 0.0)
+    return ERROR_INT("sum <= 0.0", procName, 1);
+
+  mean = moment / sum;
+  var = var / sum - mean * mean;
+
+  /* Score every split, with [0 ... i] in the lower class */
+  norm = 4.0 / ((l_float32) (n - 1) * (n - 1));
+  ave1prev = 0.0;
+  ave2prev = mean;
+  num1prev = 0.0;
+  num2prev = sum;
+  maxindex = n / 2;
+  maxscore = 0.0;
+
+  for (i = 0; i < n; i++) {
+    val = (l_float32) hist[i];
+    num1 = num1prev + val;
+    ave1 = (num1 == 0) ? ave1prev : (num1prev * ave1prev + i * val) / num1;
+    num2 = num2prev - val;
+    ave2 = (num2 == 0) ? ave2prev : (num2prev * ave2prev - i * val) / num2;
+    fract = num1 / sum;
+    score = norm * (fract * (1 - fract)) * (ave2 - ave1) * (ave2 - ave1);
+
+    scores[i] = score;
+    aves1[i] = ave1;
+    aves2[i] = ave2;
+    nums1[i] = num1;
+
+    if (score > maxscore) {
+      maxscore = score;
+      maxindex = i;
+    }
+
+    num1prev = num1;
+    num2prev = num2;
+    ave1prev = ave1;
+    ave2prev = ave2;
+  }
+
+  /* Among contiguous scores near the max, split at the emptiest bin */
+  minscore = (1.0 - scorefract) * maxscore;
+  for (i = maxindex - 1; i >= 0; i--) {
+    if (scores[i] < minscore)
+      break;
+  }
+  minrange = i + 1;
+  for (i = maxindex + 1; i < n; i++) {
+    if (scores[i] < minscore)
+      break;
+  }
+  maxrange = i - 1;
+
+  minval = (l_float32) hist[minrange];
+  bestsplit = minrange;
+  for (i = minrange + 1; i <= maxrange; i++) {
+    if (hist[i] < minval) {
+      minval = (l_float32) hist[i];
+      bestsplit = i;
+    }
+  }
+
+  if (pfdr) {
+    /* Between-class variance = sum of weighted squared distances
+     between-class and overall means */
+    fract = nums1[bestsplit] / sum;
+    between = (fract * (1 - fract)) * (aves1[bestsplit] - aves2[bestsplit]) *
+              (aves1[bestsplit] - aves2[bestsplit]);
+
+    /* Within-class variance = difference between total variance
+     and between-class variance */
+    within = var - between;
+
+    /* FDR = between-class variance over within-class variance */
+    if (within <= 1) {
+      fdr = between;
+    } else {
+      fdr = between / within;
+    }
+
+    *pfdr = fdr;
+  }
+
+  if (pthresh)
+    *pthresh = bestsplit;
+
+  return 0;
+}
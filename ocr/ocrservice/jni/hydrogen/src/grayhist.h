@@ -0,0 +1,50 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_GRAYHIST_H_
+#define HYDROGEN_GRAYHIST_H_
+
+#include "leptonica.h"
+
+/* Number of bins in an 8 bpp gray histogram */
+#define GRAY_HIST_BINS 256
+
+/* Gray histograms for a grid of cells over an 8 bpp image, computed in one
+ * pass into a flat array of GRAY_HIST_BINS counts per cell. Cells follow
+ * pixTilingCreate(): cell_w = w / nx and cell_h = h / ny, with the last
+ * column and row absorbing any remainder.
+ */
+struct GrayHistGrid {
+  l_int32 nx;
+  l_int32 ny;
+  l_int32 cell_w;
+  l_int32 cell_h;
+  l_uint32 *hist;
+};
+
+GrayHistGrid *grayHistGridCreate(PIX *pixs, l_int32 nx, l_int32 ny);
+
+void grayHistGridDestroy(GrayHistGrid **pgrid);
+
+l_int32 grayHistGridGetRegion(GrayHistGrid *grid, l_int32 x0, l_int32 y0, l_int32 x1, l_int32 y1,
+                              l_uint32 *hist);
+
+l_int32 pixGetGrayHistogramArray(PIX *pixs, l_uint32 *hist);
+
+l_int32 histGetFisherThresh(const l_uint32 *hist, l_float32 scorefract, l_float32 *pfdr,
+                            l_int32 *pthresh);
+
+#endif /* HYDROGEN_GRAYHIST_H_ */
@@ -14,28 +14,396 @@
  * limitations under the License.
  */
 
+#include <cmath>
 #include <ctime>
 #include <cstring>
 #include <cstdlib>
+#include <pthread.h>
 
 #include "leptonica.h"
+#include "arena.h"
 #include "hydrogentextdetector.h"
 #include "clusterer.h"
+#include "conncomp.h"
+#include "similar.h"
 #include "thresholder.h"
+#include "threadpool.h"
 #include "utilities.h"
 
+/* Largest central area used for scene signatures, as in similar.cpp */
+#define SIGNATURE_MAX_SIZE 480
+
+/* Initial size of each extraction pass scratch arena, in bytes */
+#define SCRATCH_BLOCK_SIZE (256 * 1024)
+
+/* Brick used to link edges into text blocks on the reduced image */
+#define COARSE_LINK_X 5
+#define COARSE_LINK_Y 3
+
+/* Padding around changed edge tiles re-extracted in streaming mode, in
+ * pixels, and the share of the frame past which the whole frame is
+ * extracted instead */
+#define STREAM_DIRTY_MARGIN 32
+#define STREAM_MAX_DIRTY_FRACTION 0.5
+
+/* Times dirty regions are grown over the carried areas they touch */
+#define STREAM_MAX_GROW_PASSES 4
+
+/* ComputeSignature() works out of static buffers */
+static pthread_mutex_t signature_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns a new copy of the scene signature of pix8, or NULL if pix8 is
+ * too small to have one.
+ */
+static l_int32 *ComputeSceneSignature(PIX *pix8, l_int32 *psize) {
+  l_int32 w, h, wpl, cw, ch, left, top, x, y, size;
+  l_uint8 *luminance;
+  l_uint32 *data, *line;
+  l_int32 *signature;
+  uint32 *result;
+
+  pixGetDimensions(pix8, &w, &h, NULL);
+
+  if (w < 3 || h < 3)
+    return NULL;
+
+  /* Only the central area contributes, so only unpack that */
+  cw = L_MIN(SIGNATURE_MAX_SIZE, w);
+  ch = L_MIN(SIGNATURE_MAX_SIZE, h);
+  left = (w - cw) / 2;
+  top = (h - ch) / 2;
+  data = pixGetData(pix8);
+  wpl = pixGetWpl(pix8);
+  luminance = (l_uint8 *) malloc(cw * ch);
+
+  for (y = 0; y < ch; y++) {
+    line = data + (top + y) * wpl;
+    for (x = 0; x < cw; x++) {
+      luminance[y * cw + x] = GET_DATA_BYTE(line, left + x);
+    }
+  }
+
+  pthread_mutex_lock(&signature_mutex);
+  result = ComputeSignature(luminance, cw, ch, &size);
+  signature = (l_int32 *) malloc(size * sizeof(l_int32));
+  memcpy(signature, result, size * sizeof(l_int32));
+  pthread_mutex_unlock(&signature_mutex);
+
+  free(luminance);
+
+  *psize = size;
+
+  return signature;
+}
+
+/* Returns whether both parameter sets run the same skew sweep */
+static bool SameSkewSweep(const HydrogenTextDetector::TextDetectorParameters &a,
+                          const HydrogenTextDetector::TextDetectorParameters &b) {
+  return a.skew_sweep_range == b.skew_sweep_range && a.skew_sweep_delta == b.skew_sweep_delta
+      && a.skew_sweep_reduction == b.skew_sweep_reduction
+      && a.skew_search_reduction == b.skew_search_reduction
+      && a.skew_search_min_delta == b.skew_search_min_delta;
+}
+
+static void StartStage(l_float64 *start) {
+  start[0] = getWallTimeMs();
+  start[1] = getThreadCpuTimeMs();
+}
+
+static void EndStage(HydrogenTextDetector::DetectorStats *stats, l_int32 stage,
+                     const l_float64 *start) {
+  stats->wall_ms[stage] += (l_float32) (getWallTimeMs() - start[0]);
+  stats->cpu_ms[stage] += (l_float32) (getThreadCpuTimeMs() - start[1]);
+}
+
+static void ResetStats(HydrogenTextDetector::DetectorStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->edge_tiles_changed = -1;
+  stats->extracted_regions = -1;
+}
+
+static void AddExtractionStats(HydrogenTextDetector::DetectorStats *dst,
+                               const HydrogenTextDetector::DetectorStats *src) {
+  for (int i = HydrogenTextDetector::STAGE_CONNCOMP; i <= HydrogenTextDetector::STAGE_MERGE; i++) {
+    dst->wall_ms[i] += src->wall_ms[i];
+    dst->cpu_ms[i] += src->cpu_ms[i];
+  }
+
+  dst->components += src->components;
+  dst->pairs_removed += src->pairs_removed;
+  dst->clusters += src->clusters;
+  dst->fragments_merged += src->fragments_merged;
+}
+
+/* Returns the packed size of an area bitmap, or 0 if it cannot be exported.
+ * Rows are not padded; only the total is rounded up to a multiple of 4. */
+static l_int32 ExportBitmapSize(PIX *pix, l_int32 w, l_int32 h) {
+  if (!pix || pixGetDepth(pix) != 1 || pixGetWidth(pix) != w || pixGetHeight(pix) != h)
+    return 0;
+
+  return (((w + 7) / 8) * h + 3) & ~3;
+}
+
+/* Copies a 1 bpp image into unpadded rows of (w + 7) / 8 bytes, MSB first,
+ * and zeros the rest of size, which ExportBitmapSize() rounds up to a
+ * multiple of 4 bytes */
+static void ExportBitmap(PIX *pix, l_uint8 *dst, l_int32 size) {
+  l_int32 w, h, wpl, x, y, bpl;
+  l_uint32 *data, *line;
+  l_uint8 pad_mask;
+
+  w = pixGetWidth(pix);
+  h = pixGetHeight(pix);
+  data = pixGetData(pix);
+  wpl = pixGetWpl(pix);
+  bpl = (w + 7) / 8;
+  pad_mask = (l_uint8) (0xff << ((8 - (w & 7)) & 7));
+
+  for (y = 0; y < h; y++) {
+    line = data + y * wpl;
+
+    for (x = 0; x < bpl; x++) {
+      dst[x] = (l_uint8) GET_DATA_BYTE(line, x);
+    }
+
+    /* Leptonica leaves garbage in the bits past the image width */
+    dst[bpl - 1] &= pad_mask;
+    dst += bpl;
+  }
+
+  memset(dst, 0, size - bpl * h);
+}
+
 HydrogenTextDetector::HydrogenTextDetector() {
   pixs_ = NULL;
+  luma_[0] = NULL;
+  luma_[1] = NULL;
+  rois_ = NULL;
   text_areas_ = NULL;
   text_confs_ = NULL;
+  thread_pool_ = NULL;
+  thread_pool_size_ = 0;
+  scratch_[0] = NULL;
+  scratch_[1] = NULL;
+  skew_angle_ = 0.0;
+  ResetStats(&stats_);
+  skew_cached_ = false;
+  skew_cached_angle_ = 0.0;
+  skew_cached_conf_ = 0.0;
+  skew_signature_ = NULL;
+  skew_signature_size_ = 0;
+  skew_reused_ = 0;
+  stream_pix8_ = NULL;
+  stream_edges_ = NULL;
+  stream_areas_ = NULL;
+  stream_confs_ = NULL;
+  stream_skew_angle_ = 0.0;
+  stream_tile_ages_ = NULL;
+  stream_num_tiles_ = 0;
+  stream_residual_x_ = 0.0;
+  stream_residual_y_ = 0.0;
+  stream_area_offsets_ = NULL;
+  area_deltas_ = NULL;
+  num_area_deltas_ = 0;
+  motion_x_ = 0.0;
+  motion_y_ = 0.0;
 }
 
 HydrogenTextDetector::~HydrogenTextDetector() {
   Clear();
+  ResetStream();
+
+  free(area_deltas_);
+  pixDestroy(&luma_[0]);
+  pixDestroy(&luma_[1]);
+  boxaDestroy(&rois_);
+  arenaDestroy(&scratch_[0]);
+  arenaDestroy(&scratch_[1]);
+  delete thread_pool_;
+}
+
+ThreadPool *HydrogenTextDetector::GetThreadPool() {
+  if (parameters_.num_threads <= 1) {
+    return NULL;
+  }
+
+  // Recreate the pool if the requested thread count changed. Compare against
+  // the count it was requested with, since a pool that couldn't start every
+  // thread would otherwise be rebuilt on each call.
+  if (thread_pool_ && thread_pool_size_ != parameters_.num_threads) {
+    delete thread_pool_;
+    thread_pool_ = NULL;
+  }
+
+  if (!thread_pool_) {
+    thread_pool_ = new ThreadPool(parameters_.num_threads);
+    thread_pool_size_ = parameters_.num_threads;
+  }
+
+  return thread_pool_;
+}
+
+Arena *HydrogenTextDetector::GetScratch(l_int32 index) {
+  if (!scratch_[index]) {
+    scratch_[index] = arenaCreate(SCRATCH_BLOCK_SIZE);
+  }
+
+  return scratch_[index];
+}
+
+BOXA *HydrogenTextDetector::FindCandidateRegions(PIX *pix8) {
+  l_int32 w, h, i, j, factor, margin, x0, y0, x1, y1;
+  BOXA *boxa, *boxad;
+  BOX *box, *roi, *overlap;
+
+  PROCNAME("HydrogenTextDetector::FindCandidateRegions");
+
+  if (parameters_.coarse_reduction != 1 && parameters_.coarse_reduction != 2
+      && parameters_.coarse_reduction != 4)
+    return (BOXA *) ERROR_PTR("coarse_reduction not 1, 2 or 4", procName, NULL);
+
+  pixGetDimensions(pix8, &w, &h, NULL);
+  boxa = boxaCreate(0);
+
+  if (parameters_.coarse_reduction != 1) {
+    // Reduce by area averaging, which keeps edges that subsampling would
+    // alias away
+    PIX *pixr = pixClone(pix8);
+    for (factor = 1; factor < parameters_.coarse_reduction; factor *= 2) {
+      PIX *pixt = pixScaleAreaMap2(pixr);
+      pixDestroy(&pixr);
+      pixr = pixt;
+    }
+
+    PIX *edgesr;
+    pixEdgeAdaptiveThresholdParallel(pixr, &edgesr, L_MAX(8, parameters_.edge_tile_x / factor),
+                                     L_MAX(8, parameters_.edge_tile_y / factor),
+                                     parameters_.edge_thresh, parameters_.edge_avg_thresh,
+                                     GetThreadPool());
+    pixDestroy(&pixr);
+
+    // Link neighboring characters, then take each linked block as a
+    // candidate, padded to catch strokes that were lost in the reduction
+    PIX *linked = pixDilateBrick(NULL, edgesr, COARSE_LINK_X, COARSE_LINK_Y);
+    CCLabels *ccl = ccLabelsCreate(linked, 1, 8, NULL);
+    margin = parameters_.coarse_margin;
+
+    for (i = 0; ccl && i < ccl->num_comps; i++) {
+      CCComp *comp = &ccl->comps[i];
+
+      if (comp->area < parameters_.coarse_min_area) {
+        continue;
+      }
+
+      x0 = L_MAX(0, comp->x * factor - margin);
+      y0 = L_MAX(0, comp->y * factor - margin);
+      x1 = (comp->x + comp->w) * factor + margin;
+      y1 = (comp->y + comp->h) * factor + margin;
+      boxaAddBox(boxa, boxCreate(x0, y0, x1 - x0, y1 - y0), L_INSERT);
+    }
+
+    if (parameters_.debug) fprintf(stderr, "Found %d coarse candidate blocks\n", boxaGetCount(boxa));
+
+    ccLabelsDestroy(&ccl);
+    pixDestroy(&linked);
+    pixDestroy(&edgesr);
+
+    // Keep only the parts of candidates that fall inside a region of interest
+    if (rois_) {
+      boxad = boxaCreate(0);
+
+      for (i = 0; i < boxaGetCount(boxa); i++) {
+        box = boxaGetBox(boxa, i, L_CLONE);
+
+        for (j = 0; j < boxaGetCount(rois_); j++) {
+          roi = boxaGetBox(rois_, j, L_CLONE);
+
+          if ((overlap = boxOverlapRegion(box, roi)) != NULL) {
+            boxaAddBox(boxad, overlap, L_INSERT);
+          }
+
+          boxDestroy(&roi);
+        }
+
+        boxDestroy(&box);
+      }
+
+      boxaDestroy(&boxa);
+      boxa = boxad;
+    }
+  } else if (rois_) {
+    boxaDestroy(&boxa);
+    boxa = boxaCopy(rois_, L_COPY);
+  }
+
+  // Clip to the image, dropping regions that lie entirely outside it
+  boxad = boxaCreate(0);
+  for (i = 0; i < boxaGetCount(boxa); i++) {
+    box = boxaGetBox(boxa, i, L_CLONE);
+
+    BOX *clipped = boxClipToRectangle(box, w, h);
+    if (clipped && clipped->w > 0 && clipped->h > 0) {
+      boxaAddBox(boxad, clipped, L_INSERT);
+    } else {
+      boxDestroy(&clipped);
+    }
+
+    boxDestroy(&box);
+  }
+
+  boxaDestroy(&boxa);
+  boxa = boxaCombineOverlaps(boxad);
+  boxaDestroy(&boxad);
+
+  return boxa;
+}
+
+PIX *HydrogenTextDetector::ThresholdRegions(PIX *pix8, l_int32 *pcount) {
+  l_int32 i, n;
+  PIX *edges, *crop, *cropedges;
+  BOX *box, *clipped;
+  BOXA *regions;
+
+  regions = FindCandidateRegions(pix8);
+  n = regions ? boxaGetCount(regions) : 0;
+  edges = pixCreate(pixGetWidth(pix8), pixGetHeight(pix8), 1);
+
+  // Pixels outside every region are left as non-edges, so later stages
+  // only see components inside the regions
+  for (i = 0; i < n; i++) {
+    box = boxaGetBox(regions, i, L_CLONE);
+    crop = pixClipRectangle(pix8, box, &clipped);
+    boxDestroy(&box);
+
+    if (!crop) {
+      boxDestroy(&clipped);
+      continue;
+    }
+
+    if (!pixEdgeAdaptiveThresholdParallel(crop, &cropedges, parameters_.edge_tile_x,
+                                          parameters_.edge_tile_y, parameters_.edge_thresh,
+                                          parameters_.edge_avg_thresh, GetThreadPool())) {
+      pixRasterop(edges, clipped->x, clipped->y, clipped->w, clipped->h, PIX_SRC, cropedges, 0, 0);
+      pixDestroy(&cropedges);
+    }
+
+    pixDestroy(&crop);
+    boxDestroy(&clipped);
+  }
+
+  boxaDestroy(&regions);
+
+  if (pcount) {
+    *pcount = n;
+  }
+
+  return edges;
 }
 
-PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pconfs) {
+PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, bool inverted, Arena *arena,
+                                               DetectorStats *stats, NUMA **pconfs) {
   l_int32 result;
+  l_float64 start[2];
 
   if (parameters_.debug) fprintf(stderr, "ExtractTextRegions()\n");
 
@@ -49,7 +417,10 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   PIXA *conncomp;
 
   if (parameters_.debug) fprintf(stderr, "ConnCompValidPixa()\n");
-  result = ConnCompValidPixa(pix8, edges, &conncomp, &connconfs, parameters_);
+  StartStage(start);
+  result = ConnCompValidPixa(pix8, edges, inverted ? 0 : 1, &conncomp, &connconfs, arena,
+                             parameters_);
+  EndStage(stats, STAGE_CONNCOMP, start);
 
   if (parameters_.debug) fprintf(stderr, "Found %d connected components\n", result);
 
@@ -61,10 +432,14 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   }
 
   l_int32 count = pixaGetCount(conncomp);
-  l_uint8 *remove = (l_uint8 *) calloc(count, sizeof(l_uint8));
+  l_uint8 *remove = (l_uint8 *) arenaCalloc(arena, count, sizeof(l_uint8));
+  stats->components += count;
 
   if (parameters_.debug) fprintf(stderr, "RemoveInvalidPairs()\n");
-  result = RemoveInvalidPairs(pix8, conncomp, connconfs, remove, parameters_);
+  StartStage(start);
+  result = RemoveInvalidPairs(pix8, conncomp, connconfs, remove, arena, parameters_);
+  EndStage(stats, STAGE_PAIRS, start);
+  stats->pairs_removed += L_MAX(0, result);
 
   if (parameters_.debug) fprintf(stderr, "Removed %d invalid pairs\n", result);
 
@@ -75,10 +450,14 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
     pixWriteImpliedFormat(filename, temp, 85, 0);
   }
 
-  NUMA *clusterconfs;
-  PIXA *clusters;
+  NUMA *clusterconfs = NULL;
+  PIXA *clusters = NULL;
   if (parameters_.debug) fprintf(stderr, "ClusterValidComponents()\n");
-  result = ClusterValidComponents(pix8, conncomp, connconfs, remove, &clusters, &clusterconfs, parameters_);
+  StartStage(start);
+  result = ClusterValidComponents(pix8, conncomp, connconfs, remove, &clusters, &clusterconfs, arena,
+                                  parameters_);
+  EndStage(stats, STAGE_CLUSTER, start);
+  stats->clusters += L_MAX(0, result);
 
   if (parameters_.debug) fprintf(stderr, "Created %d clusters\n", result);
 
@@ -92,18 +471,311 @@ PIXA *HydrogenTextDetector::ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pco
   // Merge unused components that are contained inside the detected text areas.
   // This typically catches punctuation and dots over i's and j's.
   if (parameters_.debug) fprintf(stderr, "MergePairFragments()\n");
+  StartStage(start);
   result = MergePairFragments(pix8, clusters, conncomp, remove);
+  EndStage(stats, STAGE_MERGE, start);
+  stats->fragments_merged += L_MAX(0, result);
 
   *pconfs = clusterconfs;
 
   pixaDestroy(&conncomp);
-  free(remove);
+  arenaFree(arena, remove);
+
+  return clusters;
+}
+
+struct ExtractTextRegionsPass {
+  HydrogenTextDetector *detector;
+  PIX *pix8;
+  PIX *edges;
+  Arena *scratch[2];
+  HydrogenTextDetector::DetectorStats stats[2];
+  PIXA *clusters[2];
+  NUMA *confs[2];
+};
+
+void HydrogenTextDetector::ExtractTextRegionsTask(void *arg, l_int32 index) {
+  ExtractTextRegionsPass *pass = (ExtractTextRegionsPass *) arg;
+
+  pass->clusters[index] = pass->detector->ExtractTextRegions(pass->pix8, pass->edges, index == 1,
+                                                             pass->scratch[index],
+                                                             &pass->stats[index],
+                                                             &pass->confs[index]);
+}
+
+PIXA *HydrogenTextDetector::ExtractBothPasses(PIX *pix8, PIX *edges, Arena **scratch,
+                                              NUMA **pconfs) {
+  NUMA *confs, *invconfs;
+  PIXA *clusters, *invclusters;
+  ThreadPool *pool = parameters_.parallel_passes ? GetThreadPool() : NULL;
+
+  if (pool && pool->GetNumThreads() > 1) {
+    if (parameters_.debug) fprintf(stderr, "Extracting normal and inverted regions in parallel...\n");
+
+    // Both passes only read the edge map. Results are stored by pass index,
+    // so the joined output order matches the serial path.
+    ExtractTextRegionsPass pass;
+    pass.detector = this;
+    pass.pix8 = pix8;
+    pass.edges = edges;
+    pass.scratch[0] = scratch[0];
+    pass.scratch[1] = scratch[1];
+    ResetStats(&pass.stats[0]);
+    ResetStats(&pass.stats[1]);
+
+    pool->ParallelFor(2, ExtractTextRegionsTask, &pass);
+
+    AddExtractionStats(&stats_, &pass.stats[0]);
+    AddExtractionStats(&stats_, &pass.stats[1]);
+
+    clusters = pass.clusters[0];
+    confs = pass.confs[0];
+    invclusters = pass.clusters[1];
+    invconfs = pass.confs[1];
+  } else {
+    clusters = ExtractTextRegions(pix8, edges, false, scratch[0], &stats_, &confs);
+
+    // The inverted pass labels OFF pixels, so edges is never modified. It
+    // can be the streaming edge map itself when no rotation was needed.
+    invclusters = ExtractTextRegions(pix8, edges, true, scratch[1], &stats_, &invconfs);
+  }
+
+  pixaJoin(clusters, invclusters, 0, 0);
+  pixaDestroy(&invclusters);
+
+  numaJoin(confs, invconfs);
+  numaDestroy(&invconfs);
+
+  *pconfs = confs;
 
   return clusters;
 }
 
-PIX *HydrogenTextDetector::DetectAndFixSkew(PIX *pixs) {
+BOXA *HydrogenTextDetector::FindDirtyRegions(PIX *pix8, PIXA *carried) {
+  l_int32 w, h, nx, ny, tw, th, x, y, i, j, n, left, top, right, bottom, area, pass;
+  l_int32 intersects;
+  bool grew;
+  BOXA *boxa, *boxad;
+  BOX *box, *areabox, *bounds;
+
+  pixGetDimensions(pix8, &w, &h, NULL);
+
+  // Same tiling as pixEdgeAdaptiveThresholdIncremental()
+  nx = L_MAX(1, w / parameters_.edge_tile_x);
+  ny = L_MAX(1, h / parameters_.edge_tile_y);
+  tw = w / nx;
+  th = h / ny;
+
+  if (!stream_tile_ages_ || nx * ny != stream_num_tiles_) {
+    return NULL;
+  }
+
+  // Tiles recomputed this frame have age 0. Pad them so components that
+  // cross into unchanged tiles are labeled whole.
+  boxa = boxaCreate(0);
+  for (y = 0; y < ny; y++) {
+    for (x = 0; x < nx; x++) {
+      if (stream_tile_ages_[y * nx + x] != 0) {
+        continue;
+      }
+
+      left = L_MAX(0, x * tw - STREAM_DIRTY_MARGIN);
+      top = L_MAX(0, y * th - STREAM_DIRTY_MARGIN);
+      right = L_MIN(w, ((x == nx - 1) ? w : (x + 1) * tw) + STREAM_DIRTY_MARGIN);
+      bottom = L_MIN(h, ((y == ny - 1) ? h : (y + 1) * th) + STREAM_DIRTY_MARGIN);
+      boxaAddBox(boxa, boxCreate(left, top, right - left, bottom - top), L_INSERT);
+    }
+  }
+
+  // Carried areas that touch a region are dropped and found again, so grow
+  // the regions over them until none is cut in two
+  grew = true;
+  for (pass = 0; grew && pass < STREAM_MAX_GROW_PASSES; pass++) {
+    boxad = boxaCombineOverlaps(boxa);
+    boxaDestroy(&boxa);
+    boxa = boxad;
+
+    grew = false;
+    n = boxaGetCount(boxa);
+    for (i = 0; i < n; i++) {
+      box = boxaGetBox(boxa, i, L_CLONE);
+
+      for (j = 0; j < pixaGetCount(carried); j++) {
+        areabox = pixaGetBox(carried, j, L_CLONE);
+        boxIntersects(box, areabox, &intersects);
+
+        if (intersects) {
+          bounds = boxBoundingRegion(box, areabox);
+          if (bounds->w != box->w || bounds->h != box->h) {
+            boxSetGeometry(box, bounds->x, bounds->y, bounds->w, bounds->h);
+            grew = true;
+          }
+          boxDestroy(&bounds);
+        }
+
+        boxDestroy(&areabox);
+      }
+
+      boxDestroy(&box);
+    }
+  }
+
+  if (grew) {
+    boxad = boxaCombineOverlaps(boxa);
+    boxaDestroy(&boxa);
+    boxa = boxad;
+  }
+
+  // Carried areas can hang over the frame edges
+  boxad = boxaCreate(0);
+  area = 0;
+  for (i = 0; i < boxaGetCount(boxa); i++) {
+    box = boxaGetBox(boxa, i, L_CLONE);
+    bounds = boxClipToRectangle(box, w, h);
+
+    if (bounds) {
+      area += bounds->w * bounds->h;
+      boxaAddBox(boxad, bounds, L_INSERT);
+    }
+
+    boxDestroy(&box);
+  }
+  boxaDestroy(&boxa);
+
+  // Past this, separate passes cost more than one over the whole frame
+  if (area > STREAM_MAX_DIRTY_FRACTION * w * h) {
+    boxaDestroy(&boxad);
+    return NULL;
+  }
+
+  return boxad;
+}
+
+PIXA *HydrogenTextDetector::ExtractDirtyRegions(PIX *pix8, PIX *edges, BOXA *regions,
+                                                PIXA *carried, NUMA *carriedconfs,
+                                                Arena **scratch, NUMA **pconfs) {
+  l_int32 i, j, n, x, y, w, h, intersects;
+  l_float32 conf;
+  bool inside;
+  PIXA *pixad, *clusters;
+  NUMA *confs, *clusterconfs;
+  BOX *box, *areabox;
+  PIX *crop8, *cropedges;
+
+  pixad = pixaCreate(0);
+  confs = numaCreate(0);
+  n = boxaGetCount(regions);
+
+  // Keep the carried areas outside every region as they are
+  for (i = 0; i < pixaGetCount(carried); i++) {
+    areabox = pixaGetBox(carried, i, L_CLONE);
+    inside = false;
+
+    for (j = 0; j < n && !inside; j++) {
+      box = boxaGetBox(regions, j, L_CLONE);
+      boxIntersects(box, areabox, &intersects);
+      inside = intersects;
+      boxDestroy(&box);
+    }
+
+    if (inside) {
+      boxDestroy(&areabox);
+      continue;
+    }
+
+    numaGetFValue(carriedconfs, i, &conf);
+    pixaAddPix(pixad, pixaGetPix(carried, i, L_CLONE), L_INSERT);
+    pixaAddBox(pixad, areabox, L_INSERT);
+    numaAddNumber(confs, conf);
+  }
+
+  // Extract each region on its own and move what it finds into the frame
+  for (j = 0; j < n; j++) {
+    box = boxaGetBox(regions, j, L_CLONE);
+    crop8 = pixClipRectangle(pix8, box, NULL);
+    cropedges = pixClipRectangle(edges, box, NULL);
+
+    if (crop8 && cropedges) {
+      clusters = ExtractBothPasses(crop8, cropedges, scratch, &clusterconfs);
+
+      for (i = 0; clusters && i < pixaGetCount(clusters); i++) {
+        pixaGetBoxGeometry(clusters, i, &x, &y, &w, &h);
+        numaGetFValue(clusterconfs, i, &conf);
+        pixaAddPix(pixad, pixaGetPix(clusters, i, L_CLONE), L_INSERT);
+        pixaAddBox(pixad, boxCreate(box->x + x, box->y + y, w, h), L_INSERT);
+        numaAddNumber(confs, conf);
+      }
+
+      pixaDestroy(&clusters);
+      numaDestroy(&clusterconfs);
+    }
+
+    pixDestroy(&crop8);
+    pixDestroy(&cropedges);
+    boxDestroy(&box);
+  }
+
+  *pconfs = confs;
+
+  return pixad;
+}
+
+bool HydrogenTextDetector::FindSkew(PIX *pix8, PIX *edges, l_float32 *pangle,
+                                    l_float32 *pconf) {
+  l_int32 *signature = NULL;
+  l_int32 size = 0;
+  bool found;
+
+  // The cached result only holds for the sweep it came from
+  if (skew_cached_ && !SameSkewSweep(parameters_, skew_cached_params_)) {
+    ClearSkewCache();
+  }
+
+  // Consecutive camera frames usually share their skew, so skip the sweep
+  // while the scene matches the one it was last run on. The signature is
+  // only a luminance histogram and can't see rotation, so sweep again
+  // after skew_reuse_max_count frames regardless.
+  if (parameters_.skew_reuse_max_diff >= 0) {
+    signature = ComputeSceneSignature(pix8, &size);
+
+    if (signature && skew_cached_ && size == skew_signature_size_
+        && skew_reused_ < parameters_.skew_reuse_max_count
+        && Diff(skew_signature_, signature, size) <= parameters_.skew_reuse_max_diff) {
+      if (parameters_.debug) fprintf(stderr, "Reused skew from unchanged scene\n");
+
+      free(signature);
+      skew_reused_++;
+
+      *pangle = skew_cached_angle_;
+      *pconf = skew_cached_conf_;
+
+      return true;
+    }
+  }
+
+  found = !pixFindSkewSweepAndSearch(edges, pangle, pconf, parameters_.skew_sweep_reduction,
+                                     parameters_.skew_search_reduction,
+                                     parameters_.skew_sweep_range, parameters_.skew_sweep_delta,
+                                     parameters_.skew_search_min_delta);
+
+  // Failures are cached with zero confidence so that a static scene
+  // doesn't repeat them.
+  free(skew_signature_);
+  skew_signature_ = signature;
+  skew_signature_size_ = size;
+  skew_cached_ = (signature != NULL);
+  skew_cached_angle_ = found ? *pangle : 0.0;
+  skew_cached_conf_ = found ? *pconf : 0.0;
+  skew_cached_params_ = parameters_;
+  skew_reused_ = 0;
+
+  return found;
+}
+
+PIX *HydrogenTextDetector::DetectAndFixSkew(PIX *pix8, PIX *pixs) {
   l_float32 angle, conf;
+  BOX *box = NULL;
+  PIX *pixc = NULL;
 
   skew_angle_ = 0.0;
 
@@ -113,17 +785,34 @@ PIX *HydrogenTextDetector::DetectAndFixSkew(PIX *pixs) {
     return pixClone(pixs);
   }
 
-  if (pixFindSkewSweepAndSearch(pixs, &angle, &conf, parameters_.skew_sweep_reduction,
-                                parameters_.skew_search_reduction, parameters_.skew_sweep_range,
-                                parameters_.skew_sweep_delta, parameters_.skew_search_min_delta)) {
+  // Only tiles that passed edge thresholding can hold text, so measure just
+  // the region that contains them.
+  if (pixClipToForeground(pixs, &pixc, &box) || !pixc || !box) {
+    if (parameters_.debug) fprintf(stderr, "Bypassed skew (no edges)\n");
+
+    pixDestroy(&pixc);
+    boxDestroy(&box);
+
+    return pixClone(pixs);
+  }
+
+  bool found = FindSkew(pix8, pixc, &angle, &conf);
+
+  pixDestroy(&pixc);
+
+  if (!found) {
     if (parameters_.debug) fprintf(stderr, "Bypassed skew (failed sweep and search)\n");
 
+    boxDestroy(&box);
+
     return pixClone(pixs);
   }
 
   if (conf <= 0 || L_ABS(angle) < parameters_.skew_min_angle) {
     if (parameters_.debug) fprintf(stderr, "Bypassed skew (low confidence or small angle)\n");
 
+    boxDestroy(&box);
+
     return pixClone(pixs);
   }
 
@@ -136,21 +825,169 @@ PIX *HydrogenTextDetector::DetectAndFixSkew(PIX *pixs) {
   l_float32 deg2rad = 3.1415926535 / 180.0;
   l_float32 radians = angle * deg2rad;
 
-  PIX *pixd = pixRotate(pixs, radians, L_ROTATE_SAMPLING, L_BRING_IN_WHITE, 0, 0);
+  PIX *pixd;
+  if (parameters_.skew_rotate_region) {
+    pixd = pixRotateRegion(pixs, box, radians);
+  } else {
+    pixd = pixRotate(pixs, radians, L_ROTATE_SAMPLING, L_BRING_IN_WHITE, 0, 0);
+  }
+
+  boxDestroy(&box);
 
   return pixd;
 }
 
+void HydrogenTextDetector::SetMotion(l_float32 dx, l_float32 dy, const l_float32 *area_deltas,
+                                     l_int32 num_areas) {
+  motion_x_ = dx;
+  motion_y_ = dy;
+
+  free(area_deltas_);
+  area_deltas_ = NULL;
+  num_area_deltas_ = 0;
+
+  if (area_deltas && num_areas > 0) {
+    area_deltas_ = (l_float32 *) malloc(2 * num_areas * sizeof(l_float32));
+    memcpy(area_deltas_, area_deltas, 2 * num_areas * sizeof(l_float32));
+    num_area_deltas_ = num_areas;
+  }
+}
+
+void HydrogenTextDetector::ClearMotion() {
+  SetMotion(0.0, 0.0, NULL, 0);
+}
+
+void HydrogenTextDetector::ResetStream() {
+  ClearStreamFrame();
+  ClearSkewCache();
+}
+
+void HydrogenTextDetector::ClearSkewCache() {
+  free(skew_signature_);
+  skew_signature_ = NULL;
+  skew_signature_size_ = 0;
+  skew_cached_ = false;
+  skew_reused_ = 0;
+}
+
+void HydrogenTextDetector::ClearStreamFrame() {
+  pixDestroy(&stream_pix8_);
+  pixDestroy(&stream_edges_);
+  pixaDestroy(&stream_areas_);
+  numaDestroy(&stream_confs_);
+  stream_skew_angle_ = 0.0;
+  free(stream_tile_ages_);
+  stream_tile_ages_ = NULL;
+  stream_num_tiles_ = 0;
+  stream_residual_x_ = 0.0;
+  stream_residual_y_ = 0.0;
+  free(stream_area_offsets_);
+  stream_area_offsets_ = NULL;
+}
+
+PIXA *HydrogenTextDetector::WarpStreamAreas(NUMA **pconfs) {
+  l_int32 i, n, x, y, w, h;
+  l_float32 dx, dy, cosa, sina;
+  PIXA *pixad;
+  PIX *pix;
+
+  n = pixaGetCount(stream_areas_);
+  pixad = pixaCreate(n);
+
+  // Areas live in the deskewed frame, so rotate source motion into it the
+  // same way pixRotate() moved the edges.
+  l_float32 radians = -stream_skew_angle_ * 3.1415926535 / 180.0;
+  cosa = cos(radians);
+  sina = sin(radians);
+
+  for (i = 0; i < n; i++) {
+    if (num_area_deltas_ == n) {
+      dx = area_deltas_[2 * i];
+      dy = area_deltas_[2 * i + 1];
+    } else {
+      dx = motion_x_;
+      dy = motion_y_;
+    }
+
+    // Areas keep the boxes they were extracted with and only the summed
+    // motion is rounded, so slow motion still moves them
+    stream_area_offsets_[2 * i] += cosa * dx - sina * dy;
+    stream_area_offsets_[2 * i + 1] += sina * dx + cosa * dy;
+
+    pixaGetBoxGeometry(stream_areas_, i, &x, &y, &w, &h);
+    x += (l_int32) floor(stream_area_offsets_[2 * i] + 0.5);
+    y += (l_int32) floor(stream_area_offsets_[2 * i + 1] + 0.5);
+
+    pix = pixaGetPix(stream_areas_, i, L_CLONE);
+    pixaAddPix(pixad, pix, L_INSERT);
+    pixaAddBox(pixad, boxCreate(x, y, w, h), L_INSERT);
+  }
+
+  *pconfs = numaClone(stream_confs_);
+
+  return pixad;
+}
+
+void HydrogenTextDetector::SetRegionsOfInterest(BOXA *rois) {
+  boxaDestroy(&rois_);
+
+  if (rois) {
+    rois_ = boxaCopy(rois, L_COPY);
+  }
+}
+
 void HydrogenTextDetector::SetSourceImage(PIX *pixs) {
   pixs_ = pixClone(pixs);
 }
 
+void HydrogenTextDetector::SetSourceLuminance(const l_uint8 *data, l_int32 width, l_int32 height,
+                                              l_int32 stride) {
+  pixDestroy(&pixs_);
+
+  // Streaming mode keeps the previous frame, so alternate between two
+  // buffers and only allocate when both are still referenced elsewhere
+  int slot = 0;
+  for (int i = 0; i < 2; i++) {
+    if (!luma_[i] || pixGetRefcount(luma_[i]) == 1) {
+      slot = i;
+      break;
+    }
+  }
+
+  PIX *pixd = luma_[slot];
+  if (pixd && (pixGetRefcount(pixd) > 1 || pixGetWidth(pixd) != width
+      || pixGetHeight(pixd) != height)) {
+    pixDestroy(&luma_[slot]);
+    pixd = NULL;
+  }
+
+  pixd = pixCreateFromLuminance(pixd, data, width, height, stride);
+  if (!pixd) {
+    return;
+  }
+
+  luma_[slot] = pixd;
+  pixs_ = pixClone(pixd);
+}
+
 void HydrogenTextDetector::DetectText() {
   if (parameters_.debug) fprintf(stderr, "DetectText()\n");
 
   clock_t timer = clock();
+  l_float64 total_start[2], start[2];
+  size_t scratch_used = 0;
+
+  ResetStats(&stats_);
+  StartStage(total_start);
 
-  PIX *pix8 = pixConvertTo8(pixs_, false);
+  // Grayscale input, including luminance set by SetSourceLuminance(), is
+  // used as is rather than copied
+  PIX *pix8;
+  if (pixGetDepth(pixs_) == 8 && !pixGetColormap(pixs_)) {
+    pix8 = pixClone(pixs_);
+  } else {
+    pix8 = pixConvertTo8(pixs_, false);
+  }
 
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     char filename[255];
@@ -159,8 +996,84 @@ void HydrogenTextDetector::DetectText() {
   }
 
   PIX *edges;
-  pixEdgeAdaptiveThreshold(pix8, &edges, parameters_.edge_tile_x, parameters_.edge_tile_y,
-                           parameters_.edge_thresh, parameters_.edge_avg_thresh);
+  l_int32 changed = -1;
+
+  // Region edge maps are blank outside the regions, so they can't seed
+  // streaming mode's tile reuse
+  bool regions = rois_ || parameters_.coarse_reduction != 1;
+  bool streaming = parameters_.streaming && !regions;
+
+  StartStage(start);
+
+  if (regions) {
+    ClearStreamFrame();
+
+    l_int32 count;
+    edges = ThresholdRegions(pix8, &count);
+
+    if (parameters_.debug) fprintf(stderr, "Thresholded %d regions\n", count);
+  } else if (streaming) {
+    l_int32 num_tiles = L_MAX(1, pixGetWidth(pix8) / parameters_.edge_tile_x)
+        * L_MAX(1, pixGetHeight(pix8) / parameters_.edge_tile_y);
+
+    // Start over when the tiling changes. Tiles copied for too long are
+    // recomputed one by one through their ages, so slow drift can't
+    // accumulate.
+    if (stream_pix8_ && (!pixSizesEqual(stream_pix8_, pix8) || num_tiles != stream_num_tiles_)) {
+      ClearStreamFrame();
+    }
+
+    if (!stream_tile_ages_) {
+      stream_tile_ages_ = (l_int32 *) calloc(num_tiles, sizeof(l_int32));
+      stream_num_tiles_ = num_tiles;
+    }
+
+    // Tiles only shift by whole pixels, so carry the rest of the motion
+    // over to the next frame
+    l_float32 shift_x = motion_x_ + stream_residual_x_;
+    l_float32 shift_y = motion_y_ + stream_residual_y_;
+    l_int32 tile_shift_x = (l_int32) floor(shift_x + 0.5);
+    l_int32 tile_shift_y = (l_int32) floor(shift_y + 0.5);
+    stream_residual_x_ = stream_pix8_ ? shift_x - tile_shift_x : 0.0;
+    stream_residual_y_ = stream_pix8_ ? shift_y - tile_shift_y : 0.0;
+
+    pixEdgeAdaptiveThresholdIncremental(pix8, stream_pix8_, stream_edges_, &edges,
+                                        parameters_.edge_tile_x, parameters_.edge_tile_y,
+                                        parameters_.edge_thresh, parameters_.edge_avg_thresh,
+                                        tile_shift_x, tile_shift_y, parameters_.stream_tile_diff,
+                                        stream_tile_ages_, parameters_.stream_max_reuse,
+                                        GetThreadPool(), &changed);
+
+    if (parameters_.debug) fprintf(stderr, "Recomputed %d edge tiles\n", changed);
+  } else {
+    ClearStreamFrame();
+
+    pixEdgeAdaptiveThresholdParallel(pix8, &edges, parameters_.edge_tile_x,
+                                     parameters_.edge_tile_y, parameters_.edge_thresh,
+                                     parameters_.edge_avg_thresh, GetThreadPool());
+  }
+
+  EndStage(&stats_, STAGE_EDGES, start);
+  stats_.edge_tiles_changed = changed;
+
+  // If every tile was reused, the scene only moved. Carry the previous text
+  // areas along with it instead of extracting them again.
+  if (changed == 0 && stream_areas_) {
+    text_areas_ = WarpStreamAreas(&text_confs_);
+    skew_angle_ = stream_skew_angle_;
+
+    pixDestroy(&stream_edges_);
+    pixDestroy(&stream_pix8_);
+    stream_edges_ = edges;
+    stream_pix8_ = pix8;
+
+    ClearMotion();
+
+    stats_.reused_areas = true;
+    EndStage(&stats_, STAGE_TOTAL, total_start);
+
+    return;
+  }
 
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     char filename[255];
@@ -170,8 +1083,18 @@ void HydrogenTextDetector::DetectText() {
     pixDestroy(&edges8);
   }
 
-  PIX *deskew = DetectAndFixSkew(edges);
-  pixDestroy(&edges);
+  StartStage(start);
+  PIX *deskew = DetectAndFixSkew(pix8, edges);
+  EndStage(&stats_, STAGE_SKEW, start);
+
+  if (streaming) {
+    pixDestroy(&stream_edges_);
+    pixDestroy(&stream_pix8_);
+    stream_edges_ = edges;
+    stream_pix8_ = pixClone(pix8);
+  } else {
+    pixDestroy(&edges);
+  }
 
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     char filename[255];
@@ -182,22 +1105,46 @@ void HydrogenTextDetector::DetectText() {
     pixDestroy(&deskew8);
   }
 
+  // With text areas to carry over, only extract again around the edge tiles
+  // that changed. Areas live in the deskewed frame, so this needs both
+  // frames unrotated.
+  PIXA *carried = NULL;
+  NUMA *carriedconfs = NULL;
+  BOXA *dirty = NULL;
+
+  if (streaming && stream_areas_ && skew_angle_ == 0.0 && stream_skew_angle_ == 0.0) {
+    carried = WarpStreamAreas(&carriedconfs);
+    dirty = FindDirtyRegions(pix8, carried);
+  }
+
   NUMA *confs;
-  PIXA *clusters = ExtractTextRegions(pix8, deskew, &confs);
+  PIXA *clusters;
+  Arena *scratch[2] = { GetScratch(0), GetScratch(1) };
+
+  // Arenas are only reset by Clear(), so measure what this call adds
+  for (int i = 0; i < 2; i++) {
+    if (scratch[i]) scratch_used -= scratch[i]->used;
+  }
 
-  if (parameters_.debug) fprintf(stderr, "Inverting image...\n");
-  pixInvert(deskew, deskew);
+  if (dirty) {
+    if (parameters_.debug) fprintf(stderr, "Extracting %d dirty regions\n", boxaGetCount(dirty));
 
-  NUMA *invconfs;
-  PIXA *invclusters = ExtractTextRegions(pix8, deskew, &invconfs);
-  pixDestroy(&deskew);
-  pixDestroy(&pix8);
+    clusters = ExtractDirtyRegions(pix8, deskew, dirty, carried, carriedconfs, scratch, &confs);
+    stats_.extracted_regions = boxaGetCount(dirty);
+  } else {
+    clusters = ExtractBothPasses(pix8, deskew, scratch, &confs);
+  }
 
-  pixaJoin(clusters, invclusters, 0, 0);
-  pixaDestroy(&invclusters);
+  for (int i = 0; i < 2; i++) {
+    if (scratch[i]) scratch_used += scratch[i]->used;
+  }
+  stats_.bytes_allocated = (l_int32) scratch_used;
 
-  numaJoin(confs, invconfs);
-  numaDestroy(&invconfs);
+  boxaDestroy(&dirty);
+  pixaDestroy(&carried);
+  numaDestroy(&carriedconfs);
+  pixDestroy(&deskew);
+  pixDestroy(&pix8);
 
   text_areas_ = pixaCopy(clusters, L_CLONE);
   pixaDestroy(&clusters);
@@ -205,6 +1152,22 @@ void HydrogenTextDetector::DetectText() {
   text_confs_ = numaClone(confs);
   numaDestroy(&confs);
 
+  if (streaming) {
+    pixaDestroy(&stream_areas_);
+    numaDestroy(&stream_confs_);
+    stream_areas_ = pixaCopy(text_areas_, L_CLONE);
+    stream_confs_ = numaClone(text_confs_);
+    stream_skew_angle_ = skew_angle_;
+
+    free(stream_area_offsets_);
+    stream_area_offsets_ = (l_float32 *) calloc(2 * pixaGetCount(stream_areas_) + 1,
+                                                sizeof(l_float32));
+  }
+
+  ClearMotion();
+
+  EndStage(&stats_, STAGE_TOTAL, total_start);
+
   if (parameters_.debug && parameters_.out_dir[0] != '\0') {
     PIX *temp = pixaDisplayHeatmap(text_areas_, pixs_->w, pixs_->h, text_confs_);
     char filename[255];
@@ -225,6 +1188,10 @@ void HydrogenTextDetector::Clear() {
   if (pixs_) {
     pixDestroy(&pixs_);
   }
+
+  // Scratch memory is kept for the next call
+  arenaReset(scratch_[0]);
+  arenaReset(scratch_[1]);
 }
 
 PIXA *HydrogenTextDetector::GetTextAreas() {
@@ -235,6 +1202,74 @@ l_float32 HydrogenTextDetector::GetSkewAngle() {
   return skew_angle_;
 }
 
+l_int32 HydrogenTextDetector::ExportResults(l_uint8 *buffer, l_int32 capacity, l_int32 flags) {
+  l_int32 i, n, x, y, w, h, size, offset, bitmap_offset, bitmap_size;
+  l_int32 record[6];
+  l_float32 conf;
+  PIX *pix;
+
+  n = text_areas_ ? pixaGetCount(text_areas_) : 0;
+  size = EXPORT_HEADER_SIZE + n * EXPORT_AREA_SIZE;
+
+  if (flags & EXPORT_BITMAPS) {
+    for (i = 0; i < n; i++) {
+      pixaGetBoxGeometry(text_areas_, i, &x, &y, &w, &h);
+      pix = pixaGetPix(text_areas_, i, L_CLONE);
+      size += ExportBitmapSize(pix, w, h);
+      pixDestroy(&pix);
+    }
+  }
+
+  if (!buffer || capacity < EXPORT_HEADER_SIZE)
+    return size;
+
+  record[0] = EXPORT_VERSION;
+  record[1] = size;
+  record[2] = n;
+  record[3] = flags & EXPORT_BITMAPS;
+  memcpy(buffer, record, 4 * sizeof(l_int32));
+  memcpy(buffer + 4 * sizeof(l_int32), &skew_angle_, sizeof(l_float32));
+
+  if (capacity < size)
+    return size;
+
+  offset = EXPORT_HEADER_SIZE;
+  bitmap_offset = EXPORT_HEADER_SIZE + n * EXPORT_AREA_SIZE;
+
+  for (i = 0; i < n; i++) {
+    pixaGetBoxGeometry(text_areas_, i, &x, &y, &w, &h);
+    pix = pixaGetPix(text_areas_, i, L_CLONE);
+
+    conf = 0.0;
+    if (text_confs_)
+      numaGetFValue(text_confs_, i, &conf);
+
+    bitmap_size = (flags & EXPORT_BITMAPS) ? ExportBitmapSize(pix, w, h) : 0;
+
+    record[0] = x;
+    record[1] = y;
+    record[2] = w;
+    record[3] = h;
+    memcpy(&record[4], &conf, sizeof(l_float32));
+    record[5] = bitmap_size ? bitmap_offset : 0;
+    memcpy(buffer + offset, record, EXPORT_AREA_SIZE);
+    offset += EXPORT_AREA_SIZE;
+
+    if (bitmap_size) {
+      ExportBitmap(pix, buffer + bitmap_offset, bitmap_size);
+      bitmap_offset += bitmap_size;
+    }
+
+    pixDestroy(&pix);
+  }
+
+  return size;
+}
+
+const HydrogenTextDetector::DetectorStats *HydrogenTextDetector::GetStats() {
+  return &stats_;
+}
+
 NUMA *HydrogenTextDetector::GetTextConfs() {
   return numaClone(text_confs_);
 }
@@ -19,6 +19,9 @@
 
 #include "leptonica.h"
 
+struct Arena;
+class ThreadPool;
+
 class HydrogenTextDetector {
 public:
   HydrogenTextDetector();
@@ -29,6 +32,28 @@ public:
     bool debug;
     char out_dir[255];
 
+    // Worker threads for parallel stages (1 = serial)
+    l_int32 num_threads;
+
+    // Run the normal and inverted extraction passes concurrently
+    bool parallel_passes;
+
+    // Streaming mode for live video: reuse unchanged edge tiles and carry
+    // text areas forward while only the camera moves. When tiles change,
+    // text is only extracted again around them, unless that covers most of
+    // the frame or either frame was deskewed.
+    bool streaming;
+    l_int32 stream_tile_diff;
+    l_int32 stream_max_reuse;
+
+    // Coarse-to-fine mode: find candidate blocks on a 2x or 4x reduced image
+    // (1 = off), then threshold only those at full resolution. Margins are
+    // in full-resolution pixels and areas in reduced pixels. Other values
+    // are an error, and leave no candidates.
+    l_int32 coarse_reduction;
+    l_int32 coarse_margin;
+    l_int32 coarse_min_area;
+
     // Edge-based thresholding
     l_int32 edge_tile_x;
     l_int32 edge_tile_y;
@@ -43,6 +68,13 @@ public:
     l_int32 skew_sweep_reduction;
     l_int32 skew_search_reduction;
     l_float32 skew_search_min_delta;
+    l_int32 skew_reuse_max_diff;
+    l_int32 skew_reuse_max_count;
+
+    // Rotate only the padded region holding edge tiles instead of the whole
+    // edge map. Faster, but pixels near the region edges may land a pixel or
+    // two away from where pixRotate() puts them.
+    bool skew_rotate_region;
 
     // Singleton filter
     l_float32 single_min_aspect;
@@ -50,6 +82,9 @@ public:
     l_int32 single_min_area;
     l_float32 single_min_density;
 
+    // Score singletons with the learned confidence model instead of 1.0
+    bool single_confidence;
+
     // Quick pair filter
     l_float32 pair_h_ratio;
     l_float32 pair_d_ratio;
@@ -71,6 +106,14 @@ public:
 
     TextDetectorParameters()
         : debug(false),
+          num_threads(1),
+          parallel_passes(false),
+          streaming(false),
+          stream_tile_diff(4),
+          stream_max_reuse(30),
+          coarse_reduction(1),
+          coarse_margin(32),
+          coarse_min_area(16),
           edge_tile_x(32),
           edge_tile_y(64),
           edge_thresh(64),
@@ -82,10 +125,14 @@ public:
           skew_sweep_reduction(8),
           skew_search_reduction(4),
           skew_search_min_delta(0.01),
+          skew_reuse_max_diff(5),
+          skew_reuse_max_count(10),
+          skew_rotate_region(false),
           single_min_aspect(0.1),
           single_max_aspect(4.0),
           single_min_area(4),
           single_min_density(0.2),
+          single_confidence(false),
           pair_h_ratio(1.0),
           pair_d_ratio(1.5),
           pair_h_dist_ratio(2.0),
@@ -103,12 +150,84 @@ public:
     }
   };
 
+  // Stages timed by DetectorStats
+  enum Stage {
+    STAGE_EDGES = 0,
+    STAGE_SKEW,
+    STAGE_CONNCOMP,
+    STAGE_PAIRS,
+    STAGE_CLUSTER,
+    STAGE_MERGE,
+    STAGE_TOTAL,
+    NUM_STAGES
+  };
+
+  // Packed layout written by ExportResults(), in native byte order. The
+  // header holds version, total size, area count and flags as int32s and
+  // the skew angle as a float. One record per text area follows, holding x,
+  // y, w and h as int32s, the confidence as a float and the byte offset of
+  // the area bitmap, or 0 if bitmaps were not requested. Each bitmap is the
+  // 1 bpp area mask, MSB first, with unpadded rows of (w + 7) / 8 bytes.
+  // Zeros after the last row pad the whole bitmap to a multiple of 4 bytes,
+  // so every bitmap offset stays 4-byte aligned.
+  enum {
+    EXPORT_VERSION = 1,
+    EXPORT_HEADER_SIZE = 20,
+    EXPORT_AREA_SIZE = 24,
+    EXPORT_BITMAPS = 1
+  };
+
+  // Profile of the last DetectText() call. Extraction stages are summed
+  // over the normal and inverted passes. CPU time is counted on the thread
+  // that runs each stage, so work handed to the edge thresholding pool is
+  // not included.
+  struct DetectorStats {
+    // Time per stage, in milliseconds
+    l_float32 wall_ms[NUM_STAGES];
+    l_float32 cpu_ms[NUM_STAGES];
+
+    // Edge tiles recomputed in streaming mode, or -1 if all were computed
+    l_int32 edge_tiles_changed;
+
+    // Text areas carried over from the previous frame without extraction
+    bool reused_areas;
+
+    // Regions around changed edge tiles extracted in streaming mode, or -1
+    // if the whole frame was
+    l_int32 extracted_regions;
+
+    l_int32 components;
+    l_int32 pairs_removed;
+    l_int32 clusters;
+    l_int32 fragments_merged;
+
+    // Scratch memory used by the extraction passes, in bytes
+    l_int32 bytes_allocated;
+  };
+
   // Function to set the original source image
   void SetSourceImage(PIX *);
 
+  // Function to set the source image from an 8-bit luminance buffer, such as
+  // the Y plane of an NV21 camera frame. The buffer is only read during the
+  // call.
+  void SetSourceLuminance(const l_uint8 *data, l_int32 width, l_int32 height, l_int32 stride);
+
+  // Function to restrict detection to a set of boxes in the source image, or
+  // to the whole image if rois is NULL. Streaming mode is suspended while
+  // regions are set.
+  void SetRegionsOfInterest(BOXA *rois);
+
+  // Function to set scene motion since the previous frame in streaming mode,
+  // optionally with one (x, y) pair per previous text area
+  void SetMotion(l_float32 dx, l_float32 dy, const l_float32 *area_deltas, l_int32 num_areas);
+
   // Main text detection function
   void DetectText();
 
+  // Drop the previous frame kept by streaming mode and the cached skew
+  void ResetStream();
+
   // Clear recognition results between calls
   void Clear();
 
@@ -124,6 +243,14 @@ public:
   // Function to return detected skew angle
   l_float32 GetSkewAngle();
 
+  // Function to write text areas, confidences and skew into a caller-owned
+  // buffer using the EXPORT_* layout. Returns the number of bytes needed;
+  // only the header is written if capacity is smaller than that.
+  l_int32 ExportResults(l_uint8 *buffer, l_int32 capacity, l_int32 flags);
+
+  // Function to return the profile of the last detection
+  const DetectorStats *GetStats();
+
   // Function to return the original source image
   PIX *GetSourceImage();
 
@@ -134,18 +261,112 @@ private:
 
   // Source image
   PIX *pixs_;
+  // Buffers for SetSourceLuminance(), reused while no one else holds them
+  PIX *luma_[2];
+  // Regions of interest, or NULL for the whole image
+  BOXA *rois_;
   // Detected text areas
   PIXA *text_areas_;
   // Confidences of detected text areas
   NUMA *text_confs_;
   // Detected skew angle
   l_float32 skew_angle_;
+  // Profile of the last detection
+  DetectorStats stats_;
+
+  // Result of the last skew sweep and the signature of its scene
+  bool skew_cached_;
+  l_float32 skew_cached_angle_;
+  l_float32 skew_cached_conf_;
+  l_int32 *skew_signature_;
+  l_int32 skew_signature_size_;
+  // Sweeps skipped in a row, and the parameters of the last sweep
+  l_int32 skew_reused_;
+  TextDetectorParameters skew_cached_params_;
+
+  // Previous frame state for streaming mode
+  PIX *stream_pix8_;
+  PIX *stream_edges_;
+  PIXA *stream_areas_;
+  NUMA *stream_confs_;
+  l_float32 stream_skew_angle_;
+  // Consecutive copies of each edge tile, and how many tiles there are
+  l_int32 *stream_tile_ages_;
+  l_int32 stream_num_tiles_;
+  // Motion not yet applied by whole-pixel tile shifts
+  l_float32 stream_residual_x_;
+  l_float32 stream_residual_y_;
+  // Motion of each stream area since it was extracted, as (x, y) pairs
+  l_float32 *stream_area_offsets_;
+
+  // Motion of the scene and of each previous text area for the next frame
+  l_float32 motion_x_;
+  l_float32 motion_y_;
+  l_float32 *area_deltas_;
+  l_int32 num_area_deltas_;
+
+  // Worker pool for parallel stages, created on demand, and the thread count
+  // it was requested with. The pool may run fewer threads if some couldn't be
+  // started.
+  ThreadPool *thread_pool_;
+  l_int32 thread_pool_size_;
+
+  // Scratch memory for the normal and inverted extraction passes, released
+  // in bulk by Clear()
+  Arena *scratch_[2];
+
+  // Function to drop the previous frame kept by streaming mode
+  void ClearStreamFrame();
+
+  // Function to forget the last skew sweep
+  void ClearSkewCache();
+
+  // Function to return a worker pool sized to parameters_.num_threads
+  ThreadPool *GetThreadPool();
+
+  // Function to return the scratch arena for an extraction pass
+  Arena *GetScratch(l_int32 index);
+
+  // Function to return the regions to threshold in coarse-to-fine or ROI
+  // mode, clipped to pix8 and with overlapping regions combined
+  BOXA *FindCandidateRegions(PIX *pix8);
+
+  // Function to threshold pix8 only within the candidate regions
+  PIX *ThresholdRegions(PIX *pix8, l_int32 *pcount);
+
+  // Function to extract text areas from a PIX, from the OFF pixels of the
+  // edge map if inverted is set
+  PIXA *ExtractTextRegions(PIX *pix8, PIX *edges, bool inverted, Arena *arena,
+                           DetectorStats *stats, NUMA **pconfs);
+
+  // Worker entry point for running one extraction pass on the pool
+  static void ExtractTextRegionsTask(void *arg, l_int32 index);
+
+  // Function to run the normal and inverted extraction passes, on the pool
+  // if parallel passes are enabled, and join their results
+  PIXA *ExtractBothPasses(PIX *pix8, PIX *edges, Arena **scratch, NUMA **pconfs);
+
+  // Function to return the regions to extract again in streaming mode: the
+  // edge tiles recomputed this frame, padded and grown over the carried
+  // areas they touch. Returns NULL if the whole frame should be extracted.
+  BOXA *FindDirtyRegions(PIX *pix8, PIXA *carried);
+
+  // Function to extract text within regions only, keeping the carried areas
+  // that lie outside all of them
+  PIXA *ExtractDirtyRegions(PIX *pix8, PIX *edges, BOXA *regions, PIXA *carried,
+                            NUMA *carriedconfs, Arena **scratch, NUMA **pconfs);
+
+  // Function to estimate skew, reusing the last estimate for unchanged scenes
+  bool FindSkew(PIX *pix8, PIX *edges, l_float32 *pangle, l_float32 *pconf);
+
+  // Function to reset motion after it has been applied to a frame
+  void ClearMotion();
 
-  // Function to extract text areas from a PIX
-  PIXA *ExtractTextRegions(PIX *pix8, PIX *edges, NUMA **pconfs);
+  // Function to move the previous text areas by the current motion
+  PIXA *WarpStreamAreas(NUMA **pconfs);
 
   // Function to detect and fix text skew
-  PIX *DetectAndFixSkew(PIX *pixs);
+  PIX *DetectAndFixSkew(PIX *pix8, PIX *pixs);
 };
 
 #endif /* HYDROGEN_HYDROGENTEXTDETECTOR_H_ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(l_int32 num_threads) {
+  PROCNAME("ThreadPool");
+
+  num_threads_ = L_MAX(1, num_threads);
+  num_workers_ = 0;
+  workers_ = NULL;
+
+  function_ = NULL;
+  arg_ = NULL;
+  count_ = 0;
+  next_index_ = 0;
+  generation_ = 0;
+  busy_workers_ = 0;
+  shutdown_ = false;
+
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&work_cond_, NULL);
+  pthread_cond_init(&done_cond_, NULL);
+
+  // The calling thread always participates, so only spawn the remainder.
+  if (num_threads_ > 1) {
+    workers_ = (pthread_t *) malloc((num_threads_ - 1) * sizeof(pthread_t));
+
+    for (int i = 0; i < num_threads_ - 1; i++) {
+      if (pthread_create(&workers_[i], NULL, WorkerMain, this)) {
+        L_WARNING("failed to create worker thread", procName);
+        break;
+      }
+
+      num_workers_++;
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock(&mutex_);
+  shutdown_ = true;
+  pthread_cond_broadcast(&work_cond_);
+  pthread_mutex_unlock(&mutex_);
+
+  for (int i = 0; i < num_workers_; i++) {
+    pthread_join(workers_[i], NULL);
+  }
+
+  free(workers_);
+
+  pthread_cond_destroy(&done_cond_);
+  pthread_cond_destroy(&work_cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+l_int32 ThreadPool::GetNumThreads() {
+  return num_workers_ + 1;
+}
+
+void ThreadPool::ParallelFor(l_int32 count, TaskFunction function, void *arg) {
+  if (count <= 0)
+    return;
+
+  // Nothing to share, so skip the handoff entirely.
+  if (num_workers_ == 0 || count == 1) {
+    for (int i = 0; i < count; i++) {
+      function(arg, i);
+    }
+
+    return;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  function_ = function;
+  arg_ = arg;
+  count_ = count;
+  next_index_ = 0;
+  busy_workers_ = num_workers_;
+  generation_++;
+  pthread_cond_broadcast(&work_cond_);
+  pthread_mutex_unlock(&mutex_);
+
+  RunItems();
+
+  // Every worker checks in once per batch, so none can miss a generation.
+  pthread_mutex_lock(&mutex_);
+  while (busy_workers_ > 0) {
+    pthread_cond_wait(&done_cond_, &mutex_);
+  }
+  function_ = NULL;
+  arg_ = NULL;
+  pthread_mutex_unlock(&mutex_);
+}
+
+void ThreadPool::RunItems() {
+  l_int32 index;
+
+  while ((index = __sync_fetch_and_add(&next_index_, 1)) < count_) {
+    function_(arg_, index);
+  }
+}
+
+void *ThreadPool::WorkerMain(void *arg) {
+  ThreadPool *pool = (ThreadPool *) arg;
+  l_int32 generation = 0;
+
+  while (true) {
+    pthread_mutex_lock(&pool->mutex_);
+    while (!pool->shutdown_ && pool->generation_ == generation) {
+      pthread_cond_wait(&pool->work_cond_, &pool->mutex_);
+    }
+
+    if (pool->shutdown_) {
+      pthread_mutex_unlock(&pool->mutex_);
+      break;
+    }
+
+    generation = pool->generation_;
+    pthread_mutex_unlock(&pool->mutex_);
+
+    pool->RunItems();
+
+    pthread_mutex_lock(&pool->mutex_);
+    if (--pool->busy_workers_ == 0) {
+      pthread_cond_signal(&pool->done_cond_);
+    }
+    pthread_mutex_unlock(&pool->mutex_);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HYDROGEN_THREADPOOL_H_
+#define HYDROGEN_THREADPOOL_H_
+
+#include <pthread.h>
+
+#include "leptonica.h"
+
+/**
+ * Persistent pool of worker threads used to split detector stages into
+ * independent work items. Workers are created once and sleep between calls,
+ * so the pool can be reused across frames without thread creation overhead.
+ *
+ * A pool may only be driven by one caller at a time.
+ */
+class ThreadPool {
+public:
+  typedef void (*TaskFunction)(void *arg, l_int32 index);
+
+  // Creates a pool that runs work on num_threads threads, including the
+  // calling thread. A pool with one thread runs everything inline.
+  explicit ThreadPool(l_int32 num_threads);
+
+  ~ThreadPool();
+
+  // Runs function(arg, i) for every i in [0, count) and blocks until all
+  // items have completed. Items are claimed dynamically, so uneven items
+  // balance across workers.
+  void ParallelFor(l_int32 count, TaskFunction function, void *arg);
+
+  l_int32 GetNumThreads();
+
+private:
+  static void *WorkerMain(void *arg);
+
+  // Claims and runs items from the current batch until none remain.
+  void RunItems();
+
+  l_int32 num_threads_;
+  l_int32 num_workers_;
+  pthread_t *workers_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_cond_;
+  pthread_cond_t done_cond_;
+
+  // Current batch, guarded by mutex_ except for next_index_, which is
+  // claimed with atomic increments.
+  TaskFunction function_;
+  void *arg_;
+  l_int32 count_;
+  volatile l_int32 next_index_;
+  l_int32 generation_;
+  l_int32 busy_workers_;
+  bool shutdown_;
+};
+
+#endif /* HYDROGEN_THREADPOOL_H_ */
@@ -15,9 +15,14 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "leptonica.h"
+#include "edgekernels.h"
+#include "grayhist.h"
 #include "thresholder.h"
+#include "threadpool.h"
 
 /*!
  *  pixFisherAdaptiveThreshold()
@@ -28,13 +33,20 @@
  *              scorefract (fraction of the max Otsu score; typ. 0.1)
  *              fdrthresh (threshold for Fisher's Discriminant Rate; typ. 5.0)
  *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Tiles match pixTilingCreate(), with the last column and row
+ *          absorbing any remainder. All tile histograms are counted in a
+ *          single pass, and tiles are thresholded in place in pixd.
  */
 l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
                                 l_float32 score_fract, l_float32 thresh) {
   l_float32 fdr;
-  l_int32 w, h, d, nx, ny, x, y, t;
-  PIX *pixb, *pixd, *pixt;
-  PIXTILING *pt;
+  l_int32 w, h, d, nx, ny, x, y, t, i, j, left, top, right, bottom, wpls, wpld;
+  l_uint32 hist[GRAY_HIST_BINS];
+  l_uint32 *datas, *datad, *lines, *lined;
+  PIX *pixd;
+  GrayHistGrid *grid;
 
   PROCNAME("pixFisherAdaptiveThreshold");
 
@@ -51,24 +63,41 @@ l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int
   /* Compute FDR & threshold for individual tiles */
   nx = L_MAX(1, w / tile_x);
   ny = L_MAX(1, h / tile_y);
-  pt = pixTilingCreate(pixs, nx, ny, 0, 0, 0, 0);
+  if ((grid = grayHistGridCreate(pixs, nx, ny)) == NULL)
+    return ERROR_INT("grid not made", procName, 1);
+
   pixd = pixCreate(w, h, 1);
+  datas = pixGetData(pixs);
+  wpls = pixGetWpl(pixs);
+  datad = pixGetData(pixd);
+  wpld = pixGetWpl(pixd);
+
   for (y = 0; y < ny; y++) {
-    for (x = 0; x < nx; x++) {
-      pixt = pixTilingGetTile(pt, y, x);
-      pixGetFisherThresh(pixt, score_fract, &fdr, &t);
+    top = y * grid->cell_h;
+    bottom = (y == ny - 1) ? h : top + grid->cell_h;
 
-      if (fdr > thresh) {
-        pixb = pixThresholdToBinary(pixt, t);
-        pixTilingPaintTile(pixd, y, x, pixb, pt);
-        pixDestroy(&pixb);
+    for (x = 0; x < nx; x++) {
+      grayHistGridGetRegion(grid, x, y, x, y, hist);
+      if (histGetFisherThresh(hist, score_fract, &fdr, &t) || fdr <= thresh)
+        continue;
+
+      /* Same as pixThresholdToBinary(): pixels below t become ON */
+      left = x * grid->cell_w;
+      right = (x == nx - 1) ? w : left + grid->cell_w;
+
+      for (i = top; i < bottom; i++) {
+        lines = datas + i * wpls;
+        lined = datad + i * wpld;
+
+        for (j = left; j < right; j++) {
+          if (GET_DATA_BYTE(lines, j) < t)
+            SET_DATA_BIT(lined, j);
+        }
       }
-
-      pixDestroy(&pixt);
     }
   }
 
-  pixTilingDestroy(&pt);
+  grayHistGridDestroy(&grid);
 
   *ppixd = pixd;
 
@@ -86,10 +115,7 @@ l_int32 pixFisherAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int
  *      Return: 0 if OK, 1 on error
  */
 l_int32 pixGetFisherThresh(PIX *pixs, l_float32 scorefract, l_float32 *pfdr, l_int32 *pthresh) {
-  l_float32 mean1, mean2, sum, sum1, sum2, fract;
-  l_float32 var, between, within, fdr;
-  l_int32 thresh;
-  NUMA *na;
+  l_uint32 hist[GRAY_HIST_BINS];
 
   PROCNAME("pixGetFisherThresh");
 
@@ -98,48 +124,40 @@ l_int32 pixGetFisherThresh(PIX *pixs, l_float32 scorefract, l_float32 *pfdr, l_i
   if (!pfdr && !pthresh)
     return ERROR_INT("neither &pfdr nor &pthresh defined", procName, 1);
 
-  na = pixGetGrayHistogram(pixs, 1);
+  if (pixGetGrayHistogramArray(pixs, hist))
+    return ERROR_INT("histogram not made", procName, 1);
 
-  /* Compute Otsu threshold for histogram */
-  numaSplitDistribution(na, scorefract, &thresh, &mean1, &mean2, &sum1, &sum2, NULL);
-
-  /* Compute Fisher's Discriminant Rate if needed */
-  if (pfdr) {
-    numaGetHistogramStats(na, 0.0, 1.0, NULL, NULL, NULL, &var);
-    numaGetSum(na, &sum);
-
-    /* Between-class variance = sum of weighted squared distances
-     between-class and overall means */
-    fract = sum1 / sum;
-    between = (fract * (1 - fract)) * (mean1 - mean2) * (mean1 - mean2);
-
-    /* Within-class variance = difference between total variance
-     and between-class variance */
-    within = var - between;
-
-    /* FDR = between-class variance over within-class variance */
-    if (within <= 1) {
-      fdr = between;
-    } else {
-      fdr = between / within;
-    }
+  return histGetFisherThresh(hist, scorefract, pfdr, pthresh);
+}
 
-    *pfdr = fdr;
+/* Copies a raster line into a buffer in pixel order */
+static void UnpackByteLine(l_uint32 *line, l_int32 wpl, l_uint32 *buf) {
+  for (l_int32 i = 0; i < wpl; i++) {
+#ifdef L_BIG_ENDIAN
+    buf[i] = line[i];
+#else  /* L_LITTLE_ENDIAN */
+    buf[i] = __builtin_bswap32(line[i]);
+#endif  /* L_BIG_ENDIAN */
   }
-
-  if (pthresh)
-    *pthresh = thresh;
-
-  numaDestroy(&na);
-
-  return 0;
 }
 
+/*!
+ *  pixThreshedSobelEdgeFilter()
+ *
+ *      Input:  pixs (8 bpp)
+ *              threshold (minimum edge magnitude, clipped to 255)
+ *      Return: pixd (1 bpp), or null on error
+ *
+ *  Notes:
+ *      (1) Output pixel (i, j) holds the thresholded Sobel magnitude of
+ *          the 3x3 window whose top left corner is (i, j). The last two
+ *          rows and columns are cleared.
+ *      (2) Each line is run through the vector kernels in edgekernels.h,
+ *          which write packed words directly.
+ */
 PIX *pixThreshedSobelEdgeFilter(PIX *pixs, l_int32 threshold) {
-  l_uint8 bval, bidx;
-  l_int32 w, h, d, i, j, wplt, wpld, gx, gy, vald;
-  l_int32 val1, val2, val3, val4, val5, val6, val7, val8, val9;
-  l_uint32 *datat, *linet, *datad, *lined;
+  l_int32 w, h, d, i, wplt, wpld;
+  l_uint32 *datat, *datad, *bufs, *rows[3], *temp;
   PIX *pixd;
 
   PROCNAME("pixThreshedSobelEdgeFilter");
@@ -150,74 +168,66 @@ PIX *pixThreshedSobelEdgeFilter(PIX *pixs, l_int32 threshold) {
   if (d != 8)
     return (PIX *) ERROR_PTR("pixs not 8 bpp", procName, NULL);
 
+  if ((pixd = pixCreate(w, h, 1)) == NULL)
+    return (PIX *) ERROR_PTR("pixd not made", procName, NULL);
+
+  if (w < 3 || h < 3)
+    return pixd;
+
   /* Compute filter output at each location. */
-  pixd = pixCreateNoInit(w, h, 1);
   datat = pixGetData(pixs);
   wplt = pixGetWpl(pixs);
   datad = pixGetData(pixd);
   wpld = pixGetWpl(pixd);
-  val1 = val2 = val3 = val4 = val5 = 0;
-  val6 = val7 = val8 = val9 = 0;
-  bval = bidx = 0;
-  for (i = 0; i < h - 1; i++) {
-    linet = datat + i * wplt;
-    lined = datad + i * wpld;
-    for (j = 0; j < w - 1; j++) {
-      if (j == 0) { /* start a new row */
-        val1 = GET_DATA_BYTE(linet, j);
-        val2 = GET_DATA_BYTE(linet + wplt, j);
-        val3 = GET_DATA_BYTE(linet + (wplt << 1), j);
-        val4 = GET_DATA_BYTE(linet, j + 1);
-        val5 = GET_DATA_BYTE(linet + wplt, j + 1);
-        val6 = GET_DATA_BYTE(linet + (wplt << 1), j + 1);
-        val7 = GET_DATA_BYTE(linet, j + 2);
-        val8 = GET_DATA_BYTE(linet + wplt, j + 2);
-        val9 = GET_DATA_BYTE(linet + (wplt << 1), j + 2);
-        bval = 0;
-        bidx = 0x80;
-      } else { /* shift right by 1 pixel; update incrementally */
-        val1 = val4;
-        val2 = val5;
-        val3 = val6;
-        val4 = val7;
-        val5 = val8;
-        val6 = val9;
-        val7 = GET_DATA_BYTE(linet, j + 2);
-        val8 = GET_DATA_BYTE(linet + wplt, j + 2);
-        val9 = GET_DATA_BYTE(linet + (wplt << 1), j + 2);
-      }
 
-      bval <<= 1;
-      bidx >>= 1;
+  /* Keep three unpacked lines, rotating them as the window moves down */
+  bufs = (l_uint32 *) malloc(3 * wplt * sizeof(l_uint32));
+  for (i = 0; i < 3; i++) {
+    rows[i] = bufs + i * wplt;
+  }
 
-      gx = val1 + (val2 << 1) + val3 - val7 - (val8 << 1) - val9;
-      gy = val1 + (val4 << 1) + val7 - val3 - (val6 << 1) - val9;
-      vald = L_MIN(255, L_ABS(gx) + L_ABS(gy));
+  UnpackByteLine(datat, wplt, rows[0]);
+  UnpackByteLine(datat + wplt, wplt, rows[1]);
 
-      /* Flip high bit if value exceeds threshold */
-      if (vald >= threshold) {
-        bval |= 1;
-      }
+  for (i = 0; i < h - 2; i++) {
+    UnpackByteLine(datat + (i + 2) * wplt, wplt, rows[2]);
 
-      if (bidx == 0) {
-        SET_DATA_BYTE(lined, j / 8, bval);
+    edgeSobelThreshLine((l_uint8 *) rows[0], (l_uint8 *) rows[1], (l_uint8 *) rows[2], w - 2,
+                        threshold, datad + i * wpld);
 
-        bval = 0;
-        bidx = 0x80;
-      }
-    }
+    temp = rows[0];
+    rows[0] = rows[1];
+    rows[1] = rows[2];
+    rows[2] = temp;
   }
 
+  free(bufs);
+
   return pixd;
 }
 
+/*!
+ *  pixGradientEnergy()
+ *
+ *      Input:  pixs (8 bpp)
+ *              mask (1 bpp, same size as pixs)
+ *              &energy (<return> mean difference across mask edges)
+ *      Return: 0 if OK, -1 on error
+ *
+ *  Notes:
+ *      (1) Averages |pixs(x) - pixs(x + 1)| over horizontal neighbors whose
+ *          mask bits differ. The count starts at 1, so an edgeless mask
+ *          gives 0.
+ *      (2) Edges are found a word at a time: with the next word's first
+ *          bit shifted in, word ^ (word << 1) has a bit set exactly where
+ *          the mask changes, and pixs is only read at those bits.
+ */
 l_uint8 pixGradientEnergy(PIX *pixs, PIX *mask, l_float32 *penergy) {
-  l_int32 w, h, d;
-  l_uint8 val1, val2;
-  l_uint32 mask1, mask2;
+  l_int32 w, h, d, x, wi, nwords, bit;
   l_int32 wpls, wplm;
   l_uint32 *datas, *lines;
   l_uint32 *datam, *linem;
+  l_uint32 word, next, edges, lastmask;
   l_int32 total, count;
 
   PROCNAME("pixGradientEnergy");
@@ -227,36 +237,42 @@ l_uint8 pixGradientEnergy(PIX *pixs, PIX *mask, l_float32 *penergy) {
   pixGetDimensions(pixs, &w, &h, &d);
   if (d != 8)
     return ERROR_INT("pixs not 8 bpp", procName, -1);
+  if (!mask || pixGetDepth(mask) != 1)
+    return ERROR_INT("mask undefined or not 1 bpp", procName, -1);
+  if (pixGetWidth(mask) < w || pixGetHeight(mask) < h)
+    return ERROR_INT("mask smaller than pixs", procName, -1);
 
-  /* Compute filter output at each location. */
   datas = pixGetData(pixs);
   wpls = pixGetWpl(pixs);
   datam = pixGetData(mask);
   wplm = pixGetWpl(mask);
   total = 0;
   count = 1;
-  mask1 = mask2 = 0;
-  val1 = val2 = 0;
-  for (int y = 0; y < h; y++) {
+
+  /* Edges start at x = 0 ... w - 2; bits past that are dropped */
+  nwords = (w + 30) / 32;
+  lastmask = (w - 1) & 31 ? 0xffffffff << (32 - ((w - 1) & 31)) : 0xffffffff;
+
+  for (l_int32 y = 0; y < h && w > 1; y++) {
     lines = datas + y * wpls;
     linem = datam + y * wplm;
-    for (int x = 0; x < w - 1; x++) {
-      if (x == 0) { /* start a new row */
-        mask1 = GET_DATA_BIT(linem, x);
-        mask2 = GET_DATA_BIT(linem, x + 1);
-        val1 = GET_DATA_BYTE(lines, x);
-        val2 = GET_DATA_BYTE(lines, x + 1);
-      } else { /* shift right by 1 pixel; update incrementally */
-        val1 = val2;
-        val2 = GET_DATA_BYTE(lines, x + 1);
-        mask1 = mask2;
-        mask2 = GET_DATA_BIT(linem, x + 1);
-      }
-
-      /* If we're on an edge, add the gradient value and increment */
-      if (mask1 != mask2) {
-        total += L_ABS(val1 - val2);
-        count += 1;
+    next = linem[0];
+
+    for (wi = 0; wi < nwords; wi++) {
+      word = next;
+      next = (32 * (wi + 1) < w) ? linem[wi + 1] : 0;
+      edges = word ^ ((word << 1) | (next >> 31));
+
+      if (wi == nwords - 1)
+        edges &= lastmask;
+
+      /* Visit set bits from the leftmost pixel */
+      while (edges) {
+        bit = __builtin_clz(edges);
+        x = 32 * wi + bit;
+        total += L_ABS(GET_DATA_BYTE(lines, x) - GET_DATA_BYTE(lines, x + 1));
+        count++;
+        edges &= ~(0x80000000 >> bit);
       }
     }
   }
@@ -266,9 +282,21 @@ l_uint8 pixGradientEnergy(PIX *pixs, PIX *mask, l_float32 *penergy) {
   return 0;
 }
 
+/*!
+ *  pixEdgeMax()
+ *
+ *      Input:  pixs (8 bpp)
+ *              &max (<return> largest horizontal difference)
+ *              &avg (<return> sum of differences over the pixel count)
+ *      Return: 0 if OK, -1 on error
+ *
+ *  Notes:
+ *      (1) Differences are taken between pixels four apart. Whole words of
+ *          each line go through edgeAbsDiffStats(); the remainder is read
+ *          one pixel at a time.
+ */
 l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
-  l_int32 w, h, d, wplt, vald;
-  l_uint8 val1, val2, val3, val4, val5;
+  l_int32 w, h, d, wplt, vald, n, span;
   l_uint32 *datat, *linet;
   l_int32 max, total;
 
@@ -285,27 +313,15 @@ l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
   wplt = pixGetWpl(pixs);
   max = 0;
   total = 0;
-  val1 = val2 = val3 = val4 = val5 = 0;
+  n = L_MAX(0, w - 5);
+  span = n & ~3;
   for (int y = 0; y < h; y++) {
     linet = datat + y * wplt;
-    for (int x = 0; x < w - 5; x++) {
-      if (x == 0) { /* start a new row */
-        val1 = GET_DATA_BYTE(linet, x);
-        val2 = GET_DATA_BYTE(linet, x + 1);
-        val3 = GET_DATA_BYTE(linet, x + 2);
-        val4 = GET_DATA_BYTE(linet, x + 3);
-        val5 = GET_DATA_BYTE(linet, x + 4);
-      } else { /* shift right by 1 pixel; update incrementally */
-        val1 = val2;
-        val2 = val3;
-        val3 = val4;
-        val4 = val5;
-        val5 = GET_DATA_BYTE(linet, x + 4);
-      }
 
-      //maxd = L_MAX(val5, L_MAX(val4, L_MAX(val3, L_MAX(val2, val1))));
-      //mind = L_MIN(val5, L_MIN(val4, L_MIN(val3, L_MIN(val2, val1))));
-      vald = L_ABS(val1 - val5); //maxd - mind;
+    edgeAbsDiffStats((l_uint8 *) linet, span, &max, &total);
+
+    for (int x = span; x < n; x++) {
+      vald = L_ABS(GET_DATA_BYTE(linet, x) - GET_DATA_BYTE(linet, x + 4));
 
       if (vald > max) {
         max = vald;
@@ -321,6 +337,275 @@ l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
   return 0;
 }
 
+/* Adds |v(x) - v(x + 4)| for x in [x0, x1) of an 8 bpp line to the edge stats.
+ * Whole words go through edgeAbsDiffStats(); the ends are read per pixel.
+ */
+static void RegionEdgeStats(l_uint32 *line, l_int32 x0, l_int32 x1, l_int32 *pmax,
+                            l_int32 *ptotal) {
+  l_int32 x, a, b, vald;
+
+  a = L_MIN(x1, (x0 + 3) & ~3);
+  b = L_MAX(a, x1 & ~3);
+
+  for (x = x0; x < a; x++) {
+    vald = L_ABS(GET_DATA_BYTE(line, x) - GET_DATA_BYTE(line, x + 4));
+    *pmax = L_MAX(*pmax, vald);
+    *ptotal += vald;
+  }
+
+  if (b > a)
+    edgeAbsDiffStats((l_uint8 *) line + a, b - a, pmax, ptotal);
+
+  for (x = b; x < x1; x++) {
+    vald = L_ABS(GET_DATA_BYTE(line, x) - GET_DATA_BYTE(line, x + 4));
+    *pmax = L_MAX(*pmax, vald);
+    *ptotal += vald;
+  }
+}
+
+/* Adds pixels x0 through x1 - 1 of an 8 bpp line to a gray histogram */
+static void RegionHistogram(l_uint32 *line, l_int32 x0, l_int32 x1, l_uint32 *hist) {
+  l_int32 x, a, b;
+  l_uint8 *bytes;
+
+  a = L_MIN(x1, (x0 + 3) & ~3);
+  b = L_MAX(a, x1 & ~3);
+
+  for (x = x0; x < a; x++)
+    hist[GET_DATA_BYTE(line, x)]++;
+
+  /* Byte order within a word does not matter here */
+  bytes = (l_uint8 *) line;
+  for (x = a; x < b; x++)
+    hist[bytes[x]]++;
+
+  for (x = b; x < x1; x++)
+    hist[GET_DATA_BYTE(line, x)]++;
+}
+
+/*!
+ *  pixGetRegionFeatures()
+ *
+ *      Input:  pix8 (8 bpp)
+ *              x, y, w, h (region of pix8)
+ *              runs (<optional> mask runs in pix8 coordinates, in raster
+ *                    order and within the region; can be null)
+ *              num_runs
+ *              features (<return> features of the region)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Computes in a single pass over the region what pixGetFisherThresh(),
+ *          pixEdgeMax(), pixGradientEnergy() and pixCountPixels() give on a
+ *          crop of pix8 and a mask of the same size, without making either.
+ *      (2) Mask transitions are read off the run ends, so the gradient
+ *          energy costs one lookup per run end instead of one per pixel.
+ *      (3) Without runs, density and gradient energy are zero.
+ */
+l_int32 pixGetRegionFeatures(PIX *pix8, l_int32 x, l_int32 y, l_int32 w, l_int32 h,
+                             const CCRun *runs, l_int32 num_runs, RegionFeatures *features) {
+  l_int32 i, k, wpl, right, n, max, total, count, energy, pixel_count;
+  l_uint32 *data, *line;
+  l_uint32 hist[GRAY_HIST_BINS];
+
+  PROCNAME("pixGetRegionFeatures");
+
+  if (!pix8 || pixGetDepth(pix8) != 8)
+    return ERROR_INT("pix8 undefined or not 8 bpp", procName, 1);
+  if (!features)
+    return ERROR_INT("features not defined", procName, 1);
+  if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+      x + w > pixGetWidth(pix8) || y + h > pixGetHeight(pix8))
+    return ERROR_INT("region not within pix8", procName, 1);
+
+  data = pixGetData(pix8);
+  wpl = pixGetWpl(pix8);
+  right = x + w - 1;
+  n = L_MAX(0, w - 5);
+  if (!runs)
+    num_runs = 0;
+
+  memset(hist, 0, sizeof(hist));
+  max = total = 0;
+  energy = 0;
+  count = 1;
+  pixel_count = 0;
+  k = 0;
+
+  for (i = y; i < y + h; i++) {
+    line = data + i * wpl;
+
+    RegionHistogram(line, x, x + w, hist);
+    RegionEdgeStats(line, x, x + n, &max, &total);
+
+    /* Each run end inside the region is a mask transition */
+    for (; k < num_runs && runs[k].y == i; k++) {
+      pixel_count += runs[k].xend - runs[k].xstart + 1;
+
+      if (runs[k].xstart > x) {
+        energy += L_ABS(GET_DATA_BYTE(line, runs[k].xstart - 1) -
+                        GET_DATA_BYTE(line, runs[k].xstart));
+        count++;
+      }
+
+      if (runs[k].xend < right) {
+        energy += L_ABS(GET_DATA_BYTE(line, runs[k].xend) -
+                        GET_DATA_BYTE(line, runs[k].xend + 1));
+        count++;
+      }
+    }
+  }
+
+  features->pixel_count = pixel_count;
+  features->density = pixel_count / (l_float32) (w * h);
+  features->gradient_energy = runs ? energy / (l_float32) count : 0.0;
+  features->edge_max = max;
+  features->edge_avg = total / (w * h);
+
+  if (histGetFisherThresh(hist, 0.0, &features->fdr, NULL))
+    return ERROR_INT("fdr not computed", procName, 1);
+
+  return 0;
+}
+
+/* Sampling step, in pixels, for comparing tiles against the previous frame */
+#define TILE_DIFF_STEP 4
+
+struct EdgeThresholdTask {
+  PIXTILING *pt;
+  PIX *pixd;
+  l_int32 thresh;
+  l_int32 avg_thresh;
+
+  /* Previous frame, for reusing unchanged tiles; pixprev is NULL otherwise */
+  PIX *pixprev;
+  PIX *edgesprev;
+  l_int32 shift_x;
+  l_int32 shift_y;
+  l_int32 max_diff;
+
+  /* Consecutive copies of each tile before and after this frame, or NULL
+   * to reuse tiles for as long as they match */
+  const l_int32 *agesprev;
+  l_int32 *ages;
+  l_int32 max_reuse;
+
+  /* Number of tiles thresholded from scratch */
+  l_int32 changed;
+};
+
+/* Returns whether the tile at (left, top) matches the previous frame moved
+ * by the scene shift. Tiles that were partly out of frame always differ.
+ */
+static bool EdgeTileUnchanged(EdgeThresholdTask *task, l_int32 left, l_int32 top, l_int32 width,
+                              l_int32 height) {
+  l_int32 x, y, px, py, wp, hp, wpls, wplp, total, count;
+  l_uint32 *datas, *datap, *lines, *linep;
+
+  pixGetDimensions(task->pixprev, &wp, &hp, NULL);
+  px = left - task->shift_x;
+  py = top - task->shift_y;
+
+  if (px < 0 || py < 0 || px + width > wp || py + height > hp)
+    return false;
+
+  datas = pixGetData(task->pt->pix);
+  wpls = pixGetWpl(task->pt->pix);
+  datap = pixGetData(task->pixprev);
+  wplp = pixGetWpl(task->pixprev);
+  total = 0;
+  count = 0;
+
+  for (y = 0; y < height; y += TILE_DIFF_STEP) {
+    lines = datas + (top + y) * wpls;
+    linep = datap + (py + y) * wplp;
+    for (x = 0; x < width; x += TILE_DIFF_STEP) {
+      total += L_ABS(GET_DATA_BYTE(lines, left + x) - GET_DATA_BYTE(linep, px + x));
+      count++;
+    }
+  }
+
+  return total <= task->max_diff * count;
+}
+
+/* Returns the most consecutive copies among the previous tiles that the
+ * tile at (left, top) would be copied from once shifted.
+ */
+static l_int32 EdgeTileSourceAge(EdgeThresholdTask *task, l_int32 left, l_int32 top,
+                                 l_int32 width, l_int32 height) {
+  l_int32 nx, ny, x0, y0, x1, y1, x, y, age;
+  PIXTILING *pt = task->pt;
+
+  pixTilingGetCount(pt, &nx, &ny);
+  x0 = L_MIN(nx - 1, (left - task->shift_x) / pt->w);
+  y0 = L_MIN(ny - 1, (top - task->shift_y) / pt->h);
+  x1 = L_MIN(nx - 1, (left - task->shift_x + width - 1) / pt->w);
+  y1 = L_MIN(ny - 1, (top - task->shift_y + height - 1) / pt->h);
+  age = 0;
+
+  for (y = y0; y <= y1; y++) {
+    for (x = x0; x <= x1; x++) {
+      age = L_MAX(age, task->agesprev[y * nx + x]);
+    }
+  }
+
+  return age;
+}
+
+/* Thresholds one horizontal row of tiles into pixd. Rows of tiles never
+ * share destination words, so separate rows may be painted concurrently.
+ */
+static void EdgeThresholdTileRow(EdgeThresholdTask *task, l_int32 y) {
+  l_int32 x, nx, t, max, avg, w, h, left, top, width, height, age;
+  PIXTILING *pt = task->pt;
+  PIX *pixb, *pixt;
+
+  pixTilingGetCount(pt, &nx, NULL);
+  pixGetDimensions(pt->pix, &w, &h, NULL);
+
+  /* Tiles have no overlap, and the last row and column take the remainder */
+  top = y * pt->h;
+  height = (y == pt->ny - 1) ? h - top : pt->h;
+
+  for (x = 0; x < nx; x++) {
+    left = x * pt->w;
+    width = (x == nx - 1) ? w - left : pt->w;
+
+    /* Copied tiles inherit the age of every tile they were copied from,
+     * so edges can't be carried past max_reuse frames by moving between
+     * tiles */
+    if (task->pixprev && EdgeTileUnchanged(task, left, top, width, height)) {
+      age = task->ages ? EdgeTileSourceAge(task, left, top, width, height) + 1 : 0;
+
+      if (age <= task->max_reuse) {
+        pixRasterop(task->pixd, left, top, width, height, PIX_SRC, task->edgesprev,
+                    left - task->shift_x, top - task->shift_y);
+        if (task->ages) task->ages[y * nx + x] = age;
+        continue;
+      }
+    }
+
+    __sync_fetch_and_add(&task->changed, 1);
+    if (task->ages) task->ages[y * nx + x] = 0;
+
+    pixt = pixTilingGetTile(pt, y, x);
+    pixEdgeMax(pixt, &max, &avg);
+
+    if (max > task->thresh && avg > task->avg_thresh) {
+      pixSplitDistributionFgBg(pixt, 0.0, 1, &t, NULL, NULL, 0);
+      pixb = pixThresholdToBinary(pixt, t);
+      pixTilingPaintTile(task->pixd, y, x, pixb, pt);
+      pixDestroy(&pixb);
+    }
+
+    pixDestroy(&pixt);
+  }
+}
+
+static void EdgeThresholdTileRowTask(void *arg, l_int32 y) {
+  EdgeThresholdTileRow((EdgeThresholdTask *) arg, y);
+}
+
 /*!
  *  pixEdgeAdaptiveThreshold()
  *
@@ -333,12 +618,78 @@ l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg) {
  */
 l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
                                   l_int32 thresh, l_int32 avg_thresh) {
-  l_int32 w, h, d, nx, ny, x, y, t, max, avg;
-  PIX *pixb, *pixd, *pixt;
+  return pixEdgeAdaptiveThresholdParallel(pixs, ppixd, tile_x, tile_y, thresh, avg_thresh, NULL);
+}
+
+/*!
+ *  pixEdgeAdaptiveThresholdParallel()
+ *
+ *      Input:  pixs (8 bpp)
+ *              &pixd (<required return> thresholded input for pixs)
+ *              tile_x, tile_y (desired tile dimensions; actual size may vary)
+ *              thresh
+ *              avg_thresh
+ *              pool (<optional> worker pool; NULL runs serially)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Rows of tiles are distributed across the pool and painted
+ *          directly into pixd. Output is identical to the serial path.
+ */
+l_uint8 pixEdgeAdaptiveThresholdParallel(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
+                                          l_int32 thresh, l_int32 avg_thresh, ThreadPool *pool) {
+  return pixEdgeAdaptiveThresholdIncremental(pixs, NULL, NULL, ppixd, tile_x, tile_y, thresh,
+                                             avg_thresh, 0, 0, 0, NULL, 0, pool, NULL);
+}
+
+/*!
+ *  pixEdgeAdaptiveThresholdIncremental()
+ *
+ *      Input:  pixs (8 bpp)
+ *              pixprev (<optional> 8 bpp previous frame)
+ *              edgesprev (<optional> thresholded output for pixprev)
+ *              &pixd (<required return> thresholded input for pixs)
+ *              tile_x, tile_y (desired tile dimensions; actual size may vary)
+ *              thresh
+ *              avg_thresh
+ *              shift_x, shift_y (scene motion from pixprev to pixs)
+ *              max_diff (largest mean absolute difference between a tile
+ *                        and the shifted previous frame for reuse)
+ *              ages (<optional> consecutive copies of each tile, updated
+ *                    in place; see note 3)
+ *              max_reuse (most consecutive copies of a tile when ages is
+ *                         given)
+ *              pool (<optional> worker pool; NULL runs serially)
+ *              &changed (<optional return> number of tiles recomputed)
+ *      Return: 0 if OK, 1 on error
+ *
+ *  Notes:
+ *      (1) Tiles that still match pixprev after shifting are copied from
+ *          edgesprev instead of being thresholded again. Without pixprev,
+ *          every tile is thresholded.
+ *      (2) Tiles are compared on a sparse grid of pixels, so this check
+ *          costs much less than thresholding them.
+ *      (3) ages holds one entry per tile in row-major order, for
+ *          L_MAX(1, w / tile_x) by L_MAX(1, h / tile_y) tiles, and should
+ *          start out zeroed. A tile is thresholded again once its edges
+ *          would have been copied more than max_reuse times in a row.
+ */
+l_uint8 pixEdgeAdaptiveThresholdIncremental(PIX *pixs, PIX *pixprev, PIX *edgesprev,
+                                            PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
+                                            l_int32 thresh, l_int32 avg_thresh, l_int32 shift_x,
+                                            l_int32 shift_y, l_int32 max_diff, l_int32 *ages,
+                                            l_int32 max_reuse, ThreadPool *pool,
+                                            l_int32 *pchanged) {
+  l_int32 w, h, d, nx, ny, y;
+  l_int32 *agesprev = NULL;
+  PIX *pixd;
   PIXTILING *pt;
+  EdgeThresholdTask task;
 
-  PROCNAME("pixEdgeAdaptiveThreshold");
+  PROCNAME("pixEdgeAdaptiveThresholdIncremental");
 
+  if (pchanged)
+    *pchanged = 0;
   if (!pixs)
     return ERROR_INT("pixs not defined", procName, 1);
   if (!ppixd)
@@ -348,29 +699,48 @@ l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32
     return ERROR_INT("pixs not 8 bpp", procName, 1);
   if (tile_x < 8 || tile_y < 8)
     return ERROR_INT("sx and sy must be >= 8", procName, 1);
+  if (pixprev && (!edgesprev || pixGetDepth(pixprev) != 8 || pixGetDepth(edgesprev) != 1))
+    return ERROR_INT("pixprev or edgesprev not valid", procName, 1);
 
   /* Compute FDR & threshold for individual tiles */
   nx = L_MAX(1, w / tile_x);
   ny = L_MAX(1, h / tile_y);
   pt = pixTilingCreate(pixs, nx, ny, 0, 0, 0, 0);
   pixd = pixCreate(w, h, 1);
-  for (y = 0; y < ny; y++) {
-    for (x = 0; x < nx; x++) {
-      pixt = pixTilingGetTile(pt, y, x);
-      pixEdgeMax(pixt, &max, &avg);
-
-      if (max > thresh && avg > avg_thresh) {
-        pixSplitDistributionFgBg(pixt, 0.0, 1, &t, NULL, NULL, 0);
-        pixb = pixThresholdToBinary(pixt, t);
-        pixTilingPaintTile(pixd, y, x, pixb, pt);
-        pixDestroy(&pixb);
-      }
 
-      pixDestroy(&pixt);
+  task.pt = pt;
+  task.pixd = pixd;
+  task.thresh = thresh;
+  task.avg_thresh = avg_thresh;
+  task.pixprev = pixprev;
+  task.edgesprev = edgesprev;
+  task.shift_x = shift_x;
+  task.shift_y = shift_y;
+  task.max_diff = max_diff;
+  task.ages = ages;
+  task.max_reuse = max_reuse;
+  task.changed = 0;
+
+  /* Rows are painted concurrently and read their neighbors' ages */
+  if (ages) {
+    agesprev = (l_int32 *) malloc(nx * ny * sizeof(l_int32));
+    memcpy(agesprev, ages, nx * ny * sizeof(l_int32));
+  }
+  task.agesprev = agesprev;
+
+  if (pool && pool->GetNumThreads() > 1) {
+    pool->ParallelFor(ny, EdgeThresholdTileRowTask, &task);
+  } else {
+    for (y = 0; y < ny; y++) {
+      EdgeThresholdTileRow(&task, y);
     }
   }
 
   pixTilingDestroy(&pt);
+  free(agesprev);
+
+  if (pchanged)
+    *pchanged = task.changed;
 
   *ppixd = pixd;
 
@@ -18,6 +18,19 @@
 #define HYDROGEN_THRESHOLDER_H_
 
 #include "leptonica.h"
+#include "conncomp.h"
+
+class ThreadPool;
+
+/* Features of an 8 bpp region and an optional component mask within it */
+struct RegionFeatures {
+  l_int32 pixel_count;
+  l_float32 density;
+  l_float32 fdr;
+  l_float32 gradient_energy;
+  l_int32 edge_max;
+  l_int32 edge_avg;
+};
 
 l_int32 pixGetFisherThresh(PIX *pixs, l_float32 scorefract, l_float32 *pfdr, l_int32 *pthresh);
 
@@ -30,7 +43,20 @@ l_uint8 pixGradientEnergy(PIX *pixs, PIX *mask, l_float32 *pdensity);
 
 l_uint8 pixEdgeMax(PIX *pixs, l_int32 *pmax, l_int32 *pavg);
 
+l_int32 pixGetRegionFeatures(PIX *pix8, l_int32 x, l_int32 y, l_int32 w, l_int32 h,
+                             const CCRun *runs, l_int32 num_runs, RegionFeatures *features);
+
 l_uint8 pixEdgeAdaptiveThreshold(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
                                  l_int32 thresh, l_int32 avg_thresh);
 
+l_uint8 pixEdgeAdaptiveThresholdParallel(PIX *pixs, PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
+                                         l_int32 thresh, l_int32 avg_thresh, ThreadPool *pool);
+
+l_uint8 pixEdgeAdaptiveThresholdIncremental(PIX *pixs, PIX *pixprev, PIX *edgesprev,
+                                            PIX **ppixd, l_int32 tile_x, l_int32 tile_y,
+                                            l_int32 thresh, l_int32 avg_thresh, l_int32 shift_x,
+                                            l_int32 shift_y, l_int32 max_diff, l_int32 *ages,
+                                            l_int32 max_reuse, ThreadPool *pool,
+                                            l_int32 *pchanged);
+
 #endif /* HYDROGEN_THRESHOLDER_H_ */
@@ -20,6 +20,9 @@
  * PIX *blended = pixBlendWithGrayMask(normalized, enhanced, edgemask, 0, 0);
  */
 
+#include <math.h>
+#include <time.h>
+
 #include "leptonica.h"
 #include "utilities.h"
 
@@ -177,3 +180,142 @@ PIX *pixaDisplayHeatmap(PIXA *pixa, l_int32 w, l_int32 h, NUMA *confs) {
 
   return pixd;
 }
+
+/*!
+ *  pixRotateRegion()
+ *
+ *      Input:  pixs (1 bpp)
+ *              box (region of pixs holding every ON pixel)
+ *              angle (radians; clockwise is positive)
+ *      Return: pixd (same size as pixs), or null on error
+ *
+ *  Notes:
+ *      (1) Equivalent to pixRotate() about the center of pixs with
+ *          L_ROTATE_SAMPLING and L_BRING_IN_WHITE, but only rotates a
+ *          padded copy of box. Pixels outside box are taken to be OFF.
+ *      (2) Sampling truncates toward the rotation center, so individual
+ *          pixels may land a pixel or two away from where a rotation of
+ *          the whole image would put them.
+ */
+PIX *pixRotateRegion(PIX *pixs, BOX *box, l_float32 angle) {
+  l_int32 w, h, d, xb, yb, wb, hb, border, wr, hr, dx, dy;
+  l_float32 cosa, sina, xoff, yoff;
+  PIX *pixc, *pixb, *pixr, *pixd;
+
+  PROCNAME("pixRotateRegion");
+
+  if (!pixs)
+    return (PIX *) ERROR_PTR("pixs not defined", procName, NULL);
+  if (!box)
+    return (PIX *) ERROR_PTR("box not defined", procName, NULL);
+  pixGetDimensions(pixs, &w, &h, &d);
+  if (d != 1)
+    return (PIX *) ERROR_PTR("pixs not 1 bpp", procName, NULL);
+
+  boxGetGeometry(box, &xb, &yb, &wb, &hb);
+  cosa = cos(angle);
+  sina = sin(angle);
+
+  /* Pad the region so that none of it rotates out of frame */
+  border = (l_int32) (0.5 * (wb + hb) * L_ABS(sina)) + 2;
+  if ((pixc = pixClipRectangle(pixs, box, NULL)) == NULL)
+    return (PIX *) ERROR_PTR("pixc not made", procName, NULL);
+  pixb = pixAddBorder(pixc, border, 0);
+  pixr = pixRotate(pixb, angle, L_ROTATE_SAMPLING, L_BRING_IN_WHITE, 0, 0);
+  pixGetDimensions(pixr, &wr, &hr, NULL);
+
+  /* Rotating the region about its own center differs from rotating it
+   * about the center of pixs by a translation. Find where the region's
+   * center lands in the full rotation and paste it there.
+   */
+  xoff = xb - border + wr / 2 - w / 2;
+  yoff = yb - border + hr / 2 - h / 2;
+  dx = w / 2 + (l_int32) floor(cosa * xoff - sina * yoff + 0.5) - wr / 2;
+  dy = h / 2 + (l_int32) floor(sina * xoff + cosa * yoff + 0.5) - hr / 2;
+
+  pixd = pixCreateTemplate(pixs);
+  pixRasterop(pixd, dx, dy, wr, hr, PIX_SRC, pixr, 0, 0);
+
+  pixDestroy(&pixr);
+  pixDestroy(&pixb);
+  pixDestroy(&pixc);
+
+  return pixd;
+}
+
+/*!
+ *  pixCreateFromLuminance()
+ *
+ *      Input:  pixd (<optional> 8 bpp pix of size w x h to fill; can be null)
+ *              data (8-bit luminance, e.g. the Y plane of an NV21 frame)
+ *              w, h
+ *              stride (bytes from one row of data to the next)
+ *      Return: pixd, or null on error
+ *
+ *  Notes:
+ *      (1) Leptonica keeps 8 bpp pixels in 32-bit words, which on little
+ *          endian hosts reverses each group of 4 bytes relative to a camera
+ *          buffer. Rows are therefore repacked a word at a time in a single
+ *          pass rather than wrapped.
+ *      (2) Passing the pix from the previous frame as pixd avoids allocating
+ *          a new one. pixd is returned with its reference count unchanged.
+ */
+PIX *pixCreateFromLuminance(PIX *pixd, const l_uint8 *data, l_int32 w, l_int32 h,
+                            l_int32 stride) {
+  l_int32 x, y, wd, hd, dd, wpld, nwords;
+  l_uint32 *datad, *lined;
+  const l_uint8 *lines;
+
+  PROCNAME("pixCreateFromLuminance");
+
+  if (!data)
+    return (PIX *) ERROR_PTR("data not defined", procName, NULL);
+  if (w <= 0 || h <= 0 || stride < w)
+    return (PIX *) ERROR_PTR("invalid dimensions", procName, NULL);
+
+  if (pixd) {
+    pixGetDimensions(pixd, &wd, &hd, &dd);
+    if (wd != w || hd != h || dd != 8)
+      return (PIX *) ERROR_PTR("pixd not 8 bpp of size w x h", procName, NULL);
+  } else if ((pixd = pixCreateNoInit(w, h, 8)) == NULL) {
+    return (PIX *) ERROR_PTR("pixd not made", procName, NULL);
+  }
+
+  datad = pixGetData(pixd);
+  wpld = pixGetWpl(pixd);
+  nwords = w / 4;
+
+  for (y = 0; y < h; y++) {
+    lines = data + y * stride;
+    lined = datad + y * wpld;
+
+    for (x = 0; x < nwords; x++) {
+      lined[x] = ((l_uint32) lines[4 * x] << 24) | ((l_uint32) lines[4 * x + 1] << 16) |
+                 ((l_uint32) lines[4 * x + 2] << 8) | lines[4 * x + 3];
+    }
+
+    for (x = 4 * nwords; x < w; x++) {
+      SET_DATA_BYTE(lined, x, lines[x]);
+    }
+  }
+
+  return pixd;
+}
+
+/* Monotonic wall clock, in milliseconds */
+l_float64 getWallTimeMs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* CPU time consumed by the calling thread, in milliseconds */
+l_float64 getThreadCpuTimeMs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
@@ -25,4 +25,13 @@ PIX *pixaDisplayRandomCmapFiltered(PIXA *pixa, l_int32 w, l_int32 h, l_uint8 *fi
 
 PIX *pixaDisplayHeatmap(PIXA *pixa, l_int32 w, l_int32 h, NUMA *confs);
 
+PIX *pixRotateRegion(PIX *pixs, BOX *box, l_float32 angle);
+
+PIX *pixCreateFromLuminance(PIX *pixd, const l_uint8 *data, l_int32 w, l_int32 h,
+                            l_int32 stride);
+
+l_float64 getWallTimeMs();
+
+l_float64 getThreadCpuTimeMs();
+
 #endif /* HYDROGEN_UTILITIES_H_ */
@@ -80,56 +80,19 @@ bool ValidatePairOld(BOX *b1, BOX *b2) {
   return true;
 }
 
-l_float32 ComputeFDR(PIX *cc8) {
-  l_float32 fdr;
-
-  pixGetFisherThresh(cc8, 0.0, &fdr, NULL);
-
-  return fdr;
-}
-
-l_float32 ComputeGradientEnergy(PIX *cc8, PIX *cc) {
-  l_float32 energy;
-
-  pixGradientEnergy(cc8, cc, &energy);
-
-  return energy;
-}
-
-l_float32 ComputeCCDensity(PIX *pix) {
-  l_int32 area = pix->w * pix->h;
-  l_int32 pixel_count;
-
-  pixCountPixels(pix, &pixel_count, NULL);
-
-  return pixel_count / (l_float32) area;
-}
-
-l_float32 ComputeCCEdgeMax(PIX *pix8) {
-  l_int32 max;
-  l_int32 avg;
-
-  pixEdgeMax(pix8, &max, &avg);
-
-  return (l_float32) max;
-}
-
-l_float32 ComputeSingletonConfidence(PIX *pix, BOX *box, PIX *pix8) {
-  l_float32 aspect_ratio = box->w / (l_float32) box->h;
-  l_float32 density = ComputeCCDensity(pix);
-  l_float32 gradient = ComputeGradientEnergy(pix8, pix);
-  l_float32 edgemax = ComputeCCEdgeMax(pix8);
+l_float32 ComputeSingletonConfidence(CCComp *comp, RegionFeatures *features) {
+  l_float32 aspect_ratio = comp->w / (l_float32) comp->h;
 
   /* Compute features for confidence */
-  l_float32 features[7];
-  features[0] = 1.0;
-  features[1] = aspect_ratio;
-  features[2] = aspect_ratio * aspect_ratio;
-  features[3] = gradient;
-  features[4] = aspect_ratio / density;
-  features[5] = edgemax;
-
-  l_float32 beta[5];
+  l_float32 feature_vec[6];
+  feature_vec[0] = 1.0;
+  feature_vec[1] = aspect_ratio;
+  feature_vec[2] = aspect_ratio * aspect_ratio;
+  feature_vec[3] = features->gradient_energy;
+  feature_vec[4] = aspect_ratio / features->density;
+  feature_vec[5] = features->edge_max;
+
+  l_float32 beta[6];
   beta[0] = -3.099;
   beta[1] = 1.244;
   beta[2] = -0.1142;
@@ -139,16 +102,21 @@ l_float32 ComputeSingletonConfidence(PIX *pix, BOX *box, PIX *pix8) {
 
   l_float32 confidence = 0.0;
   for (int i = 0; i < 6; i++) {
-    confidence += features[i] * beta[i];
+    confidence += feature_vec[i] * beta[i];
   }
 
   return confidence;
 }
 
-bool ValidateSingleton(PIX *pix, BOX *box, PIX *pix8, l_float32 *pconf,
+/**
+ * Test whether a labeled component looks like a single character. The
+ * component is read directly from its runs, so no crops are allocated.
+ */
+bool ValidateSingleton(CCLabels *ccl, CCComp *comp, PIX *pix8, l_float32 *pconf,
                        HydrogenTextDetector::TextDetectorParameters &params) {
-  l_float32 aspect_ratio = box->w / (l_float32) box->h;
-  l_float32 density = ComputeCCDensity(pix);
+  l_float32 aspect_ratio = comp->w / (l_float32) comp->h;
+  l_int32 area = comp->w * comp->h;
+  l_float32 density = comp->area / (l_float32) area;
 
   *pconf = 0.0;
 
@@ -163,13 +131,20 @@ bool ValidateSingleton(PIX *pix, BOX *box, PIX *pix8, l_float32 *pconf,
   if (density < params.single_min_density)
     return false;
 
-  l_int32 area = box->w * box->h;
-
   /* Area */
   if (area < params.single_min_area)
     return false;
 
-  *pconf = 1.0; //ComputeSingletonConfidence(pix, box, pix8);
+  *pconf = 1.0;
+
+  /* Score the component from a single pass over its runs and pix8 */
+  if (params.single_confidence) {
+    RegionFeatures features;
+
+    if (!pixGetRegionFeatures(pix8, comp->x, comp->y, comp->w, comp->h,
+                              ccl->runs + comp->run_start, comp->run_count, &features))
+      *pconf = ComputeSingletonConfidence(comp, &features);
+  }
 
   return true;
 }
@@ -347,7 +322,8 @@ bool ValidateClusterPair(BOX *b1, BOX *b2, bool *too_far, l_float32 *pconf,
 }
 
 /**
- * Test whether a finalized cluster is valid.
+ * Test whether a finalized cluster is valid. Its features are read from the
+ * box within pix8, so no crop is made.
  */
 bool ValidateCluster(PIX *pix8, PIXA *pixa, BOX *box, l_float32 *pconf,
                      HydrogenTextDetector::TextDetectorParameters &params) {
@@ -355,7 +331,7 @@ bool ValidateCluster(PIX *pix8, PIXA *pixa, BOX *box, l_float32 *pconf,
 
   l_float32 aspect = box->w / (l_float32) box->h;
   l_int32 count = pixaGetCount(pixa);
-  l_float32 fdr = ComputeFDR(pix8);
+  RegionFeatures features;
 
   if (box->h < 15)
     return false;
@@ -366,17 +342,18 @@ bool ValidateCluster(PIX *pix8, PIXA *pixa, BOX *box, l_float32 *pconf,
   if (count < params.cluster_min_blobs)
     return false;
 
-  if (fdr < params.cluster_min_fdr)
+  if (pixGetRegionFeatures(pix8, box->x, box->y, box->w, box->h, NULL, 0, &features))
     return false;
-/*
-  l_int32 edge_max, edge_avg;
-  pixEdgeMax(pix8, &edge_max, &edge_avg);
 
-  if (edge_max < params.cluster_min_edge || edge_avg < params.cluster_min_edge_avg)
+  if (features.fdr < params.cluster_min_fdr)
+    return false;
+/*
+  if (features.edge_max < params.cluster_min_edge ||
+      features.edge_avg < params.cluster_min_edge_avg)
     return false;
 */
   // TODO(alanv): Combine all of these into a confidence score, higher = better
-  *pconf = log(fdr); //log(fdr * edge_max * edge_avg);
+  *pconf = log(features.fdr); //log(fdr * edge_max * edge_avg);
 
   return true;
 }
@@ -19,10 +19,11 @@
 
 #include "leptonica.h"
 #include "hydrogentextdetector.h"
+#include "conncomp.h"
 
 bool ValidatePairOld(BOX *b1, BOX *b2);
 
-bool ValidateSingleton(PIX *pix, BOX *box, PIX *pix8, l_float32 *pconf,
+bool ValidateSingleton(CCLabels *ccl, CCComp *comp, PIX *pix8, l_float32 *pconf,
                        HydrogenTextDetector::TextDetectorParameters &params);
 
 bool ValidatePair(BOX *b1, BOX *b2, l_float32 *pconf,
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark and check for the box grid used by pair and cluster search:
+ *
+ *   boxgridbench [-q queries] [-s seed]
+ *
+ * Random sets of 1k to 100k component-sized boxes are indexed with
+ * boxGridCreate(), spread over an image that grows with the count so the
+ * density stays like that of a page of text. Queries shaped like the pair
+ * search in RemoveInvalidPairs(), spanning the box and a few heights to
+ * either side, are then timed through boxGridQuery() and through a linear
+ * scan over every box. Both must return the same candidates in the same
+ * order. The exit status is nonzero on any mismatch.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "leptonica.h"
+#include "boxgrid.h"
+#include "utilities.h"
+
+/* Box counts to benchmark */
+static const l_int32 kCounts[] = { 1000, 3000, 10000, 30000, 100000 };
+
+static const l_int32 kNumCounts = sizeof(kCounts) / sizeof(kCounts[0]);
+
+/* Image area per box, in square pixels, and component size limits */
+#define AREA_PER_BOX 2000
+#define MIN_BOX_SIZE 2
+#define MAX_BOX_SIZE 40
+
+static l_int32 Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [-q queries] [-s seed]\n", program);
+  return 2;
+}
+
+/* Returns every box with x <= right, x + w >= left, y <= bottom and
+ * y + h >= top, as boxGridQuery() is documented to.
+ */
+static l_int32 LinearQuery(const BoxGrid *grid, l_int32 left, l_int32 top, l_int32 right,
+                           l_int32 bottom, l_int32 *indices) {
+  l_int32 i, count;
+
+  count = 0;
+
+  for (i = 0; i < grid->n; i++) {
+    if (grid->x[i] <= right && grid->x[i] + grid->w[i] >= left && grid->y[i] <= bottom
+        && grid->y[i] + grid->h[i] >= top) {
+      indices[count++] = i;
+    }
+  }
+
+  return count;
+}
+
+/* Returns the query rectangle for box i, as the pair search would build it */
+static void GetQuery(const BoxGrid *grid, l_int32 i, l_int32 *pleft, l_int32 *ptop,
+                     l_int32 *pright, l_int32 *pbottom) {
+  l_int32 max_dist = 4 * grid->h[i] + 1;
+
+  *pleft = grid->x[i] - max_dist;
+  *ptop = grid->y[i];
+  *pright = grid->x[i] + grid->w[i] + max_dist;
+  *pbottom = grid->y[i] + grid->h[i];
+}
+
+int main(int argc, char **argv) {
+  l_int32 num_queries = 2000;
+  l_int32 seed = 1;
+  l_int32 c, i, q, n, side, left, top, right, bottom, num_grid, num_linear, total, failures;
+  l_int32 *grid_indices, *linear_indices, *queries;
+  l_float64 start, build_ms, grid_us, linear_us;
+  PIXA *pixa;
+  BoxGrid *grid;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "q:s:")) != -1) {
+    switch (opt) {
+      case 'q':
+        num_queries = atoi(optarg);
+        break;
+      case 's':
+        seed = atoi(optarg);
+        break;
+      default:
+        return Usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || num_queries < 1)
+    return Usage(argv[0]);
+
+  srand(seed);
+  failures = 0;
+
+  printf("%d queries per set, seed %d\n", num_queries, seed);
+  printf("%8s %10s %12s %12s %9s %10s\n", "boxes", "build ms", "grid us/q", "linear us/q",
+         "speedup", "found/q");
+
+  for (c = 0; c < kNumCounts; c++) {
+    n = kCounts[c];
+    side = (l_int32) sqrt((l_float64) n * AREA_PER_BOX);
+    pixa = pixaCreate(n);
+
+    for (i = 0; i < n; i++) {
+      pixaAddBox(pixa, boxCreate(rand() % side, rand() % side,
+                                 MIN_BOX_SIZE + rand() % (MAX_BOX_SIZE - MIN_BOX_SIZE),
+                                 MIN_BOX_SIZE + rand() % (MAX_BOX_SIZE - MIN_BOX_SIZE)),
+                 L_INSERT);
+    }
+
+    start = getWallTimeMs();
+    grid = boxGridCreate(pixa, NULL);
+    build_ms = getWallTimeMs() - start;
+
+    /* Query around a fixed sample of boxes, so both searches see the same
+     * work regardless of the order they run in */
+    queries = (l_int32 *) malloc(num_queries * sizeof(l_int32));
+    for (q = 0; q < num_queries; q++) {
+      queries[q] = rand() % n;
+    }
+
+    grid_indices = (l_int32 *) malloc(n * sizeof(l_int32));
+    linear_indices = (l_int32 *) malloc(n * sizeof(l_int32));
+    total = 0;
+
+    start = getWallTimeMs();
+    for (q = 0; q < num_queries; q++) {
+      GetQuery(grid, queries[q], &left, &top, &right, &bottom);
+      total += boxGridQuery(grid, left, top, right, bottom, grid_indices);
+    }
+    grid_us = (getWallTimeMs() - start) * 1000.0 / num_queries;
+
+    start = getWallTimeMs();
+    for (q = 0; q < num_queries; q++) {
+      GetQuery(grid, queries[q], &left, &top, &right, &bottom);
+      LinearQuery(grid, left, top, right, bottom, linear_indices);
+    }
+    linear_us = (getWallTimeMs() - start) * 1000.0 / num_queries;
+
+    /* Compare outside the timed loops, including queries that reach past
+     * the image edges */
+    for (q = 0; q < num_queries; q++) {
+      GetQuery(grid, queries[q], &left, &top, &right, &bottom);
+      if (q % 2) {
+        left -= side / 4;
+        top -= side / 4;
+      }
+
+      num_grid = boxGridQuery(grid, left, top, right, bottom, grid_indices);
+      num_linear = LinearQuery(grid, left, top, right, bottom, linear_indices);
+
+      if (num_grid != num_linear
+          || memcmp(grid_indices, linear_indices, num_grid * sizeof(l_int32))) {
+        if (!failures) {
+          fprintf(stderr, "%d boxes: query (%d, %d)-(%d, %d) found %d boxes, expected %d\n", n,
+                  left, top, right, bottom, num_grid, num_linear);
+        }
+        failures++;
+      }
+    }
+
+    printf("%8d %10.2f %12.3f %12.3f %8.1fx %10.1f\n", n, build_ms, grid_us, linear_us,
+           linear_us / grid_us, total / (l_float64) num_queries);
+
+    free(queries);
+    free(grid_indices);
+    free(linear_indices);
+    boxGridDestroy(&grid);
+    pixaDestroy(&pixa);
+  }
+
+  if (failures) {
+    fprintf(stderr, "%d queries differ from the linear scan\n", failures);
+    return 1;
+  }
+
+  printf("All queries match the linear scan\n");
+
+  return 0;
+}
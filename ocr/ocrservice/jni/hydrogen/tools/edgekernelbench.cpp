@@ -0,0 +1,215 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-level benchmark and check for the edge kernels:
+ *
+ *   edgekernelbench [-w width] [-h height] [-t thresh] [-r runs]
+ *
+ * A random width x height 8 bpp image is run through edgeSobelThreshLine()
+ * one line at a time, as pixThreshedSobelEdgeFilter() does, and through
+ * edgeAbsDiffStats(), as pixEdgeMax() does. Every supported kernel level is
+ * timed in megapixels per second, and its output is compared against
+ * EDGE_KERNELS_SCALAR, also on lines of every length up to 128 pixels and at
+ * every threshold. The exit status is nonzero on any mismatch.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "leptonica.h"
+#include "edgekernels.h"
+#include "utilities.h"
+
+/* Longest line, in pixels, checked at every length and threshold */
+#define MAX_CHECK_LENGTH 128
+
+static const char *kLevelNames[] = { "scalar", "sse2", "avx2", "neon" };
+
+static const l_int32 kNumLevels = sizeof(kLevelNames) / sizeof(kLevelNames[0]);
+
+/* Output of one pass over the whole image, and the time per run of each
+ * kernel in milliseconds */
+struct EdgeResult {
+  l_uint32 *sobel;
+  l_int32 max;
+  l_int32 total;
+  l_float64 sobel_ms;
+  l_float64 stats_ms;
+};
+
+static l_int32 Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [-w width] [-h height] [-t thresh] [-r runs]\n", program);
+  return 2;
+}
+
+/* Runs both kernels over every line of the w x h image at the current
+ * level, runs times each.
+ */
+static void RunKernels(const l_uint8 *image, l_int32 w, l_int32 h, l_int32 thresh,
+                       l_int32 runs, EdgeResult *result) {
+  l_int32 i, r, wpld;
+  l_float64 start;
+
+  wpld = (w - 2 + 31) / 32;
+  start = getWallTimeMs();
+
+  for (r = 0; r < runs; r++) {
+    for (i = 0; i < h - 2; i++) {
+      edgeSobelThreshLine(image + i * w, image + (i + 1) * w, image + (i + 2) * w, w - 2,
+                          thresh, result->sobel + i * wpld);
+    }
+  }
+
+  result->sobel_ms = (getWallTimeMs() - start) / runs;
+  start = getWallTimeMs();
+
+  for (r = 0; r < runs; r++) {
+    result->max = 0;
+    result->total = 0;
+    for (i = 0; i < h; i++) {
+      edgeAbsDiffStats(image + i * w, w - 4, &result->max, &result->total);
+    }
+  }
+
+  result->stats_ms = (getWallTimeMs() - start) / runs;
+}
+
+/* Compares the current level against the scalar kernels on short lines of
+ * every length, at every threshold the Sobel kernel distinguishes. Returns
+ * the number of mismatches.
+ */
+static l_int32 CheckShortLines(const l_uint8 *image, l_int32 w) {
+  l_int32 level, n, t, k, max[2], total[2], failures;
+  l_uint32 lined[2][(MAX_CHECK_LENGTH + 31) / 32];
+
+  level = edgeKernelsGetLevel();
+  failures = 0;
+
+  for (n = 1; n <= MAX_CHECK_LENGTH && n + 4 <= w; n++) {
+    for (t = -1; t <= 256; t++) {
+      for (k = 0; k < 2; k++) {
+        edgeKernelsSetLevel(k == 0 ? EDGE_KERNELS_SCALAR : level);
+
+        /* Bits past n must be cleared, so start from different garbage */
+        memset(lined[k], k == 0 ? 0xa5 : 0x5a, sizeof(lined[k]));
+        edgeSobelThreshLine(image, image + w, image + 2 * w, n, t, lined[k]);
+      }
+
+      if (memcmp(lined[0], lined[1], ((n + 31) / 32) * sizeof(l_uint32))) {
+        failures++;
+      }
+    }
+
+    for (k = 0; k < 2; k++) {
+      edgeKernelsSetLevel(k == 0 ? EDGE_KERNELS_SCALAR : level);
+
+      max[k] = 0;
+      total[k] = 0;
+      edgeAbsDiffStats(image, n, &max[k], &total[k]);
+    }
+
+    if (max[0] != max[1] || total[0] != total[1]) {
+      failures++;
+    }
+  }
+
+  edgeKernelsSetLevel(level);
+
+  return failures;
+}
+
+int main(int argc, char **argv) {
+  l_int32 width = 1280;
+  l_int32 height = 720;
+  l_int32 thresh = 64;
+  l_int32 runs = 20;
+  l_int32 level, i, size, failures;
+  l_float64 mpixels;
+  l_uint8 *image;
+  EdgeResult reference, result;
+  bool matches;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:h:t:r:")) != -1) {
+    switch (opt) {
+      case 'w':
+        width = atoi(optarg);
+        break;
+      case 'h':
+        height = atoi(optarg);
+        break;
+      case 't':
+        thresh = atoi(optarg);
+        break;
+      case 'r':
+        runs = L_MAX(1, atoi(optarg));
+        break;
+      default:
+        return Usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || width < 8 || height < 3)
+    return Usage(argv[0]);
+
+  /* Smooth ramps with noise, so the Sobel output isn't all set or clear */
+  image = (l_uint8 *) malloc(width * height);
+  srand(1);
+  for (i = 0; i < width * height; i++) {
+    image[i] = (l_uint8) (((i % width) * 3 + (i / width) * 2 + rand() % 96) & 0xff);
+  }
+
+  size = ((width - 2 + 31) / 32) * (height - 2) * sizeof(l_uint32);
+  reference.sobel = (l_uint32 *) malloc(size);
+  result.sobel = (l_uint32 *) malloc(size);
+  mpixels = width * (l_float64) height / 1000000.0;
+  failures = 0;
+
+  printf("%dx%d image, threshold %d, %d runs\n", width, height, thresh, runs);
+  printf("%-8s %12s %9s %12s %9s\n", "level", "sobel MP/s", "speedup", "absdiff MP/s",
+         "speedup");
+
+  edgeKernelsSetLevel(EDGE_KERNELS_SCALAR);
+  RunKernels(image, width, height, thresh, runs, &reference);
+
+  for (level = 0; level < kNumLevels; level++) {
+    if (!edgeKernelsLevelSupported(level))
+      continue;
+
+    edgeKernelsSetLevel(level);
+    RunKernels(image, width, height, thresh, runs, &result);
+
+    matches = !memcmp(reference.sobel, result.sobel, size) && reference.max == result.max
+        && reference.total == result.total && CheckShortLines(image, width) == 0;
+
+    if (!matches)
+      failures++;
+
+    printf("%-8s %12.1f %8.2fx %12.1f %8.2fx  %s\n", kLevelNames[level],
+           mpixels / (result.sobel_ms / 1000.0), reference.sobel_ms / result.sobel_ms,
+           mpixels / (result.stats_ms / 1000.0), reference.stats_ms / result.stats_ms,
+           matches ? "matches scalar" : "DIFFERS FROM SCALAR");
+  }
+
+  free(image);
+  free(reference.sobel);
+  free(result.sobel);
+
+  return failures ? 1 : 0;
+}
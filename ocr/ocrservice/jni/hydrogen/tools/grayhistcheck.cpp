@@ -0,0 +1,238 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Check of the histogram-based Fisher thresholding against Leptonica:
+ *
+ *   grayhistcheck [-n images] [-s seed] [image ...]
+ *
+ * Each image, or each of the random 8 bpp images generated when none are
+ * given, is split into a random grid of cells. The histogram of every cell
+ * from grayHistGridCreate() must match pixGetGrayHistogram() on the same
+ * tile from pixTilingGetTile(), and pixGetGrayHistogramArray() must match
+ * it on the whole image. The threshold from histGetFisherThresh() must then
+ * match numaSplitDistribution(), and its Fisher's Discriminant Rate the one
+ * computed from numaSplitDistribution() and numaGetHistogramStats(), as
+ * pixGetFisherThresh() did before it stopped allocating NUMAs. The exit
+ * status is nonzero on any mismatch.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "leptonica.h"
+#include "grayhist.h"
+
+/* Largest relative difference allowed in the Fisher's Discriminant Rate */
+#define FDR_TOLERANCE 1e-4
+
+/* Score fractions checked, as used by callers */
+static const l_float32 kScoreFracts[] = { 0.0, 0.1, 0.3 };
+
+static const l_int32 kNumScoreFracts = sizeof(kScoreFracts) / sizeof(kScoreFracts[0]);
+
+static l_int32 Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [-n images] [-s seed] [image ...]\n", program);
+  return 2;
+}
+
+/* Returns a random 8 bpp image: noise, two-tone text-like blocks with noise,
+ * or a flat field.
+ */
+static PIX *CreateRandomImage() {
+  l_int32 w, h, x, y, mode, val, wpl;
+  l_uint32 *data, *line;
+  PIX *pix;
+
+  w = 16 + rand() % 400;
+  h = 16 + rand() % 300;
+  mode = rand() % 3;
+  pix = pixCreate(w, h, 8);
+  data = pixGetData(pix);
+  wpl = pixGetWpl(pix);
+
+  for (y = 0; y < h; y++) {
+    line = data + y * wpl;
+
+    for (x = 0; x < w; x++) {
+      if (mode == 0) {
+        val = rand() % 256;
+      } else if (mode == 1) {
+        val = ((x / 7 + y / 5) & 1) ? 40 + rand() % 20 : 200 + rand() % 30;
+      } else {
+        val = 128;
+      }
+
+      SET_DATA_BYTE(line, x, val);
+    }
+  }
+
+  return pix;
+}
+
+/* Returns the threshold and Fisher's Discriminant Rate of na the way
+ * pixGetFisherThresh() originally computed them.
+ */
+static void GetReferenceFisher(NUMA *na, l_float32 scorefract, l_float32 *pfdr,
+                               l_int32 *pthresh) {
+  l_float32 mean1, mean2, sum, sum1, sum2, fract, var, between, within;
+
+  numaSplitDistribution(na, scorefract, pthresh, &mean1, &mean2, &sum1, &sum2, NULL);
+  numaGetHistogramStats(na, 0.0, 1.0, NULL, NULL, NULL, &var);
+  numaGetSum(na, &sum);
+
+  fract = sum1 / sum;
+  between = (fract * (1 - fract)) * (mean1 - mean2) * (mean1 - mean2);
+  within = var - between;
+
+  *pfdr = (within <= 1) ? between : between / within;
+}
+
+/* Returns whether hist holds the same counts as na */
+static bool HistMatches(const l_uint32 *hist, NUMA *na) {
+  l_int32 i;
+  l_float32 val;
+
+  if (numaGetCount(na) != GRAY_HIST_BINS)
+    return false;
+
+  for (i = 0; i < GRAY_HIST_BINS; i++) {
+    numaGetFValue(na, i, &val);
+    if (hist[i] != (l_uint32) val)
+      return false;
+  }
+
+  return true;
+}
+
+/* Checks one 8 bpp image and returns the number of mismatches */
+static l_int32 CheckImage(PIX *pix8, const char *name, l_int32 *pcells) {
+  l_int32 w, h, nx, ny, x, y, k, thresh, ref_thresh, failures;
+  l_uint32 hist[GRAY_HIST_BINS];
+  l_float32 fdr, ref_fdr;
+  GrayHistGrid *grid;
+  PIXTILING *pt;
+  PIX *pixt;
+  NUMA *na;
+
+  pixGetDimensions(pix8, &w, &h, NULL);
+  failures = 0;
+
+  na = pixGetGrayHistogram(pix8, 1);
+  if (pixGetGrayHistogramArray(pix8, hist) || !HistMatches(hist, na)) {
+    fprintf(stderr, "%s: whole-image histogram differs\n", name);
+    failures++;
+  }
+  numaDestroy(&na);
+
+  nx = 1 + rand() % L_MAX(1, w / 8);
+  ny = 1 + rand() % L_MAX(1, h / 8);
+  grid = grayHistGridCreate(pix8, nx, ny);
+  pt = pixTilingCreate(pix8, nx, ny, 0, 0, 0, 0);
+
+  for (y = 0; y < ny; y++) {
+    for (x = 0; x < nx; x++) {
+      pixt = pixTilingGetTile(pt, y, x);
+      na = pixGetGrayHistogram(pixt, 1);
+      (*pcells)++;
+
+      grayHistGridGetRegion(grid, x, y, x, y, hist);
+      if (!HistMatches(hist, na)) {
+        fprintf(stderr, "%s: histogram of cell (%d, %d) of %dx%d differs\n", name, x, y, nx,
+                ny);
+        failures++;
+      }
+
+      for (k = 0; k < kNumScoreFracts; k++) {
+        histGetFisherThresh(hist, kScoreFracts[k], &fdr, &thresh);
+        GetReferenceFisher(na, kScoreFracts[k], &ref_fdr, &ref_thresh);
+
+        if (thresh != ref_thresh
+            || fabs(fdr - ref_fdr) > FDR_TOLERANCE * L_MAX(1.0, fabs(ref_fdr))) {
+          fprintf(stderr, "%s: cell (%d, %d) at score fraction %.1f gave threshold %d and "
+                  "FDR %f, expected %d and %f\n", name, x, y, kScoreFracts[k], thresh, fdr,
+                  ref_thresh, ref_fdr);
+          failures++;
+        }
+      }
+
+      numaDestroy(&na);
+      pixDestroy(&pixt);
+    }
+  }
+
+  pixTilingDestroy(&pt);
+  grayHistGridDestroy(&grid);
+
+  return failures;
+}
+
+int main(int argc, char **argv) {
+  l_int32 num_images = 50;
+  l_int32 seed = 1;
+  l_int32 i, cells, failures;
+  char name[32];
+  PIX *pix, *pix8;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        num_images = atoi(optarg);
+        break;
+      case 's':
+        seed = atoi(optarg);
+        break;
+      default:
+        return Usage(argv[0]);
+    }
+  }
+
+  srand(seed);
+  cells = 0;
+  failures = 0;
+
+  if (optind < argc) {
+    for (i = optind; i < argc; i++) {
+      if ((pix = pixRead(argv[i])) == NULL) {
+        fprintf(stderr, "%s: cannot read image\n", argv[i]);
+        failures++;
+        continue;
+      }
+
+      pix8 = pixConvertTo8(pix, false);
+      failures += CheckImage(pix8, argv[i], &cells);
+
+      pixDestroy(&pix8);
+      pixDestroy(&pix);
+    }
+  } else {
+    for (i = 0; i < num_images; i++) {
+      snprintf(name, sizeof(name), "random %d", i);
+
+      pix8 = CreateRandomImage();
+      failures += CheckImage(pix8, name, &cells);
+
+      pixDestroy(&pix8);
+    }
+  }
+
+  printf("Checked %d cells: %d mismatches\n", cells, failures);
+
+  return failures ? 1 : 0;
+}
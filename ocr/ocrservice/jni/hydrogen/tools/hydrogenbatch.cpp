@@ -0,0 +1,168 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Command-line driver that runs Hydrogen text detection over a list of
+ * images and prints one JSON line per image as results complete:
+ *
+ *   hydrogenbatch [-t threads] [image ...]
+ *
+ * With no image arguments, paths are read from standard input, one per line.
+ * Output lines carry the index of the image in the list, so consumers can
+ * restore input order if they need it. Stage timings are given as
+ * [wall_ms, cpu_ms] pairs.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "leptonica.h"
+#include "batchdetector.h"
+
+#define MAX_PATH_LENGTH 4096
+
+/* Names of the HydrogenTextDetector::Stage values, in order */
+static const char *kStageNames[] = {
+  "edges", "skew", "conncomp", "pairs", "cluster", "merge", "total"
+};
+
+static PIX *LoadImage(void *arg, l_int32 index) {
+  char **paths = (char **) arg;
+
+  return pixRead(paths[index]);
+}
+
+static void PrintString(const char *str) {
+  putchar('"');
+
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      printf("\\%c", *str);
+    } else if ((unsigned char) *str < 0x20) {
+      printf("\\u%04x", *str);
+    } else {
+      putchar(*str);
+    }
+  }
+
+  putchar('"');
+}
+
+static void PrintResult(void *arg, const BatchTextDetector::Result *result) {
+  char **paths = (char **) arg;
+  l_int32 i, n, x, y, w, h;
+  l_float32 conf;
+
+  printf("{\"id\":%d,\"path\":", result->index);
+  PrintString(paths[result->index]);
+  printf(",\"ok\":%s,\"skew\":%.4f,\"load_ms\":%.2f,\"detect_ms\":%.2f,\"regions\":[",
+         result->ok ? "true" : "false", result->skew_angle, result->load_ms, result->detect_ms);
+
+  n = result->areas ? pixaGetCount(result->areas) : 0;
+  for (i = 0; i < n; i++) {
+    pixaGetBoxGeometry(result->areas, i, &x, &y, &w, &h);
+    conf = 0.0;
+    numaGetFValue(result->confs, i, &conf);
+    printf("%s[%d,%d,%d,%d,%.4f]", i ? "," : "", x, y, w, h, conf);
+  }
+
+  printf("]");
+
+  if (result->stats) {
+    const HydrogenTextDetector::DetectorStats *stats = result->stats;
+
+    printf(",\"stages\":{");
+    for (i = 0; i < HydrogenTextDetector::NUM_STAGES; i++) {
+      printf("%s\"%s\":[%.2f,%.2f]", i ? "," : "", kStageNames[i], stats->wall_ms[i],
+             stats->cpu_ms[i]);
+    }
+    printf("},\"components\":%d,\"pairs_removed\":%d,\"clusters\":%d,"
+           "\"fragments_merged\":%d,\"bytes_allocated\":%d", stats->components,
+           stats->pairs_removed, stats->clusters, stats->fragments_merged, stats->bytes_allocated);
+  }
+
+  printf("}\n");
+  fflush(stdout);
+}
+
+static char **ReadPaths(FILE *fp, l_int32 *pcount) {
+  char line[MAX_PATH_LENGTH];
+  char **paths;
+  l_int32 count, nalloc, len;
+
+  count = 0;
+  nalloc = 64;
+  paths = (char **) malloc(nalloc * sizeof(char *));
+
+  while (fgets(line, sizeof(line), fp)) {
+    len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = '\0';
+    if (len == 0)
+      continue;
+
+    if (count == nalloc) {
+      nalloc *= 2;
+      paths = (char **) realloc(paths, nalloc * sizeof(char *));
+    }
+
+    paths[count++] = strdup(line);
+  }
+
+  *pcount = count;
+
+  return paths;
+}
+
+int main(int argc, char **argv) {
+  l_int32 i, count, num_threads, opt;
+  char **paths;
+
+  num_threads = (l_int32) sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    switch (opt) {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-t threads] [image ...]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind < argc) {
+    count = argc - optind;
+    paths = (char **) malloc(count * sizeof(char *));
+    for (i = 0; i < count; i++) {
+      paths[i] = strdup(argv[optind + i]);
+    }
+  } else {
+    paths = ReadPaths(stdin, &count);
+  }
+
+  BatchTextDetector batch(L_MAX(1, num_threads));
+  batch.Run(count, LoadImage, paths, PrintResult, paths);
+
+  for (i = 0; i < count; i++) {
+    free(paths[i]);
+  }
+  free(paths);
+
+  return 0;
+}
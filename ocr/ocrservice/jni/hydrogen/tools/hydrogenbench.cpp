@@ -0,0 +1,376 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Golden-output regression and throughput harness for Hydrogen text
+ * detection:
+ *
+ *   hydrogenbench [-g golden_dir [-u]] [-r runs] [-j threads] [-b pixels]
+ *                 [-c conf_tolerance] corpus_dir
+ *
+ * Every image in corpus_dir is detected runs times by one detector. With -g,
+ * the text areas of the last run are compared against golden_dir/<name>.txt,
+ * which holds one "x y w h conf" line per area in output order; -u writes
+ * those files instead of checking them. Boxes may differ by the -b pixel
+ * tolerance and confidences by the relative -c tolerance.
+ *
+ * Per-image median latency is printed as each image completes, followed by
+ * latency percentiles over all runs and the peak resident set size. The exit
+ * status is nonzero if any image failed to load or to match its golden file.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "leptonica.h"
+#include "hydrogentextdetector.h"
+#include "utilities.h"
+
+#define MAX_PATH_LENGTH 4096
+
+/* Image extensions read from the corpus directory */
+static const char *kExtensions[] = {
+  ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".pnm", ".pgm", ".ppm", ".gif"
+};
+
+struct GoldenArea {
+  l_int32 x;
+  l_int32 y;
+  l_int32 w;
+  l_int32 h;
+  l_float32 conf;
+};
+
+static int CompareStrings(const void *a, const void *b) {
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  l_float64 x = *(const l_float64 *) a;
+  l_float64 y = *(const l_float64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+static bool HasImageExtension(const char *name) {
+  const char *ext = strrchr(name, '.');
+
+  if (!ext)
+    return false;
+
+  for (size_t i = 0; i < sizeof(kExtensions) / sizeof(kExtensions[0]); i++) {
+    if (!strcasecmp(ext, kExtensions[i]))
+      return true;
+  }
+
+  return false;
+}
+
+/* Returns the image file names in dir, sorted so runs are comparable */
+static char **ListImages(const char *dir, l_int32 *pcount) {
+  DIR *dp;
+  struct dirent *entry;
+  char **names;
+  l_int32 count, nalloc;
+
+  *pcount = 0;
+
+  if ((dp = opendir(dir)) == NULL)
+    return NULL;
+
+  count = 0;
+  nalloc = 64;
+  names = (char **) malloc(nalloc * sizeof(char *));
+
+  while ((entry = readdir(dp)) != NULL) {
+    if (!HasImageExtension(entry->d_name))
+      continue;
+
+    if (count == nalloc) {
+      nalloc *= 2;
+      names = (char **) realloc(names, nalloc * sizeof(char *));
+    }
+
+    names[count++] = strdup(entry->d_name);
+  }
+
+  closedir(dp);
+  qsort(names, count, sizeof(char *), CompareStrings);
+
+  *pcount = count;
+
+  return names;
+}
+
+static l_float64 Percentile(const l_float64 *sorted, l_int32 n, l_float64 p) {
+  l_int32 rank;
+
+  if (n == 0)
+    return 0.0;
+
+  /* Nearest rank */
+  rank = (l_int32) ceil(p / 100.0 * n);
+
+  return sorted[L_MIN(n, L_MAX(1, rank)) - 1];
+}
+
+static void GoldenPath(char *path, const char *golden_dir, const char *name) {
+  snprintf(path, MAX_PATH_LENGTH, "%s/%s.txt", golden_dir, name);
+}
+
+static bool WriteGolden(const char *path, PIXA *areas, NUMA *confs) {
+  l_int32 i, n, x, y, w, h;
+  l_float32 conf;
+  FILE *fp;
+
+  if ((fp = fopen(path, "w")) == NULL)
+    return false;
+
+  n = areas ? pixaGetCount(areas) : 0;
+  for (i = 0; i < n; i++) {
+    pixaGetBoxGeometry(areas, i, &x, &y, &w, &h);
+    conf = 0.0;
+    numaGetFValue(confs, i, &conf);
+    fprintf(fp, "%d %d %d %d %.6g\n", x, y, w, h, conf);
+  }
+
+  fclose(fp);
+
+  return true;
+}
+
+/* Returns the number of areas read from a golden file, or -1 if missing */
+static l_int32 ReadGolden(const char *path, GoldenArea **pareas) {
+  GoldenArea area, *areas;
+  l_int32 count, nalloc;
+  FILE *fp;
+
+  *pareas = NULL;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+
+  count = 0;
+  nalloc = 16;
+  areas = (GoldenArea *) malloc(nalloc * sizeof(GoldenArea));
+
+  while (fscanf(fp, "%d %d %d %d %f", &area.x, &area.y, &area.w, &area.h, &area.conf) == 5) {
+    if (count == nalloc) {
+      nalloc *= 2;
+      areas = (GoldenArea *) realloc(areas, nalloc * sizeof(GoldenArea));
+    }
+
+    areas[count++] = area;
+  }
+
+  fclose(fp);
+  *pareas = areas;
+
+  return count;
+}
+
+/* Prints the first difference from the golden areas and returns false */
+static bool CheckGolden(const char *name, const char *path, PIXA *areas, NUMA *confs,
+                        l_int32 box_tolerance, l_float32 conf_tolerance) {
+  l_int32 i, n, expected, x, y, w, h;
+  l_float32 conf, limit;
+  GoldenArea *golden;
+  bool ok = true;
+
+  if ((expected = ReadGolden(path, &golden)) < 0) {
+    fprintf(stderr, "%s: missing golden file %s\n", name, path);
+    return false;
+  }
+
+  n = areas ? pixaGetCount(areas) : 0;
+  if (n != expected) {
+    fprintf(stderr, "%s: found %d areas, expected %d\n", name, n, expected);
+    ok = false;
+  }
+
+  for (i = 0; ok && i < n; i++) {
+    pixaGetBoxGeometry(areas, i, &x, &y, &w, &h);
+    conf = 0.0;
+    numaGetFValue(confs, i, &conf);
+    limit = conf_tolerance * L_MAX(1.0, fabs(golden[i].conf));
+
+    if (L_ABS(x - golden[i].x) > box_tolerance || L_ABS(y - golden[i].y) > box_tolerance
+        || L_ABS(w - golden[i].w) > box_tolerance || L_ABS(h - golden[i].h) > box_tolerance
+        || fabs(conf - golden[i].conf) > limit) {
+      fprintf(stderr, "%s: area %d is [%d %d %d %d %.6g], expected [%d %d %d %d %.6g]\n",
+              name, i, x, y, w, h, conf, golden[i].x, golden[i].y, golden[i].w,
+              golden[i].h, golden[i].conf);
+      ok = false;
+    }
+  }
+
+  free(golden);
+
+  return ok;
+}
+
+static int Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [-g golden_dir [-u]] [-r runs] [-j threads] [-b pixels] "
+          "[-c conf_tolerance] corpus_dir\n", program);
+
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  l_int32 i, r, count, runs, num_threads, box_tolerance, opt, failures, num_times;
+  l_float32 conf_tolerance;
+  l_float64 start, *times, *image_times;
+  const char *corpus_dir, *golden_dir;
+  char path[MAX_PATH_LENGTH];
+  char **names;
+  bool update;
+  struct rusage usage;
+  PIX *pix;
+  PIXA *areas;
+  NUMA *confs;
+
+  golden_dir = NULL;
+  update = false;
+  runs = 5;
+  num_threads = 1;
+  box_tolerance = 0;
+  conf_tolerance = 1e-4;
+
+  while ((opt = getopt(argc, argv, "g:ur:j:b:c:")) != -1) {
+    switch (opt) {
+      case 'g':
+        golden_dir = optarg;
+        break;
+      case 'u':
+        update = true;
+        break;
+      case 'r':
+        runs = L_MAX(1, atoi(optarg));
+        break;
+      case 'j':
+        num_threads = L_MAX(1, atoi(optarg));
+        break;
+      case 'b':
+        box_tolerance = L_MAX(0, atoi(optarg));
+        break;
+      case 'c':
+        conf_tolerance = atof(optarg);
+        break;
+      default:
+        return Usage(argv[0]);
+    }
+  }
+
+  if (optind != argc - 1 || (update && !golden_dir))
+    return Usage(argv[0]);
+
+  corpus_dir = argv[optind];
+
+  if ((names = ListImages(corpus_dir, &count)) == NULL) {
+    fprintf(stderr, "Cannot read corpus directory %s\n", corpus_dir);
+    return 2;
+  }
+
+  HydrogenTextDetector detector;
+  HydrogenTextDetector::TextDetectorParameters *params = detector.GetMutableParameters();
+
+  // Every run should do the full work, so don't carry skew between images
+  params->num_threads = num_threads;
+  params->parallel_passes = num_threads > 1;
+  params->skew_reuse_max_diff = -1;
+
+  times = (l_float64 *) malloc(L_MAX(1, count * runs) * sizeof(l_float64));
+  image_times = (l_float64 *) malloc(runs * sizeof(l_float64));
+  num_times = 0;
+  failures = 0;
+
+  for (i = 0; i < count; i++) {
+    snprintf(path, sizeof(path), "%s/%s", corpus_dir, names[i]);
+
+    if ((pix = pixRead(path)) == NULL) {
+      fprintf(stderr, "%s: cannot read image\n", names[i]);
+      failures++;
+      continue;
+    }
+
+    areas = NULL;
+    confs = NULL;
+
+    for (r = 0; r < runs; r++) {
+      pixaDestroy(&areas);
+      numaDestroy(&confs);
+
+      start = getWallTimeMs();
+      detector.SetSourceImage(pix);
+      detector.DetectText();
+      image_times[r] = getWallTimeMs() - start;
+      times[num_times++] = image_times[r];
+
+      areas = detector.GetTextAreas();
+      confs = detector.GetTextConfs();
+      detector.Clear();
+    }
+
+    qsort(image_times, runs, sizeof(l_float64), CompareDoubles);
+    printf("%-40s %4d areas %9.2f ms\n", names[i], areas ? pixaGetCount(areas) : 0,
+           Percentile(image_times, runs, 50));
+
+    if (golden_dir) {
+      GoldenPath(path, golden_dir, names[i]);
+
+      if (update) {
+        if (!WriteGolden(path, areas, confs)) {
+          fprintf(stderr, "%s: cannot write golden file %s\n", names[i], path);
+          failures++;
+        }
+      } else if (!CheckGolden(names[i], path, areas, confs, box_tolerance, conf_tolerance)) {
+        failures++;
+      }
+    }
+
+    pixaDestroy(&areas);
+    numaDestroy(&confs);
+    pixDestroy(&pix);
+  }
+
+  qsort(times, num_times, sizeof(l_float64), CompareDoubles);
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("\n%d images, %d runs each\n", count, runs);
+  printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", Percentile(times, num_times, 50),
+         Percentile(times, num_times, 90), Percentile(times, num_times, 99),
+         Percentile(times, num_times, 100));
+  printf("peak rss: %ld KB\n", (long) usage.ru_maxrss);
+
+  if (golden_dir && !update) {
+    printf("golden: %d of %d images failed\n", failures, count);
+  }
+
+  for (i = 0; i < count; i++) {
+    free(names[i]);
+  }
+  free(names);
+  free(times);
+  free(image_times);
+
+  return failures ? 1 : 0;
+}
@@ -16,7 +16,10 @@ LOCAL_CFLAGS := -Wall \
 
 LOCAL_SRC_FILES := optical_flow-jni.cpp \
                    optical_flow.cpp \
-                   feature_detector.cpp
+                   feature_detector.cpp \
+                   image_kernels.cpp \
+                   object_tracker.cpp \
+                   worker_pool.cpp
 
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../common
 
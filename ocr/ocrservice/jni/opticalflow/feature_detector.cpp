@@ -24,11 +24,17 @@
 #include "time_log.h"
 
 #include "image.h"
+#include "image_kernels.h"
 #include "feature_detector.h"
 
 // Threshold for pixels to be considered different.
 #define FAST_DIFF_AMOUNT 10
 
+// Number of contiguous circle pixels that must all be brighter or all be
+// darker than the center for FAST. 12 is the original FAST-12; 9 finds more
+// and weaker corners.
+#define FAST_ARC_LENGTH 12
+
 // How far from edge of frame to stop looking for FAST features.
 #define FAST_BORDER_BUFFER 20
 
@@ -44,8 +50,13 @@
 // considered a candidate feature for Harris filtering.
 #define MIN_NUM_CONNECTED 8
 
+// How many selection cells in each direction a feature selected with
+// MIN_FEATURE_DIST_NORMAL can suppress candidates in.
+#define SELECTION_RANGE \
+    ((MIN_FEATURE_DIST_NORMAL + SELECTION_CELL_SIZE - 1) / SELECTION_CELL_SIZE)
+
 // Size of the window to integrate over for Harris filtering.
-// Compare to WINDOW_SIZE in optical_flow.h.
+// Compare to OpticalFlowConfig::window_size in optical_flow.h.
 #define HARRIS_WINDOW_SIZE 2
 
 // Arbitrary parameter for how picky Harris filter is, the higher the more
@@ -54,7 +65,7 @@
 
 namespace flow {
 
-void scoreFeatures(const Image<int32>& I_x, const Image<int32>& I_y,
+void scoreFeatures(const Image<int16>& I_x, const Image<int16>& I_y,
                    const int32 num_candidates,
                    Point2D* const candidate_features) {
   // Score all the features
@@ -64,19 +75,55 @@ void scoreFeatures(const Image<int32>& I_x, const Image<int32>& I_y,
   }
 }
 
-// Quicksorts detected features by score and then selects them such that
-// they are separated by a minimum distance.
+// Returns the cell of cell_grid that a feature falls in.
+static inline int32* getSelectionCell(const Point2D& feature,
+                                      Image<int32>* const cell_grid) {
+  const int32 cell_x = clip(static_cast<int32>(feature.x) / SELECTION_CELL_SIZE,
+                            ZERO, cell_grid->width_less_one_);
+  const int32 cell_y = clip(static_cast<int32>(feature.y) / SELECTION_CELL_SIZE,
+                            ZERO, cell_grid->height_less_one_);
+  return cell_grid->getPixelPtr(cell_x, cell_y);
+}
+
+// Keeps the best candidate in each cell, then quicksorts those by score and
+// selects them such that they are separated by a minimum distance.
 int32 sortAndSelect(const int32 num_candidates, const int32 max_features,
                     const Image<bool>& interest_map,
                     Point2D* const candidate_features,
                     Point2D* const final_features,
-                    Image<uint8>* const best_feature_map) {
-  qsort(candidate_features, num_candidates);
+                    Image<int32>* const cell_grid) {
+  // Two features in one cell are always closer than the minimum distance, so
+  // only the best of them could be selected anyway.
+  cell_grid->clear(-1);
+  for (int32 i = 0; i < num_candidates; ++i) {
+    const Point2D& candidate = candidate_features[i];
+    if (candidate.score <= 0.0f) {
+      continue;
+    }
+
+    int32* const cell = getSelectionCell(candidate, cell_grid);
+    if (*cell < 0 || candidate.score > candidate_features[*cell].score) {
+      *cell = i;
+    }
+  }
+
+  // Compact the survivors in place. Each one only moves to a lower index, so
+  // nothing is overwritten before it's read.
+  int32 num_survivors = 0;
+  for (int32 i = 0; i < num_candidates; ++i) {
+    if (candidate_features[i].score > 0.0f &&
+        *getSelectionCell(candidate_features[i], cell_grid) == i) {
+      candidate_features[num_survivors] = candidate_features[i];
+      ++num_survivors;
+    }
+  }
+
+  qsort(candidate_features, num_survivors);
 
 #ifdef SANITY_CHECKS
   // Verify that the array got sorted.
   float32 last_score = -FLT_MAX;
-  for (int32 i = 0; i < num_candidates; ++i) {
+  for (int32 i = 0; i < num_survivors; ++i) {
     const float32 curr_score = (candidate_features + i)->score;
 
     // Scores should be monotonically increasing.
@@ -88,25 +135,55 @@ int32 sortAndSelect(const int32 num_candidates, const int32 max_features,
   }
 #endif
 
-  best_feature_map->clear(false);
+  // From here on cells hold the index of the final feature selected in them.
+  cell_grid->clear(-1);
 
   int32 num_features = 0;
 
-  for (int32 i = num_candidates - 1; i >= 0; --i) {
+  for (int32 i = num_survivors - 1; i >= 0; --i) {
     const Point2D& candidate = candidate_features[i];
+    const int32 x = candidate.x;
+    const int32 y = candidate.y;
+    const int32 cell_x = clip(x / SELECTION_CELL_SIZE,
+                              ZERO, cell_grid->width_less_one_);
+    const int32 cell_y = clip(y / SELECTION_CELL_SIZE,
+                              ZERO, cell_grid->height_less_one_);
+
+    // Reject the candidate if it falls within the disk any nearby selected
+    // feature claims. Features in an interest region claim a smaller disk, so
+    // other features may appear closer to them than normal.
+    bool claimed = false;
+    const int32 end_y = min(cell_y + SELECTION_RANGE,
+                            cell_grid->height_less_one_);
+    const int32 end_x = min(cell_x + SELECTION_RANGE,
+                            cell_grid->width_less_one_);
+    for (int32 c_y = max(cell_y - SELECTION_RANGE, ZERO);
+         c_y <= end_y && !claimed; ++c_y) {
+      const int32* const cells = cell_grid->getPixelPtrConst(0, c_y);
+      for (int32 c_x = max(cell_x - SELECTION_RANGE, ZERO); c_x <= end_x;
+           ++c_x) {
+        if (cells[c_x] < 0) {
+          continue;
+        }
 
-    // Since features are sorted, the first 0 or less value means we can stop
-    // looking.
-    if (candidate.score <= 0.0f) {
-      break;
+        const Point2D& selected = final_features[cells[c_x]];
+        const int32 sel_x = selected.x;
+        const int32 sel_y = selected.y;
+        const int32 distance = interest_map.getPixel(sel_x, sel_y) ?
+            MIN_FEATURE_DIST_INTEREST : MIN_FEATURE_DIST_NORMAL;
+
+        const int32 d_x = x - sel_x;
+        const int32 d_y = y - sel_y;
+        if (abs(d_x) < distance && abs(d_y) < distance &&
+            square(d_x) + square(d_y) <= square(distance)) {
+          claimed = true;
+          break;
+        }
+      }
     }
 
-    // Lookup whether this feature is in an interest region.  If so, other
-    // features may appear closer to it than normal.
-    const int32 distance = interest_map.getPixel(candidate.x, candidate.y) ?
-        MIN_FEATURE_DIST_INTEREST : MIN_FEATURE_DIST_NORMAL;
-
-    if (markImage(candidate.x, candidate.y, distance, best_feature_map)) {
+    if (!claimed) {
+      *cell_grid->getPixelPtr(cell_x, cell_y) = num_features;
       final_features[num_features] = candidate;
       num_features++;
 
@@ -119,87 +196,6 @@ int32 sortAndSelect(const int32 num_candidates, const int32 max_features,
   return num_features;
 }
 
-// Walks along the given circle checking for pixels above or below the center.
-// Returns a score, or 0 if the feature did not pass the criteria.
-//
-// Parameters:
-//  circle_perimeter: the circumference in pixels of the circle.
-//  threshold: the minimum number of contiguous pixels that must be above or
-//             below the center value.
-//  center_ptr: the location of the center pixel in memory
-//  offsets: the relative offsets from the center pixel of the edge pixels.
-inline int32 testCircle(const int32 circle_perimeter, const int32 threshold,
-                        const uint8* const center_ptr,
-                        const int32* offsets) {
-  // Get the actual value of the center pixel for easier reference later on.
-  const int32 center_value = static_cast<int32>(*center_ptr);
-
-  // Number of total pixels to check.  Have to wrap around some in case
-  // the contiguous section is split by the array edges.
-  const int32 num_total = circle_perimeter + threshold - 1;
-
-  int32 num_above = 0;
-  int32 above_diff = 0;
-
-  int32 num_below = 0;
-  int32 below_diff = 0;
-
-  // Used to tell when this is definitely not going to meet the threshold so we
-  // can early abort.
-  int32 minimum_by_now = threshold - num_total + 1;
-
-  // Go through every pixel along the perimeter of the circle, and then around
-  // again a little bit.
-  for (int32 i = 0; i < num_total; ++i) {
-    // This should be faster than mod.
-    const int32 perim_index = i < circle_perimeter ? i : i - circle_perimeter;
-
-    // This gets the value of the current pixel along the perimeter by using
-    // a precomputed offset.
-    const int32 curr_value =
-        static_cast<int32>(center_ptr[offsets[perim_index]]);
-
-    const int32 difference = curr_value - center_value;
-
-    if (difference > FAST_DIFF_AMOUNT) {
-      above_diff += difference;
-      ++num_above;
-
-      num_below = 0;
-      below_diff = 0;
-
-      if (num_above >= threshold) {
-        return above_diff;
-      }
-    } else if (difference < -FAST_DIFF_AMOUNT) {
-      below_diff += difference;
-      ++num_below;
-
-      num_above = 0;
-      above_diff = 0;
-
-      if (num_below >= threshold) {
-        return below_diff;
-      }
-    } else {
-      num_above = 0;
-      num_below = 0;
-      above_diff = 0;
-      below_diff = 0;
-    }
-
-    // See if there's any chance of making the threshold.
-    if (max(num_above, num_below) < minimum_by_now) {
-      // Didn't pass.
-      return 0;
-    }
-    ++minimum_by_now;
-  }
-
-  // Didn't pass.
-  return 0;
-}
-
 // Creates features in a regular grid, regardless of image contents.
 int32 seedFeatures(const Image<uint8>& frame,
                    const int32 num_x, const int32 num_y,
@@ -232,7 +228,7 @@ int32 seedFeatures(const Image<uint8>& frame,
 
 
 // Returns how likely a point in the image is to be a corner.
-float32 harrisFilter(const Image<int32>& I_x, const Image<int32>& I_y,
+float32 harrisFilter(const Image<int16>& I_x, const Image<int16>& I_y,
                      const int32 x, const int32 y) {
   // Image gradient matrix.
   float32 G[] = { 0, 0, 0, 0 };
@@ -262,116 +258,73 @@ float32 harrisFilter(const Image<int32>& I_x, const Image<int32>& I_y,
 }
 
 // FAST feature detector.
-int32 findFastFeatures(const Image<uint8>& frame, const int32 max_num_features,
+int32 findFastFeatures(const Image<uint8>& frame,
+                       const Image<int16>& I_x, const Image<int16>& I_y,
+                       Image<int32>* const cell_grid,
                        Point2D* const features,
-                       Image<uint8>* const best_feature_map) {
-  /*
-   // Reference for a circle of diameter 7.
-   const int32 circle[] = {0, 0, 1, 1, 1, 0, 0,
-                           0, 1, 0, 0, 0, 1, 0,
-                           1, 0, 0, 0, 0, 0, 1,
-                           1, 0, 0, 0, 0, 0, 1,
-                           1, 0, 0, 0, 0, 0, 1,
-                           0, 1, 0, 0, 0, 1, 0,
-                           0, 0, 1, 1, 1, 0, 0};
-   const int32 circle_offset[] =
-       {2, 3, 4, 8, 12, 14, 20, 21, 27, 28, 34, 36, 40, 44, 45, 46};
-   */
-
-  // Quick test of compass directions.  Any length 16 circle with a break of up
-  // to 4 pixels will have at least 3 of these 4 pixels active.
-  static const int32 short_circle_perimeter = 4;
-  static const int32 short_threshold = 3;
-  static const int32 short_circle_x[] = { -3,  0, +3,  0 };
-  static const int32 short_circle_y[] = {  0, -3,  0, +3 };
-
-  // Precompute image offsets.
-  int32 short_offsets[short_circle_perimeter];
-  for (int i = 0; i < short_circle_perimeter; ++i) {
-    short_offsets[i] = short_circle_x[i] + short_circle_y[i] * frame.getWidth();
-  }
-
-  // Large circle values.
-  static const int32 full_circle_perimeter = 16;
-  static const int32 full_threshold = 12;
-  static const int32 full_circle_x[] =
-      { -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2, -3, -3, -3, -2 };
-  static const int32 full_circle_y[] =
-      { -3, -3, -3, -2, -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2 };
-
-  // Precompute image offsets.
-  int32 full_offsets[full_circle_perimeter];
-  for (int i = 0; i < full_circle_perimeter; ++i) {
-    full_offsets[i] = full_circle_x[i] + full_circle_y[i] * frame.getWidth();
-  }
-
-  const int frame_width = frame.getWidth();
+                       Image<uint8>* const corner_map) {
+  const int32 frame_width = frame.getWidth();
 
-  const int end_y = frame.getHeight() - FAST_BORDER_BUFFER;
-  const int end_x = frame.getWidth() - FAST_BORDER_BUFFER;
+  const int32 end_y = frame.getHeight() - FAST_BORDER_BUFFER;
+  const int32 end_x = frame.getWidth() - FAST_BORDER_BUFFER;
 
-  best_feature_map->clear(0);
+  if (end_x - FAST_BORDER_BUFFER < 3 || end_y - FAST_BORDER_BUFFER < 3) {
+    return 0;
+  }
 
-  // Loop through once to find FAST feature clumps.
+  // Mark every pixel that passes the FAST test, a vector of pixels at a time.
   for (int32 img_y = FAST_BORDER_BUFFER; img_y < end_y; ++img_y) {
-    const uint8* curr_pixel_ptr =
-        frame.getPixelPtrConst(FAST_BORDER_BUFFER, img_y);
-
-    for (int32 img_x = FAST_BORDER_BUFFER; img_x < end_x; ++img_x) {
-      // Only insert it if it meets the quick minimum requirements test.
-      if (testCircle(short_circle_perimeter, short_threshold,
-                     curr_pixel_ptr, short_offsets) != 0) {
-
-        // Longer test for actual feature score..
-        const int32 fast_score = testCircle(full_circle_perimeter,
-                                            full_threshold,
-                                            curr_pixel_ptr,
-                                            full_offsets);
-
-        // Non-zero score means the feature was found.
-        if (fast_score != 0) {
-          uint8* const center_ptr = best_feature_map->getPixelPtr(img_x, img_y);
-
-          // Increase the feature count on this pixel and the pixels in all
-          // 4 cardinal directions.
-          *center_ptr += 5;
-          *(center_ptr - 1) += 1;
-          *(center_ptr + 1) += 1;
-          *(center_ptr - frame_width) += 1;
-          *(center_ptr + frame_width) += 1;
-        }
-      }
-
-      ++curr_pixel_ptr;
-    }  // x
-  }  // y
+    fastCornerRowKernel(frame.getPixelPtrConst(FAST_BORDER_BUFFER, img_y),
+                        frame_width, end_x - FAST_BORDER_BUFFER,
+                        FAST_ARC_LENGTH, FAST_DIFF_AMOUNT,
+                        corner_map->getPixelPtr(FAST_BORDER_BUFFER, img_y));
+  }
 
   timeLog("Found FAST features");
 
+  cell_grid->clear(-1);
+
   int32 num_features = 0;
-  // Loop through again and Harris filter pixels in the center of clumps.
-  // We can shrink the window by 1 pixel on every side.
+  // Loop through again and Harris filter pixels in the center of clumps,
+  // keeping only the best in each cell. We can shrink the window by 1 pixel on
+  // every side.
   for (int32 img_y = FAST_BORDER_BUFFER + 1; img_y < end_y - 1; ++img_y) {
-    const int32 start_x = FAST_BORDER_BUFFER + 1;
+    const uint8* const corners = corner_map->getPixelPtrConst(0, img_y);
+    int32* const cells =
+        cell_grid->getPixelPtr(0, img_y / SELECTION_CELL_SIZE);
 
-    const uint8* curr_pixel_ptr =
-        best_feature_map->getPixelPtrConst(start_x, img_y);
+    for (int32 img_x = FAST_BORDER_BUFFER + 1; img_x < end_x - 1; ++img_x) {
+      if (!corners[img_x]) {
+        continue;
+      }
 
-    for (int32 img_x = start_x; img_x < end_x - 1; ++img_x) {
-      if (*curr_pixel_ptr >= MIN_NUM_CONNECTED) {
-        Point2D* const feature = features + num_features;
-        feature->x = img_x;
-        feature->y = img_y;
-        feature->score = 0;
-        feature->type = FEATURE_FAST;
+      // A corner counts 5 for itself and 1 for each of its 4 cardinal
+      // neighbours.
+      const int32 num_connected = 5 * corners[img_x] +
+          corners[img_x - 1] + corners[img_x + 1] +
+          corners[img_x - frame_width] + corners[img_x + frame_width];
+      if (num_connected < MIN_NUM_CONNECTED) {
+        continue;
+      }
 
+      const float32 score = harrisFilter(I_x, I_y, img_x, img_y);
+      if (score <= 0.0f) {
+        continue;
+      }
+
+      int32* const cell = cells + img_x / SELECTION_CELL_SIZE;
+      if (*cell < 0) {
+        *cell = num_features;
         ++num_features;
-        if (num_features >= max_num_features) {
-          return num_features;
-        }
+      } else if (score <= features[*cell].score) {
+        continue;
       }
 
-      ++curr_pixel_ptr;
+      Point2D* const feature = features + *cell;
+      feature->x = img_x;
+      feature->y = img_y;
+      feature->score = score;
+      feature->type = FEATURE_FAST;
     }  // x
   }  // y
 
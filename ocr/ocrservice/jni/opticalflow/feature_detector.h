@@ -6,6 +6,11 @@
 
 namespace flow {
 
+// Side of the square cells candidates are bucketed in for non-max
+// suppression. Its diagonal must be less than the minimum feature distance,
+// so that no two features in one cell are ever both selected.
+#define SELECTION_CELL_SIZE 4
+
 // Add features along a regular grid.
 int32 seedFeatures(const Image<uint8>& frame,
                    const int32 num_x, const int32 num_y,
@@ -14,30 +19,35 @@ int32 seedFeatures(const Image<uint8>& frame,
                    const int32 type, Point2D* const features);
 
 // Compute the corneriness of a point in the image.
-float32 harrisFilter(const Image<int32>& I_x, const Image<int32>& I_y,
+float32 harrisFilter(const Image<int16>& I_x, const Image<int16>& I_y,
                      const int32 x, const int32 y);
 
 // Scan the frame for potential features using the FAST feature detector.
+// Returns the best Harris-scored candidate in each SELECTION_CELL_SIZE cell,
+// so features needs room for one feature per pixel of cell_grid. cell_grid
+// and corner_map are scratch.
 int32 findFastFeatures(const Image<uint8>& frame,
-                       const int32 max_num_features,
+                       const Image<int16>& I_x, const Image<int16>& I_y,
+                       Image<int32>* const cell_grid,
                        Point2D* const features,
-                       Image<uint8>* const best_feature_map);
+                       Image<uint8>* const corner_map);
 
 // Score a bunch of candidate features.  Assigns the scores to the input
 // candidate_features array entries.
-void scoreFeatures(const Image<int32>& I_x, const Image<int32>& I_y,
+void scoreFeatures(const Image<int16>& I_x, const Image<int16>& I_y,
                    const int32 num_candidates,
                    Point2D* const candidate_features);
 
 // Copy the best features (with local non-max suppression) from
-// candidate_features to final_features.
+// candidate_features to final_features. Reorders candidate_features, and uses
+// cell_grid, one pixel per SELECTION_CELL_SIZE cell of the frame, as scratch.
 // Returns the number of features copied.
 int32 sortAndSelect(const int32 num_candidates,
                     const int32 max_features,
                     const Image<bool>& interest_map,
                     Point2D* const candidate_features,
                     Point2D* const final_features,
-                    Image<uint8>* const best_feature_map);
+                    Image<int32>* const cell_grid);
 
 }  // namespace flow
 
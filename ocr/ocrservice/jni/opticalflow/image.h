@@ -4,7 +4,10 @@
 #ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_H_
 #define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_H_
 
+#include <string.h>
+
 #include "optical_flow_utils.h"
+#include "image_kernels.h"
 
 // TODO(andrewharp): Make this a cast to uint32 if/when we go unsigned for
 // operations.
@@ -42,6 +45,7 @@ template <typename T>
 class Image {
  public:
   Image(const int32 width, const int32 height) :
+      owns_data_(true),
       width_(width),
       height_(height),
       width_less_one_(width_ - 1),
@@ -51,6 +55,7 @@ class Image {
   }
 
   explicit Image(const Size& size) :
+      owns_data_(true),
       width_(size.width),
       height_(size.height),
       width_less_one_(width_ - 1),
@@ -60,8 +65,11 @@ class Image {
   }
 
   // Constructor that creates an image from preallocated data.
-  // Note: The image takes ownership of the data.
-  Image(const int32 width, const int32 height, T* const image) :
+  // Note: The image takes ownership of the data unless owns_data is false, in
+  // which case the data must outlive the image.
+  Image(const int32 width, const int32 height, T* const image,
+        const bool owns_data = true) :
+      owns_data_(owns_data),
       width_(width),
       height_(height),
       width_less_one_(width_ - 1),
@@ -74,7 +82,9 @@ class Image {
   }
 
   ~Image() {
-    free(image_data_);
+    if (owns_data_) {
+      free(image_data_);
+    }
   }
 
   inline int32 getWidth() const { return width_; }
@@ -102,32 +112,6 @@ class Image {
 
     const T* const pix_ptr = getPixelPtrConst(floored_x, floored_y);
 
-// Experimental NEON acceleration... not to be turned on until it's faster.
-#if FALSE
-#ifdef HAVE_ARMEABI_V7A
-    if (supportsNeon()) {
-      // Output value:
-      // a * c * p1 +
-      // b * c * p2 +
-      // a * d * p3 +
-      // b * d * p4
-      const float32x2_t ab = {a, b};
-      const float32x4_t ab_c_ab_d = vcombine_f32(vmul_n_f32(ab, c),
-                                                 vmul_n_f32(ab, d));
-
-      const float32x4_t p1p2p3p4 = {pix_ptr[0], pix_ptr[1],
-                                    pix_ptr[width_], pix_ptr[width_ + 1]};
-
-      float32x4_t almost = vmulq_f32(ab_c_ab_d, p1p2p3p4);
-
-      // Butterfly-ish sum.
-      almost = vaddq_f32(vrev64q_f32(almost), almost);
-
-      return vgetq_lane_f32(almost, 0) + vgetq_lane_f32(almost, 1);
-    }
-#endif
-#endif
-
     // Get the pixel values surrounding this point.
     const T& p1 = pix_ptr[0];
     const T& p2 = pix_ptr[1];
@@ -198,100 +182,10 @@ class Image {
   }
 
 
-#ifdef HAVE_ARMEABI_V7A
-  // This function does the bulk of the work.
-  inline void downsample32ColumnsNeon(const uint8* const original,
-                                      const int32 stride,
-                                      const int32 orig_x) {
-    // Divide input x offset by 4 to find output offset.
-    const int32 new_x = orig_x >> 2;
-
-    // Initial offset into top row.
-    const uint8* offset = original + orig_x;
-
-    // Sum along vertical columns.
-    // Process 32x4 input pixels and 8x1 output pixels per iteration.
-    for (int32 new_y = 0; new_y < height_; ++new_y) {
-      uint16x8_t accum1 = vdupq_n_u16(0);
-      uint16x8_t accum2 = vdupq_n_u16(0);
-
-      // Go top to bottom across the four rows of input pixels that make up
-      // this output row.
-      for (int32 row_num = 0; row_num < 4; ++row_num) {
-        // First 16 bytes.
-        {
-          // Load 32 bytes of data from current offset.
-          const uint8x16_t curr_data1 = vld1q_u8(offset);
-          // Pairwise add and accumulate into accum vectors (16 bit to account
-          // for values above 255).
-          accum1 = vpadalq_u8(accum1, curr_data1);
-        }
-
-        // Second 16 bytes.
-        {
-          // Load 32 bytes of data from current offset.
-          const uint8x16_t curr_data2 = vld1q_u8(offset + 16);
-          // Pairwise add and accumulate into accum vectors (16 bit to account
-          // for values above 255).
-          accum2 = vpadalq_u8(accum2, curr_data2);
-        }
-
-        // Move offset down one row.
-        offset += stride;
-      }
-
-      // Add and widen, then divide by 16 (number of input pixels per output
-      // pixel) and narrow data from 32 bits per pixel to 16 bpp.
-      const uint16x4_t tmp_pix1 = vqshrn_n_u32(vpaddlq_u16(accum1), 4);
-      const uint16x4_t tmp_pix2 = vqshrn_n_u32(vpaddlq_u16(accum2), 4);
-
-      // Combine 4x1 pixel strips into 8x1 pixel strip and narrow from
-      // 16 bits to 8 bits per pixel.
-      const uint8x8_t allpixels = vmovn_u16(vcombine_u16(tmp_pix1, tmp_pix2));
-
-      // This points to the leftmost pixel of our 8 horizontally arranged
-      // pixels in the destination data.
-      uint8* const ptr_dst = getPixelPtr(new_x, new_y);
-
-      // Copy all pixels from composite 8x1 vector into output strip.
-      vst1_u8(ptr_dst, allpixels);
-    }
-  }
-
-
-  // Hardware accelerated downsampling method for supported devices.
-  // Requires that image size be a multiple of 16 pixels in each dimension,
-  // and that downsampling be by a factor of 4.
-  void downsampleAveragedNeon(const uint8* const original,
-                              const int32 stride) {
-    // Hardcoded to only work on 4x downsampling.
-    const int32 orig_width = width_ * 4;
-
-    // We process 32 input pixels lengthwise at a time.
-    // The output per pass of this loop is an 8 wide by 1 tall pixel strip.
-    for (int32 orig_x = 0; orig_x < orig_width; orig_x += 32) {
-      // Push it to the left enough so that it never goes out of bounds.
-      // This will result in some extra computation on the last pass on
-      // devices whose frame widths are not multiples of 32.
-      downsample32ColumnsNeon(original, stride, min(orig_x, orig_width - 32));
-    }
-  }
-#endif
-
-
   // Naive downsampler that reduces image size by factor by averaging pixels in
   // blocks of size factor x factor.
   void downsampleAveraged(const T* const original, const int32 stride,
                           const int32 factor) {
-#ifdef HAVE_ARMEABI_V7A
-    if (supportsNeon() &&
-        factor == 4 &&
-        (height_ % 4) == 0) {
-      downsampleAveragedNeon(original, stride);
-      return;
-    }
-#endif
-
     const int32 pixels_per_block = factor * factor;
 
     // For every pixel in resulting image.
@@ -425,7 +319,7 @@ class Image {
     return (3 * (original.getPixel(max_x, min_y)
                  + original.getPixel(max_x, max_y)
                  - original.getPixel(min_x, min_y)
-                 - original.getPixel(min_x, min_y))
+                 - original.getPixel(min_x, max_y))
             + 10 * (original.getPixel(max_x, center_y)
                     - original.getPixel(min_x, center_y))) / 32;
   }
@@ -578,6 +472,7 @@ class Image {
   }
 
   T* image_data_;
+  const bool owns_data_;
   int32 width_;
   int32 height_;
 
@@ -591,6 +486,39 @@ class Image {
 };
 
 
+// 8-bit images run the pyramid and gradient operations through the
+// vectorized kernels in image_kernels.h. The generic versions above remain
+// for other pixel types.
+template <>
+inline void Image<uint8>::downsampleAveraged(const uint8* const original,
+                                             const int32 stride,
+                                             const int32 factor) {
+  downsampleAveragedKernel(original, stride, factor,
+                           image_data_, width_, height_);
+}
+
+template <>
+inline void Image<uint8>::downsampleSmoothed3x3(const Image<uint8>& original) {
+  downsampleSmoothed3x3Kernel(original.image_data_,
+                              original.width_, original.height_,
+                              image_data_, width_, height_);
+}
+
+template <>
+template <>
+inline void Image<int16>::derivativeX(const Image<uint8>& original) {
+  derivativeXKernel(original.getPixelPtrConst(0, 0), width_, height_,
+                    image_data_);
+}
+
+template <>
+template <>
+inline void Image<int16>::derivativeY(const Image<uint8>& original) {
+  derivativeYKernel(original.getPixelPtrConst(0, 0), width_, height_,
+                    image_data_);
+}
+
+
 // Create a pyramid of downsampled images. The first level of the pyramid is the
 // original image.
 inline void computeSmoothedPyramid(const Image<uint8>& frame,
@@ -612,8 +540,8 @@ inline void computeSmoothedPyramid(const Image<uint8>& frame,
 // Create a spatial derivative pyramid based on a downsampled pyramid.
 inline void computeSpatialPyramid(const Image<uint8>** const pyramid,
                                   const int32 num_levels,
-                                  Image<int32>** pyramid_x,
-                                  Image<int32>** pyramid_y) {
+                                  Image<int16>** pyramid_x,
+                                  Image<int16>** pyramid_y) {
   for (int32 l = 0; l < num_levels; ++l) {
     const Image<uint8>& frame = *pyramid[l];
 
@@ -709,9 +637,10 @@ inline void calculateG(const float32* const vals_x, const float32* const vals_y,
       yy = vmlaq_f32(yy, y, y);
     }
 
-    static float32_t xx_vals[4];
-    static float32_t xy_vals[4];
-    static float32_t yy_vals[4];
+    // Kept on the stack, as windows are tracked from several threads.
+    float32_t xx_vals[4];
+    float32_t xy_vals[4];
+    float32_t yy_vals[4];
 
     vst1q_f32(xx_vals, xx);
     vst1q_f32(xy_vals, xy);
@@ -743,7 +672,7 @@ inline void calculateG(const float32* const vals_x, const float32* const vals_y,
 // Looks up interpolated pixels, then calls above method for implementation.
 inline void calculateG(const int window_size,
                        const float32 center_x, const float center_y,
-                       const Image<int32>& I_x, const Image<int32>& I_y,
+                       const Image<int16>& I_x, const Image<int16>& I_y,
                        float* const G) {
   CHECK(I_x.validPixel(center_x, center_y), "Problem in calculateG!");
 
@@ -756,9 +685,10 @@ inline void calculateG(const int window_size,
   static const int kWindowBufferSize =
       (kMaxWindowRadius * 2 + 1) * (kMaxWindowRadius * 2 + 1);
 
-  // Preallocate buffers statically for efficiency.
-  static float32 vals_x[kWindowBufferSize];
-  static float32 vals_y[kWindowBufferSize];
+  // On the stack rather than static, so features can be scored from several
+  // threads at once.
+  float32 vals_x[kWindowBufferSize];
+  float32 vals_y[kWindowBufferSize];
 
   int32 num_vals = 0;
 
@@ -0,0 +1,1383 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Each vector row function processes whole blocks starting at a given x and
+// returns the first x it did not process. AVX2 rows are finished with SSE2
+// blocks, then the scalar code handles what is left and the clamped edge
+// pixels.
+
+// Intrinsics headers have to come before the min/max macros in utils.h.
+#if defined(__i386__) || defined(__x86_64__)
+#define FLOW_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#include <string.h>
+
+#include "utils.h"
+
+#include "image_kernels.h"
+
+namespace flow {
+
+static int32 kernel_level = -1;
+
+// Scalar kernels.
+
+static inline int32 halfDiff(const int32 first, const int32 second) {
+  return (second - first) / 2;
+}
+
+static inline uint8 averagedPixel(const uint8* const src, const int32 stride,
+                                  const int32 factor, const int32 x) {
+  const uint8* p = src + x * factor;
+
+  // Making this int32 so larger factors can't overflow.
+  int32 pixel_sum = 0;
+
+  for (int32 row = 0; row < factor; ++row) {
+    for (int32 col = 0; col < factor; ++col) {
+      pixel_sum += p[col];
+    }
+    p += stride;
+  }
+
+  return pixel_sum / (factor * factor);
+}
+
+static inline uint8 smoothedPixel(const uint8* const r0, const uint8* const r1,
+                                  const uint8* const r2, const int32 src_width,
+                                  const int32 x) {
+  const int32 orig_x = clip(2 * x, 0, src_width - 1);
+  const int32 min_x = clip(orig_x - 1, 0, src_width - 1);
+  const int32 max_x = clip(orig_x + 1, 0, src_width - 1);
+
+  const int32 pixel_sum = r1[orig_x] * 4 +
+      (r1[max_x] + r1[min_x] + r2[orig_x] + r0[orig_x]) * 2 +
+      (r2[max_x] + r2[min_x] + r0[max_x] + r0[min_x]);
+
+  return pixel_sum >> 4;
+}
+
+// The 16-pixel Bresenham circle of radius 3 that FAST tests, clockwise from
+// the top.
+static const int32 kFastCircleX[] =
+    { -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2, -3, -3, -3, -2 };
+static const int32 kFastCircleY[] =
+    { -3, -3, -3, -2, -1,  0, +1, +2, +3, +3, +3, +2, +1, +0, -1, -2 };
+
+// The circle's compass points. Any arc of n contiguous circle pixels covers at
+// least n / 4 of them, which makes for a cheap rejection test.
+static const int32 kFastCompass[] = { 1, 5, 9, 13 };
+
+#define FAST_CIRCLE_SIZE 16
+
+static inline uint8 fastCornerPixel(const uint8* const p,
+                                    const int32* const offsets,
+                                    const int32 arc_length,
+                                    const int32 threshold) {
+  const int32 bright = p[0] + threshold;
+  const int32 dark = p[0] - threshold;
+
+  const int32 min_compass = arc_length / 4;
+  int32 num_bright = 0;
+  int32 num_dark = 0;
+  for (int32 i = 0; i < 4; ++i) {
+    const int32 value = p[offsets[kFastCompass[i]]];
+    num_bright += value > bright;
+    num_dark += value < dark;
+  }
+  if (num_bright < min_compass && num_dark < min_compass) {
+    return 0;
+  }
+
+  // Go around the circle and then some, so arcs that wrap are counted too.
+  int32 run_bright = 0;
+  int32 run_dark = 0;
+  for (int32 i = 0; i < FAST_CIRCLE_SIZE + arc_length - 1; ++i) {
+    const int32 value = p[offsets[i % FAST_CIRCLE_SIZE]];
+    run_bright = value > bright ? run_bright + 1 : 0;
+    run_dark = value < dark ? run_dark + 1 : 0;
+    if (run_bright >= arc_length || run_dark >= arc_length) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// Window samples weighted as in Image::getPixelInterp, where a and b weight the
+// left and right columns and c and d the top and bottom rows.
+struct InterpWeights {
+  float32 a;
+  float32 b;
+  float32 c;
+  float32 d;
+};
+
+template <typename T>
+static inline float32 interpPixel(const T* const top, const T* const bottom,
+                                  const InterpWeights& w, const int32 x) {
+  return w.c * ((w.a * top[x]) + (w.b * top[x + 1])) +
+         w.d * ((w.a * bottom[x]) + (w.b * bottom[x + 1]));
+}
+
+#ifdef FLOW_KERNELS_X86
+
+#ifdef __SSE2__
+
+// SSE2 kernels.
+
+// Divides signed 16-bit lanes by 2^shift, rounding toward zero like C does.
+#define DIV_POW2_EPI16(v, shift) \
+    _mm_srai_epi16(_mm_add_epi16((v), _mm_srli_epi16(_mm_srai_epi16((v), 15), \
+                                                     16 - (shift))), (shift))
+
+// Sums adjacent byte pairs into 16-bit lanes.
+static inline __m128i pairSumsSSE2(const __m128i v) {
+  const __m128i low_bytes = _mm_set1_epi16(0xff);
+  return _mm_add_epi16(_mm_and_si128(v, low_bytes), _mm_srli_epi16(v, 8));
+}
+
+static int32 downsampleAveragedRowSSE2(const uint8* const src,
+                                       const int32 stride, const int32 factor,
+                                       const int32 width, uint8* const dst,
+                                       int32 x) {
+
+  if (factor == 2) {
+    for (; x + 16 <= width; x += 16) {
+      const uint8* const p = src + 2 * x;
+      __m128i sums[2];
+
+      for (int32 half = 0; half < 2; ++half) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (p + 16 * half));
+        const __m128i b =
+            _mm_loadu_si128((const __m128i*) (p + stride + 16 * half));
+        sums[half] = _mm_srli_epi16(
+            _mm_add_epi16(pairSumsSSE2(a), pairSumsSSE2(b)), 2);
+      }
+
+      _mm_storeu_si128((__m128i*) (dst + x),
+                       _mm_packus_epi16(sums[0], sums[1]));
+    }
+  } else if (factor == 4) {
+    const __m128i ones = _mm_set1_epi16(1);
+
+    for (; x + 16 <= width; x += 16) {
+      const uint8* const p = src + 4 * x;
+      __m128i sums[4];
+
+      // Each chunk of 16 input columns makes 4 output pixels.
+      for (int32 chunk = 0; chunk < 4; ++chunk) {
+        __m128i acc = _mm_setzero_si128();
+
+        for (int32 row = 0; row < 4; ++row) {
+          acc = _mm_add_epi16(acc, pairSumsSSE2(_mm_loadu_si128(
+              (const __m128i*) (p + row * stride + 16 * chunk))));
+        }
+
+        sums[chunk] = _mm_srli_epi32(_mm_madd_epi16(acc, ones), 4);
+      }
+
+      _mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(
+          _mm_packs_epi32(sums[0], sums[1]),
+          _mm_packs_epi32(sums[2], sums[3])));
+    }
+  }
+
+  return x;
+}
+
+// Left + 2 * center + right for the 8 output pixels at x.
+static inline __m128i smoothedRow8SSE2(const uint8* const row, const int32 x) {
+  const __m128i low_bytes = _mm_set1_epi16(0xff);
+  const __m128i a = _mm_loadu_si128((const __m128i*) (row + 2 * x - 1));
+  const __m128i b = _mm_loadu_si128((const __m128i*) (row + 2 * x + 1));
+
+  const __m128i left = _mm_and_si128(a, low_bytes);
+  const __m128i center = _mm_srli_epi16(a, 8);
+  const __m128i right = _mm_and_si128(b, low_bytes);
+
+  return _mm_add_epi16(_mm_add_epi16(left, right), _mm_slli_epi16(center, 1));
+}
+
+static inline __m128i smoothed8SSE2(const uint8* const r0,
+                                    const uint8* const r1,
+                                    const uint8* const r2, const int32 x) {
+  const __m128i sum = _mm_add_epi16(
+      _mm_add_epi16(smoothedRow8SSE2(r0, x), smoothedRow8SSE2(r2, x)),
+      _mm_slli_epi16(smoothedRow8SSE2(r1, x), 1));
+
+  return _mm_srli_epi16(sum, 4);
+}
+
+static int32 downsampleSmoothedRowSSE2(const uint8* const r0,
+                                       const uint8* const r1,
+                                       const uint8* const r2,
+                                       const int32 src_width,
+                                       const int32 width, uint8* const dst,
+                                       int32 x) {
+
+  for (; x + 16 <= width && 2 * x + 33 <= src_width; x += 16) {
+    _mm_storeu_si128((__m128i*) (dst + x),
+                     _mm_packus_epi16(smoothed8SSE2(r0, r1, r2, x),
+                                      smoothed8SSE2(r0, r1, r2, x + 8)));
+  }
+
+  return x;
+}
+
+// Half differences of next - prev for 16 pixels.
+static inline void halfDiff16SSE2(const uint8* const prev,
+                                  const uint8* const next, int16* const dst) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i a = _mm_loadu_si128((const __m128i*) prev);
+  const __m128i b = _mm_loadu_si128((const __m128i*) next);
+
+  const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(b, zero),
+                                   _mm_unpacklo_epi8(a, zero));
+  const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(b, zero),
+                                   _mm_unpackhi_epi8(a, zero));
+
+  _mm_storeu_si128((__m128i*) dst, DIV_POW2_EPI16(lo, 1));
+  _mm_storeu_si128((__m128i*) (dst + 8), DIV_POW2_EPI16(hi, 1));
+}
+
+static int32 derivativeXRowSSE2(const uint8* const row, const int32 width,
+                                int16* const dst,
+                                int32 x) {
+
+  for (; x + 17 <= width; x += 16) {
+    halfDiff16SSE2(row + x - 1, row + x + 1, dst + x);
+  }
+
+  return x;
+}
+
+static int32 derivativeYRowSSE2(const uint8* const prev,
+                                const uint8* const next, const int32 width,
+                                int16* const dst,
+                                int32 x) {
+
+  for (; x + 16 <= width; x += 16) {
+    halfDiff16SSE2(prev + x, next + x, dst + x);
+  }
+
+  return x;
+}
+
+// Converts four consecutive pixels to floats.
+static inline __m128 loadFloats4SSE2(const uint8* const p) {
+  int32 word;
+  memcpy(&word, p, sizeof(word));
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+}
+
+static inline __m128 loadFloats4SSE2(const int16* const p) {
+  const __m128i v = _mm_loadl_epi64((const __m128i*) p);
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+template <typename T>
+static inline void sampleWindow4SSE2(const T* const top, const T* const bottom,
+                                     const InterpWeights& w,
+                                     float32* const dst, const int32 x) {
+  const __m128 a = _mm_set1_ps(w.a);
+  const __m128 b = _mm_set1_ps(w.b);
+
+  const __m128 top_sum = _mm_add_ps(_mm_mul_ps(a, loadFloats4SSE2(top + x)),
+                                    _mm_mul_ps(b, loadFloats4SSE2(top + x + 1)));
+  const __m128 bottom_sum =
+      _mm_add_ps(_mm_mul_ps(a, loadFloats4SSE2(bottom + x)),
+                 _mm_mul_ps(b, loadFloats4SSE2(bottom + x + 1)));
+
+  _mm_storeu_ps(dst + x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w.c), top_sum),
+                                    _mm_mul_ps(_mm_set1_ps(w.d), bottom_sum)));
+}
+
+// Window rows are short, so a partial last block is redone overlapping the
+// previous one instead of being left to the scalar code.
+template <typename T>
+static int32 sampleWindowRowSSE2(const T* const top, const T* const bottom,
+                                 const InterpWeights& w, const int32 size,
+                                 float32* const dst, int32 x) {
+  for (; x + 4 <= size; x += 4) {
+    sampleWindow4SSE2(top, bottom, w, dst, x);
+  }
+
+  if (x < size && size >= 4) {
+    sampleWindow4SSE2(top, bottom, w, dst, size - 4);
+    x = size;
+  }
+
+  return x;
+}
+
+static inline float32 horizontalSumSSE2(const __m128 v) {
+  const __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static int32 windowMomentsSSE2(const float32* const values,
+                               const float32* const a, const float32* const b,
+                               const int32 num_vals, const float32 offset,
+                               float32* const sums) {
+  const __m128 offsets = _mm_set1_ps(offset);
+
+  __m128 sum = _mm_setzero_ps();
+  __m128 sum_sq = _mm_setzero_ps();
+  __m128 sum_a = _mm_setzero_ps();
+  __m128 sum_b = _mm_setzero_ps();
+
+  int32 i = 0;
+  for (; i + 4 <= num_vals; i += 4) {
+    const __m128 v = _mm_sub_ps(_mm_loadu_ps(values + i), offsets);
+    sum = _mm_add_ps(sum, v);
+    sum_sq = _mm_add_ps(sum_sq, _mm_mul_ps(v, v));
+    sum_a = _mm_add_ps(sum_a, _mm_mul_ps(v, _mm_loadu_ps(a + i)));
+    sum_b = _mm_add_ps(sum_b, _mm_mul_ps(v, _mm_loadu_ps(b + i)));
+  }
+
+  sums[0] += horizontalSumSSE2(sum);
+  sums[1] += horizontalSumSSE2(sum_sq);
+  sums[2] += horizontalSumSSE2(sum_a);
+  sums[3] += horizontalSumSSE2(sum_b);
+
+  return i;
+}
+
+// Tests the 16 pixels at row + x at once. Lanes hold all ones where a circle
+// pixel is not brighter (or not darker) than the center by more than the
+// threshold, and the arc runs are counted per lane.
+static int32 fastCornerRowSSE2(const uint8* const row,
+                               const int32* const offsets,
+                               const int32 width, const int32 arc_length,
+                               const int32 threshold, uint8* const dst,
+                               int32 x) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i thresholds = _mm_set1_epi8(static_cast<char>(threshold));
+  const __m128i arc = _mm_set1_epi8(arc_length);
+  const __m128i max_misses = _mm_set1_epi8(4 - arc_length / 4);
+
+  for (; x + 16 <= width; x += 16) {
+    const uint8* const p = row + x;
+    const __m128i center = _mm_loadu_si128((const __m128i*) p);
+    const __m128i bright = _mm_adds_epu8(center, thresholds);
+    const __m128i dark = _mm_subs_epu8(center, thresholds);
+
+    __m128i not_bright[FAST_CIRCLE_SIZE];
+    __m128i not_dark[FAST_CIRCLE_SIZE];
+
+    // Count the compass points that miss, and skip the block if every lane
+    // misses too many for both signs.
+    __m128i bright_misses = zero;
+    __m128i dark_misses = zero;
+    for (int32 k = 0; k < 4; ++k) {
+      const int32 i = kFastCompass[k];
+      const __m128i v = _mm_loadu_si128((const __m128i*) (p + offsets[i]));
+      not_bright[i] = _mm_cmpeq_epi8(_mm_subs_epu8(v, bright), zero);
+      not_dark[i] = _mm_cmpeq_epi8(_mm_subs_epu8(dark, v), zero);
+      bright_misses = _mm_sub_epi8(bright_misses, not_bright[i]);
+      dark_misses = _mm_sub_epi8(dark_misses, not_dark[i]);
+    }
+
+    const __m128i rejected =
+        _mm_and_si128(_mm_cmpgt_epi8(bright_misses, max_misses),
+                      _mm_cmpgt_epi8(dark_misses, max_misses));
+    if (_mm_movemask_epi8(rejected) == 0xFFFF) {
+      _mm_storeu_si128((__m128i*) (dst + x), zero);
+      continue;
+    }
+
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE; ++i) {
+      if (i % 4 != 1) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (p + offsets[i]));
+        not_bright[i] = _mm_cmpeq_epi8(_mm_subs_epu8(v, bright), zero);
+        not_dark[i] = _mm_cmpeq_epi8(_mm_subs_epu8(dark, v), zero);
+      }
+    }
+
+    __m128i run_bright = zero;
+    __m128i run_dark = zero;
+    __m128i found = zero;
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE + arc_length - 1; ++i) {
+      const int32 index = i % FAST_CIRCLE_SIZE;
+      run_bright = _mm_andnot_si128(not_bright[index],
+                                    _mm_add_epi8(run_bright, one));
+      run_dark = _mm_andnot_si128(not_dark[index],
+                                  _mm_add_epi8(run_dark, one));
+      found = _mm_or_si128(found, _mm_or_si128(_mm_cmpeq_epi8(run_bright, arc),
+                                               _mm_cmpeq_epi8(run_dark, arc)));
+    }
+
+    _mm_storeu_si128((__m128i*) (dst + x), _mm_and_si128(found, one));
+  }
+
+  return x;
+}
+
+#endif  // __SSE2__
+
+// AVX2 kernels.
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define DIV_POW2_EPI16_AVX2(v, shift) \
+    _mm256_srai_epi16(_mm256_add_epi16((v), _mm256_srli_epi16( \
+        _mm256_srai_epi16((v), 15), 16 - (shift))), (shift))
+
+static inline AVX2_TARGET __m256i pairSumsAVX2(const __m256i v) {
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+  return _mm256_add_epi16(_mm256_and_si256(v, low_bytes),
+                          _mm256_srli_epi16(v, 8));
+}
+
+static inline AVX2_TARGET __m256i load16AVX2(const uint8* const p) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) p));
+}
+
+static AVX2_TARGET int32 downsampleAveragedRowAVX2(const uint8* const src,
+                                                   const int32 stride,
+                                                   const int32 factor,
+                                                   const int32 width,
+                                                   uint8* const dst,
+                                                   int32 x) {
+
+  if (factor == 2) {
+    for (; x + 32 <= width; x += 32) {
+      const uint8* const p = src + 2 * x;
+      __m256i sums[2];
+
+      for (int32 half = 0; half < 2; ++half) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*) (p + 32 * half));
+        const __m256i b =
+            _mm256_loadu_si256((const __m256i*) (p + stride + 32 * half));
+        sums[half] = _mm256_srli_epi16(
+            _mm256_add_epi16(pairSumsAVX2(a), pairSumsAVX2(b)), 2);
+      }
+
+      // Packing interleaves 128-bit lanes; put pixels back in order.
+      _mm256_storeu_si256((__m256i*) (dst + x), _mm256_permute4x64_epi64(
+          _mm256_packus_epi16(sums[0], sums[1]), 0xd8));
+    }
+  } else if (factor == 4) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    for (; x + 32 <= width; x += 32) {
+      const uint8* const p = src + 4 * x;
+      __m256i sums[4];
+
+      // Each chunk of 32 input columns makes 8 output pixels.
+      for (int32 chunk = 0; chunk < 4; ++chunk) {
+        __m256i acc = _mm256_setzero_si256();
+
+        for (int32 row = 0; row < 4; ++row) {
+          acc = _mm256_add_epi16(acc, pairSumsAVX2(_mm256_loadu_si256(
+              (const __m256i*) (p + row * stride + 32 * chunk))));
+        }
+
+        sums[chunk] = _mm256_srli_epi32(_mm256_madd_epi16(acc, ones), 4);
+      }
+
+      const __m256i packed = _mm256_packus_epi16(
+          _mm256_packs_epi32(sums[0], sums[1]),
+          _mm256_packs_epi32(sums[2], sums[3]));
+      _mm256_storeu_si256((__m256i*) (dst + x),
+                          _mm256_permutevar8x32_epi32(packed, order));
+    }
+  }
+
+  return x;
+}
+
+static inline AVX2_TARGET __m256i smoothedRow16AVX2(const uint8* const row,
+                                                    const int32 x) {
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+  const __m256i a = _mm256_loadu_si256((const __m256i*) (row + 2 * x - 1));
+  const __m256i b = _mm256_loadu_si256((const __m256i*) (row + 2 * x + 1));
+
+  const __m256i left = _mm256_and_si256(a, low_bytes);
+  const __m256i center = _mm256_srli_epi16(a, 8);
+  const __m256i right = _mm256_and_si256(b, low_bytes);
+
+  return _mm256_add_epi16(_mm256_add_epi16(left, right),
+                          _mm256_slli_epi16(center, 1));
+}
+
+static inline AVX2_TARGET __m256i smoothed16AVX2(const uint8* const r0,
+                                                 const uint8* const r1,
+                                                 const uint8* const r2,
+                                                 const int32 x) {
+  const __m256i sum = _mm256_add_epi16(
+      _mm256_add_epi16(smoothedRow16AVX2(r0, x), smoothedRow16AVX2(r2, x)),
+      _mm256_slli_epi16(smoothedRow16AVX2(r1, x), 1));
+
+  return _mm256_srli_epi16(sum, 4);
+}
+
+static AVX2_TARGET int32 downsampleSmoothedRowAVX2(const uint8* const r0,
+                                                   const uint8* const r1,
+                                                   const uint8* const r2,
+                                                   const int32 src_width,
+                                                   const int32 width,
+                                                   uint8* const dst,
+                                                   int32 x) {
+
+  for (; x + 32 <= width && 2 * x + 65 <= src_width; x += 32) {
+    const __m256i packed = _mm256_packus_epi16(
+        smoothed16AVX2(r0, r1, r2, x), smoothed16AVX2(r0, r1, r2, x + 16));
+    _mm256_storeu_si256((__m256i*) (dst + x),
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+
+  return x;
+}
+
+static inline AVX2_TARGET void halfDiff16AVX2(const uint8* const prev,
+                                              const uint8* const next,
+                                              int16* const dst) {
+  const __m256i d = _mm256_sub_epi16(load16AVX2(next), load16AVX2(prev));
+  _mm256_storeu_si256((__m256i*) dst, DIV_POW2_EPI16_AVX2(d, 1));
+}
+
+static AVX2_TARGET int32 derivativeXRowAVX2(const uint8* const row,
+                                            const int32 width,
+                                            int16* const dst,
+                                            int32 x) {
+
+  for (; x + 17 <= width; x += 16) {
+    halfDiff16AVX2(row + x - 1, row + x + 1, dst + x);
+  }
+
+  return x;
+}
+
+static AVX2_TARGET int32 derivativeYRowAVX2(const uint8* const prev,
+                                            const uint8* const next,
+                                            const int32 width,
+                                            int16* const dst,
+                                            int32 x) {
+
+  for (; x + 16 <= width; x += 16) {
+    halfDiff16AVX2(prev + x, next + x, dst + x);
+  }
+
+  return x;
+}
+
+static AVX2_TARGET int32 fastCornerRowAVX2(const uint8* const row,
+                                           const int32* const offsets,
+                                           const int32 width,
+                                           const int32 arc_length,
+                                           const int32 threshold,
+                                           uint8* const dst, int32 x) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i thresholds = _mm256_set1_epi8(static_cast<char>(threshold));
+  const __m256i arc = _mm256_set1_epi8(arc_length);
+  const __m256i max_misses = _mm256_set1_epi8(4 - arc_length / 4);
+
+  for (; x + 32 <= width; x += 32) {
+    const uint8* const p = row + x;
+    const __m256i center = _mm256_loadu_si256((const __m256i*) p);
+    const __m256i bright = _mm256_adds_epu8(center, thresholds);
+    const __m256i dark = _mm256_subs_epu8(center, thresholds);
+
+    __m256i not_bright[FAST_CIRCLE_SIZE];
+    __m256i not_dark[FAST_CIRCLE_SIZE];
+
+    __m256i bright_misses = zero;
+    __m256i dark_misses = zero;
+    for (int32 k = 0; k < 4; ++k) {
+      const int32 i = kFastCompass[k];
+      const __m256i v =
+          _mm256_loadu_si256((const __m256i*) (p + offsets[i]));
+      not_bright[i] = _mm256_cmpeq_epi8(_mm256_subs_epu8(v, bright), zero);
+      not_dark[i] = _mm256_cmpeq_epi8(_mm256_subs_epu8(dark, v), zero);
+      bright_misses = _mm256_sub_epi8(bright_misses, not_bright[i]);
+      dark_misses = _mm256_sub_epi8(dark_misses, not_dark[i]);
+    }
+
+    const __m256i rejected =
+        _mm256_and_si256(_mm256_cmpgt_epi8(bright_misses, max_misses),
+                         _mm256_cmpgt_epi8(dark_misses, max_misses));
+    if (_mm256_movemask_epi8(rejected) == -1) {
+      _mm256_storeu_si256((__m256i*) (dst + x), zero);
+      continue;
+    }
+
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE; ++i) {
+      if (i % 4 != 1) {
+        const __m256i v =
+            _mm256_loadu_si256((const __m256i*) (p + offsets[i]));
+        not_bright[i] = _mm256_cmpeq_epi8(_mm256_subs_epu8(v, bright), zero);
+        not_dark[i] = _mm256_cmpeq_epi8(_mm256_subs_epu8(dark, v), zero);
+      }
+    }
+
+    __m256i run_bright = zero;
+    __m256i run_dark = zero;
+    __m256i found = zero;
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE + arc_length - 1; ++i) {
+      const int32 index = i % FAST_CIRCLE_SIZE;
+      run_bright = _mm256_andnot_si256(not_bright[index],
+                                       _mm256_add_epi8(run_bright, one));
+      run_dark = _mm256_andnot_si256(not_dark[index],
+                                     _mm256_add_epi8(run_dark, one));
+      found = _mm256_or_si256(found,
+                              _mm256_or_si256(_mm256_cmpeq_epi8(run_bright, arc),
+                                              _mm256_cmpeq_epi8(run_dark, arc)));
+    }
+
+    _mm256_storeu_si256((__m256i*) (dst + x), _mm256_and_si256(found, one));
+  }
+
+  return x;
+}
+
+#endif  // FLOW_KERNELS_X86
+
+#ifdef HAVE_ARMEABI_V7A
+
+// NEON kernels.
+
+// Divides signed 16-bit lanes by 2^shift, rounding toward zero like C does.
+#define DIV_POW2_S16_NEON(v, shift) \
+    vshrq_n_s16(vaddq_s16((v), vreinterpretq_s16_u16(vshrq_n_u16( \
+        vreinterpretq_u16_s16(vshrq_n_s16((v), 15)), 16 - (shift)))), (shift))
+
+static int32 downsampleAveragedRowNEON(const uint8* const src,
+                                       const int32 stride, const int32 factor,
+                                       const int32 width, uint8* const dst,
+                                       int32 x) {
+
+  if (factor == 2) {
+    for (; x + 16 <= width; x += 16) {
+      const uint8* const p = src + 2 * x;
+      uint8x8_t halves[2];
+
+      for (int32 half = 0; half < 2; ++half) {
+        uint16x8_t acc = vpaddlq_u8(vld1q_u8(p + 16 * half));
+        acc = vpadalq_u8(acc, vld1q_u8(p + stride + 16 * half));
+        halves[half] = vshrn_n_u16(acc, 2);
+      }
+
+      vst1q_u8(dst + x, vcombine_u8(halves[0], halves[1]));
+    }
+  } else if (factor == 4) {
+    for (; x + 16 <= width; x += 16) {
+      const uint8* const p = src + 4 * x;
+      uint16x4_t sums[4];
+
+      // Each chunk of 16 input columns makes 4 output pixels.
+      for (int32 chunk = 0; chunk < 4; ++chunk) {
+        uint16x8_t acc = vdupq_n_u16(0);
+
+        for (int32 row = 0; row < 4; ++row) {
+          acc = vpadalq_u8(acc, vld1q_u8(p + row * stride + 16 * chunk));
+        }
+
+        sums[chunk] = vshrn_n_u32(vpaddlq_u16(acc), 4);
+      }
+
+      vst1q_u8(dst + x, vcombine_u8(
+          vmovn_u16(vcombine_u16(sums[0], sums[1])),
+          vmovn_u16(vcombine_u16(sums[2], sums[3]))));
+    }
+  }
+
+  return x;
+}
+
+// Left + 2 * center + right for the 16 output pixels at x, as low and high
+// halves.
+static inline void smoothedRow16NEON(const uint8* const row, const int32 x,
+                                     uint16x8_t* const lo,
+                                     uint16x8_t* const hi) {
+  const uint8x16x2_t a = vld2q_u8(row + 2 * x - 1);
+  const uint8x16x2_t b = vld2q_u8(row + 2 * x + 1);
+
+  *lo = vaddq_u16(vaddl_u8(vget_low_u8(a.val[0]), vget_low_u8(b.val[0])),
+                  vshll_n_u8(vget_low_u8(a.val[1]), 1));
+  *hi = vaddq_u16(vaddl_u8(vget_high_u8(a.val[0]), vget_high_u8(b.val[0])),
+                  vshll_n_u8(vget_high_u8(a.val[1]), 1));
+}
+
+static int32 downsampleSmoothedRowNEON(const uint8* const r0,
+                                       const uint8* const r1,
+                                       const uint8* const r2,
+                                       const int32 src_width,
+                                       const int32 width, uint8* const dst,
+                                       int32 x) {
+
+  for (; x + 16 <= width && 2 * x + 33 <= src_width; x += 16) {
+    uint16x8_t lo0, hi0, lo1, hi1, lo2, hi2;
+
+    smoothedRow16NEON(r0, x, &lo0, &hi0);
+    smoothedRow16NEON(r1, x, &lo1, &hi1);
+    smoothedRow16NEON(r2, x, &lo2, &hi2);
+
+    const uint16x8_t lo = vaddq_u16(vaddq_u16(lo0, lo2), vshlq_n_u16(lo1, 1));
+    const uint16x8_t hi = vaddq_u16(vaddq_u16(hi0, hi2), vshlq_n_u16(hi1, 1));
+
+    vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(lo, 4), vshrn_n_u16(hi, 4)));
+  }
+
+  return x;
+}
+
+static inline void halfDiff16NEON(const uint8* const prev,
+                                  const uint8* const next, int16* const dst) {
+  const uint8x16_t a = vld1q_u8(prev);
+  const uint8x16_t b = vld1q_u8(next);
+
+  const int16x8_t lo = vreinterpretq_s16_u16(
+      vsubl_u8(vget_low_u8(b), vget_low_u8(a)));
+  const int16x8_t hi = vreinterpretq_s16_u16(
+      vsubl_u8(vget_high_u8(b), vget_high_u8(a)));
+
+  vst1q_s16(dst, DIV_POW2_S16_NEON(lo, 1));
+  vst1q_s16(dst + 8, DIV_POW2_S16_NEON(hi, 1));
+}
+
+static int32 derivativeXRowNEON(const uint8* const row, const int32 width,
+                                int16* const dst,
+                                int32 x) {
+
+  for (; x + 17 <= width; x += 16) {
+    halfDiff16NEON(row + x - 1, row + x + 1, dst + x);
+  }
+
+  return x;
+}
+
+static int32 derivativeYRowNEON(const uint8* const prev,
+                                const uint8* const next, const int32 width,
+                                int16* const dst,
+                                int32 x) {
+
+  for (; x + 16 <= width; x += 16) {
+    halfDiff16NEON(prev + x, next + x, dst + x);
+  }
+
+  return x;
+}
+
+// Converts four consecutive pixels to floats.
+static inline float32x4_t loadFloats4NEON(const uint8* const p) {
+  uint32 word;
+  memcpy(&word, p, sizeof(word));
+  const uint8x8_t v = vreinterpret_u8_u32(vdup_n_u32(word));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(v))));
+}
+
+static inline float32x4_t loadFloats4NEON(const int16* const p) {
+  return vcvtq_f32_s32(vmovl_s16(vld1_s16(p)));
+}
+
+template <typename T>
+static inline void sampleWindow4NEON(const T* const top, const T* const bottom,
+                                     const InterpWeights& w,
+                                     float32* const dst, const int32 x) {
+  const float32x4_t top_sum =
+      vaddq_f32(vmulq_n_f32(loadFloats4NEON(top + x), w.a),
+                vmulq_n_f32(loadFloats4NEON(top + x + 1), w.b));
+  const float32x4_t bottom_sum =
+      vaddq_f32(vmulq_n_f32(loadFloats4NEON(bottom + x), w.a),
+                vmulq_n_f32(loadFloats4NEON(bottom + x + 1), w.b));
+
+  vst1q_f32(dst + x, vaddq_f32(vmulq_n_f32(top_sum, w.c),
+                               vmulq_n_f32(bottom_sum, w.d)));
+}
+
+// Window rows are short, so a partial last block is redone overlapping the
+// previous one instead of being left to the scalar code.
+template <typename T>
+static int32 sampleWindowRowNEON(const T* const top, const T* const bottom,
+                                 const InterpWeights& w, const int32 size,
+                                 float32* const dst, int32 x) {
+  for (; x + 4 <= size; x += 4) {
+    sampleWindow4NEON(top, bottom, w, dst, x);
+  }
+
+  if (x < size && size >= 4) {
+    sampleWindow4NEON(top, bottom, w, dst, size - 4);
+    x = size;
+  }
+
+  return x;
+}
+
+static inline float32 horizontalSumNEON(const float32x4_t v) {
+  const float32x2_t pairs = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+  return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+}
+
+static int32 windowMomentsNEON(const float32* const values,
+                               const float32* const a, const float32* const b,
+                               const int32 num_vals, const float32 offset,
+                               float32* const sums) {
+  const float32x4_t offsets = vdupq_n_f32(offset);
+
+  float32x4_t sum = vdupq_n_f32(0.0f);
+  float32x4_t sum_sq = vdupq_n_f32(0.0f);
+  float32x4_t sum_a = vdupq_n_f32(0.0f);
+  float32x4_t sum_b = vdupq_n_f32(0.0f);
+
+  int32 i = 0;
+  for (; i + 4 <= num_vals; i += 4) {
+    const float32x4_t v = vsubq_f32(vld1q_f32(values + i), offsets);
+    sum = vaddq_f32(sum, v);
+    sum_sq = vmlaq_f32(sum_sq, v, v);
+    sum_a = vmlaq_f32(sum_a, v, vld1q_f32(a + i));
+    sum_b = vmlaq_f32(sum_b, v, vld1q_f32(b + i));
+  }
+
+  sums[0] += horizontalSumNEON(sum);
+  sums[1] += horizontalSumNEON(sum_sq);
+  sums[2] += horizontalSumNEON(sum_a);
+  sums[3] += horizontalSumNEON(sum_b);
+
+  return i;
+}
+
+// NEON has unsigned compares, so lanes hold all ones where a circle pixel is
+// brighter (or darker) than the center by more than the threshold.
+static int32 fastCornerRowNEON(const uint8* const row,
+                               const int32* const offsets,
+                               const int32 width, const int32 arc_length,
+                               const int32 threshold, uint8* const dst,
+                               int32 x) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t one = vdupq_n_u8(1);
+  const uint8x16_t thresholds = vdupq_n_u8(threshold);
+  const uint8x16_t arc = vdupq_n_u8(arc_length);
+  const uint8x16_t min_compass = vdupq_n_u8(arc_length / 4);
+
+  for (; x + 16 <= width; x += 16) {
+    const uint8* const p = row + x;
+    const uint8x16_t center = vld1q_u8(p);
+    const uint8x16_t bright = vqaddq_u8(center, thresholds);
+    const uint8x16_t dark = vqsubq_u8(center, thresholds);
+
+    uint8x16_t is_bright[FAST_CIRCLE_SIZE];
+    uint8x16_t is_dark[FAST_CIRCLE_SIZE];
+
+    // Count the compass points that hit, and skip the block if no lane has
+    // enough for either sign.
+    uint8x16_t bright_hits = zero;
+    uint8x16_t dark_hits = zero;
+    for (int32 k = 0; k < 4; ++k) {
+      const int32 i = kFastCompass[k];
+      const uint8x16_t v = vld1q_u8(p + offsets[i]);
+      is_bright[i] = vcgtq_u8(v, bright);
+      is_dark[i] = vcltq_u8(v, dark);
+      bright_hits = vsubq_u8(bright_hits, is_bright[i]);
+      dark_hits = vsubq_u8(dark_hits, is_dark[i]);
+    }
+
+    const uint8x16_t candidates = vorrq_u8(vcgeq_u8(bright_hits, min_compass),
+                                           vcgeq_u8(dark_hits, min_compass));
+    const uint8x8_t any = vorr_u8(vget_low_u8(candidates),
+                                  vget_high_u8(candidates));
+    if (vget_lane_u64(vreinterpret_u64_u8(any), 0) == 0) {
+      vst1q_u8(dst + x, zero);
+      continue;
+    }
+
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE; ++i) {
+      if (i % 4 != 1) {
+        const uint8x16_t v = vld1q_u8(p + offsets[i]);
+        is_bright[i] = vcgtq_u8(v, bright);
+        is_dark[i] = vcltq_u8(v, dark);
+      }
+    }
+
+    uint8x16_t run_bright = zero;
+    uint8x16_t run_dark = zero;
+    uint8x16_t found = zero;
+    for (int32 i = 0; i < FAST_CIRCLE_SIZE + arc_length - 1; ++i) {
+      const int32 index = i % FAST_CIRCLE_SIZE;
+      run_bright = vandq_u8(is_bright[index], vaddq_u8(run_bright, one));
+      run_dark = vandq_u8(is_dark[index], vaddq_u8(run_dark, one));
+      found = vorrq_u8(found, vorrq_u8(vceqq_u8(run_bright, arc),
+                                       vceqq_u8(run_dark, arc)));
+    }
+
+    vst1q_u8(dst + x, vandq_u8(found, one));
+  }
+
+  return x;
+}
+
+#endif  // HAVE_ARMEABI_V7A
+
+// Dispatch.
+
+bool kernelLevelSupported(const int32 level) {
+  switch (level) {
+    case KERNELS_SCALAR:
+      return true;
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      return __builtin_cpu_supports("sse2");
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      return supportsNeon();
+#endif
+    default:
+      return false;
+  }
+}
+
+
+int32 getKernelLevel() {
+  // Detection is idempotent, so concurrent first calls are harmless.
+  if (kernel_level < 0) {
+    int32 level = KERNELS_NEON;
+    while (!kernelLevelSupported(level)) {
+      --level;
+    }
+    kernel_level = level;
+  }
+
+  return kernel_level;
+}
+
+
+bool setKernelLevel(const int32 level) {
+  if (!kernelLevelSupported(level)) {
+    LOGE("Kernel level %d is not supported!", level);
+    return false;
+  }
+
+  kernel_level = level;
+  return true;
+}
+
+
+// Row dispatch, shared by the whole-image kernels and the fused pyramid
+// kernels.
+
+static void averagedRow(const int32 level, const uint8* const src_row,
+                        const int32 stride, const int32 factor,
+                        uint8* const dst_row, const int32 width) {
+  if (factor == 1) {
+    memcpy(dst_row, src_row, width);
+    return;
+  }
+
+  int32 x = 0;
+
+  switch (level) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      x = downsampleAveragedRowSSE2(src_row, stride, factor, width, dst_row, x);
+      break;
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      x = downsampleAveragedRowAVX2(src_row, stride, factor, width, dst_row, x);
+#ifdef __SSE2__
+      x = downsampleAveragedRowSSE2(src_row, stride, factor, width, dst_row, x);
+#endif
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      x = downsampleAveragedRowNEON(src_row, stride, factor, width, dst_row, x);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; x < width; ++x) {
+    dst_row[x] = averagedPixel(src_row, stride, factor, x);
+  }
+}
+
+
+static void smoothedRow(const int32 level, const uint8* const src,
+                        const int32 src_width, const int32 src_height,
+                        const int32 y, uint8* const dst_row,
+                        const int32 width) {
+  const int32 orig_y = clip(2 * y, 0, src_height - 1);
+  const uint8* const r0 = src + clip(orig_y - 1, 0, src_height - 1) * src_width;
+  const uint8* const r1 = src + orig_y * src_width;
+  const uint8* const r2 = src + clip(orig_y + 1, 0, src_height - 1) * src_width;
+
+  if (width < 1) {
+    return;
+  }
+
+  dst_row[0] = smoothedPixel(r0, r1, r2, src_width, 0);
+  int32 x = 1;
+
+  switch (level) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      x = downsampleSmoothedRowSSE2(r0, r1, r2, src_width, width, dst_row, x);
+      break;
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      x = downsampleSmoothedRowAVX2(r0, r1, r2, src_width, width, dst_row, x);
+#ifdef __SSE2__
+      x = downsampleSmoothedRowSSE2(r0, r1, r2, src_width, width, dst_row, x);
+#endif
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      x = downsampleSmoothedRowNEON(r0, r1, r2, src_width, width, dst_row, x);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; x < width; ++x) {
+    dst_row[x] = smoothedPixel(r0, r1, r2, src_width, x);
+  }
+}
+
+
+static void derivativeXRow(const int32 level, const uint8* const row,
+                           const int32 width, int16* const dst_row) {
+  if (width < 2) {
+    memset(dst_row, 0, width * sizeof(*dst_row));
+    return;
+  }
+
+  // One-sided differences at the edges.
+  dst_row[0] = halfDiff(row[0], row[1]);
+  dst_row[width - 1] = halfDiff(row[width - 2], row[width - 1]);
+
+  int32 x = 1;
+
+  switch (level) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      x = derivativeXRowSSE2(row, width, dst_row, x);
+      break;
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      x = derivativeXRowAVX2(row, width, dst_row, x);
+#ifdef __SSE2__
+      x = derivativeXRowSSE2(row, width, dst_row, x);
+#endif
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      x = derivativeXRowNEON(row, width, dst_row, x);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; x < width - 1; ++x) {
+    dst_row[x] = halfDiff(row[x - 1], row[x + 1]);
+  }
+}
+
+
+static void derivativeYRow(const int32 level, const uint8* const src,
+                           const int32 width, const int32 height,
+                           const int32 y, int16* const dst_row) {
+  const uint8* const prev = src + max(0, y - 1) * width;
+  const uint8* const next = src + min(height - 1, y + 1) * width;
+  int32 x = 0;
+
+  switch (level) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      x = derivativeYRowSSE2(prev, next, width, dst_row, x);
+      break;
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      x = derivativeYRowAVX2(prev, next, width, dst_row, x);
+#ifdef __SSE2__
+      x = derivativeYRowSSE2(prev, next, width, dst_row, x);
+#endif
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      x = derivativeYRowNEON(prev, next, width, dst_row, x);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; x < width; ++x) {
+    dst_row[x] = halfDiff(prev[x], next[x]);
+  }
+}
+
+
+// Computes both derivatives of row y, which needs rows up to y + 1 to have
+// been written already.
+static inline void gradientRow(const int32 level, const uint8* const src,
+                               const int32 width, const int32 height,
+                               const int32 y,
+                               int16* const dst_x, int16* const dst_y) {
+  derivativeXRow(level, src + y * width, width, dst_x + y * width);
+  derivativeYRow(level, src, width, height, y, dst_y + y * width);
+}
+
+
+void downsampleAveragedKernel(const uint8* const src, const int32 stride,
+                              const int32 factor,
+                              uint8* const dst,
+                              const int32 width, const int32 height) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    averagedRow(level, src + y * factor * stride, stride, factor,
+                dst + y * width, width);
+  }
+}
+
+
+void downsampleSmoothed3x3Kernel(const uint8* const src,
+                                 const int32 src_width, const int32 src_height,
+                                 uint8* const dst,
+                                 const int32 width, const int32 height) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    smoothedRow(level, src, src_width, src_height, y, dst + y * width, width);
+  }
+}
+
+
+void derivativeXKernel(const uint8* const src,
+                       const int32 width, const int32 height,
+                       int16* const dst) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    derivativeXRow(level, src + y * width, width, dst + y * width);
+  }
+}
+
+
+void derivativeYKernel(const uint8* const src,
+                       const int32 width, const int32 height,
+                       int16* const dst) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    derivativeYRow(level, src, width, height, y, dst + y * width);
+  }
+}
+
+
+// The fused kernels trail the gradients one row behind the image rows, so
+// each row is differenced while it and its neighbours are still in cache.
+
+void downsampleAveragedGradientsKernel(const uint8* const src,
+                                       const int32 stride, const int32 factor,
+                                       uint8* const dst,
+                                       const int32 width, const int32 height,
+                                       int16* const dst_x,
+                                       int16* const dst_y) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    averagedRow(level, src + y * factor * stride, stride, factor,
+                dst + y * width, width);
+    if (y > 0) {
+      gradientRow(level, dst, width, height, y - 1, dst_x, dst_y);
+    }
+  }
+
+  if (height > 0) {
+    gradientRow(level, dst, width, height, height - 1, dst_x, dst_y);
+  }
+}
+
+
+void downsampleSmoothedGradientsKernel(const uint8* const src,
+                                       const int32 src_width,
+                                       const int32 src_height,
+                                       uint8* const dst,
+                                       const int32 width, const int32 height,
+                                       int16* const dst_x,
+                                       int16* const dst_y) {
+  const int32 level = getKernelLevel();
+
+  for (int32 y = 0; y < height; ++y) {
+    smoothedRow(level, src, src_width, src_height, y, dst + y * width, width);
+    if (y > 0) {
+      gradientRow(level, dst, width, height, y - 1, dst_x, dst_y);
+    }
+  }
+
+  if (height > 0) {
+    gradientRow(level, dst, width, height, height - 1, dst_x, dst_y);
+  }
+}
+
+
+
+
+void fastCornerRowKernel(const uint8* const row, const int32 stride,
+                         const int32 width, const int32 arc_length,
+                         const int32 threshold, uint8* const dst) {
+  int32 offsets[FAST_CIRCLE_SIZE];
+  for (int32 i = 0; i < FAST_CIRCLE_SIZE; ++i) {
+    offsets[i] = kFastCircleX[i] + kFastCircleY[i] * stride;
+  }
+
+  int32 x = 0;
+
+  switch (getKernelLevel()) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+      x = fastCornerRowSSE2(row, offsets, width, arc_length, threshold, dst, x);
+      break;
+#endif
+#ifdef FLOW_KERNELS_X86
+    case KERNELS_AVX2:
+      x = fastCornerRowAVX2(row, offsets, width, arc_length, threshold, dst, x);
+#ifdef __SSE2__
+      x = fastCornerRowSSE2(row, offsets, width, arc_length, threshold, dst, x);
+#endif
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      x = fastCornerRowNEON(row, offsets, width, arc_length, threshold, dst, x);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; x < width; ++x) {
+    dst[x] = fastCornerPixel(row + x, offsets, arc_length, threshold);
+  }
+}
+
+
+template <typename T>
+static void sampleWindow(const T* const src, const int32 stride,
+                         const float32 x_frac, const float32 y_frac,
+                         const int32 size, float32* const dst) {
+  const int32 level = getKernelLevel();
+
+  InterpWeights w;
+  w.b = x_frac;
+  w.a = 1.0f - x_frac;
+  w.d = y_frac;
+  w.c = 1.0f - y_frac;
+
+  for (int32 y = 0; y < size; ++y) {
+    const T* const top = src + y * stride;
+    const T* const bottom = top + stride;
+    float32* const dst_row = dst + y * size;
+    int32 x = 0;
+
+    switch (level) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+      case KERNELS_SSE2:
+      case KERNELS_AVX2:
+        x = sampleWindowRowSSE2(top, bottom, w, size, dst_row, x);
+        break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+      case KERNELS_NEON:
+        x = sampleWindowRowNEON(top, bottom, w, size, dst_row, x);
+        break;
+#endif
+      default:
+        break;
+    }
+
+    for (; x < size; ++x) {
+      dst_row[x] = interpPixel(top, bottom, w, x);
+    }
+  }
+}
+
+
+void sampleWindowKernel(const uint8* const src, const int32 stride,
+                        const float32 x_frac, const float32 y_frac,
+                        const int32 size, float32* const dst) {
+  sampleWindow(src, stride, x_frac, y_frac, size, dst);
+}
+
+
+void sampleWindowKernel(const int16* const src, const int32 stride,
+                        const float32 x_frac, const float32 y_frac,
+                        const int32 size, float32* const dst) {
+  sampleWindow(src, stride, x_frac, y_frac, size, dst);
+}
+
+
+void windowMomentsKernel(const float32* const values,
+                         const float32* const a, const float32* const b,
+                         const int32 num_vals, const float32 offset,
+                         float32* const sums) {
+  sums[0] = 0.0f;
+  sums[1] = 0.0f;
+  sums[2] = 0.0f;
+  sums[3] = 0.0f;
+
+  int32 i = 0;
+
+  switch (getKernelLevel()) {
+#if defined(FLOW_KERNELS_X86) && defined(__SSE2__)
+    case KERNELS_SSE2:
+    case KERNELS_AVX2:
+      i = windowMomentsSSE2(values, a, b, num_vals, offset, sums);
+      break;
+#endif
+#ifdef HAVE_ARMEABI_V7A
+    case KERNELS_NEON:
+      i = windowMomentsNEON(values, a, b, num_vals, offset, sums);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (; i < num_vals; ++i) {
+    const float32 v = values[i] - offset;
+    sums[0] += v;
+    sums[1] += v * v;
+    sums[2] += v * a[i];
+    sums[3] += v * b[i];
+  }
+}
+
+}  // namespace flow
@@ -0,0 +1,111 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Vectorized kernels for building image pyramids and spatial derivatives on
+// 8-bit frames, and for sampling the windows tracked by Lucas-Kanade. Each
+// kernel has scalar, SSE2, AVX2 and NEON versions, picked at runtime by the
+// best level the CPU supports. The integer kernels produce identical output at
+// every level, so the scalar level doubles as a reference for the others; the
+// float kernels may differ in the last bits from summation order.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_KERNELS_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_KERNELS_H_
+
+#include "types.h"
+
+namespace flow {
+
+// Instruction set levels for the image kernels.
+enum {
+  KERNELS_SCALAR = 0,
+  KERNELS_SSE2 = 1,
+  KERNELS_AVX2 = 2,
+  KERNELS_NEON = 3
+};
+
+// Returns true if this build and CPU can run the given level.
+bool kernelLevelSupported(const int32 level);
+
+// Returns the level used by the kernels, detecting the best supported one on
+// first use.
+int32 getKernelLevel();
+
+// Forces a kernel level, for benchmarks and for checking the vector kernels
+// against KERNELS_SCALAR. Returns false if the level is not supported. Not
+// safe to call while other threads are running the kernels.
+bool setKernelLevel(const int32 level);
+
+// Averages factor x factor blocks of src into the width x height image at dst.
+// Factors 2 and 4 are vectorized.
+void downsampleAveragedKernel(const uint8* const src, const int32 stride,
+                              const int32 factor,
+                              uint8* const dst,
+                              const int32 width, const int32 height);
+
+// Halves src with a [1 2 1]^2 / 16 smoothing filter, clamping at the edges.
+// See Image::downsampleSmoothed3x3.
+void downsampleSmoothed3x3Kernel(const uint8* const src,
+                                 const int32 src_width, const int32 src_height,
+                                 uint8* const dst,
+                                 const int32 width, const int32 height);
+
+// Half central differences in x and y, with one-sided differences at the
+// edges. See Image::derivativeX and Image::derivativeY.
+void derivativeXKernel(const uint8* const src,
+                       const int32 width, const int32 height,
+                       int16* const dst);
+
+void derivativeYKernel(const uint8* const src,
+                       const int32 width, const int32 height,
+                       int16* const dst);
+
+// Fused pyramid passes: downsampleAveragedKernel or
+// downsampleSmoothed3x3Kernel into dst, followed by derivativeXKernel and
+// derivativeYKernel of dst into dst_x and dst_y, in a single sweep over the
+// rows. The output matches the separate kernels.
+void downsampleAveragedGradientsKernel(const uint8* const src,
+                                       const int32 stride, const int32 factor,
+                                       uint8* const dst,
+                                       const int32 width, const int32 height,
+                                       int16* const dst_x,
+                                       int16* const dst_y);
+
+void downsampleSmoothedGradientsKernel(const uint8* const src,
+                                       const int32 src_width,
+                                       const int32 src_height,
+                                       uint8* const dst,
+                                       const int32 width, const int32 height,
+                                       int16* const dst_x,
+                                       int16* const dst_y);
+
+// FAST corner test on the width pixels starting at row. dst[x] is 1 if at
+// least arc_length contiguous pixels of the 16-pixel circle of radius 3 around
+// row[x] are all brighter than it by more than threshold, or all darker by
+// more than threshold, and 0 otherwise. arc_length is 9 for FAST-9, 12 for
+// FAST-12 and at most 16. Reads 3 pixels of margin on every side.
+void fastCornerRowKernel(const uint8* const row, const int32 stride,
+                         const int32 width, const int32 arc_length,
+                         const int32 threshold, uint8* const dst);
+
+// Bilinearly samples a size x size window into dst, row by row. src points at
+// the integer top-left pixel of the window, and every sample shares the same
+// fractional offset (x_frac, y_frac) from its pixel, so the weights are only
+// computed once. Reads (size + 1) x (size + 1) pixels.
+void sampleWindowKernel(const uint8* const src, const int32 stride,
+                        const float32 x_frac, const float32 y_frac,
+                        const int32 size, float32* const dst);
+
+void sampleWindowKernel(const int16* const src, const int32 stride,
+                        const float32 x_frac, const float32 y_frac,
+                        const int32 size, float32* const dst);
+
+// Accumulates the sums of v, v * v, v * a[i] and v * b[i] into sums[0..3],
+// where v = values[i] - offset, over num_vals values. Subtracting an offset
+// close to the mean keeps the squared sum precise.
+void windowMomentsKernel(const float32* const values,
+                         const float32* const a, const float32* const b,
+                         const int32 num_vals, const float32 offset,
+                         float32* const sums);
+
+}  // namespace flow
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_IMAGE_KERNELS_H_
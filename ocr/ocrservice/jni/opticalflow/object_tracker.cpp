@@ -0,0 +1,304 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "utils.h"
+
+#include "image.h"
+#include "optical_flow.h"
+#include "object_tracker.h"
+
+// Number of features an object needs to fit a rotation and scale. With fewer,
+// it just follows the flow around it.
+#define MIN_FIT_FEATURES 3
+
+// Number of times features that disagree with the fit are thrown out and the
+// fit redone.
+#define NUM_FIT_ITERATIONS 3
+
+// Residual, in downsampled pixels, below which a feature is never thrown out.
+// Keeps well tracked features from being discarded over tracking noise.
+#define MIN_OUTLIER_ERROR 0.5f
+
+// Mean squared distance, in downsampled pixels, that fit features must be
+// spread from their centroid to fit a rotation and scale.
+#define MIN_FIT_SPREAD 4.0f
+
+// Largest change in scale between two frames that's believed.
+#define MAX_SCALE_CHANGE 0.2f
+
+namespace flow {
+
+ObjectTracker::ObjectTracker(const int32 max_features) :
+    num_objects_(0),
+    next_id_(0),
+    from_(new Point2D[max_features]),
+    to_(new Point2D[max_features]),
+    inliers_(new bool[max_features]) {}
+
+
+ObjectTracker::~ObjectTracker() {
+  delete[] from_;
+  delete[] to_;
+  delete[] inliers_;
+}
+
+
+int32 ObjectTracker::addObject(const Point2D& center,
+                               const float32 width, const float32 height) {
+  if (num_objects_ >= MAX_TRACKED_OBJECTS) {
+    LOGW("Already tracking %d objects!", num_objects_);
+    return -1;
+  }
+
+  TrackedObject* const object = objects_ + num_objects_;
+  object->id = next_id_;
+  object->center_x = center.x;
+  object->center_y = center.y;
+  object->width = width;
+  object->height = height;
+  object->angle = 0.0f;
+  object->num_features = 0;
+
+  ++num_objects_;
+  ++next_id_;
+
+  return object->id;
+}
+
+
+void ObjectTracker::removeObject(const int32 id) {
+  for (int32 i = 0; i < num_objects_; ++i) {
+    if (objects_[i].id == id) {
+      // Keep the rest in the order they were added.
+      for (int32 j = i + 1; j < num_objects_; ++j) {
+        objects_[j - 1] = objects_[j];
+      }
+      --num_objects_;
+      return;
+    }
+  }
+}
+
+
+void ObjectTracker::clear() {
+  num_objects_ = 0;
+}
+
+
+void ObjectTracker::update(const FramePair& pair, const float32 scale) {
+  for (int32 i = 0; i < num_objects_; ++i) {
+    updateObject(pair, scale, objects_ + i);
+  }
+}
+
+
+int32 ObjectTracker::getObjects(float32* const out_data) const {
+  for (int32 i = 0; i < num_objects_; ++i) {
+    const TrackedObject& object = objects_[i];
+    float32* const data = out_data + i * OBJECT_STEP;
+
+    data[0] = object.id;
+    data[1] = object.center_x;
+    data[2] = object.center_y;
+    data[3] = object.width;
+    data[4] = object.height;
+    data[5] = object.angle;
+    data[6] = object.num_features;
+  }
+
+  return num_objects_;
+}
+
+
+int32 ObjectTracker::gatherFeatures(const TrackedObject& object,
+                                    const FramePair& pair,
+                                    const float32 scale) {
+  const float32 center_x = object.center_x / scale;
+  const float32 center_y = object.center_y / scale;
+  const float32 half_width = object.width / (2.0f * scale);
+  const float32 half_height = object.height / (2.0f * scale);
+
+  const float32 cos_angle = cosf(object.angle);
+  const float32 sin_angle = sinf(object.angle);
+
+  int32 num_features = 0;
+
+  for (int32 i = 0; i < pair.number_of_features_; ++i) {
+    if (!pair.optical_flow_found_feature_[i]) {
+      continue;
+    }
+
+    // Rotate into the object's own axes to test against the box.
+    const Point2D& feature = pair.frame1_features_[i];
+    const float32 d_x = feature.x - center_x;
+    const float32 d_y = feature.y - center_y;
+
+    if (fabs(cos_angle * d_x + sin_angle * d_y) <= half_width &&
+        fabs(cos_angle * d_y - sin_angle * d_x) <= half_height) {
+      from_[num_features] = feature;
+      to_[num_features] = pair.frame2_features_[i];
+      ++num_features;
+    }
+  }
+
+  return num_features;
+}
+
+
+bool ObjectTracker::fitSimilarity(const int32 num_features,
+                                  float32* const a, float32* const b,
+                                  float32* const t_x,
+                                  float32* const t_y) const {
+  // Centroids of both point sets.
+  int32 num_inliers = 0;
+  float32 from_x = 0.0f;
+  float32 from_y = 0.0f;
+  float32 to_x = 0.0f;
+  float32 to_y = 0.0f;
+  for (int32 i = 0; i < num_features; ++i) {
+    if (inliers_[i]) {
+      from_x += from_[i].x;
+      from_y += from_[i].y;
+      to_x += to_[i].x;
+      to_y += to_[i].y;
+      ++num_inliers;
+    }
+  }
+
+  if (num_inliers < MIN_FIT_FEATURES) {
+    return false;
+  }
+
+  from_x /= num_inliers;
+  from_y /= num_inliers;
+  to_x /= num_inliers;
+  to_y /= num_inliers;
+
+  // Least squares for a and b about the centroids, in closed form.
+  float32 spread = 0.0f;
+  float32 dot = 0.0f;
+  float32 cross = 0.0f;
+  for (int32 i = 0; i < num_features; ++i) {
+    if (inliers_[i]) {
+      const float32 p_x = from_[i].x - from_x;
+      const float32 p_y = from_[i].y - from_y;
+      const float32 q_x = to_[i].x - to_x;
+      const float32 q_y = to_[i].y - to_y;
+
+      spread += square(p_x) + square(p_y);
+      dot += p_x * q_x + p_y * q_y;
+      cross += p_x * q_y - p_y * q_x;
+    }
+  }
+
+  if (spread < MIN_FIT_SPREAD * num_inliers) {
+    return false;
+  }
+
+  *a = dot / spread;
+  *b = cross / spread;
+  *t_x = to_x - (*a * from_x - *b * from_y);
+  *t_y = to_y - (*b * from_x + *a * from_y);
+
+  return true;
+}
+
+
+void ObjectTracker::updateObject(const FramePair& pair, const float32 scale,
+                                 TrackedObject* const object) {
+  const int32 num_features = gatherFeatures(*object, pair, scale);
+  for (int32 i = 0; i < num_features; ++i) {
+    inliers_[i] = true;
+  }
+
+  float32 a = 1.0f;
+  float32 b = 0.0f;
+  float32 t_x = 0.0f;
+  float32 t_y = 0.0f;
+
+  bool fit = false;
+  int32 num_inliers = num_features;
+
+  for (int32 iteration = 0; iteration <= NUM_FIT_ITERATIONS; ++iteration) {
+    fit = fitSimilarity(num_features, &a, &b, &t_x, &t_y);
+    if (!fit || iteration == NUM_FIT_ITERATIONS) {
+      break;
+    }
+
+    // Throw out features more than NUM_DEVIATIONS from the fit, as
+    // FramePair::getWeightedDelta does, then refit to the rest. Every feature
+    // is retested, so one thrown out early can come back.
+    float32 sum_squares = 0.0f;
+    for (int32 i = 0; i < num_features; ++i) {
+      if (inliers_[i]) {
+        sum_squares +=
+            square(a * from_[i].x - b * from_[i].y + t_x - to_[i].x) +
+            square(b * from_[i].x + a * from_[i].y + t_y - to_[i].y);
+      }
+    }
+    const float32 max_squared_error =
+        max(square(NUM_DEVIATIONS) * sum_squares / num_inliers,
+            square(MIN_OUTLIER_ERROR));
+
+    bool changed = false;
+    num_inliers = 0;
+    for (int32 i = 0; i < num_features; ++i) {
+      const float32 squared_error =
+          square(a * from_[i].x - b * from_[i].y + t_x - to_[i].x) +
+          square(b * from_[i].x + a * from_[i].y + t_y - to_[i].y);
+      const bool inlier = squared_error <= max_squared_error;
+
+      changed |= inlier != inliers_[i];
+      inliers_[i] = inlier;
+      num_inliers += inlier;
+    }
+
+    if (!changed) {
+      break;
+    }
+  }
+
+  const float32 scale_change = sqrtf(square(a) + square(b));
+  if (fit && fabs(scale_change - 1.0f) > MAX_SCALE_CHANGE) {
+    fit = false;
+  }
+
+  const float32 center_x = object->center_x / scale;
+  const float32 center_y = object->center_y / scale;
+
+  if (fit) {
+    object->center_x = (a * center_x - b * center_y + t_x) * scale;
+    object->center_y = (b * center_x + a * center_y + t_y) * scale;
+    object->width *= scale_change;
+    object->height *= scale_change;
+    object->angle += atan2f(b, a);
+    object->num_features = num_inliers;
+  } else {
+    // Too few features inside to trust a rotation or scale, so move with the
+    // flow around the object as getAccumulatedDelta would.
+    const float32 radius = (object->width + object->height) / (4.0f * scale);
+    const Point2D delta =
+        pair.queryFlow(Point2D(center_x, center_y), radius);
+
+    object->center_x += delta.x * scale;
+    object->center_y += delta.y * scale;
+    object->num_features = 0;
+  }
+}
+
+}  // namespace flow
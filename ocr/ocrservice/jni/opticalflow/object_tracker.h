@@ -0,0 +1,102 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Tracks registered boxes, such as detected text regions, from frame to frame
+// by fitting a similarity transform to the optical flow features inside each
+// one. OpticalFlow owns an ObjectTracker and updates it on every computeFlow,
+// so callers only need to read back the boxes.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OBJECT_TRACKER_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OBJECT_TRACKER_H_
+
+#include "types.h"
+#include "optical_flow_utils.h"
+
+// Maximum number of objects tracked at once.
+#define MAX_TRACKED_OBJECTS 64
+
+// Number of floats each object takes up when exporting to an array.
+#define OBJECT_STEP 7
+
+namespace flow {
+
+class FramePair;
+
+class ObjectTracker {
+ public:
+  // Allocates room for fitting up to max_features features per object, the
+  // most a FramePair holds.
+  explicit ObjectTracker(const int32 max_features);
+  ~ObjectTracker();
+
+  // Starts tracking the box centered at center, in frame coordinates. Returns
+  // the object's id, or -1 if MAX_TRACKED_OBJECTS are already tracked. Ids are
+  // never reused.
+  int32 addObject(const Point2D& center,
+                  const float32 width, const float32 height);
+
+  // Stops tracking the object. Unknown ids are ignored.
+  void removeObject(const int32 id);
+
+  // Stops tracking every object.
+  void clear();
+
+  // Moves every object along with the features pair tracked inside it.
+  // Feature positions are multiplied by scale to get frame coordinates.
+  void update(const FramePair& pair, const float32 scale);
+
+  // Copies every tracked object to out_data, which should be at least
+  // MAX_TRACKED_OBJECTS * OBJECT_STEP long. Its format is
+  // [id center_x center_y width height angle num_features] repeated N times,
+  // where N is the number of objects and is returned as the result. angle is
+  // the rotation since the object was added, in radians, and num_features the
+  // number of features its last update was fit to, or 0 if it could only
+  // follow the flow around it.
+  int32 getObjects(float32* const out_data) const;
+
+ private:
+  // A box that has moved and rotated about its center since it was added.
+  struct TrackedObject {
+    int32 id;
+    float32 center_x;
+    float32 center_y;
+    float32 width;
+    float32 height;
+    float32 angle;
+    int32 num_features;
+  };
+
+  // Gathers the found features inside object from pair into from_ and to_,
+  // returning how many there are.
+  int32 gatherFeatures(const TrackedObject& object, const FramePair& pair,
+                       const float32 scale);
+
+  // Fits the similarity transform to = [a -b; b a] * from + t over the
+  // num_features gathered features, skipping those not in inliers_. Returns
+  // false if the features are too close together to fit a rotation and
+  // scale.
+  bool fitSimilarity(const int32 num_features,
+                     float32* const a, float32* const b,
+                     float32* const t_x, float32* const t_y) const;
+
+  // Moves one object, fitting a similarity transform to its features while
+  // throwing out features that don't agree with the rest.
+  void updateObject(const FramePair& pair, const float32 scale,
+                    TrackedObject* const object);
+
+  TrackedObject objects_[MAX_TRACKED_OBJECTS];
+  int32 num_objects_;
+  int32 next_id_;
+
+  // Scratch for the features of the object being updated.
+  Point2D* const from_;
+  Point2D* const to_;
+  bool* const inliers_;
+
+  // Not copyable, as the arrays are owned.
+  ObjectTracker(const ObjectTracker&);
+  void operator=(const ObjectTracker&);
+};
+
+}  // namespace flow
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OBJECT_TRACKER_H_
@@ -25,6 +25,8 @@
 #include "time_log.h"
 #include "image.h"
 #include "optical_flow.h"
+#include "object_tracker.h"
+#include "worker_pool.h"
 
 namespace flow {
 
@@ -33,14 +35,15 @@ extern "C" {
 #endif
 
   JNIEXPORT
-  void
+  jboolean
   JNICALL
   Java_com_googlecode_eyesfree_opticflow_OpticalFlow_initNative(
       JNIEnv* env,
       jobject thiz,
       jint width,
       jint height,
-      jint downsample_factor);
+      jint downsample_factor,
+      jobject params);
 
   JNIEXPORT
   void
@@ -66,6 +69,23 @@ extern "C" {
       JNIEnv* env,
       jobject thiz);
 
+  JNIEXPORT
+  void
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_computeFlowAsyncNative(
+      JNIEnv* env,
+      jobject thiz,
+      jbyteArray photo_data,
+      jlong timestamp,
+      jboolean cached_ok);
+
+  JNIEXPORT
+  void
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_waitForFlowNative(
+      JNIEnv* env,
+      jobject thiz);
+
   JNIEXPORT
   void
   JNICALL
@@ -102,6 +122,30 @@ extern "C" {
       jfloat radius,
       jfloatArray delta);
 
+  JNIEXPORT
+  jint
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_registerObjectNative(
+      JNIEnv* env,
+      jobject thiz,
+      jfloat left, jfloat top, jfloat right, jfloat bottom,
+      jlong timestamp);
+
+  JNIEXPORT
+  void
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_unregisterObjectNative(
+      JNIEnv* env,
+      jobject thiz,
+      jint id);
+
+  JNIEXPORT
+  jfloatArray
+  JNICALL
+  Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getObjectsNative(
+      JNIEnv* env,
+      jobject thiz);
+
   JNIEXPORT
   void
   JNICALL
@@ -115,21 +159,70 @@ extern "C" {
 
 OpticalFlow* optical_flow = NULL;
 
+// Holds the features copied out by getFeaturesNative(), sized for
+// max_features at init. Readers may call in from several threads at once.
+static jfloat* feature_scratch = NULL;
+static pthread_mutex_t feature_scratch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static int32 getIntField(JNIEnv* env, jclass clazz, jobject obj,
+                         const char* field) {
+  const jfieldID field_id = env->GetFieldID(clazz, field, "I");
+  return env->GetIntField(obj, field_id);
+}
+
+
+static bool getBooleanField(JNIEnv* env, jclass clazz, jobject obj,
+                            const char* field) {
+  const jfieldID field_id = env->GetFieldID(clazz, field, "Z");
+  return env->GetBooleanField(obj, field_id) == JNI_TRUE;
+}
+
 
 JNIEXPORT
-void
+jboolean
 JNICALL
 Java_com_googlecode_eyesfree_opticflow_OpticalFlow_initNative(
     JNIEnv* env,
     jobject thiz,
     jint width,
     jint height,
-    jint downsample_factor) {
+    jint downsample_factor,
+    jobject params) {
   SAFE_DELETE(optical_flow);
 
-  LOGI("Initializing optical flow. %dx%d, %d",
-       width, height, downsample_factor);
-  optical_flow = new OpticalFlow(width, height, downsample_factor);
+  const jclass params_class = env->GetObjectClass(params);
+
+  OpticalFlowConfig config;
+  config.max_features = getIntField(env, params_class, params, "max_features");
+  config.num_levels = getIntField(env, params_class, params, "num_levels");
+  config.window_size = getIntField(env, params_class, params, "window_size");
+  config.num_iterations =
+      getIntField(env, params_class, params, "num_iterations");
+  config.num_frames = getIntField(env, params_class, params, "num_frames");
+  config.min_features = getIntField(env, params_class, params, "min_features");
+  config.regen_features_ms =
+      getIntField(env, params_class, params, "regen_features_ms");
+  config.num_threads = getIntField(env, params_class, params, "num_threads");
+  config.approximate_queries =
+      getBooleanField(env, params_class, params, "approximate_queries");
+
+  env->DeleteLocalRef(params_class);
+
+  if (!config.isValid()) {
+    return JNI_FALSE;
+  }
+
+  LOGI("Initializing optical flow. %dx%d, %d, %d features, %d levels, "
+       "window %d", width, height, downsample_factor, config.max_features,
+       config.num_levels, config.window_size);
+  optical_flow = new OpticalFlow(width, height, downsample_factor, config);
+
+  MutexLock lock(&feature_scratch_mutex);
+  delete[] feature_scratch;
+  feature_scratch = new jfloat[config.max_features * FEATURE_STEP];
+
+  return JNI_TRUE;
 }
 
 
@@ -153,6 +246,7 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_addFrameNative(
   timeLog("Got elements");
 
   // Add the frame to the optical flow object.
+  optical_flow->waitForFlow();
   optical_flow->nextFrame(reinterpret_cast<uint8*>(pixels), timestamp);
 
   env->ReleaseByteArrayElements(photo_data, pixels, JNI_ABORT);
@@ -169,6 +263,7 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_computeFeaturesNative(
     jboolean cached_ok) {
   CHECK(optical_flow != NULL, "Optical flow not initialized!");
 
+  optical_flow->waitForFlow();
   optical_flow->computeFeatures(cached_ok);
 }
 
@@ -181,10 +276,46 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_computeFlowNative(
     jobject thiz) {
   CHECK(optical_flow != NULL, "Optical flow not initialized!");
 
+  optical_flow->waitForFlow();
   optical_flow->computeFlow();
 }
 
 
+JNIEXPORT
+void
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_computeFlowAsyncNative(
+    JNIEnv* env,
+    jobject thiz,
+    jbyteArray photo_data,
+    jlong timestamp,
+    jboolean cached_ok) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  jboolean iCopied = JNI_FALSE;
+  jbyte* pixels = env->GetByteArrayElements(photo_data, &iCopied);
+
+  // The pixels are only read before this returns, so they can be released
+  // while the frame is still being tracked.
+  optical_flow->processFrameAsync(reinterpret_cast<uint8*>(pixels), timestamp,
+                                  cached_ok, NULL, NULL);
+
+  env->ReleaseByteArrayElements(photo_data, pixels, JNI_ABORT);
+}
+
+
+JNIEXPORT
+void
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_waitForFlowNative(
+    JNIEnv* env,
+    jobject thiz) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  optical_flow->waitForFlow();
+}
+
+
 JNIEXPORT
 void
 JNICALL
@@ -193,6 +324,8 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_printInfoNative(
     jobject thiz) {
   CHECK(optical_flow != NULL, "Optical flow not initialized!");
 
+  optical_flow->waitForFlow();
+
   printTimeLog();
   optical_flow->printInfo();
 }
@@ -222,19 +355,19 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getFeaturesNative(
     jboolean only_found) {
   CHECK(optical_flow != NULL, "Optical flow not initialized!");
 
-  jfloat feature_arr[MAX_FEATURES * FEATURE_STEP];
+  MutexLock lock(&feature_scratch_mutex);
 
   const int32 number_of_features =
-      optical_flow->getFeatures(only_found, feature_arr);
+      optical_flow->getFeatures(only_found, feature_scratch);
 
   // Create and return the array that will be passed back to Java.
   jfloatArray features = env->NewFloatArray(number_of_features * FEATURE_STEP);
   if (features == NULL) {
     LOGE("null array!");
-    return NULL;
+  } else {
+    env->SetFloatArrayRegion(
+        features, 0, number_of_features * FEATURE_STEP, feature_scratch);
   }
-  env->SetFloatArrayRegion(
-      features, 0, number_of_features * FEATURE_STEP, feature_arr);
 
   return features;
 }
@@ -262,6 +395,57 @@ Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getAccumulatedDeltaNative(
 }
 
 
+JNIEXPORT
+jint
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_registerObjectNative(
+    JNIEnv* env,
+    jobject thiz,
+    jfloat left, jfloat top, jfloat right, jfloat bottom,
+    jlong timestamp) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  return optical_flow->registerObject(left, top, right, bottom, timestamp);
+}
+
+
+JNIEXPORT
+void
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_unregisterObjectNative(
+    JNIEnv* env,
+    jobject thiz,
+    jint id) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  optical_flow->unregisterObject(id);
+}
+
+
+JNIEXPORT
+jfloatArray
+JNICALL
+Java_com_googlecode_eyesfree_opticflow_OpticalFlow_getObjectsNative(
+    JNIEnv* env,
+    jobject thiz) {
+  CHECK(optical_flow != NULL, "Optical flow not initialized!");
+
+  jfloat object_arr[MAX_TRACKED_OBJECTS * OBJECT_STEP];
+  const int32 number_of_objects = optical_flow->getObjects(object_arr);
+
+  // Every object goes back to Java in one array.
+  jfloatArray objects = env->NewFloatArray(number_of_objects * OBJECT_STEP);
+  if (objects == NULL) {
+    LOGE("null array!");
+  } else {
+    env->SetFloatArrayRegion(
+        objects, 0, number_of_objects * OBJECT_STEP, object_arr);
+  }
+
+  return objects;
+}
+
+
 JNIEXPORT
 void
 JNICALL
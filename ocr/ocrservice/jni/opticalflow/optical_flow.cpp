@@ -16,6 +16,11 @@
 
 // Author: Andrew Harp
 
+#include <stdlib.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+
 #include "utils.h"
 #include "time_log.h"
 
@@ -25,13 +30,172 @@
 
 #include "optical_flow.h"
 #include "feature_detector.h"
+#include "object_tracker.h"
+#include "worker_pool.h"
 
 namespace flow {
 
+// Frame 1 data for one feature at one pyramid level, which stays constant
+// through the Lucas-Kanade iterations at that level.
+template <int32 kArraySize>
+struct TrackedWindow {
+  float32 vals_I_x[kArraySize];
+  float32 vals_I_y[kArraySize];
+
+  // Whether the gradient matrix could be inverted. If not, the remaining
+  // fields are unset and the level is skipped.
+  bool invertible;
+  float32 G_inv[4];
+
+  float32 mean_I;
+  float32 std_dev_I;
+
+  // Sums of the window gradients.
+  float32 sum_I_x;
+  float32 sum_I_y;
+
+  // Sums of (I - mean_I) times the window gradients.
+  float32 b_I_x;
+  float32 b_I_y;
+};
+
+// Rounds size up to a whole number of cache lines.
+static inline int32 alignToCacheLine(const int32 size) {
+  return (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+}
+
+// Allocates a cache-aligned block, which is released with free().
+static uint8* allocateAligned(const int32 size) {
+#ifdef HAVE_MALLOC_H
+  return static_cast<uint8*>(memalign(CACHE_LINE_SIZE, size));
+#else
+  void* block = NULL;
+  return posix_memalign(&block, CACHE_LINE_SIZE, size) == 0 ?
+      static_cast<uint8*>(block) : NULL;
+#endif
+}
+
+// Shared arguments for trackBatchTask.
+struct TrackBatchArgs {
+  const OpticalFlow* optical_flow;
+  FramePair* frame_pair;
+};
+
+ImageData::ImageData(Size size, const int32 num_levels) :
+    num_levels_(num_levels),
+    timestamp_(0) {
+  // Lay out every level's image and gradients back to back, each plane
+  // starting on its own cache line.
+  int32 total_size = 0;
+  Size level_size = size;
+  for (int32 i = 0; i < num_levels_; ++i) {
+    const int32 num_pixels = level_size.width * level_size.height;
+    total_size += alignToCacheLine(num_pixels * sizeof(uint8)) +
+                  2 * alignToCacheLine(num_pixels * sizeof(int16));
+    level_size.width /= 2;
+    level_size.height /= 2;
+  }
+
+  storage_ = allocateAligned(total_size);
+  if (storage_ == NULL) {
+    LOGE("Couldn't allocate %d bytes of frame data!", total_size);
+  }
+
+  uint8* plane = storage_;
+  for (int32 i = 0; i < num_levels_; ++i) {
+    const int32 num_pixels = size.width * size.height;
+
+    pyramid_[i] = new Image<uint8>(size.width, size.height, plane, false);
+    plane += alignToCacheLine(num_pixels * sizeof(uint8));
+
+    spatial_x_[i] = new Image<int16>(size.width, size.height,
+                                     reinterpret_cast<int16*>(plane), false);
+    plane += alignToCacheLine(num_pixels * sizeof(int16));
+
+    spatial_y_[i] = new Image<int16>(size.width, size.height,
+                                     reinterpret_cast<int16*>(plane), false);
+    plane += alignToCacheLine(num_pixels * sizeof(int16));
+
+    size.width /= 2;
+    size.height /= 2;
+  }
+
+  image_ = pyramid_[0];
+}
+
+
+ImageData::~ImageData() {
+  // image_ will be deleted along with the rest of the pyramids.
+  for (int32 i = 0; i < num_levels_; ++i) {
+    SAFE_DELETE(pyramid_[i]);
+    SAFE_DELETE(spatial_x_[i]);
+    SAFE_DELETE(spatial_y_[i]);
+  }
+
+  free(storage_);
+}
+
+
+void ImageData::init(const uint8* const new_frame, const int32 stride,
+                     const clock_t timestamp,
+                     const int32 downsample_factor) {
+  timestamp_ = timestamp;
+
+  downsampleAveragedGradientsKernel(
+      new_frame, stride, downsample_factor,
+      image_->getPixelPtr(0, 0), image_->getWidth(), image_->getHeight(),
+      spatial_x_[0]->getPixelPtr(0, 0), spatial_y_[0]->getPixelPtr(0, 0));
+  timeLog("Downsampled image");
+
+  for (int32 i = 1; i < num_levels_; ++i) {
+    const Image<uint8>& prev = *pyramid_[i - 1];
+    Image<uint8>* const level = pyramid_[i];
+
+    downsampleSmoothedGradientsKernel(
+        prev.getPixelPtrConst(0, 0), prev.getWidth(), prev.getHeight(),
+        level->getPixelPtr(0, 0), level->getWidth(), level->getHeight(),
+        spatial_x_[i]->getPixelPtr(0, 0), spatial_y_[i]->getPixelPtr(0, 0));
+  }
+  timeLog("Created pyramid and spatial derivatives");
+}
+
+
+bool OpticalFlowConfig::isValid() const {
+  if (max_features < 1 || max_features > MAX_FEATURES) {
+    LOGE("max_features %d is not in [1, %d]!", max_features, MAX_FEATURES);
+    return false;
+  }
+  if (num_levels < 1 || num_levels > MAX_LEVELS) {
+    LOGE("num_levels %d is not in [1, %d]!", num_levels, MAX_LEVELS);
+    return false;
+  }
+  if (window_size < 1 || window_size > MAX_WINDOW_SIZE) {
+    LOGE("window_size %d is not in [1, %d]!", window_size, MAX_WINDOW_SIZE);
+    return false;
+  }
+  if (num_iterations < 1) {
+    LOGE("num_iterations %d is less than 1!", num_iterations);
+    return false;
+  }
+  if (num_frames < 2) {
+    LOGE("num_frames %d is less than 2!", num_frames);
+    return false;
+  }
+  if (min_features < 0 || regen_features_ms < 0 || num_threads < 0) {
+    LOGE("Negative min_features (%d), regen_features_ms (%d) or "
+         "num_threads (%d)!", min_features, regen_features_ms, num_threads);
+    return false;
+  }
+  return true;
+}
+
+
 OpticalFlow::OpticalFlow(const int32 frame_width,
                          const int32 frame_height,
-                         const int32 downsample_factor) :
+                         const int32 downsample_factor,
+                         const OpticalFlowConfig& config) :
     downsample_factor_(downsample_factor),
+    config_(config),
     original_size_(frame_width, frame_height),
     working_size_(frame_width / downsample_factor_,
                   frame_height / downsample_factor_),
@@ -43,30 +207,136 @@ OpticalFlow::OpticalFlow(const int32 frame_width,
     frame_added_(false),
     features_computed_(false),
     flow_computed_(false) {
-  for (int i = 0; i < NUM_FRAMES; ++i) {
-    frame_pairs_[i].init(0);
+  CHECK(config_.isValid(), "Invalid optical flow config!");
+
+  frame_pairs_ = new FramePair*[config_.num_frames];
+  for (int32 i = 0; i < config_.num_frames; ++i) {
+    frame_pairs_[i] =
+        new FramePair(config_.max_features, config_.approximate_queries);
+    frame_pairs_[i]->init(0);
   }
 
   interest_map_ = new Image<bool>(working_size_);
+  interest_map_->clear(false);
+  tracking_interest_map_ = new Image<bool>(working_size_);
+  tracking_interest_map_->clear(false);
+  object_tracker_ = new ObjectTracker(config_.max_features);
   feature_scratch_ = new Image<uint8>(working_size_);
+  selection_grid_ = new Image<int32>(
+      (working_size_.width + SELECTION_CELL_SIZE - 1) / SELECTION_CELL_SIZE,
+      (working_size_.height + SELECTION_CELL_SIZE - 1) / SELECTION_CELL_SIZE);
+
+  tmp_features_ = new Point2D[config_.max_features +
+                              FEATURE_GRID_WIDTH * FEATURE_GRID_HEIGHT +
+                              selection_grid_->getWidth() *
+                              selection_grid_->getHeight()];
+
+  for (int32 i = 0; i < FRAME_RING_SIZE; ++i) {
+    frame_ring_[i] = new ImageData(working_size_, config_.num_levels);
+  }
+  ring_index_ = 0;
 
-  frame1_ = new ImageData(working_size_);
-  frame2_ = new ImageData(working_size_);
+  frame1_ = frame_ring_[0];
+  frame2_ = frame_ring_[1];
+
+  const int32 num_threads = config_.num_threads > 0 ? config_.num_threads :
+      min(WorkerPool::getNumCpus(), MAX_TRACKING_THREADS);
+  worker_pool_ = new WorkerPool(num_threads);
+
+  pthread_mutex_init(&flow_mutex_, NULL);
+  newest_pending_ = false;
+
+  tracking_thread_ = new WorkerThread();
+  async_cached_ok_ = false;
+  async_callback_ = NULL;
+  async_context_ = NULL;
+  async_timestamp_ = 0;
 }
 
 
 OpticalFlow::~OpticalFlow() {
+  // Let any frame in flight finish before its data goes away.
+  SAFE_DELETE(tracking_thread_);
+
   // Delete all image storage.
   SAFE_DELETE(feature_scratch_);
+  SAFE_DELETE(selection_grid_);
+  delete[] tmp_features_;
   SAFE_DELETE(interest_map_);
+  SAFE_DELETE(tracking_interest_map_);
+  SAFE_DELETE(object_tracker_);
 
-  SAFE_DELETE(frame1_);
-  SAFE_DELETE(frame2_);
+  for (int32 i = 0; i < FRAME_RING_SIZE; ++i) {
+    SAFE_DELETE(frame_ring_[i]);
+  }
+
+  SAFE_DELETE(worker_pool_);
+
+  for (int32 i = 0; i < config_.num_frames; ++i) {
+    SAFE_DELETE(frame_pairs_[i]);
+  }
+  delete[] frame_pairs_;
+
+  pthread_mutex_destroy(&flow_mutex_);
 }
 
 
 void OpticalFlow::nextFrame(const uint8* const new_frame,
                             const clock_t timestamp) {
+  waitForFlow();
+
+  ImageData* const frame = frame_ring_[ring_index_];
+  frame->init(new_frame, original_size_.width, timestamp, downsample_factor_);
+
+  addFrame(frame, timestamp);
+
+  MutexLock lock(&flow_mutex_);
+  interest_map_->clear(false);
+}
+
+
+void OpticalFlow::processFrameAsync(const uint8* const new_frame,
+                                    const clock_t timestamp,
+                                    const bool cached_ok,
+                                    FlowCallback callback,
+                                    void* context) {
+  // The slot at ring_index_ is neither frame1_ nor frame2_, so it can be
+  // filled while those two are being tracked.
+  ImageData* const frame = frame_ring_[ring_index_];
+  frame->init(new_frame, original_size_.width, timestamp, downsample_factor_);
+
+  waitForFlow();
+  addFrame(frame, timestamp);
+
+  async_cached_ok_ = cached_ok;
+  async_callback_ = callback;
+  async_context_ = context;
+  async_timestamp_ = timestamp;
+  tracking_thread_->start(trackFrameTask, this);
+}
+
+
+void OpticalFlow::waitForFlow() {
+  tracking_thread_->wait();
+}
+
+
+void OpticalFlow::trackFrameTask(void* arg) {
+  OpticalFlow* const optical_flow = static_cast<OpticalFlow*>(arg);
+
+  optical_flow->computeFeatures(optical_flow->async_cached_ok_);
+  optical_flow->computeFlow();
+
+  if (optical_flow->async_callback_ != NULL) {
+    optical_flow->async_callback_(optical_flow->async_context_, *optical_flow,
+                                  optical_flow->async_timestamp_);
+  }
+}
+
+
+void OpticalFlow::addFrame(ImageData* const frame, const clock_t timestamp) {
+  MutexLock lock(&flow_mutex_);
+
   frame_added_ = false;
   features_computed_ = false;
   flow_computed_ = false;
@@ -75,34 +345,33 @@ void OpticalFlow::nextFrame(const uint8* const new_frame,
   ++num_frames_;
 
   // If we've got too many, push up the start of the queue.
-  if (num_frames_ > NUM_FRAMES) {
+  if (num_frames_ > config_.num_frames) {
     first_frame_index_ = geNthIndexFromStart(1);
     --num_frames_;
   }
 
-  FramePair* const curr_change = frame_pairs_ + geNthIndexFromEnd(0);
+  // This reuses the slot of the pair just pushed out of the queue, which
+  // queries can't see any more.
+  FramePair* const curr_change = frame_pairs_[geNthIndexFromEnd(0)];
   curr_change->init(timestamp);
+  newest_pending_ = true;
 
-  interest_map_->clear(false);
-
-  // Cache out data from last frame.
-  // Don't run on frame 0 (no point) or frame 1 (because the old frame will
-  // already be in frame1_).
-  if (num_frames_ > 2) {
-    swap(&frame1_, &frame2_);
-    timeLog("Copied data from last run");
-  }
-
-  frame2_->init(new_frame, original_size_.width, timestamp, downsample_factor_);
-
+  // The frame before this one in the ring becomes frame1_.
+  //
   // Special case for the first frame: make sure the image ends up in
   // frame1_ so that feature detection can be done on it if desired.
   // TODO(andrewharp): Make it so that feature detection is always done
   // on the last frame added.
   if (num_frames_ == 1) {
-    swap(&frame1_, &frame2_);
+    frame1_ = frame;
+  } else {
+    frame1_ =
+        frame_ring_[(ring_index_ + FRAME_RING_SIZE - 1) % FRAME_RING_SIZE];
+    frame2_ = frame;
   }
 
+  ring_index_ = (ring_index_ + 1) % FRAME_RING_SIZE;
+
   frame_added_ = true;
 }
 
@@ -113,12 +382,24 @@ void OpticalFlow::computeFlow() {
 
   if (num_frames_ < 2) {
     LOGV("Frame index was %d, skipping computation.", num_frames_);
+    MutexLock lock(&flow_mutex_);
+    newest_pending_ = false;
     return;
   }
 
-  FramePair* const curr_change = &frame_pairs_[geNthIndexFromEnd(0)];
+  FramePair* const curr_change = frame_pairs_[geNthIndexFromEnd(0)];
 
   findCorrespondences(curr_change);
+  curr_change->buildQueryIndex();
+
+  // Publish the pair and move the objects along with it in one step, so
+  // queries and objects always agree on the newest frame.
+  {
+    MutexLock lock(&flow_mutex_);
+    object_tracker_->update(*curr_change, downsample_factor_);
+    newest_pending_ = false;
+  }
+  timeLog("Updated objects");
 
   flow_computed_ = true;
 }
@@ -141,35 +422,34 @@ void OpticalFlow::findFeatures(const FramePair& prev_change,
       tmp_features_ + number_of_tmp_features);
   timeLog("Seeded features.");
 
-  const int32 max_num_fast = MAX_TEMP_FEATURES - number_of_tmp_features;
-  number_of_tmp_features +=
-      findFastFeatures(*frame1_->image_, max_num_fast,
-                       tmp_features_ + number_of_tmp_features,
-                       feature_scratch_);
-
-  if (number_of_tmp_features >= MAX_TEMP_FEATURES) {
-    LOGW("Hit cap of %d for temporary features!", number_of_tmp_features);
-  }
-
   // Score them...
   scoreFeatures(*frame1_->spatial_x_[0], *frame1_->spatial_y_[0],
                 number_of_tmp_features, tmp_features_);
 
   timeLog("Scored features");
 
+  // FAST features come out already scored.
+  number_of_tmp_features +=
+      findFastFeatures(*frame1_->image_,
+                       *frame1_->spatial_x_[0], *frame1_->spatial_y_[0],
+                       selection_grid_,
+                       tmp_features_ + number_of_tmp_features,
+                       feature_scratch_);
+
   // Now pare it down a bit.
   curr_change->number_of_features_ = sortAndSelect(
       number_of_tmp_features,
-      MAX_FEATURES,
-      *interest_map_,
+      config_.max_features,
+      *tracking_interest_map_,
       tmp_features_,
       curr_change->frame1_features_,
-      feature_scratch_);
+      selection_grid_);
 
   timeLog("Sorted and selected features");
 
   LOGV("Picked %d (%d max) final features out of %d potential.",
-       curr_change->number_of_features_, MAX_FEATURES, number_of_tmp_features);
+       curr_change->number_of_features_, config_.max_features,
+       number_of_tmp_features);
 
   last_time_fresh_features_ = curr_change->end_time;
 }
@@ -202,16 +482,29 @@ void OpticalFlow::computeFeatures(const bool cached_ok) {
   CHECK(frame_added_ && !features_computed_ && !flow_computed_,
         "Optical Flow function called out of order!");
 
-  const FramePair& prev_change = frame_pairs_[geNthIndexFromEnd(1)];
-  FramePair* const curr_change = &frame_pairs_[geNthIndexFromEnd(0)];
+  // On the first frame, the slot before it in the queue is still empty.
+  const int32 prev_index = num_frames_ > 1 ? geNthIndexFromEnd(1) :
+      (first_frame_index_ + config_.num_frames - 1) % config_.num_frames;
+  const FramePair& prev_change = *frame_pairs_[prev_index];
+  FramePair* const curr_change = frame_pairs_[geNthIndexFromEnd(0)];
+
+  // Take the regions added for this frame, leaving an empty map for the
+  // next one.
+  {
+    MutexLock lock(&flow_mutex_);
+    Image<bool>* const regions = interest_map_;
+    interest_map_ = tracking_interest_map_;
+    tracking_interest_map_ = regions;
+    interest_map_->clear(false);
+  }
 
   const int32 num_found_features = prev_change.countFoundFeatures();
   const clock_t ms_since_last_refresh =
       (curr_change->end_time - last_time_fresh_features_);
 
   if (cached_ok &&
-      num_found_features >= MIN_FEATURES &&
-      ms_since_last_refresh <= REGEN_FEATURES_MS) {
+      num_found_features >= config_.min_features &&
+      ms_since_last_refresh <= config_.regen_features_ms) {
     // Reuse the found features from the last frame if we can.
     curr_change->number_of_features_ =
         copyFeatures(prev_change, curr_change->frame1_features_);
@@ -220,7 +513,7 @@ void OpticalFlow::computeFeatures(const bool cached_ok) {
     // time, or it's time to regenerate anyway.
     LOGV("Not enough features (%d/%d), or it's been too long (%ld), "
          "finding more.",
-         num_found_features, MIN_FEATURES, ms_since_last_refresh);
+         num_found_features, config_.min_features, ms_since_last_refresh);
     findFeatures(prev_change, curr_change);
   }
 
@@ -230,11 +523,13 @@ void OpticalFlow::computeFeatures(const bool cached_ok) {
 
 int32 OpticalFlow::getFeatures(const bool only_found,
                                float32* const out_data) const {
-  CHECK(frame_added_ && features_computed_,
-        "Optical Flow function called out of order!");
+  MutexLock lock(&flow_mutex_);
+  if (getNumQueryableFrames() == 0) {
+    return 0;
+  }
 
   int32 curr_feature = 0;
-  const FramePair& change = frame_pairs_[geNthIndexFromEnd(0)];
+  const FramePair& change = *frame_pairs_[getNthQueryableIndexFromEnd(0)];
 
   for (int32 i = 0; i < change.number_of_features_; ++i) {
     if (!only_found || change.optical_flow_found_feature_[i]) {
@@ -261,185 +556,302 @@ int32 OpticalFlow::getFeatures(const bool only_found,
 void OpticalFlow::findCorrespondences(FramePair* const frame_pair) const {
   // Features aren't found until they're found.
   memset(frame_pair->optical_flow_found_feature_, false,
-         sizeof(*frame_pair->optical_flow_found_feature_) * MAX_FEATURES);
+         sizeof(*frame_pair->optical_flow_found_feature_) *
+         frame_pair->max_features_);
   timeLog("Cleared old found features");
 
-  int32 num_features_found = 0;
+  // Batches write disjoint ranges of the FramePair, so they need no locking.
+  TrackBatchArgs args;
+  args.optical_flow = this;
+  args.frame_pair = frame_pair;
 
-  // For every feature...
-  for (int32 i_feat = 0; i_feat < frame_pair->number_of_features_; ++i_feat) {
-    Point2D* feature1 = frame_pair->frame1_features_ + i_feat;
-    Point2D* feature2 = frame_pair->frame2_features_ + i_feat;
-
-    if (findFlowAtPoint(feature1->x, feature1->y,
-                        &feature2->x, &feature2->y)) {
-      frame_pair->optical_flow_found_feature_[i_feat] = true;
-      ++num_features_found;
-    }
-  }
+  const int32 num_batches =
+      (frame_pair->number_of_features_ + FEATURE_BATCH_SIZE - 1) /
+      FEATURE_BATCH_SIZE;
+  worker_pool_->parallelFor(num_batches, trackBatchTask, &args);
 
   timeLog("Found correspondences");
 
-  LOGV("Found %d of %d feature correspondences",
-       num_features_found, frame_pair->number_of_features_);
+  LOGV("Found %d of %d feature correspondences on %d threads",
+       frame_pair->countFoundFeatures(), frame_pair->number_of_features_,
+       worker_pool_->getNumThreads());
+}
+
+
+void OpticalFlow::trackBatchTask(void* arg, const int32 index) {
+  const TrackBatchArgs* const args = static_cast<TrackBatchArgs*>(arg);
+  FramePair* const frame_pair = args->frame_pair;
+
+  const int32 first = index * FEATURE_BATCH_SIZE;
+  const int32 num_features =
+      min(FEATURE_BATCH_SIZE, frame_pair->number_of_features_ - first);
+
+  args->optical_flow->trackFeatureBatch(
+      frame_pair->frame1_features_ + first, num_features,
+      frame_pair->frame2_features_ + first,
+      frame_pair->optical_flow_found_feature_ + first);
 }
 
 
-// An implementation of the Pyramidal Lucas-Kanade Optical Flow algorithm.
-// See http://robots.stanford.edu/cs223b04/algo_tracking.pdf for details.
 bool OpticalFlow::findFlowAtPoint(const float32 u_x, const float32 u_y,
                                   float32* final_x, float32* final_y) const {
-  const float32 threshold_squared = square(THRESHOLD);
+  const Point2D feature1(u_x, u_y);
+  Point2D feature2;
+  bool found;
 
-  // Initial guess.
-  float32 g_x = 0.0f;
-  float32 g_y = 0.0f;
+  trackFeatureBatch(&feature1, 1, &feature2, &found);
 
-  // For every level in the pyramid, update the coordinates of the best match.
-  for (int32 l = NUM_LEVELS - 1; l >= 0; --l) {
-    // Shrink factor from original.
-    const int32 shrink_factor = (1 << l);
+  *final_x = feature2.x;
+  *final_y = feature2.y;
+  return found;
+}
 
-    // Images I (prev) and J (next).
-    const Image<uint8>& img_I = *frame1_->pyramid_[l];
-    const Image<uint8>& img_J = *frame2_->pyramid_[l];
 
-    // Computed gradients.
-    const Image<int32>& I_x = *frame1_->spatial_x_[l];
-    const Image<int32>& I_y = *frame1_->spatial_y_[l];
+// Returns true if a window of the given radius whose top-left sample is at
+// (left, top) can be interpolated entirely within the image. Only the corners
+// need checking, and the comparisons fail for NaN positions.
+template <typename T>
+static inline bool validWindow(const Image<T>& image, const int32 window_size,
+                               const float32 left, const float32 top) {
+  return image.validInterpPixel(left, top) &&
+         image.validInterpPixel(left + 2 * window_size,
+                                top + 2 * window_size);
+}
 
-    // Image position vector (p := u^l), scaled for this level.
-    const float32 p_x = u_x / static_cast<float32>(shrink_factor);
-    const float32 p_y = u_y / static_cast<float32>(shrink_factor);
+// Samples the window whose top-left sample is at (left, top), which must be
+// valid, into vals.
+template <typename T>
+static inline void sampleWindow(const Image<T>& image, const int32 window_size,
+                                const float32 left, const float32 top,
+                                float32* const vals) {
+  const int32 floored_x = static_cast<int32>(left);
+  const int32 floored_y = static_cast<int32>(top);
+
+  sampleWindowKernel(image.getPixelPtrConst(floored_x, floored_y),
+                     image.getWidth(), left - floored_x, top - floored_y,
+                     2 * window_size + 1, vals);
+}
 
-    // LOGV("Level %d: (%d, %d) / %d -> (%d, %d)",
-    //      l, u_x, u_y, shrink_factor, p_x, p_y);
+// Prepares a feature's frame 1 window at one pyramid level. Returns false if
+// the window leaves the image.
+template <int32 kArraySize>
+static inline bool prepareWindow(const ImageData& frame1, const int32 level,
+                                 const int32 window_size,
+                                 const float32 p_x, const float32 p_y,
+                                 TrackedWindow<kArraySize>* const window) {
+  const int32 array_size = square(2 * window_size + 1);
+  const float32 left = p_x - window_size;
+  const float32 top = p_y - window_size;
+
+  const Image<uint8>& img_I = *frame1.pyramid_[level];
+  if (!validWindow(img_I, window_size, left, top)) {
+    return false;
+  }
 
-    // Get values for frame 1.  They remain constant through the inner
-    // iteration loop.
-    float32 vals_I[ARRAY_SIZE];
-    float32 vals_I_x[ARRAY_SIZE];
-    float32 vals_I_y[ARRAY_SIZE];
+  float32 vals_I[kArraySize];
+  sampleWindow(img_I, window_size, left, top, vals_I);
+  sampleWindow(*frame1.spatial_x_[level], window_size, left, top,
+               window->vals_I_x);
+  sampleWindow(*frame1.spatial_y_[level], window_size, left, top,
+               window->vals_I_y);
 
-    int32 val_idx = 0;
-    for (int32 win_x = -WINDOW_SIZE; win_x <= WINDOW_SIZE; ++win_x) {
-      for (int32 win_y = -WINDOW_SIZE; win_y <= WINDOW_SIZE; ++win_y) {
-        const float32 x_pos = p_x + win_x;
-        const float32 y_pos = p_y + win_y;
+  // Compute the spatial gradient matrix about point p.
+  float32 G[] = { 0, 0, 0, 0 };
+  calculateG(window->vals_I_x, window->vals_I_y, array_size, G);
 
-        if (!img_I.validInterpPixel(x_pos, y_pos)) {
-          return false;
-        }
+  // If we can't invert, hope that the next level will have better luck.
+  window->invertible = invert2x2(G, window->G_inv);
+  if (!window->invertible) {
+    return true;
+  }
 
-        vals_I[val_idx] = img_I.getPixelInterp(x_pos, y_pos);
+  window->mean_I = computeMean(vals_I, array_size);
 
-        vals_I_x[val_idx] = I_x.getPixelInterp(x_pos, y_pos);
-        vals_I_y[val_idx] = I_y.getPixelInterp(x_pos, y_pos);
+  float32 sums[4];
+  windowMomentsKernel(vals_I, window->vals_I_x, window->vals_I_y,
+                      array_size, window->mean_I, sums);
 
-        ++val_idx;
-      }
-    }
+  window->std_dev_I = sqrtf(max(sums[1] / array_size -
+                                square(sums[0] / array_size), 0.0f));
+  window->b_I_x = sums[2];
+  window->b_I_y = sums[3];
 
-    // Compute the spatial gradient matrix about point p.
-    float32 G[] = { 0, 0, 0, 0 };
-    calculateG(vals_I_x, vals_I_y, ARRAY_SIZE, G);
+  window->sum_I_x = 0.0f;
+  window->sum_I_y = 0.0f;
+  for (int32 i = 0; i < array_size; ++i) {
+    window->sum_I_x += window->vals_I_x[i];
+    window->sum_I_y += window->vals_I_y[i];
+  }
 
-    // Find the inverse of G.
-    float32 G_inv[4];
-    if (!invert2x2(G, G_inv)) {
-      // If we can't invert, hope that the next level will have better luck.
-      continue;
+  return true;
+}
+
+// Runs the Lucas-Kanade iterations for one feature at one pyramid level,
+// refining the guess g. Returns false if the window leaves the image.
+template <int32 kArraySize>
+static inline bool refineFlow(const ImageData& frame2, const int32 level,
+                              const int32 window_size,
+                              const int32 num_iterations,
+                              const float32 p_x, const float32 p_y,
+                              const TrackedWindow<kArraySize>& window,
+                              float32* const g_x, float32* const g_y) {
+  const float32 threshold_squared = square(THRESHOLD);
+  const int32 array_size = square(2 * window_size + 1);
+  const Image<uint8>& img_J = *frame2.pyramid_[level];
+
+  // Iterate num_iterations times or until we converge.
+  for (int32 iteration = 0; iteration < num_iterations; ++iteration) {
+    const float32 left = p_x - window_size + *g_x;
+    const float32 top = p_y - window_size + *g_y;
+
+    if (!validWindow(img_J, window_size, left, top)) {
+      return false;
     }
 
+    // Get values for frame 2.
+    float32 vals_J[kArraySize];
+    sampleWindow(img_J, window_size, left, top, vals_J);
+
+    // The moments of J about mean_I give the mismatch vector directly:
+    // b = sum((I - mean_I) * I_xy) - sum((J - mean_I) * I_xy), with J
+    // normalized to the mean and deviation of I when NORMALIZE is on.
+    float32 sums[4];
+    windowMomentsKernel(vals_J, window.vals_I_x, window.vals_I_y,
+                        array_size, window.mean_I, sums);
+
 #ifdef NORMALIZE
-    const float32 mean_I = computeMean(vals_I, ARRAY_SIZE);
-    const float32 std_dev_I = computeStdDev(vals_I, ARRAY_SIZE, mean_I);
+    const float32 mean_offset = sums[0] / array_size;
+    const float32 std_dev_J =
+        sqrtf(max(sums[1] / array_size - square(mean_offset), 0.0f));
+
+    const float32 std_dev_ratio = window.std_dev_I / std_dev_J;
+
+    const float32 b_x = window.b_I_x -
+        std_dev_ratio * (sums[2] - mean_offset * window.sum_I_x);
+    const float32 b_y = window.b_I_y -
+        std_dev_ratio * (sums[3] - mean_offset * window.sum_I_y);
+#else
+    const float32 b_x = window.b_I_x - sums[2];
+    const float32 b_y = window.b_I_y - sums[3];
 #endif
 
-    // Iterate NUM_ITERATIONS times or until we converge.
-    for (int32 iteration = 0; iteration < NUM_ITERATIONS; ++iteration) {
-      // Get values for frame 2.
-      float32 vals_J[ARRAY_SIZE];
-      int32 val_idx = 0;
-      for (int32 win_x = -WINDOW_SIZE; win_x <= WINDOW_SIZE; ++win_x) {
-        for (int32 win_y = -WINDOW_SIZE; win_y <= WINDOW_SIZE; ++win_y) {
-          const float32 x_pos = p_x + win_x + g_x;
-          const float32 y_pos = p_y + win_y + g_y;
-
-          if (!img_I.validInterpPixel(x_pos, y_pos)) {
-            return false;
-          }
+    // Optical flow... solve n = G^-1 * b
+    const float32* const G_inv = window.G_inv;
+    const float32 n_x = (G_inv[0] * b_x) + (G_inv[1] * b_y);
+    const float32 n_y = (G_inv[2] * b_x) + (G_inv[3] * b_y);
 
-          vals_J[val_idx] = img_J.getPixelInterp(x_pos, y_pos);
+    // Update best guess with residual displacement from this level and
+    // iteration.
+    *g_x += n_x;
+    *g_y += n_y;
 
-          ++val_idx;
-        }
-      }
+    // Abort early if we're already below the threshold.
+    if (square(n_x) + square(n_y) < threshold_squared) {
+      break;
+    }
+  }
 
-#ifdef NORMALIZE
-      const float32 mean_J = computeMean(vals_J, ARRAY_SIZE);
-      const float32 std_dev_J = computeStdDev(vals_J, ARRAY_SIZE, mean_J);
+  return true;
+}
 
-      const float32 std_dev_ratio = std_dev_I / std_dev_J;
-#endif
 
-      // Compute image mismatch vector.
-      float32 b_x = 0.0f;
-      float32 b_y = 0.0f;
-      val_idx = 0;
-      for (int32 win_x = -WINDOW_SIZE; win_x <= WINDOW_SIZE; ++win_x) {
-        for (int32 win_y = -WINDOW_SIZE; win_y <= WINDOW_SIZE; ++win_y) {
-          // Normalized Image difference.
+void OpticalFlow::trackFeatureBatch(const Point2D* const features1,
+                                    const int32 num_features,
+                                    Point2D* const features2,
+                                    bool* const found) const {
+  const int32 window_size = config_.window_size;
+  const int32 num_levels = config_.num_levels;
 
-#ifdef NORMALIZE
-          const float32 dI = (vals_I[val_idx] - mean_I) -
-                             (vals_J[val_idx] - mean_J) * std_dev_ratio;
-#else
-          const float32 dI = vals_I[val_idx] - vals_J[val_idx];
-#endif
+  if (window_size == 3 && num_levels == 4) {
+    trackFeatureBatch<3, 4>(features1, num_features, features2, found);
+  } else if (window_size == 2 && num_levels == 3) {
+    trackFeatureBatch<2, 3>(features1, num_features, features2, found);
+  } else if (window_size == 4 && num_levels == 4) {
+    trackFeatureBatch<4, 4>(features1, num_features, features2, found);
+  } else {
+    trackFeatureBatch<0, 0>(features1, num_features, features2, found);
+  }
+}
 
-          b_x += dI * vals_I_x[val_idx];
-          b_y += dI * vals_I_y[val_idx];
 
-          ++val_idx;
-        }
-      }
+// An implementation of the Pyramidal Lucas-Kanade Optical Flow algorithm.
+// See http://robots.stanford.edu/cs223b04/algo_tracking.pdf for details.
+//
+// The batch is walked level by level, so each level's images are read for
+// every feature while they are in cache. Frame 1 windows, their gradient
+// matrix and moments are computed once per level, leaving a single window
+// sample and one fused pass over it per iteration.
+template <int32 kWindowSize, int32 kNumLevels>
+void OpticalFlow::trackFeatureBatch(const Point2D* const features1,
+                                    const int32 num_features,
+                                    Point2D* const features2,
+                                    bool* const found) const {
+  CHECK(num_features <= FEATURE_BATCH_SIZE,
+        "Batch of %d features is too large!", num_features);
+
+  // Windows are sized for the radius when it is known, else for the largest
+  // one allowed.
+  enum {
+    kRadius = kWindowSize > 0 ? kWindowSize : MAX_WINDOW_SIZE,
+    kArraySize = (2 * kRadius + 1) * (2 * kRadius + 1)
+  };
+
+  const int32 window_size = kWindowSize > 0 ? kWindowSize : config_.window_size;
+  const int32 num_levels = kNumLevels > 0 ? kNumLevels : config_.num_levels;
+  const int32 num_iterations = config_.num_iterations;
+
+  TrackedWindow<kArraySize> window;
+
+  // Current guesses, and whether each feature is still in the image.
+  float32 g_x[FEATURE_BATCH_SIZE];
+  float32 g_y[FEATURE_BATCH_SIZE];
+  bool tracking[FEATURE_BATCH_SIZE];
+
+  for (int32 i = 0; i < num_features; ++i) {
+    g_x[i] = 0.0f;
+    g_y[i] = 0.0f;
+    tracking[i] = true;
+  }
 
-      // Optical flow... solve n = G^-1 * b
-      const float32 n_x = (G_inv[0] * b_x) + (G_inv[1] * b_y);
-      const float32 n_y = (G_inv[2] * b_x) + (G_inv[3] * b_y);
+  // For every level in the pyramid, update the coordinates of the best match.
+  for (int32 l = num_levels - 1; l >= 0; --l) {
+    // Shrink factor from original.
+    const float32 shrink_factor = static_cast<float32>(1 << l);
 
-      // Update best guess with residual displacement from this level and
-      // iteration.
-      g_x += n_x;
-      g_y += n_y;
+    for (int32 i = 0; i < num_features; ++i) {
+      if (!tracking[i]) {
+        continue;
+      }
 
-      // LOGV("Iteration %d: delta (%.3f, %.3f)", iteration, n_x, n_y);
+      // Image position vector (p := u^l), scaled for this level.
+      const float32 p_x = features1[i].x / shrink_factor;
+      const float32 p_y = features1[i].y / shrink_factor;
 
-      // Abort early if we're already below the threshold.
-      if (square(n_x) + square(n_y) < threshold_squared) {
-        break;
+      if (!prepareWindow(*frame1_, l, window_size, p_x, p_y, &window) ||
+          (window.invertible &&
+           !refineFlow(*frame2_, l, window_size, num_iterations,
+                       p_x, p_y, window, g_x + i, g_y + i))) {
+        tracking[i] = false;
+        continue;
       }
-    }  // Iteration.
 
-    if (l > 0) {
-      // Every lower level of the pyramid is 2x as large dimensionally.
-      g_x = 2.0f * g_x;
-      g_y = 2.0f * g_y;
+      // Every lower level of the pyramid is 2x as large dimensionally. A
+      // level that couldn't be solved leaves the guess as it was.
+      if (l > 0 && window.invertible) {
+        g_x[i] *= 2.0f;
+        g_y[i] *= 2.0f;
+      }
     }
-  }  // Level.
-
-  // LOGV("Final displacement for feature %d was (%.2f, %.2f)",
-  //      iFeat, g_x, g_y);
+  }
 
-  *final_x = u_x + g_x;
-  *final_y = u_y + g_y;
+  for (int32 i = 0; i < num_features; ++i) {
+    features2[i].x = features1[i].x + g_x[i];
+    features2[i].y = features1[i].y + g_y[i];
 
-  // Assign the best guess, if we're still in the image.
-  if (frame1_->pyramid_[0]->validInterpPixel(*final_x, *final_y)) {
-    return true;
-  } else {
-    return false;
+    // Assign the best guess, if we're still in the image.
+    found[i] = tracking[i] &&
+        frame1_->pyramid_[0]->validInterpPixel(features2[i].x,
+                                               features2[i].y);
   }
 }
 
@@ -456,6 +868,8 @@ void OpticalFlow::addInterestRegion(const int32 num_x, const int32 num_y,
     return;
   }
 
+  MutexLock lock(&flow_mutex_);
+
   // This is inclusive of the border pixels, hence the +1.
   const int32 width = right - left + 1;
 
@@ -467,9 +881,53 @@ void OpticalFlow::addInterestRegion(const int32 num_x, const int32 num_y,
 }
 
 
+int32 OpticalFlow::registerObject(const float32 left, const float32 top,
+                                  const float32 right, const float32 bottom,
+                                  const clock_t timestamp) {
+  Point2D center((left + right) / 2.0f, (top + bottom) / 2.0f);
+  const float32 width = right - left;
+  const float32 height = bottom - top;
+
+  MutexLock lock(&flow_mutex_);
+
+  // Catch up on any frames tracked since the box was found.
+  const Point2D delta =
+      findAccumulatedDelta(center, (width + height) / 4.0f, timestamp);
+  center.x += delta.x;
+  center.y += delta.y;
+
+  return object_tracker_->addObject(center, width, height);
+}
+
+
+void OpticalFlow::unregisterObject(const int32 id) {
+  MutexLock lock(&flow_mutex_);
+  object_tracker_->removeObject(id);
+}
+
+
+int32 OpticalFlow::getObjects(float32* const out_data) const {
+  MutexLock lock(&flow_mutex_);
+  return object_tracker_->getObjects(out_data);
+}
+
+
 Point2D OpticalFlow::getAccumulatedDelta(const Point2D& position,
                                          const float32 radius,
                                          const clock_t timestamp) const {
+  MutexLock lock(&flow_mutex_);
+  return findAccumulatedDelta(position, radius, timestamp);
+}
+
+
+Point2D OpticalFlow::findAccumulatedDelta(const Point2D& position,
+                                          const float32 radius,
+                                          const clock_t timestamp) const {
+  const int32 num_frames = getNumQueryableFrames();
+  if (num_frames == 0) {
+    return Point2D(0.0f, 0.0f);
+  }
+
   Point2D curr_pos(position);
 
   // Scale down to downsampled size.
@@ -483,16 +941,16 @@ Point2D OpticalFlow::getAccumulatedDelta(const Point2D& position,
   // Anything that ended before the requested timestamp is of no concern to us.
   bool found_it = false;
   int32 num_frames_back = -1;
-  for (int32 i = 0; i < num_frames_; ++i) {
+  for (int32 i = 0; i < num_frames; ++i) {
     const FramePair& frame_pair =
-        frame_pairs_[geNthIndexFromEnd(i)];
+        *frame_pairs_[getNthQueryableIndexFromEnd(i)];
 
     if (frame_pair.end_time <= timestamp) {
       num_frames_back = i - 1;
 
       if (num_frames_back > 0) {
         LOGV("Went %d out of %d frames before finding frame. (index: %d)",
-             num_frames_back, num_frames_, geNthIndexFromEnd(i));
+             num_frames_back, num_frames, getNthQueryableIndexFromEnd(i));
       }
 
       found_it = true;
@@ -501,8 +959,9 @@ Point2D OpticalFlow::getAccumulatedDelta(const Point2D& position,
   }
 
   if (!found_it) {
-    const FramePair& frame_pair = frame_pairs_[geNthIndexFromStart(0)];
-    const FramePair& latest_frame_pair = frame_pairs_[geNthIndexFromEnd(0)];
+    const FramePair& frame_pair = *frame_pairs_[geNthIndexFromStart(0)];
+    const FramePair& latest_frame_pair =
+        *frame_pairs_[getNthQueryableIndexFromEnd(0)];
 
     clock_t latest_time = latest_frame_pair.end_time;
 
@@ -516,7 +975,8 @@ Point2D OpticalFlow::getAccumulatedDelta(const Point2D& position,
   // go out of frame, but keep tracking as best we can, using points near
   // the edge of the screen where it went out of bounds.
   for (int32 i = num_frames_back; i >= 0; --i) {
-    const FramePair& frame_pair = frame_pairs_[geNthIndexFromEnd(i)];
+    const FramePair& frame_pair =
+        *frame_pairs_[getNthQueryableIndexFromEnd(i)];
     CHECK(frame_pair.end_time >= timestamp, "Frame timestamp was too early!");
 
     const Point2D delta = frame_pair.queryFlow(curr_pos, cutoff_dist);
@@ -533,53 +993,317 @@ Point2D OpticalFlow::getAccumulatedDelta(const Point2D& position,
 }
 
 
+FramePair::FramePair(const int32 max_features,
+                     const bool approximate_queries) :
+    end_time(0),
+    max_features_(max_features),
+    frame1_features_(new Point2D[max_features]),
+    frame2_features_(new Point2D[max_features]),
+    number_of_features_(0),
+    optical_flow_found_feature_(new bool[max_features]),
+    approximate_queries_(approximate_queries),
+    indexed_features_(new IndexedFeature[max_features]),
+    num_indexed_(0),
+    grid_left_(0.0f),
+    grid_top_(0.0f),
+    cell_width_(1.0f),
+    cell_height_(1.0f) {}
+
+
+FramePair::~FramePair() {
+  delete[] frame1_features_;
+  delete[] frame2_features_;
+  delete[] optical_flow_found_feature_;
+  delete[] indexed_features_;
+}
+
+
 void FramePair::init(const clock_t end_time) {
   this->end_time = end_time;
   memset(optical_flow_found_feature_, false,
-         sizeof(*optical_flow_found_feature_) * MAX_FEATURES);
+         sizeof(*optical_flow_found_feature_) * max_features_);
   number_of_features_ = 0;
+  num_indexed_ = 0;
 }
 
 
-Point2D FramePair::queryFlow(
-    const Point2D& initial, const float32 cutoff_dist) const {
-  float32 weights[MAX_FEATURES];
-  memset(weights, 0, sizeof(float32) * MAX_FEATURES);
+void FramePair::buildQueryIndex() {
+  num_indexed_ = 0;
+  memset(query_cells_, 0, sizeof(query_cells_));
 
-  // Compute the max score.
+  // Find the max score and the extent of the found features.
   float32 max_score = 0.0f;
-  for (int32 i = 0; i < MAX_FEATURES; ++i) {
+  float32 left = 0.0f;
+  float32 top = 0.0f;
+  float32 right = 0.0f;
+  float32 bottom = 0.0f;
+  for (int32 i = 0; i < number_of_features_; ++i) {
+    if (optical_flow_found_feature_[i]) {
+      const Point2D& feature = frame1_features_[i];
+      if (num_indexed_ == 0) {
+        left = right = feature.x;
+        top = bottom = feature.y;
+      } else {
+        left = min(left, feature.x);
+        right = max(right, feature.x);
+        top = min(top, feature.y);
+        bottom = max(bottom, feature.y);
+      }
+      max_score = max(max_score, feature.score);
+      ++num_indexed_;
+    }
+  }
+
+  if (num_indexed_ == 0) {
+    return;
+  }
+
+  grid_left_ = left;
+  grid_top_ = top;
+  cell_width_ = max((right - left) / QUERY_GRID_WIDTH, 1.0f);
+  cell_height_ = max((bottom - top) / QUERY_GRID_HEIGHT, 1.0f);
+
+  // Counting sort the found features by cell: count each cell, then hand out
+  // ranges of indexed_features_.
+  for (int32 i = 0; i < number_of_features_; ++i) {
     if (optical_flow_found_feature_[i]) {
-      max_score = max(max_score, frame1_features_[i].score);
+      ++query_cells_[getQueryCell(frame1_features_[i])].count;
+    }
+  }
+
+  int32 start = 0;
+  for (int32 c = 0; c < QUERY_GRID_SIZE; ++c) {
+    query_cells_[c].start = start;
+    start += query_cells_[c].count;
+    query_cells_[c].count = 0;
+  }
+
+  for (int32 i = 0; i < number_of_features_; ++i) {
+    if (!optical_flow_found_feature_[i]) {
+      continue;
+    }
+
+    const Point2D& feature = frame1_features_[i];
+    QueryCell* const cell = query_cells_ + getQueryCell(feature);
+    IndexedFeature* const indexed =
+        indexed_features_ + cell->start + cell->count;
+    ++cell->count;
+
+    indexed->x = feature.x;
+    indexed->y = feature.y;
+    indexed->delta_x = frame2_features_[i].x - feature.x;
+    indexed->delta_y = frame2_features_[i].y - feature.y;
+
+    // The weighting based on score strength.
+    indexed->weight = 1.0f;
+    if (max_score > 0) {
+      indexed->weight = (feature.score / max_score) / 2.0f;
+    }
+
+    if (cell->count == 1) {
+      cell->min_delta_x = cell->max_delta_x = indexed->delta_x;
+      cell->min_delta_y = cell->max_delta_y = indexed->delta_y;
+    } else {
+      cell->min_delta_x = min(cell->min_delta_x, indexed->delta_x);
+      cell->max_delta_x = max(cell->max_delta_x, indexed->delta_x);
+      cell->min_delta_y = min(cell->min_delta_y, indexed->delta_y);
+      cell->max_delta_y = max(cell->max_delta_y, indexed->delta_y);
+    }
+
+    const float32 weight = indexed->weight;
+    cell->total_weight += weight;
+    cell->center_x += indexed->x * weight;
+    cell->center_y += indexed->y * weight;
+    cell->sum_x += indexed->delta_x * weight;
+    cell->sum_y += indexed->delta_y * weight;
+    cell->sum_squares +=
+        (square(indexed->delta_x) + square(indexed->delta_y)) * weight;
+  }
+
+  for (int32 c = 0; c < QUERY_GRID_SIZE; ++c) {
+    QueryCell* const cell = query_cells_ + c;
+    if (cell->total_weight > 0.0f) {
+      cell->center_x /= cell->total_weight;
+      cell->center_y /= cell->total_weight;
     }
   }
+}
+
 
+int32 FramePair::getQueryCell(const Point2D& point) const {
+  const int32 cell_x = clip(
+      static_cast<int32>((point.x - grid_left_) / cell_width_),
+      0, QUERY_GRID_WIDTH - 1);
+  const int32 cell_y = clip(
+      static_cast<int32>((point.y - grid_top_) / cell_height_),
+      0, QUERY_GRID_HEIGHT - 1);
+  return cell_y * QUERY_GRID_WIDTH + cell_x;
+}
+
+
+Point2D FramePair::queryFlow(
+    const Point2D& initial, const float32 cutoff_dist) const {
   const float32 cutoff_dist_squared = cutoff_dist * cutoff_dist;
-  for (int32 i = 0; i < MAX_FEATURES; ++i) {
-    if (optical_flow_found_feature_[i]) {
-      const float32 sq_x_dist = square(initial.x - frame1_features_[i].x);
-      const float32 sq_y_dist = square(initial.y - frame1_features_[i].y);
 
-      const float32 dist_squared = sq_x_dist + sq_y_dist;
+  const float32 near_dist =
+      max(cutoff_dist, QUERY_NEAR_CELLS * max(cell_width_, cell_height_));
+  const float32 near_dist_squared = near_dist * near_dist;
+
+  // The distance weight of each far cell, or a negative value for near cells
+  // whose features are weighed individually.
+  float32 cell_weights[QUERY_GRID_SIZE];
+
+  float32 total_weight = 0.0f;
+  float32 weighted_sum_x = 0.0f;
+  float32 weighted_sum_y = 0.0f;
+  float32 weighted_sum_squares = 0.0f;
 
-      // The weighting based off distance.  Anything within the cuttoff
-      // distance has a weight of 1, and everything outside of that is within
-      // the range [0, 1).
-      const float32 distance_score =
-          min(cutoff_dist_squared / dist_squared, 1.0f);
+  // Compute the weighted mean and mean square of the deltas.
+  for (int32 c = 0; c < QUERY_GRID_SIZE; ++c) {
+    const QueryCell& cell = query_cells_[c];
+    if (cell.count == 0) {
+      continue;
+    }
 
-      // The weighting based on score strength. 0.5f - 1.0f.
-      float32 intrinsic_score = 1.0f;
-      if (max_score > 0) {
-        intrinsic_score = (frame1_features_[i].score / max_score) / 2.0f;
+    // Distance to the closest point of the cell.
+    const float32 cell_left = grid_left_ + (c % QUERY_GRID_WIDTH) * cell_width_;
+    const float32 cell_top = grid_top_ + (c / QUERY_GRID_WIDTH) * cell_height_;
+    const float32 cell_dist_x = max(0.0f, max(cell_left - initial.x,
+                                              initial.x - cell_left -
+                                              cell_width_));
+    const float32 cell_dist_y = max(0.0f, max(cell_top - initial.y,
+                                              initial.y - cell_top -
+                                              cell_height_));
+
+    if (!approximate_queries_ ||
+        square(cell_dist_x) + square(cell_dist_y) < near_dist_squared) {
+      cell_weights[c] = -1.0f;
+
+      const IndexedFeature* const features = indexed_features_ + cell.start;
+      for (int32 i = 0; i < cell.count; ++i) {
+        const IndexedFeature& feature = features[i];
+
+        // The weighting based off distance.  Anything within the cuttoff
+        // distance has a weight of 1, and everything outside of that is
+        // within the range [0, 1).
+        const float32 dist_squared = square(initial.x - feature.x) +
+                                     square(initial.y - feature.y);
+        const float32 weight = feature.weight *
+            min(cutoff_dist_squared / dist_squared, 1.0f);
+
+        weighted_sum_x += feature.delta_x * weight;
+        weighted_sum_y += feature.delta_y * weight;
+        weighted_sum_squares +=
+            (square(feature.delta_x) + square(feature.delta_y)) * weight;
+        total_weight += weight;
       }
+    } else {
+      // Far cells are outside the cutoff distance, so their distance weight
+      // is always below 1.
+      const float32 weight = cutoff_dist_squared /
+          (square(initial.x - cell.center_x) +
+           square(initial.y - cell.center_y));
+      cell_weights[c] = weight;
+
+      weighted_sum_x += cell.sum_x * weight;
+      weighted_sum_y += cell.sum_y * weight;
+      weighted_sum_squares += cell.sum_squares * weight;
+      total_weight += cell.total_weight * weight;
+    }
+  }
+
+  if (total_weight <= 0.0f) {
+    return Point2D(0.0f, 0.0f);
+  }
+
+  const float32 weighted_mean_x = weighted_sum_x / total_weight;
+  const float32 weighted_mean_y = weighted_sum_y / total_weight;
+
+  // Weighted squared standard deviation from the weighted mean.
+  const float32 weighted_std_dev_squared = max(0.0f,
+      weighted_sum_squares / total_weight -
+      square(weighted_mean_x) - square(weighted_mean_y));
+  const float32 max_deviation_squared =
+      NUM_DEVIATIONS * weighted_std_dev_squared;
+
+  // Recompute weighted mean change without outliers. A far cell whose deltas
+  // all lie on one side of the cutoff is kept or thrown out as a whole;
+  // otherwise each of its features is tested, still weighed at the centroid.
+  float32 good_weight = 0.0f;
+  float32 good_sum_x = 0.0f;
+  float32 good_sum_y = 0.0f;
+
+  for (int32 c = 0; c < QUERY_GRID_SIZE; ++c) {
+    const QueryCell& cell = query_cells_[c];
+    if (cell.count == 0) {
+      continue;
+    }
 
-      // The final score will be in the range [0, 1].
-      weights[i] = distance_score * intrinsic_score;
+    if (cell_weights[c] < 0.0f) {
+      const IndexedFeature* const features = indexed_features_ + cell.start;
+      for (int32 i = 0; i < cell.count; ++i) {
+        const IndexedFeature& feature = features[i];
+
+        const float32 sqrd_deviation =
+            square(feature.delta_x - weighted_mean_x) +
+            square(feature.delta_y - weighted_mean_y);
+
+        // Throw out anything beyond NUM_DEVIATIONS.
+        if (sqrd_deviation <= max_deviation_squared) {
+          const float32 dist_squared = square(initial.x - feature.x) +
+                                       square(initial.y - feature.y);
+          const float32 weight = feature.weight *
+              min(cutoff_dist_squared / dist_squared, 1.0f);
+
+          good_sum_x += feature.delta_x * weight;
+          good_sum_y += feature.delta_y * weight;
+          good_weight += weight;
+        }
+      }
+    } else {
+      // Closest and furthest deviations of the cell's delta bounds.
+      const float32 min_dev_x = max(0.0f,
+          max(cell.min_delta_x - weighted_mean_x,
+              weighted_mean_x - cell.max_delta_x));
+      const float32 min_dev_y = max(0.0f,
+          max(cell.min_delta_y - weighted_mean_y,
+              weighted_mean_y - cell.max_delta_y));
+      const float32 max_dev_x = max(cell.max_delta_x - weighted_mean_x,
+                                    weighted_mean_x - cell.min_delta_x);
+      const float32 max_dev_y = max(cell.max_delta_y - weighted_mean_y,
+                                    weighted_mean_y - cell.min_delta_y);
+
+      if (square(max_dev_x) + square(max_dev_y) <= max_deviation_squared) {
+        good_sum_x += cell.sum_x * cell_weights[c];
+        good_sum_y += cell.sum_y * cell_weights[c];
+        good_weight += cell.total_weight * cell_weights[c];
+      } else if (square(min_dev_x) + square(min_dev_y) <=
+                 max_deviation_squared) {
+        const IndexedFeature* const features = indexed_features_ + cell.start;
+        for (int32 i = 0; i < cell.count; ++i) {
+          const IndexedFeature& feature = features[i];
+
+          const float32 sqrd_deviation =
+              square(feature.delta_x - weighted_mean_x) +
+              square(feature.delta_y - weighted_mean_y);
+
+          if (sqrd_deviation <= max_deviation_squared) {
+            const float32 weight = feature.weight * cell_weights[c];
+
+            good_sum_x += feature.delta_x * weight;
+            good_sum_y += feature.delta_y * weight;
+            good_weight += weight;
+          }
+        }
+      }
     }
   }
 
-  return getWeightedDelta(weights);
+  if (good_weight > 0.0f) {
+    return Point2D(good_sum_x / good_weight, good_sum_y / good_weight);
+  } else {
+    return Point2D(0.0f, 0.0f);
+  }
 }
 
 
@@ -588,15 +1312,15 @@ Point2D FramePair::getWeightedDelta(const float32* const weights) const {
   float32 weighted_sum_x = 0.0f;
   float32 weighted_sum_y = 0.0f;
 
-  Point2D deltas[MAX_FEATURES];
-
+  // Deltas are cheap to recompute in each pass, which saves a max_features
+  // sized buffer.
   // Compute weighted mean and deltas.
-  for (int32 i = 0; i < MAX_FEATURES; ++i) {
+  for (int32 i = 0; i < number_of_features_; ++i) {
     const float32 weight = weights[i];
     if (weight > 0.0f) {
-      deltas[i] = frame2_features_[i] - frame1_features_[i];
-      weighted_sum_x += deltas[i].x * weight;
-      weighted_sum_y += deltas[i].y * weight;
+      const Point2D delta = frame2_features_[i] - frame1_features_[i];
+      weighted_sum_x += delta.x * weight;
+      weighted_sum_y += delta.y * weight;
       total_weight += weight;
     }
   }
@@ -605,12 +1329,13 @@ Point2D FramePair::getWeightedDelta(const float32* const weights) const {
 
   // Compute weighted squared standard deviation from weighted mean.
   float32 weighted_dev_squared_sum = 0.0f;
-  for (int32 i = 0; i < MAX_FEATURES; ++i) {
+  for (int32 i = 0; i < number_of_features_; ++i) {
     const float32 weight = weights[i];
 
     if (weight > 0.0f) {
-      const float32 devX = deltas[i].x - weighted_mean_x;
-      const float32 devY = deltas[i].y - weighted_mean_y;
+      const Point2D delta = frame2_features_[i] - frame1_features_[i];
+      const float32 devX = delta.x - weighted_mean_x;
+      const float32 devY = delta.y - weighted_mean_y;
 
       const float32 squared_deviation = (devX * devX) + (devY * devY);
       weighted_dev_squared_sum += squared_deviation * weight;
@@ -624,19 +1349,20 @@ Point2D FramePair::getWeightedDelta(const float32* const weights) const {
   float32 good_sum_x = 0.0f;
   float32 good_sum_y = 0.0f;
 
-  for (int32 i = 0; i < MAX_FEATURES; ++i) {
+  for (int32 i = 0; i < number_of_features_; ++i) {
     const float32 weight = weights[i];
 
     if (weight > 0.0f) {
-      const float32 dev_x = deltas[i].x - weighted_mean_x;
-      const float32 dev_y = deltas[i].y - weighted_mean_y;
+      const Point2D delta = frame2_features_[i] - frame1_features_[i];
+      const float32 dev_x = delta.x - weighted_mean_x;
+      const float32 dev_y = delta.y - weighted_mean_y;
 
       const float32 sqrd_deviation = (dev_x * dev_x) + (dev_y * dev_y);
 
       // Throw out anything beyond NUM_DEVIATIONS.
       if (sqrd_deviation <= NUM_DEVIATIONS * weighted_std_dev_squared) {
-        good_sum_x += deltas[i].x * weight;
-        good_sum_y += deltas[i].y * weight;
+        good_sum_x += delta.x * weight;
+        good_sum_y += delta.y * weight;
         good_weight += weight;
       }
     }
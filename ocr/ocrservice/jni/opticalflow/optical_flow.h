@@ -4,36 +4,36 @@
 #ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OPTICAL_FLOW_H_
 #define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_OPTICAL_FLOW_H_
 
+#include <pthread.h>
+
 #include "types.h"
 #include "utils.h"
 
-// Feature detection.
-#define MAX_TEMP_FEATURES 4096
-#define MAX_FEATURES 128
+// Upper bound on OpticalFlowConfig::max_features.
+#define MAX_FEATURES 4096
 
 // Number of floats each feature takes up when exporting to an array.
 #define FEATURE_STEP 7
 
-// Number of frame deltas to keep around in the circular queue.
-#define NUM_FRAMES 128
-
-// Redetect if we ever have less than this number of features.
-#define MIN_FEATURES 6
+// Upper bounds on OpticalFlowConfig::num_levels and window_size, which size
+// the pyramid arrays and the tracking windows on the stack.
+#define MAX_LEVELS 6
+#define MAX_WINDOW_SIZE 5
 
-// How long to wait between forcing complete feature regeneration.
-#define REGEN_FEATURES_MS 400
+// Number of features tracked together as one work item. Each batch walks the
+// pyramid level by level, so its windows share the cache.
+#define FEATURE_BATCH_SIZE 16
 
-// Number of iterations to do tracking on each feature at each pyramid level.
-#define NUM_ITERATIONS 3
+// Upper bound on threads used for tracking, including the calling thread.
+#define MAX_TRACKING_THREADS 4
 
-// Number of pyramid levels used for tracking.
-#define NUM_LEVELS 4
+// Number of preallocated frames that nextFrame cycles through. The third
+// frame lets processFrameAsync build a new pyramid while the previous two are
+// still being tracked.
+#define FRAME_RING_SIZE 3
 
-// Window size to integrate over to find local image derivative.
-#define WINDOW_SIZE 3
-
-// Total area of integration windows.
-#define ARRAY_SIZE (2 * WINDOW_SIZE + 1) * (2 * WINDOW_SIZE + 1)
+// Alignment of each image plane in a frame.
+#define CACHE_LINE_SIZE 64
 
 // Error that's considered good enough to early abort tracking.
 #define THRESHOLD 0.03f
@@ -42,6 +42,18 @@
 // average before being thrown out for region-based queries.
 #define NUM_DEVIATIONS 2.0f
 
+// Resolution of the grid each FramePair indexes its found features by for
+// region-based queries.
+#define QUERY_GRID_WIDTH 8
+#define QUERY_GRID_HEIGHT 6
+#define QUERY_GRID_SIZE (QUERY_GRID_WIDTH * QUERY_GRID_HEIGHT)
+
+// With OpticalFlowConfig::approximate_queries, region-based queries weigh
+// features by their own distance only in cells within this many cell widths
+// of the query point, or within the query radius if that's larger. Features
+// in further cells are weighed by the distance to their cell's centroid.
+#define QUERY_NEAR_CELLS 2
+
 // Resolution of feature grid to seed features with.
 #define FEATURE_GRID_WIDTH 4
 #define FEATURE_GRID_HEIGHT 3
@@ -54,72 +66,122 @@ namespace flow {
 template <typename T>
 class Image;
 
-// Class that encapsulates all bulky processed data for a frame.
+class ObjectTracker;
+class WorkerPool;
+class WorkerThread;
+
+// Tunable parameters for OpticalFlow, fixed for the lifetime of the object.
+// Smaller windows and fewer levels and iterations trade accuracy for latency.
+// The window_size and num_levels pairs (3, 4), the default, (2, 3) and (4, 4)
+// are tracked by specialized code.
+struct OpticalFlowConfig {
+  OpticalFlowConfig() :
+      max_features(512),
+      num_levels(4),
+      window_size(3),
+      num_iterations(3),
+      num_frames(128),
+      min_features(6),
+      regen_features_ms(400),
+      num_threads(0),
+      approximate_queries(false) {}
+
+  // Returns true if every parameter is in range, logging the first that
+  // isn't.
+  bool isValid() const;
+
+  // Maximum number of features tracked per frame.
+  int32 max_features;
+
+  // Number of pyramid levels used for tracking, at most MAX_LEVELS.
+  int32 num_levels;
+
+  // Radius of the window integrated over to find the local image derivative,
+  // at most MAX_WINDOW_SIZE.
+  int32 window_size;
+
+  // Number of iterations to do tracking on each feature at each pyramid level.
+  int32 num_iterations;
+
+  // Number of frame deltas to keep around in the circular queue.
+  int32 num_frames;
+
+  // Redetect if we ever have less than this number of features.
+  int32 min_features;
+
+  // How long to wait between forcing complete feature regeneration.
+  int32 regen_features_ms;
+
+  // Threads to track features on, including the calling thread. 0 picks one
+  // per CPU, up to MAX_TRACKING_THREADS.
+  int32 num_threads;
+
+  // Whether region-based queries may weigh features in far grid cells by the
+  // distance to the cell's centroid, rather than by their own. The default
+  // exact queries still visit every found feature, so they cost O(features)
+  // each and only save the weight buffer getWeightedDelta needs. Approximate
+  // queries cost O(grid cells) plus the features near the query point, but
+  // the result can drift a fraction of a pixel from the exact one.
+  bool approximate_queries;
+};
+
+// Class that encapsulates all bulky processed data for a frame. Every image
+// lives in one cache-aligned block allocated up front, so a frame can be
+// reused indefinitely without touching the heap.
 class ImageData {
  public:
-  explicit ImageData(Size size) {
-    timestamp_ = 0;
-
-    image_ = new Image<uint8>(size);
-
-    for (int32 i = 0; i < NUM_LEVELS; ++i) {
-      pyramid_[i] = (i == 0) ? image_ : new Image<uint8>(size);
-
-      spatial_x_[i] = new Image<int32>(size);
-      spatial_y_[i] = new Image<int32>(size);
-
-      size.width /= 2;
-      size.height /= 2;
-    }
-  }
-
-  ~ImageData() {
-    // image_ will be deleted along with the rest of the pyramids.
-
-    for (int32 i = 0; i < NUM_LEVELS; ++i) {
-      SAFE_DELETE(pyramid_[i]);
-      SAFE_DELETE(spatial_x_[i]);
-      SAFE_DELETE(spatial_y_[i]);
-    }
-  }
+  ImageData(Size size, const int32 num_levels);
+  ~ImageData();
 
+  // Downsamples new_frame into the first pyramid level and builds the rest of
+  // the pyramid, computing each level's spatial derivatives in the same
+  // sweep that creates it.
   void init(const uint8* const new_frame, const int32 stride,
-            const clock_t timestamp, const int32 downsample_factor_) {
-    timestamp_ = timestamp;
+            const clock_t timestamp, const int32 downsample_factor);
 
-    image_->fromArray(new_frame, stride, downsample_factor_);
-    timeLog("Downsampled image");
-
-    // Create the smoothed pyramids.
-    computeSmoothedPyramid(*image_, NUM_LEVELS, pyramid_);
-    timeLog("Created smoothed pyramids");
-
-    // Create the spatial derivatives for frame 1.
-    computeSpatialPyramid((const Image<uint8>**)pyramid_,
-                          NUM_LEVELS, spatial_x_, spatial_y_);
-    timeLog("Created spatial derivatives");
-  }
+  const int32 num_levels_;
 
   clock_t timestamp_;
   Image<uint8>* image_;
-  Image<uint8>* pyramid_[NUM_LEVELS];
-  Image<int32>* spatial_x_[NUM_LEVELS];
-  Image<int32>* spatial_y_[NUM_LEVELS];
+  Image<uint8>* pyramid_[MAX_LEVELS];
+  Image<int16>* spatial_x_[MAX_LEVELS];
+  Image<int16>* spatial_y_[MAX_LEVELS];
+
+ private:
+  // Backing store for all of the images above.
+  uint8* storage_;
+
+  // Not copyable, as the storage is owned.
+  ImageData(const ImageData&);
+  void operator=(const ImageData&);
 };
 
 // A class that records a timestamped frame features
 // translation delta for optical flow.
 class FramePair {
  public:
+  // Allocates room for max_features features. approximate_queries is as in
+  // OpticalFlowConfig.
+  FramePair(const int32 max_features, const bool approximate_queries);
+  ~FramePair();
+
   // Cleans up the FramePair so that they can be reused.
   void init(const clock_t end_time);
 
+  // Indexes the found features by position for queryFlow. Called once the
+  // features have been tracked; init clears the index.
+  void buildQueryIndex();
+
   // Throws out outliers based on the input weighting.
   Point2D getWeightedDelta(const float32* const weights) const;
 
-  // Weights points based on the query_point and cutoff_dist, then
-  // returns getWeightedDelta.  Essentially tells you where a point at the
-  // beginning of a frame ends up.
+  // Weights points based on the query_point and cutoff_dist, then finds
+  // their weighted delta without outliers, as getWeightedDelta does.
+  // Essentially tells you where a point at the beginning of a frame ends up.
+  // Uses the index from buildQueryIndex. Every feature is weighed by its own
+  // distance unless approximate_queries is set, in which case far cells cost
+  // the same however many features they hold. Either way, outliers are
+  // thrown out feature by feature. Safe to call concurrently.
   Point2D queryFlow(const Point2D& query_point,
                     const float32 cutoff_dist) const;
 
@@ -138,11 +200,14 @@ class FramePair {
   // The time at frame2.
   clock_t end_time;
 
+  // The number of features the arrays below have room for.
+  const int32 max_features_;
+
   // This array will contain the features found in frame 1.
-  Point2D frame1_features_[MAX_FEATURES];
+  Point2D* const frame1_features_;
 
   // Contain the locations of the points from frame 1 in frame 2.
-  Point2D frame2_features_[MAX_FEATURES];
+  Point2D* const frame2_features_;
 
   // The number of features in frame 1.
   int32 number_of_features_;
@@ -151,7 +216,57 @@ class FramePair {
   // another.
   // The i-th element of this array will be non-zero if and only if the i-th
   // feature of frame 1 was found in frame 2.
-  bool optical_flow_found_feature_[MAX_FEATURES];
+  bool* const optical_flow_found_feature_;
+
+ private:
+  // A found feature as queryFlow sees it, with its score scaled into an
+  // intrinsic weight.
+  struct IndexedFeature {
+    float32 x;
+    float32 y;
+    float32 delta_x;
+    float32 delta_y;
+    float32 weight;
+  };
+
+  // Sums over the features in one grid cell, each term scaled by the
+  // feature's intrinsic weight, and the bounds of their deltas.
+  struct QueryCell {
+    int32 start;
+    int32 count;
+
+    float32 min_delta_x;
+    float32 max_delta_x;
+    float32 min_delta_y;
+    float32 max_delta_y;
+
+    float32 total_weight;
+    float32 center_x;
+    float32 center_y;
+    float32 sum_x;
+    float32 sum_y;
+    float32 sum_squares;
+  };
+
+  const bool approximate_queries_;
+
+  // Found features sorted by cell, and the cells they're sorted into.
+  IndexedFeature* const indexed_features_;
+  int32 num_indexed_;
+  QueryCell query_cells_[QUERY_GRID_SIZE];
+
+  // Returns the index of the grid cell containing point.
+  int32 getQueryCell(const Point2D& point) const;
+
+  // Placement of the grid over the found features.
+  float32 grid_left_;
+  float32 grid_top_;
+  float32 cell_width_;
+  float32 cell_height_;
+
+  // Not copyable, as the arrays are owned.
+  FramePair(const FramePair&);
+  void operator=(const FramePair&);
 };
 
 // Class encapsulating all the data and logic necessary for performing optical
@@ -168,10 +283,19 @@ class FramePair {
 //
 // // Look up the delta from a given point at a given time to the current time.
 // getAccumulatedDelta(...);
+//
+// Boxes registered with registerObject are moved along on every computeFlow,
+// and can all be read back at once with getObjects.
 class OpticalFlow {
  public:
+  // Called on the tracking thread once a frame passed to processFrameAsync
+  // has been tracked. The flow may be queried from inside the callback.
+  typedef void (*FlowCallback)(void* context, const OpticalFlow& flow,
+                               const clock_t timestamp);
+
   OpticalFlow(const int32 frame_width, const int32 frame_height,
-              const int32 downsample_factor);
+              const int32 downsample_factor,
+              const OpticalFlowConfig& config = OpticalFlowConfig());
   ~OpticalFlow();
 
   // Add a new frame to the optical flow.  Will update all the non-feature
@@ -192,8 +316,32 @@ class OpticalFlow {
   // Process the most recent two frames, and fill in the feature arrays.
   void computeFlow();
 
-  // Copy the feature arrays after computeFlow is called.
-  // out_data should be at least MAX_FEATURES * FEATURE_STEP long.
+  // Pipelined equivalent of nextFrame, computeFeatures and computeFlow.
+  // Builds new_frame's pyramid on the calling thread while the previous frame
+  // is still being tracked in the background, then hands new_frame to the
+  // tracking thread and returns. new_frame may be reused once this returns.
+  // callback, if not NULL, is called when tracking completes.
+  //
+  // Interest regions added before this call apply to this frame. While it's
+  // in flight, other threads may query the flow, use the object methods and
+  // add interest regions; they see the flow as of the last frame tracked.
+  // Frames must only be added from one thread.
+  void processFrameAsync(const uint8* const new_frame,
+                         const clock_t timestamp,
+                         const bool cached_ok,
+                         FlowCallback callback,
+                         void* context);
+
+  // Blocks until the last frame passed to processFrameAsync has been tracked.
+  // Returns immediately if none is in flight.
+  void waitForFlow();
+
+  inline const OpticalFlowConfig& getConfig() const {
+    return config_;
+  }
+
+  // Copy the feature arrays of the newest frame that has been tracked.
+  // out_data should be at least max_features * FEATURE_STEP long.
   // Currently, its format is [x1 y1 found x2 y2 score] repeated N times,
   // where N is the number of features tracked.  N is returned as the result.
   int32 getFeatures(const bool only_found, float32* const out_data) const;
@@ -204,6 +352,25 @@ class OpticalFlow {
                               const float radius,
                               const clock_t timestamp) const;
 
+  // Starts tracking the box, given in original frame coordinates as of
+  // timestamp. The box is brought up to date with getAccumulatedDelta, and
+  // from then on follows the features inside it on every computeFlow. Returns
+  // the object's id, or -1 if MAX_TRACKED_OBJECTS are already tracked.
+  //
+  // The object methods may be called from any thread, including while a
+  // frame passed to processFrameAsync is being tracked.
+  int32 registerObject(const float32 left, const float32 top,
+                       const float32 right, const float32 bottom,
+                       const clock_t timestamp);
+
+  // Stops tracking the object with the given id.
+  void unregisterObject(const int32 id);
+
+  // Copies every tracked object, as of the last computeFlow, to out_data.
+  // out_data should be at least MAX_TRACKED_OBJECTS * OBJECT_STEP long; see
+  // ObjectTracker::getObjects for the format. Returns the number of objects.
+  int32 getObjects(float32* const out_data) const;
+
   // Pay special attention to the area inside this box on the next
   // optical flow pass.
   void addInterestRegion(const int32 num_x, const int32 num_y,
@@ -214,22 +381,25 @@ class OpticalFlow {
   // Stores the results in the given FramePair.
   void findCorrespondences(FramePair* const curr_change) const;
 
-  // An implementation of the Pyramidal Lucas-Kanade Optical Flow algorithm.
+  // An implementation of the Pyramidal Lucas-Kanade Optical Flow algorithm
+  // for a single point.
   bool findFlowAtPoint(const float32 u_x, const float32 u_y,
                        float32* final_x, float32* final_y) const;
 
   void printInfo() const {
 #ifdef VERBOSE_LOGGING
+    pthread_mutex_lock(&flow_mutex_);
     const int32 first_frame_index = geNthIndexFromStart(0);
-    const FramePair& first_frame_pair = frame_pairs_[first_frame_index];
+    const FramePair& first_frame_pair = *frame_pairs_[first_frame_index];
 
     const int32 last_frame_index = geNthIndexFromEnd(0);
-    const FramePair& last_frame_pair = frame_pairs_[last_frame_index];
+    const FramePair& last_frame_pair = *frame_pairs_[last_frame_index];
 
     LOGV  ("Queue size: %d, last/first: %4d %4d: %8ld - %8ld = %8ld",
          num_frames_, last_frame_index, first_frame_index,
          last_frame_pair.end_time, first_frame_pair.end_time,
          last_frame_pair.end_time - first_frame_pair.end_time);
+    pthread_mutex_unlock(&flow_mutex_);
 #endif
   }
 
@@ -237,17 +407,59 @@ class OpticalFlow {
   inline int32 geNthIndexFromStart(const int32 offset) const {
     CHECK(offset >= 0 && offset < num_frames_,
           "Offset out of range!  %d out of %d.", offset, num_frames_);
-    return (first_frame_index_ + offset) % NUM_FRAMES;
+    return (first_frame_index_ + offset) % config_.num_frames;
   }
 
   inline int32 geNthIndexFromEnd(const int32 offset) const {
     return geNthIndexFromStart(num_frames_ - 1 - offset);
   }
 
+  // Number of frame pairs queries may read, leaving out the newest while
+  // it's still being filled in.
+  inline int32 getNumQueryableFrames() const {
+    return newest_pending_ ? num_frames_ - 1 : num_frames_;
+  }
+
+  // geNthIndexFromEnd over the frame pairs queries may read.
+  inline int32 getNthQueryableIndexFromEnd(const int32 offset) const {
+    return geNthIndexFromEnd(newest_pending_ ? offset + 1 : offset);
+  }
+
+  // getAccumulatedDelta with flow_mutex_ already held.
+  Point2D findAccumulatedDelta(const Point2D& position,
+                               const float radius,
+                               const clock_t timestamp) const;
+
+  // Makes frame, already initialized from a slot of frame_ring_, the newest
+  // frame and opens a new FramePair for it.
+  void addFrame(ImageData* const frame, const clock_t timestamp);
+
+  // WorkerThread task that tracks the frame added by processFrameAsync.
+  static void trackFrameTask(void* arg);
+
   // Finds features in the previous frame and adds them to curr_change.
   void findFeatures(const FramePair& prev_change,
                     FramePair* const curr_change);
 
+  // Tracks num_features points from frame1_ into frame2_, setting found[i]
+  // for each point that stays in the image. Handles at most
+  // FEATURE_BATCH_SIZE points.
+  void trackFeatureBatch(const Point2D* const features1,
+                         const int32 num_features,
+                         Point2D* const features2,
+                         bool* const found) const;
+
+  // trackFeatureBatch with the window radius and level count fixed at compile
+  // time, or read from config_ when 0.
+  template <int32 kWindowSize, int32 kNumLevels>
+  void trackFeatureBatch(const Point2D* const features1,
+                         const int32 num_features,
+                         Point2D* const features2,
+                         bool* const found) const;
+
+  // WorkerPool task that tracks one batch of a FramePair.
+  static void trackBatchTask(void* arg, const int32 index);
+
   // Copies and compacts the found features in the second frame of prev_change
   // into the array at new_features.
   static int32 copyFeatures(const FramePair& prev_change,
@@ -255,6 +467,8 @@ class OpticalFlow {
 
   const int32 downsample_factor_;
 
+  const OpticalFlowConfig config_;
+
   // Size of the original images.
   const Size original_size_;
 
@@ -269,19 +483,52 @@ class OpticalFlow {
 
   clock_t last_time_fresh_features_;
 
-  Point2D tmp_features_[MAX_TEMP_FEATURES];
+  // Candidates for findFeatures: room for every cached and seeded feature
+  // plus one FAST feature per selection cell, so none are ever dropped.
+  Point2D* tmp_features_;
 
-  FramePair frame_pairs_[NUM_FRAMES];
+  // Circular queue of config_.num_frames frame deltas.
+  FramePair** frame_pairs_;
 
   // Scratch memory for feature candidacy detection and non-max suppression.
   Image<uint8>* feature_scratch_;
+  Image<int32>* selection_grid_;
 
-  // Regions of the image to pay special attention to.
+  // Regions of the image to pay special attention to, as added for the next
+  // computeFeatures, and as swapped out for the frame being tracked.
   Image<bool>* interest_map_;
+  Image<bool>* tracking_interest_map_;
+
+  // Boxes that follow the flow, updated on every computeFlow.
+  ObjectTracker* object_tracker_;
+
+  // Guards object_tracker_, interest_map_ and the bookkeeping of the frame
+  // pair queue below between the tracking thread and other callers.
+  mutable pthread_mutex_t flow_mutex_;
+
+  // Whether the newest FramePair is still being filled in. Queries skip it
+  // until computeFlow finishes, so a pair is never read while it's tracked.
+  bool newest_pending_;
+
+  // Preallocated frames that nextFrame cycles through, and the slot the next
+  // frame goes in. frame1_ and frame2_ point into the ring.
+  ImageData* frame_ring_[FRAME_RING_SIZE];
+  int32 ring_index_;
 
   ImageData* frame1_;
   ImageData* frame2_;
 
+  // Threads that feature batches are tracked on.
+  WorkerPool* worker_pool_;
+
+  // Thread that processFrameAsync tracks frames on, and the arguments for the
+  // frame in flight.
+  WorkerThread* tracking_thread_;
+  bool async_cached_ok_;
+  FlowCallback async_callback_;
+  void* async_context_;
+  clock_t async_timestamp_;
+
   bool frame_added_;
   bool features_computed_;
   bool flow_computed_;
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Per-kernel benchmark for the optical flow image kernels:
+//
+//   imagekernelbench [-w width] [-h height] [-f factor] [-r runs]
+//
+// A random width x height frame is downsampled by factor, as nextFrame()
+// does, and the smoothing and gradient kernels then run on the downsampled
+// image. Every supported kernel level is timed, and its output is checked
+// against KERNELS_SCALAR. The fused pyramid kernels are also checked against
+// the separate passes they replace. The exit status is nonzero on any
+// mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "image_kernels.h"
+
+using namespace flow;
+
+static const char* kLevelNames[] = { "scalar", "sse2", "avx2", "neon" };
+
+static const int32 kNumLevels = sizeof(kLevelNames) / sizeof(kLevelNames[0]);
+
+enum {
+  BENCH_AVERAGED = 0,
+  BENCH_SMOOTHED,
+  BENCH_DERIVATIVE_X,
+  BENCH_DERIVATIVE_Y,
+  BENCH_FUSED_AVERAGED,
+  BENCH_FUSED_SMOOTHED,
+  BENCH_FAST9,
+  BENCH_FAST12,
+  NUM_BENCHMARKS
+};
+
+static const char* kBenchmarkNames[] = {
+  "downsampleAveraged", "downsampleSmoothed3x3", "derivativeX",
+  "derivativeY", "averagedGradients", "smoothedGradients", "fast9Corners",
+  "fast12Corners"
+};
+
+// Threshold the FAST benchmarks test corners with.
+static const int32 kFastThreshold = 10;
+
+struct Buffers {
+  int32 frame_width;
+  int32 frame_height;
+  int32 factor;
+  int32 width;
+  int32 height;
+
+  uint8* frame;
+  uint8* image;
+  uint8* half;
+  int16* derivative;
+
+  // Output of the fused kernels: an image followed by its x and y
+  // derivatives.
+  uint8* fused;
+  int16* fused_x;
+  int16* fused_y;
+
+  // Output of the FAST kernels, left zero around the 3 pixel margin.
+  uint8* corners;
+};
+
+static double nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Runs one kernel, returning its output and the output size in bytes.
+static const void* runBenchmark(const int32 benchmark, Buffers* const b,
+                                int32* const size) {
+  switch (benchmark) {
+    case BENCH_AVERAGED:
+      downsampleAveragedKernel(b->frame, b->frame_width, b->factor,
+                               b->image, b->width, b->height);
+      *size = b->width * b->height;
+      return b->image;
+    case BENCH_SMOOTHED:
+      downsampleSmoothed3x3Kernel(b->image, b->width, b->height,
+                                  b->half, b->width / 2, b->height / 2);
+      *size = (b->width / 2) * (b->height / 2);
+      return b->half;
+    case BENCH_DERIVATIVE_X:
+      derivativeXKernel(b->image, b->width, b->height, b->derivative);
+      *size = b->width * b->height * sizeof(*b->derivative);
+      return b->derivative;
+    case BENCH_DERIVATIVE_Y:
+      derivativeYKernel(b->image, b->width, b->height, b->derivative);
+      *size = b->width * b->height * sizeof(*b->derivative);
+      return b->derivative;
+    case BENCH_FUSED_AVERAGED:
+      downsampleAveragedGradientsKernel(b->frame, b->frame_width, b->factor,
+                                        b->fused, b->width, b->height,
+                                        b->fused_x, b->fused_y);
+      *size = b->width * b->height * 5;
+      return b->fused;
+    case BENCH_FUSED_SMOOTHED:
+      downsampleSmoothedGradientsKernel(b->image, b->width, b->height,
+                                        b->fused, b->width / 2, b->height / 2,
+                                        b->fused_x, b->fused_y);
+      *size = b->width * b->height * 5;
+      return b->fused;
+    case BENCH_FAST9:
+    case BENCH_FAST12: {
+      const int32 arc_length = benchmark == BENCH_FAST9 ? 9 : 12;
+      for (int32 y = 3; y < b->height - 3; ++y) {
+        fastCornerRowKernel(b->image + y * b->width + 3, b->width,
+                            b->width - 6, arc_length, kFastThreshold,
+                            b->corners + y * b->width + 3);
+      }
+      *size = b->width * b->height;
+      return b->corners;
+    }
+  }
+
+  *size = 0;
+  return NULL;
+}
+
+// Checks that a fused kernel's output in b->fused matches a separate
+// downsample into image followed by the derivative kernels.
+static bool matchesSeparatePasses(Buffers* const b, const uint8* const image,
+                                  const int32 width, const int32 height) {
+  const int32 num_pixels = width * height;
+  if (memcmp(b->fused, image, num_pixels) != 0) {
+    return false;
+  }
+
+  derivativeXKernel(image, width, height, b->derivative);
+  if (memcmp(b->fused_x, b->derivative, num_pixels * sizeof(int16)) != 0) {
+    return false;
+  }
+
+  derivativeYKernel(image, width, height, b->derivative);
+  return memcmp(b->fused_y, b->derivative, num_pixels * sizeof(int16)) == 0;
+}
+
+static int usage(const char* program) {
+  fprintf(stderr, "Usage: %s [-w width] [-h height] [-f factor] [-r runs]\n",
+          program);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  Buffers b;
+  int32 runs = 200;
+  int opt;
+
+  b.frame_width = 1280;
+  b.frame_height = 720;
+  b.factor = 4;
+
+  while ((opt = getopt(argc, argv, "w:h:f:r:")) != -1) {
+    switch (opt) {
+      case 'w':
+        b.frame_width = atoi(optarg);
+        break;
+      case 'h':
+        b.frame_height = atoi(optarg);
+        break;
+      case 'f':
+        b.factor = atoi(optarg);
+        break;
+      case 'r':
+        runs = max(1, atoi(optarg));
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || b.factor < 1 ||
+      b.frame_width < 2 * b.factor || b.frame_height < 2 * b.factor) {
+    return usage(argv[0]);
+  }
+
+  b.width = b.frame_width / b.factor;
+  b.height = b.frame_height / b.factor;
+
+  const int32 num_pixels = b.width * b.height;
+  b.frame = (uint8*) malloc(b.frame_width * b.frame_height);
+  b.image = (uint8*) malloc(num_pixels);
+  b.half = (uint8*) malloc(num_pixels);
+  b.derivative = (int16*) malloc(num_pixels * sizeof(int16));
+  b.fused = (uint8*) malloc(num_pixels * 5);
+  b.fused_x = (int16*) (b.fused + num_pixels);
+  b.fused_y = b.fused_x + num_pixels;
+  b.corners = (uint8*) calloc(num_pixels, 1);
+  uint8* const reference = (uint8*) malloc(num_pixels * 5);
+  uint8* const source = (uint8*) malloc(num_pixels);
+
+  // Smooth noise, so the gradients span both signs and small magnitudes.
+  srand(1);
+  for (int32 i = 0; i < b.frame_width * b.frame_height; ++i) {
+    b.frame[i] = (i % b.frame_width) / 4 + rand() % 64;
+  }
+
+  setKernelLevel(KERNELS_SCALAR);
+  downsampleAveragedKernel(b.frame, b.frame_width, b.factor,
+                           source, b.width, b.height);
+
+  int32 failures = 0;
+
+  // The fused kernels must reproduce the separate passes exactly.
+  int32 size = 0;
+  memset(b.fused, 0, num_pixels * 5);
+  runBenchmark(BENCH_FUSED_AVERAGED, &b, &size);
+  if (!matchesSeparatePasses(&b, source, b.width, b.height)) {
+    printf("%s differs from the separate passes\n",
+           kBenchmarkNames[BENCH_FUSED_AVERAGED]);
+    ++failures;
+  }
+
+  memcpy(b.image, source, num_pixels);
+  downsampleSmoothed3x3Kernel(b.image, b.width, b.height,
+                              b.half, b.width / 2, b.height / 2);
+  memset(b.fused, 0, num_pixels * 5);
+  runBenchmark(BENCH_FUSED_SMOOTHED, &b, &size);
+  if (!matchesSeparatePasses(&b, b.half, b.width / 2, b.height / 2)) {
+    printf("%s differs from the separate passes\n",
+           kBenchmarkNames[BENCH_FUSED_SMOOTHED]);
+    ++failures;
+  }
+
+  printf("%dx%d frame, factor %d, %dx%d image, %d runs\n",
+         b.frame_width, b.frame_height, b.factor, b.width, b.height, runs);
+  printf("%-24s %-8s %10s %10s\n", "kernel", "level", "us/call", "speedup");
+
+  for (int32 benchmark = 0; benchmark < NUM_BENCHMARKS; ++benchmark) {
+    double scalar_ms = 0.0;
+
+    for (int32 level = 0; level < kNumLevels; ++level) {
+      if (!kernelLevelSupported(level)) {
+        continue;
+      }
+
+      setKernelLevel(level);
+      memcpy(b.image, source, num_pixels);
+
+      const void* output = runBenchmark(benchmark, &b, &size);
+
+      if (level == KERNELS_SCALAR) {
+        memcpy(reference, output, size);
+      } else if (memcmp(reference, output, size) != 0) {
+        printf("%-24s %-8s output differs from scalar\n",
+               kBenchmarkNames[benchmark], kLevelNames[level]);
+        ++failures;
+      }
+
+      const double start = nowMs();
+      for (int32 r = 0; r < runs; ++r) {
+        runBenchmark(benchmark, &b, &size);
+      }
+      const double ms = (nowMs() - start) / runs;
+
+      if (level == KERNELS_SCALAR) {
+        scalar_ms = ms;
+      }
+
+      printf("%-24s %-8s %10.2f %9.2fx\n", kBenchmarkNames[benchmark],
+             kLevelNames[level], ms * 1000.0, scalar_ms / ms);
+    }
+  }
+
+  free(b.frame);
+  free(b.image);
+  free(b.half);
+  free(b.derivative);
+  free(b.fused);
+  free(b.corners);
+  free(reference);
+  free(source);
+
+  return failures ? 1 : 0;
+}
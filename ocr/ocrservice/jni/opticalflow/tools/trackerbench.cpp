@@ -0,0 +1,579 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for Lucas-Kanade feature tracking:
+//
+//   trackerbench [-w width] [-h height] [-f factor] [-n features] [-r runs]
+//                [-s window_size] [-l num_levels] [-i num_iterations]
+//                [-g gap_us]
+//
+// Two random textured frames, the second shifted by a known sub-pixel amount,
+// are added to an OpticalFlow. A grid of features is then tracked between them
+// at every supported kernel level, reporting the time per
+// findCorrespondences() call, the number of features found and their mean
+// error against the known shift, in original frame pixels.
+//
+// The two frames are then fed alternately through a full nextFrame,
+// computeFeatures and computeFlow sequence, through processFrameAsync waiting
+// for each frame before the next as a caller that reads results every frame
+// would, and through processFrameAsync alone, reporting the time per frame
+// spent on the calling thread by each. The calling thread sleeps for gap_us
+// between frames, as a preview thread drawing the last frame would, and that
+// sleep isn't counted. The pipelined features must match the sequential ones.
+//
+// A grid of boxes is then moved through the tracked features by an
+// ObjectTracker, reporting the time per update and how far each box ends up
+// from where the known shift puts it, in original frame pixels.
+//
+// Finally, region queries on a FramePair with a smooth synthetic flow field
+// and some outliers are timed through FramePair::queryFlow, both exact and
+// with approximate_queries, and compared with weighing every feature through
+// getWeightedDelta.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "time_log.h"
+#include "image.h"
+#include "object_tracker.h"
+#include "optical_flow.h"
+
+using namespace flow;
+
+static const char* kLevelNames[] = { "scalar", "sse2", "avx2", "neon" };
+
+static const int32 kNumLevels = sizeof(kLevelNames) / sizeof(kLevelNames[0]);
+
+// Shift of the second frame, in original frame pixels.
+static const float32 kShiftX = 5.3f;
+static const float32 kShiftY = -3.6f;
+
+static double nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// FlowCallback that counts tracked frames.
+static void countFrame(void* context, const OpticalFlow& flow,
+                       const clock_t timestamp) {
+  ++*static_cast<int32*>(context);
+}
+
+// How runSequence hands frames to an OpticalFlow.
+enum SequenceMode {
+  // nextFrame, computeFeatures and computeFlow.
+  SEQUENCE_SEQUENTIAL,
+  // processFrameAsync, then waitForFlow before the next frame.
+  SEQUENCE_BLOCKING,
+  // processFrameAsync only.
+  SEQUENCE_PIPELINED
+};
+
+// Feeds runs frames alternating between frame1 and frame2 through flow as
+// mode says, gap_us apart, and returns the time per frame spent in flow on the
+// calling thread. Leaves the last frame's features in out_data and their count
+// in num_features.
+static double runSequence(OpticalFlow* const flow, const SequenceMode mode,
+                          const uint8* const frame1,
+                          const uint8* const frame2, const int32 runs,
+                          const int32 gap_us,
+                          float32* const out_data,
+                          int32* const num_features) {
+  int32 num_tracked = 0;
+
+  // Feature selection breaks ties with a randomized sort, so both sequences
+  // need the same seed to pick the same features.
+  srand(1);
+
+  double total_ms = 0.0;
+  for (int32 r = 0; r < runs; ++r) {
+    const uint8* const frame = (r % 2 == 0) ? frame1 : frame2;
+    const clock_t timestamp = r * 33;
+
+    if (gap_us > 0) {
+      usleep(gap_us);
+    }
+
+    const double start = nowMs();
+
+    if (mode != SEQUENCE_SEQUENTIAL) {
+      flow->processFrameAsync(frame, timestamp, true, countFrame,
+                              &num_tracked);
+      if (mode == SEQUENCE_BLOCKING) {
+        flow->waitForFlow();
+      }
+    } else {
+      flow->nextFrame(frame, timestamp);
+      flow->computeFeatures(true);
+      flow->computeFlow();
+      ++num_tracked;
+    }
+    total_ms += nowMs() - start;
+  }
+  const double ms = total_ms / runs;
+
+  flow->waitForFlow();
+  if (num_tracked != runs) {
+    fprintf(stderr, "Tracked %d of %d frames!\n", num_tracked, runs);
+  }
+
+  *num_features = flow->getFeatures(false, out_data);
+  return ms;
+}
+
+// Moves a grid of boxes through pair, whose features were tracked between
+// frames shifted by kShiftX and kShiftY, and reports the cost of each update
+// and the error in where the boxes end up.
+static void benchmarkObjects(const FramePair& pair, const int32 width,
+                             const int32 height, const int32 factor,
+                             const int32 max_features, const int32 runs) {
+  static const int32 kObjectsX = 4;
+  static const int32 kObjectsY = 3;
+
+  const float32 box_width = width / 6.0f;
+  const float32 box_height = height / 5.0f;
+
+  ObjectTracker tracker(max_features);
+  float32 objects[MAX_TRACKED_OBJECTS * OBJECT_STEP];
+
+  double total_ms = 0.0;
+  for (int32 r = 0; r < runs; ++r) {
+    tracker.clear();
+    for (int32 i = 0; i < kObjectsX * kObjectsY; ++i) {
+      const Point2D center(width * (0.25f + 0.5f * (i % kObjectsX) /
+                                    (kObjectsX - 1)),
+                           height * (0.25f + 0.5f * (i / kObjectsX) /
+                                     (kObjectsY - 1)));
+      tracker.addObject(center, box_width, box_height);
+    }
+
+    const double start = nowMs();
+    tracker.update(pair, factor);
+    total_ms += nowMs() - start;
+  }
+
+  const int32 num_objects = tracker.getObjects(objects);
+
+  int32 num_fit = 0;
+  float32 total_error = 0.0f;
+  float32 max_error = 0.0f;
+  for (int32 i = 0; i < num_objects; ++i) {
+    const float32* const object = objects + i * OBJECT_STEP;
+    const float32 start_x = width * (0.25f + 0.5f * (i % kObjectsX) /
+                                     (kObjectsX - 1));
+    const float32 start_y = height * (0.25f + 0.5f * (i / kObjectsX) /
+                                      (kObjectsY - 1));
+
+    // Distance of the box's bottom right corner from where it should be,
+    // which folds any spurious rotation or scale into the error.
+    const float32 half_width = object[3] / 2.0f;
+    const float32 half_height = object[4] / 2.0f;
+    const float32 cos_angle = cosf(object[5]);
+    const float32 sin_angle = sinf(object[5]);
+    const float32 corner_x =
+        object[1] + cos_angle * half_width - sin_angle * half_height;
+    const float32 corner_y =
+        object[2] + sin_angle * half_width + cos_angle * half_height;
+    const float32 error =
+        sqrtf(square(corner_x - (start_x + kShiftX + box_width / 2.0f)) +
+              square(corner_y - (start_y + kShiftY + box_height / 2.0f)));
+
+    total_error += error;
+    max_error = max(max_error, error);
+    num_fit += object[6] > 0.0f;
+  }
+
+  printf("\n%d objects, %.0fx%.0f boxes\n", num_objects, box_width,
+         box_height);
+  printf("%-8s %10s %7s %10s %10s\n",
+         "objects", "us/update", "fit", "mean err", "max err");
+  printf("%-8s %10.2f %7d %10.4f %10.4f\n", "tracker",
+         total_ms * 1000.0 / runs, num_fit,
+         num_objects > 0 ? total_error / num_objects : 0.0f, max_error);
+}
+
+// Reference for FramePair::queryFlow: weighs every found feature by distance
+// and score, then takes the weighted delta without outliers.
+static Point2D queryFlowExact(const FramePair& pair, const Point2D& query,
+                              const float32 cutoff_dist,
+                              float32* const weights) {
+  float32 max_score = 0.0f;
+  for (int32 i = 0; i < pair.number_of_features_; ++i) {
+    if (pair.optical_flow_found_feature_[i]) {
+      max_score = max(max_score, pair.frame1_features_[i].score);
+    }
+  }
+
+  for (int32 i = 0; i < pair.number_of_features_; ++i) {
+    weights[i] = 0.0f;
+    if (pair.optical_flow_found_feature_[i]) {
+      const Point2D& feature = pair.frame1_features_[i];
+      const float32 dist_squared =
+          square(query.x - feature.x) + square(query.y - feature.y);
+      weights[i] = min(square(cutoff_dist) / dist_squared, 1.0f) *
+          (max_score > 0 ? (feature.score / max_score) / 2.0f : 1.0f);
+    }
+  }
+
+  return pair.getWeightedDelta(weights);
+}
+
+// Times queries through queryFlow on pair against queryFlowExact, returning
+// the time per query in milliseconds, and the mean and max distance between
+// the two.
+static double timeQueries(const FramePair& pair, const Point2D* const queries,
+                          const int32 num_queries, const float32 cutoff_dist,
+                          const int32 runs, float32* const weights,
+                          float32* const mean_error, float32* const max_error,
+                          float32* const checksum) {
+  *max_error = 0.0f;
+  float32 total_error = 0.0f;
+  for (int32 q = 0; q < num_queries; ++q) {
+    const Point2D exact =
+        queryFlowExact(pair, queries[q], cutoff_dist, weights);
+    const Point2D indexed = pair.queryFlow(queries[q], cutoff_dist);
+    const float32 error =
+        sqrtf(square(exact.x - indexed.x) + square(exact.y - indexed.y));
+    *max_error = max(*max_error, error);
+    total_error += error;
+  }
+  *mean_error = total_error / num_queries;
+
+  const double start = nowMs();
+  for (int32 r = 0; r < runs; ++r) {
+    for (int32 q = 0; q < num_queries; ++q) {
+      *checksum += pair.queryFlow(queries[q], cutoff_dist).x;
+    }
+  }
+  return (nowMs() - start) / (runs * num_queries);
+}
+
+// Times queries through FramePair::queryFlow, exact and approximate, and
+// queryFlowExact on a pair of num_features features spread over a
+// width x height frame.
+static void benchmarkQueries(const int32 width, const int32 height,
+                             const int32 num_features, const int32 runs) {
+  FramePair pair(num_features, false);
+  FramePair approximate_pair(num_features, true);
+  pair.init(0);
+  approximate_pair.init(0);
+
+  // A gentle rotation about the center, with one feature in eight off
+  // somewhere else entirely.
+  srand(2);
+  for (int32 i = 0; i < num_features; ++i) {
+    Point2D* const feature = pair.frame1_features_ + i;
+    feature->x = rand() % width;
+    feature->y = rand() % height;
+    feature->score = rand() % 1000;
+
+    Point2D delta(-(feature->y - height / 2) * 0.02f,
+                  (feature->x - width / 2) * 0.02f);
+    if (i % 8 == 0) {
+      delta.x = rand() % 21 - 10;
+      delta.y = rand() % 21 - 10;
+    }
+    pair.frame2_features_[i].x = feature->x + delta.x;
+    pair.frame2_features_[i].y = feature->y + delta.y;
+    pair.optical_flow_found_feature_[i] = (i % 10 != 0);
+
+    approximate_pair.frame1_features_[i] = *feature;
+    approximate_pair.frame2_features_[i] = pair.frame2_features_[i];
+    approximate_pair.optical_flow_found_feature_[i] =
+        pair.optical_flow_found_feature_[i];
+  }
+  pair.number_of_features_ = num_features;
+  approximate_pair.number_of_features_ = num_features;
+  pair.buildQueryIndex();
+  approximate_pair.buildQueryIndex();
+
+  const int32 num_queries = 64;
+  Point2D queries[num_queries];
+  for (int32 q = 0; q < num_queries; ++q) {
+    queries[q] = Point2D(rand() % width, rand() % height);
+  }
+  const float32 cutoff_dist = min(width, height) / 16.0f;
+
+  float32* const weights = new float32[num_features];
+  float32 checksum = 0.0f;
+
+  double start = nowMs();
+  for (int32 r = 0; r < runs; ++r) {
+    for (int32 q = 0; q < num_queries; ++q) {
+      checksum += queryFlowExact(pair, queries[q], cutoff_dist, weights).x;
+    }
+  }
+  const double exact_ms = (nowMs() - start) / (runs * num_queries);
+
+  float32 indexed_mean_error;
+  float32 indexed_max_error;
+  const double indexed_ms =
+      timeQueries(pair, queries, num_queries, cutoff_dist, runs, weights,
+                  &indexed_mean_error, &indexed_max_error, &checksum);
+
+  float32 approximate_mean_error;
+  float32 approximate_max_error;
+  const double approximate_ms =
+      timeQueries(approximate_pair, queries, num_queries, cutoff_dist, runs,
+                  weights, &approximate_mean_error, &approximate_max_error,
+                  &checksum);
+
+  printf("\n%d features, radius %.1f, %d queries (checksum %.1f)\n",
+         num_features, cutoff_dist, num_queries, checksum);
+  printf("%-10s %10s %9s %10s %10s\n",
+         "query", "us/query", "speedup", "mean err", "max err");
+  printf("%-10s %10.3f %8.2fx\n", "exact", exact_ms * 1000.0, 1.0);
+  printf("%-10s %10.3f %8.2fx %10.4f %10.4f\n", "indexed",
+         indexed_ms * 1000.0, exact_ms / indexed_ms,
+         indexed_mean_error, indexed_max_error);
+  printf("%-10s %10.3f %8.2fx %10.4f %10.4f\n", "approx",
+         approximate_ms * 1000.0, exact_ms / approximate_ms,
+         approximate_mean_error, approximate_max_error);
+
+  delete[] weights;
+}
+
+static int usage(const char* program) {
+  fprintf(stderr, "Usage: %s [-w width] [-h height] [-f factor] "
+          "[-n features] [-r runs]\n"
+          "       [-s window_size] [-l num_levels] [-i num_iterations] "
+          "[-g gap_us]\n",
+          program);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  int32 width = 1280;
+  int32 height = 720;
+  int32 factor = 4;
+  int32 runs = 200;
+  int32 gap_us = 0;
+  int opt;
+
+  OpticalFlowConfig config;
+  int32 num_features = config.max_features;
+
+  while ((opt = getopt(argc, argv, "w:h:f:n:r:s:l:i:g:")) != -1) {
+    switch (opt) {
+      case 'w':
+        width = atoi(optarg);
+        break;
+      case 'h':
+        height = atoi(optarg);
+        break;
+      case 'f':
+        factor = atoi(optarg);
+        break;
+      case 'n':
+        num_features = atoi(optarg);
+        break;
+      case 'r':
+        runs = max(1, atoi(optarg));
+        break;
+      case 's':
+        config.window_size = atoi(optarg);
+        break;
+      case 'l':
+        config.num_levels = atoi(optarg);
+        break;
+      case 'i':
+        config.num_iterations = atoi(optarg);
+        break;
+      case 'g':
+        gap_us = max(0, atoi(optarg));
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || factor < 1 || width < 64 * factor ||
+      height < 64 * factor || num_features < 1 ||
+      num_features > config.max_features || !config.isValid()) {
+    return usage(argv[0]);
+  }
+
+  // Blocky noise, smoothed so the texture survives downsampling.
+  Image<uint8> texture(width + 16, height + 16);
+  srand(1);
+  for (int32 y = 0; y < texture.getHeight(); ++y) {
+    for (int32 x = 0; x < texture.getWidth(); ++x) {
+      texture.setPixel(x, y, rand() % 256);
+    }
+  }
+  Image<uint8> smoothed(texture.getWidth(), texture.getHeight());
+  for (int32 pass = 0; pass < 3; ++pass) {
+    for (int32 y = 0; y < texture.getHeight(); ++y) {
+      for (int32 x = 0; x < texture.getWidth(); ++x) {
+        int32 sum = 0;
+        for (int32 dy = -2; dy <= 2; ++dy) {
+          for (int32 dx = -2; dx <= 2; ++dx) {
+            sum += texture.getPixel(
+                clip(x + dx, 0, texture.getWidth() - 1),
+                clip(y + dy, 0, texture.getHeight() - 1));
+          }
+        }
+        smoothed.setPixel(x, y, sum / 25);
+      }
+    }
+    texture.fromArray(smoothed.getPixelPtrConst(0, 0), smoothed.getWidth(), 1);
+  }
+
+  uint8* const frame1 = new uint8[width * height];
+  uint8* const frame2 = new uint8[width * height];
+  for (int32 y = 0; y < height; ++y) {
+    for (int32 x = 0; x < width; ++x) {
+      frame1[y * width + x] = texture.getPixel(x + 8, y + 8);
+      frame2[y * width + x] = static_cast<uint8>(
+          texture.getPixelInterp(x + 8 - kShiftX, y + 8 - kShiftY) + 0.5f);
+    }
+  }
+
+  OpticalFlow optical_flow(width, height, factor, config);
+  optical_flow.nextFrame(frame1, 0);
+  optical_flow.computeFeatures(false);
+  optical_flow.computeFlow();
+  optical_flow.nextFrame(frame2, 33);
+  optical_flow.computeFeatures(false);
+
+  // A grid of features inside a margin the shift can't push out of view.
+  FramePair* const pair =
+      new FramePair(config.max_features, config.approximate_queries);
+  pair->init(33);
+
+  const int32 working_width = width / factor;
+  const int32 working_height = height / factor;
+  const int32 grid_x = max(1, static_cast<int32>(
+      sqrtf(num_features * working_width / working_height)));
+  const int32 grid_y = (num_features + grid_x - 1) / grid_x;
+  const float32 margin = 32.0f;
+
+  for (int32 i = 0; i < num_features; ++i) {
+    Point2D* const feature = pair->frame1_features_ + i;
+    feature->x = margin + (working_width - 2 * margin) *
+        ((i % grid_x) + 0.5f) / grid_x;
+    feature->y = margin + (working_height - 2 * margin) *
+        ((i / grid_x) + 0.5f) / grid_y;
+  }
+  pair->number_of_features_ = num_features;
+
+  printf("%dx%d frames, factor %d, %d features, window %d, %d levels, "
+         "%d iterations, %d runs\n", width, height, factor, num_features,
+         config.window_size, config.num_levels, config.num_iterations, runs);
+  printf("%-8s %10s %9s %7s %10s\n",
+         "level", "us/call", "speedup", "found", "mean err");
+
+  double scalar_ms = 0.0;
+
+  for (int32 level = 0; level < kNumLevels; ++level) {
+    if (!kernelLevelSupported(level)) {
+      continue;
+    }
+    setKernelLevel(level);
+
+    const double start = nowMs();
+    for (int32 r = 0; r < runs; ++r) {
+      optical_flow.findCorrespondences(pair);
+    }
+    const double ms = (nowMs() - start) / runs;
+
+    if (level == KERNELS_SCALAR) {
+      scalar_ms = ms;
+    }
+
+    int32 num_found = 0;
+    float32 total_error = 0.0f;
+    for (int32 i = 0; i < num_features; ++i) {
+      if (pair->optical_flow_found_feature_[i]) {
+        const Point2D delta =
+            pair->frame2_features_[i] - pair->frame1_features_[i];
+        total_error += sqrtf(square(delta.x * factor - kShiftX) +
+                             square(delta.y * factor - kShiftY));
+        ++num_found;
+      }
+    }
+
+    printf("%-8s %10.2f %8.2fx %7d %10.4f\n", kLevelNames[level],
+           ms * 1000.0, scalar_ms / ms, num_found,
+           num_found > 0 ? total_error / num_found : 0.0f);
+  }
+
+  // Use the fastest kernels for the end-to-end comparison.
+  for (int32 level = kNumLevels - 1; level >= 0; --level) {
+    if (kernelLevelSupported(level)) {
+      setKernelLevel(level);
+      break;
+    }
+  }
+
+  float32* const sequential_features =
+      new float32[config.max_features * FEATURE_STEP];
+  float32* const pipelined_features =
+      new float32[config.max_features * FEATURE_STEP];
+  int32 num_sequential = 0;
+  int32 num_pipelined = 0;
+
+  OpticalFlow sequential_flow(width, height, factor, config);
+  const double sequential_ms =
+      runSequence(&sequential_flow, SEQUENCE_SEQUENTIAL, frame1, frame2, runs,
+                  gap_us, sequential_features, &num_sequential);
+
+  OpticalFlow blocking_flow(width, height, factor, config);
+  const double blocking_ms =
+      runSequence(&blocking_flow, SEQUENCE_BLOCKING, frame1, frame2, runs,
+                  gap_us, pipelined_features, &num_pipelined);
+
+  bool matches = num_sequential == num_pipelined &&
+      memcmp(sequential_features, pipelined_features,
+             num_sequential * FEATURE_STEP * sizeof(float32)) == 0;
+
+  OpticalFlow pipelined_flow(width, height, factor, config);
+  const double pipelined_ms =
+      runSequence(&pipelined_flow, SEQUENCE_PIPELINED, frame1, frame2, runs,
+                  gap_us, pipelined_features, &num_pipelined);
+
+  matches = matches && num_sequential == num_pipelined &&
+      memcmp(sequential_features, pipelined_features,
+             num_sequential * FEATURE_STEP * sizeof(float32)) == 0;
+
+  printf("\n%-10s %10s %9s  (%d us between frames)\n", "mode", "us/frame",
+         "speedup", gap_us);
+  printf("%-10s %10.2f %8.2fx\n", "sequential", sequential_ms * 1000.0, 1.0);
+  printf("%-10s %10.2f %8.2fx\n", "blocking", blocking_ms * 1000.0,
+         sequential_ms / blocking_ms);
+  printf("%-10s %10.2f %8.2fx  %s\n", "pipelined", pipelined_ms * 1000.0,
+         sequential_ms / pipelined_ms,
+         matches ? "features match" : "FEATURES DIFFER");
+
+  benchmarkObjects(*pair, width, height, factor, config.max_features, runs);
+
+  benchmarkQueries(width / factor, height / factor, config.max_features,
+                   runs);
+
+  delete[] sequential_features;
+  delete[] pipelined_features;
+  delete pair;
+  delete[] frame1;
+  delete[] frame2;
+
+  return matches ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2011, Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#include "worker_pool.h"
+
+namespace flow {
+
+WorkerPool::WorkerPool(const int32 num_threads) :
+    num_workers_(0),
+    workers_(NULL),
+    function_(NULL),
+    arg_(NULL),
+    count_(0),
+    next_index_(0),
+    generation_(0),
+    busy_workers_(0),
+    shutdown_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&work_cond_, NULL);
+  pthread_cond_init(&done_cond_, NULL);
+
+  // The calling thread always participates, so only spawn the remainder.
+  const int32 num_spawned = max(num_threads, 1) - 1;
+  if (num_spawned > 0) {
+    workers_ = new pthread_t[num_spawned];
+
+    for (int32 i = 0; i < num_spawned; ++i) {
+      if (pthread_create(&workers_[i], NULL, workerMain, this) != 0) {
+        LOGW("Failed to create worker thread %d of %d.", i + 1, num_spawned);
+        break;
+      }
+      ++num_workers_;
+    }
+  }
+}
+
+
+WorkerPool::~WorkerPool() {
+  pthread_mutex_lock(&mutex_);
+  shutdown_ = true;
+  pthread_cond_broadcast(&work_cond_);
+  pthread_mutex_unlock(&mutex_);
+
+  for (int32 i = 0; i < num_workers_; ++i) {
+    pthread_join(workers_[i], NULL);
+  }
+
+  delete[] workers_;
+
+  pthread_cond_destroy(&done_cond_);
+  pthread_cond_destroy(&work_cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+int32 WorkerPool::getNumCpus() {
+  const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_cpus > 0 ? static_cast<int32>(num_cpus) : 1;
+}
+
+
+void WorkerPool::parallelFor(const int32 count, TaskFunction function,
+                             void* arg) {
+  if (count <= 0) {
+    return;
+  }
+
+  // Nothing to share, so skip the handoff entirely.
+  if (num_workers_ == 0 || count == 1) {
+    for (int32 i = 0; i < count; ++i) {
+      function(arg, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  function_ = function;
+  arg_ = arg;
+  count_ = count;
+  next_index_ = 0;
+  busy_workers_ = num_workers_;
+  ++generation_;
+  pthread_cond_broadcast(&work_cond_);
+  pthread_mutex_unlock(&mutex_);
+
+  runItems();
+
+  // Every worker checks in once per batch, so none can miss a generation.
+  pthread_mutex_lock(&mutex_);
+  while (busy_workers_ > 0) {
+    pthread_cond_wait(&done_cond_, &mutex_);
+  }
+  function_ = NULL;
+  arg_ = NULL;
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void WorkerPool::runItems() {
+  int32 index;
+  while ((index = __sync_fetch_and_add(&next_index_, 1)) < count_) {
+    function_(arg_, index);
+  }
+}
+
+
+void* WorkerPool::workerMain(void* arg) {
+  WorkerPool* const pool = static_cast<WorkerPool*>(arg);
+  int32 generation = 0;
+
+  while (true) {
+    pthread_mutex_lock(&pool->mutex_);
+    while (!pool->shutdown_ && pool->generation_ == generation) {
+      pthread_cond_wait(&pool->work_cond_, &pool->mutex_);
+    }
+
+    if (pool->shutdown_) {
+      pthread_mutex_unlock(&pool->mutex_);
+      break;
+    }
+
+    generation = pool->generation_;
+    pthread_mutex_unlock(&pool->mutex_);
+
+    pool->runItems();
+
+    pthread_mutex_lock(&pool->mutex_);
+    if (--pool->busy_workers_ == 0) {
+      pthread_cond_signal(&pool->done_cond_);
+    }
+    pthread_mutex_unlock(&pool->mutex_);
+  }
+
+  return NULL;
+}
+
+
+WorkerThread::WorkerThread() :
+    started_(false),
+    function_(NULL),
+    arg_(NULL),
+    busy_(false),
+    shutdown_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&work_cond_, NULL);
+  pthread_cond_init(&done_cond_, NULL);
+}
+
+
+WorkerThread::~WorkerThread() {
+  if (started_) {
+    pthread_mutex_lock(&mutex_);
+    shutdown_ = true;
+    pthread_cond_signal(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+
+    // Any task in flight finishes before the thread sees the shutdown.
+    pthread_join(thread_, NULL);
+  }
+
+  pthread_cond_destroy(&done_cond_);
+  pthread_cond_destroy(&work_cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+void WorkerThread::start(TaskFunction function, void* arg) {
+  wait();
+
+  if (!started_) {
+    if (pthread_create(&thread_, NULL, threadMain, this) != 0) {
+      LOGW("Failed to create worker thread, running inline.");
+      function(arg);
+      return;
+    }
+    started_ = true;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  function_ = function;
+  arg_ = arg;
+  busy_ = true;
+  pthread_cond_signal(&work_cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void WorkerThread::wait() {
+  pthread_mutex_lock(&mutex_);
+  while (busy_) {
+    pthread_cond_wait(&done_cond_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void* WorkerThread::threadMain(void* arg) {
+  WorkerThread* const worker = static_cast<WorkerThread*>(arg);
+
+  pthread_mutex_lock(&worker->mutex_);
+  while (true) {
+    while (!worker->busy_ && !worker->shutdown_) {
+      pthread_cond_wait(&worker->work_cond_, &worker->mutex_);
+    }
+
+    if (!worker->busy_) {
+      break;
+    }
+
+    TaskFunction const function = worker->function_;
+    void* const task_arg = worker->arg_;
+    pthread_mutex_unlock(&worker->mutex_);
+
+    function(task_arg);
+
+    pthread_mutex_lock(&worker->mutex_);
+    worker->function_ = NULL;
+    worker->arg_ = NULL;
+    worker->busy_ = false;
+    pthread_cond_broadcast(&worker->done_cond_);
+  }
+  pthread_mutex_unlock(&worker->mutex_);
+
+  return NULL;
+}
+
+}  // namespace flow
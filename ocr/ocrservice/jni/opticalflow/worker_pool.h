@@ -0,0 +1,119 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Persistent pool of worker threads for splitting per-frame work into
+// independent items. Workers are created once and sleep between calls, so the
+// pool can be reused every frame without thread creation overhead. A
+// WorkerThread runs a whole stage in the background instead, for overlapping
+// consecutive frames.
+
+#ifndef JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_WORKER_POOL_H_
+#define JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_WORKER_POOL_H_
+
+#include <pthread.h>
+
+#include "types.h"
+
+namespace flow {
+
+// A pool may only be driven by one caller at a time.
+class WorkerPool {
+ public:
+  typedef void (*TaskFunction)(void* arg, const int32 index);
+
+  // Creates a pool that runs work on num_threads threads, including the
+  // calling thread. A pool with one thread runs everything inline.
+  explicit WorkerPool(const int32 num_threads);
+  ~WorkerPool();
+
+  // Runs function(arg, i) for every i in [0, count) and blocks until all
+  // items have completed. Items are claimed dynamically, so uneven items
+  // balance across workers.
+  void parallelFor(const int32 count, TaskFunction function, void* arg);
+
+  inline int32 getNumThreads() const {
+    return num_workers_ + 1;
+  }
+
+  // Returns the number of online CPUs, or 1 if it can't be determined.
+  static int32 getNumCpus();
+
+ private:
+  static void* workerMain(void* arg);
+
+  // Claims and runs items from the current batch until none remain.
+  void runItems();
+
+  int32 num_workers_;
+  pthread_t* workers_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_cond_;
+  pthread_cond_t done_cond_;
+
+  // Current batch, guarded by mutex_ except for next_index_, which is
+  // claimed with atomic increments.
+  TaskFunction function_;
+  void* arg_;
+  int32 count_;
+  volatile int32 next_index_;
+  int32 generation_;
+  int32 busy_workers_;
+  bool shutdown_;
+};
+
+// A single persistent thread that runs one task at a time in the background,
+// so the caller can overlap its own work with the task. The thread is created
+// on first use. Tasks may only be started by one caller at a time, but any
+// thread may wait for them.
+class WorkerThread {
+ public:
+  typedef void (*TaskFunction)(void* arg);
+
+  WorkerThread();
+  ~WorkerThread();
+
+  // Waits for the previous task, then starts function(arg) on the worker and
+  // returns. Runs the task inline if the thread can't be created.
+  void start(TaskFunction function, void* arg);
+
+  // Blocks until the last started task has completed.
+  void wait();
+
+ private:
+  static void* threadMain(void* arg);
+
+  bool started_;
+  pthread_t thread_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_cond_;
+  pthread_cond_t done_cond_;
+
+  // Pending task, guarded by mutex_.
+  TaskFunction function_;
+  void* arg_;
+  bool busy_;
+  bool shutdown_;
+};
+
+// Holds a mutex from construction until it goes out of scope.
+class MutexLock {
+ public:
+  explicit MutexLock(pthread_mutex_t* const mutex) : mutex_(mutex) {
+    pthread_mutex_lock(mutex_);
+  }
+
+  ~MutexLock() {
+    pthread_mutex_unlock(mutex_);
+  }
+
+ private:
+  pthread_mutex_t* const mutex_;
+
+  MutexLock(const MutexLock&);
+  void operator=(const MutexLock&);
+};
+
+}  // namespace flow
+
+#endif  // JAVA_COM_GOOGLE_ANDROID_APPS_UNVEIL_JNI_OPTICALFLOW_WORKER_POOL_H_
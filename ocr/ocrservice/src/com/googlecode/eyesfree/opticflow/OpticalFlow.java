@@ -17,6 +17,7 @@
 package com.googlecode.eyesfree.opticflow;
 
 import android.graphics.PointF;
+import android.graphics.RectF;
 
 /**
  * Interface to native optical flow library.
@@ -32,13 +33,68 @@ public class OpticalFlow {
         System.loadLibrary("opticalflow");
     }
 
+    /**
+     * Number of floats each object takes up in the array returned by
+     * {@link #getObjects}: id, center x, center y, width, height, rotation in
+     * radians since registration, and the number of features the last update
+     * was fit to (0 if the object could only follow the flow around it).
+     */
+    public static final int OBJECT_STEP = 7;
+
+    /**
+     * Tracking parameters, fixed once the tracker is initialized. Smaller
+     * windows and fewer levels and iterations trade accuracy for latency.
+     */
+    public static class Parameters {
+        // Maximum number of features tracked per frame
+        public int max_features = 512;
+
+        // Pyramid levels used for tracking (at most 6)
+        public int num_levels = 4;
+
+        // Radius of the tracking window (at most 5)
+        public int window_size = 3;
+
+        // Tracking iterations per feature at each pyramid level
+        public int num_iterations = 3;
+
+        // Frames of history kept for getAccumulatedDelta (at least 2)
+        public int num_frames = 128;
+
+        // Redetect features when fewer than this many are still tracked
+        public int min_features = 6;
+
+        // Milliseconds between forced feature regeneration
+        public int regen_features_ms = 400;
+
+        // Tracking threads, including the caller (0 = one per CPU)
+        public int num_threads = 0;
+
+        // Weigh features far from a region query at their grid cell's
+        // centroid. Exact queries cost time linear in the feature count;
+        // approximate ones depend mostly on the grid size, but drift a
+        // fraction of a pixel
+        public boolean approximate_queries = false;
+    }
+
     @Override
     protected void finalize() {
         resetNative();
     }
 
     public void initialize(int width, int height, int downsampleFactor) {
-        initNative(width, height, downsampleFactor);
+        initialize(width, height, downsampleFactor, new Parameters());
+    }
+
+    /**
+     * Initializes the tracker with the given parameters.
+     *
+     * @throws IllegalArgumentException if a parameter is out of range
+     */
+    public void initialize(int width, int height, int downsampleFactor, Parameters params) {
+        if (!initNative(width, height, downsampleFactor, params)) {
+            throw new IllegalArgumentException("Invalid optical flow parameters");
+        }
     }
 
     public void setImage(byte[] data, long timestamp) {
@@ -51,6 +107,27 @@ public class OpticalFlow {
         printInfoNative();
     }
 
+    /**
+     * Pipelined equivalent of {@link #setImage} followed by
+     * {@link #computeOpticalFlow}. Builds the new frame's pyramid while the
+     * previous frame is still being tracked in the background, then returns
+     * without waiting for the new frame to be tracked. The data array may be
+     * reused once this returns. Other threads may read results and track
+     * objects meanwhile; they see the last frame that finished tracking.
+     */
+    public void computeOpticalFlowAsync(byte[] data, long timestamp) {
+        computeFlowAsyncNative(data, timestamp, true);
+    }
+
+    /**
+     * Blocks until the frame passed to {@link #computeOpticalFlowAsync} has
+     * been tracked.
+     */
+    public void waitForOpticalFlow() {
+        waitForFlowNative();
+        printInfoNative();
+    }
+
     public float[] getFeatures(boolean onlyReturnCorrespondingFeatures) {
         return getFeaturesNative(onlyReturnCorrespondingFeatures);
     }
@@ -68,9 +145,33 @@ public class OpticalFlow {
         addInterestRegionNative(numX, numY, left, top, right, bottom);
     }
 
+    /**
+     * Starts tracking a box, such as a detected text area, as it was at the
+     * given timestamp. The box follows the features inside it each time the
+     * optical flow is computed.
+     *
+     * @return the object's id, or -1 if too many objects are tracked already
+     */
+    public int registerObject(RectF box, long timestamp) {
+        return registerObjectNative(box.left, box.top, box.right, box.bottom, timestamp);
+    }
+
+    public void unregisterObject(int id) {
+        unregisterObjectNative(id);
+    }
+
+    /**
+     * Returns every tracked object in one array, {@link #OBJECT_STEP} floats
+     * per object.
+     */
+    public float[] getObjects() {
+        return getObjectsNative();
+    }
+
     /*********************** NATIVE METHODS *************************************/
 
-    private native void initNative(int width, int height, int downsampleFactor);
+    private native boolean initNative(
+            int width, int height, int downsampleFactor, Parameters params);
 
     private native void addFrameNative(byte[] data, long timeStamp);
 
@@ -78,6 +179,10 @@ public class OpticalFlow {
 
     private native void computeFlowNative();
 
+    private native void computeFlowAsyncNative(byte[] data, long timeStamp, boolean cachedOk);
+
+    private native void waitForFlowNative();
+
     private native void printInfoNative();
 
     private native void getAccumulatedDeltaNative(
@@ -88,5 +193,12 @@ public class OpticalFlow {
 
     private native float[] getFeaturesNative(boolean onlyReturnCorrespondingFeatures);
 
+    private native int registerObjectNative(
+            float left, float top, float right, float bottom, long timestamp);
+
+    private native void unregisterObjectNative(int id);
+
+    private native float[] getObjectsNative();
+
     private native void resetNative();
 }
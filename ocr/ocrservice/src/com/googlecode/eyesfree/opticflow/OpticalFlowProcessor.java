@@ -165,13 +165,16 @@ public class OpticalFlowProcessor extends FrameProcessor {
 
     @Override
     protected synchronized void onPreprocess(final TimestampedFrame frame) {
-        mOpticalFlow.setImage(frame.getRawData(), frame.getTimestamp());
+        // Tracking continues in the background, so the preview thread only
+        // waits for the previous frame rather than for this one.
+        mOpticalFlow.computeOpticalFlowAsync(frame.getRawData(), frame.getTimestamp());
     }
 
     @Override
     protected synchronized void onProcessFrame(final TimestampedFrame frame) {
-        mOpticalFlow.computeOpticalFlow();
-
+        // Don't wait for tracking here, or the next frame's preprocessing
+        // could never overlap it. Methods that read results wait on their
+        // own.
         if (DebugView.isVisible) {
             updateHistory();
         }
@@ -160,17 +160,74 @@ public class TextTrackerProcessor extends FrameProcessor {
             return;
         }
 
+        // Registered rects were moved natively with every frame, so fetch
+        // them all at once.
+        float[] objects = mOpticalFlow.getObjects();
+
         for (TrackedRect tracked : mTrackedRects) {
-            PointF delta = mOpticalFlow.getAccumulatedDelta(tracked.timestamp,
-                    tracked.rect.centerX(), tracked.rect.centerY(), tracked.radius());
+            int index = findObject(objects, tracked.objectId);
+
+            if (index >= 0) {
+                float centerX = objects[index + 1];
+                float centerY = objects[index + 2];
+                float halfWidth = objects[index + 3] / 2;
+                float halfHeight = objects[index + 4] / 2;
+
+                tracked.rect.set(centerX - halfWidth, centerY - halfHeight, centerX + halfWidth,
+                        centerY + halfHeight);
+            } else {
+                PointF delta = mOpticalFlow.getAccumulatedDelta(tracked.timestamp,
+                        tracked.rect.centerX(), tracked.rect.centerY(), tracked.radius());
+
+                tracked.rect.offset(delta.x, delta.y);
+            }
 
-            tracked.rect.offset(delta.x, delta.y);
             tracked.timestamp = timestamp;
         }
 
         Log.i(TAG, "Updated " + mTrackedRects.size() + " tracked rects");
     }
 
+    /**
+     * @param objects The array returned by {@link OpticalFlow#getObjects}.
+     * @param id The object id to look for.
+     * @return Returns the offset of the object in objects, or -1 if it isn't
+     *         there.
+     */
+    private static int findObject(float[] objects, int id) {
+        if (id < 0) {
+            return -1;
+        }
+
+        for (int i = 0; i < objects.length; i += OpticalFlow.OBJECT_STEP) {
+            if ((int) objects[i] == id) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    /**
+     * Starts tracking rect natively, replacing any box it was tracked with
+     * before.
+     */
+    private void registerRect(TrackedRect rect, long timestamp) {
+        if (mOpticalFlow == null) {
+            return;
+        }
+
+        unregisterRect(rect);
+        rect.objectId = mOpticalFlow.registerObject(rect.rect, timestamp);
+    }
+
+    private void unregisterRect(TrackedRect rect) {
+        if (mOpticalFlow != null && rect.objectId >= 0) {
+            mOpticalFlow.unregisterObject(rect.objectId);
+            rect.objectId = -1;
+        }
+    }
+
     /**
      * Attempts to match the text areas in textAreas with the currently tracked
      * rectangles.
@@ -207,6 +264,7 @@ public class TextTrackerProcessor extends FrameProcessor {
 
                 if (remove) {
                     iterator.remove();
+                    unregisterRect(rect);
                     mOcrRemove.add(rect);
                 }
             }
@@ -225,7 +283,7 @@ public class TextTrackerProcessor extends FrameProcessor {
 
             TrackedRect newRect = new TrackedRect(pix, angle, quality, rect, timestamp);
 
-            onRectDiscovered(newRect);
+            onRectDiscovered(newRect, timestamp);
         }
     }
 
@@ -299,6 +357,7 @@ public class TextTrackerProcessor extends FrameProcessor {
         rect.timestamp = timestamp;
         rect.rect = new RectF(newRect);
         rect.rotation.setRotate(angle, newRect.exactCenterX(), newRect.exactCenterY());
+        registerRect(rect, timestamp);
 
         long presentSince = rect.firstTimestamp;
 
@@ -345,9 +404,11 @@ public class TextTrackerProcessor extends FrameProcessor {
 
     /**
      * @param newRect
+     * @param timestamp
      */
-    private void onRectDiscovered(TrackedRect newRect) {
+    private void onRectDiscovered(TrackedRect newRect, long timestamp) {
         mTrackedRects.add(newRect);
+        registerRect(newRect, timestamp);
     }
 
     public LinkedList<TrackedRect> getOcrAdd() {
@@ -391,6 +452,9 @@ public class TextTrackerProcessor extends FrameProcessor {
 
         public boolean queued;
 
+        /** Id of the native object tracking rect, or -1 if none is. */
+        public int objectId;
+
         public TrackedRect(Pix pix, float quality, float angle, Rect rect, long timestamp) {
             this.pix = pix;
             this.quality = quality;
@@ -399,6 +463,7 @@ public class TextTrackerProcessor extends FrameProcessor {
             this.firstTimestamp = timestamp;
             this.timestamp = timestamp;
             this.missingTimestamp = -1;
+            this.objectId = -1;
 
             rotation = new Matrix();
             rotation.setRotate(angle, rect.exactCenterX(), rect.exactCenterY());
@@ -21,10 +21,24 @@ import android.os.Environment;
 import com.googlecode.leptonica.android.Pix;
 import com.googlecode.leptonica.android.Pixa;
 
+import java.nio.ByteBuffer;
+
 /**
  * @author alanv@google.com (Alan Viverette)
  */
 public class HydrogenTextDetector {
+    /** Layout version written by {@link #exportResults}. */
+    public static final int EXPORT_VERSION = 1;
+
+    /** Size of the export header, in bytes. */
+    public static final int EXPORT_HEADER_SIZE = 20;
+
+    /** Size of each exported text area record, in bytes. */
+    public static final int EXPORT_AREA_SIZE = 24;
+
+    /** Export flag set when area bitmaps are included. */
+    public static final int EXPORT_BITMAPS = 1;
+
     private final int mNative;
 
     static {
@@ -85,6 +99,48 @@ public class HydrogenTextDetector {
         return nativeGetTextConfs(mNative);
     }
 
+    /**
+     * Writes the text areas, confidences and skew angle of the most recent
+     * detection into a direct buffer without creating any Java objects. Read
+     * the buffer using {@link java.nio.ByteOrder#nativeOrder()}.
+     * <p>
+     * The buffer starts with a header of {@link #EXPORT_HEADER_SIZE} bytes:
+     * int version, int total size, int area count, int flags and float skew
+     * angle. One record of {@link #EXPORT_AREA_SIZE} bytes per area follows:
+     * int x, y, width and height, float confidence and the int offset of the
+     * area bitmap from the start of the buffer, or 0 if there is none. Each
+     * bitmap holds one bit per pixel, most significant bit first, with
+     * unpadded rows of (width + 7) / 8 bytes. Zeros after the last row pad
+     * each bitmap to a multiple of 4 bytes, so bitmap offsets are always
+     * multiples of 4.
+     * <p>
+     * If the buffer is too small, only the header is written and the return
+     * value gives the capacity needed.
+     *
+     * @param buffer A direct buffer to fill, starting at index 0.
+     * @param bitmaps Whether to include the binarized text area bitmaps.
+     * @return The number of bytes needed for the results.
+     */
+    public int exportResults(ByteBuffer buffer, boolean bitmaps) {
+        if (buffer == null || !buffer.isDirect()) {
+            throw new IllegalArgumentException("Buffer must be direct");
+        }
+
+        return nativeExportResults(mNative, buffer, bitmaps ? EXPORT_BITMAPS : 0);
+    }
+
+    /**
+     * Returns per-stage timings and counters for the most recent call to
+     * {@link #detectText()}.
+     */
+    public Stats getStats() {
+        Stats stats = new Stats();
+
+        nativeGetStats(mNative, stats);
+
+        return stats;
+    }
+
     public Pix getSourceImage() {
         int nativePix = nativeGetSourceImage(mNative);
 
@@ -105,6 +161,70 @@ public class HydrogenTextDetector {
         nativeSetSourceImage(mNative, pixs.getNativePix());
     }
 
+    /**
+     * Sets the text detection source image from the luminance plane of a
+     * camera preview frame. For NV21 frames, the first width * height bytes
+     * are the Y plane. This skips creating a color Pix and converting it to
+     * grayscale. The buffer is copied and may be reused after calling this
+     * method.
+     *
+     * @param data The frame data, starting with the luminance plane.
+     * @param width The width of the frame in pixels.
+     * @param height The height of the frame in pixels.
+     * @param stride The number of bytes between the starts of adjacent rows.
+     */
+    public void setSourceLuminance(byte[] data, int width, int height, int stride) {
+        if (width <= 0 || height <= 0 || stride < width) {
+            throw new IllegalArgumentException("Invalid luminance dimensions");
+        } else if (data == null || data.length < (height - 1) * stride + width) {
+            throw new IllegalArgumentException("Luminance buffer too small");
+        }
+
+        nativeSetSourceLuminance(mNative, data, width, height, stride);
+    }
+
+    /**
+     * Restricts text detection to a set of rectangles in the source image.
+     * The regions apply to every following call to {@link #detectText()}
+     * until they are changed. Streaming mode is suspended while regions are
+     * set.
+     *
+     * @param rois Regions as interleaved x, y, width and height values, or
+     *            null to process the whole image.
+     */
+    public void setRegionsOfInterest(int[] rois) {
+        if (rois != null && rois.length % 4 != 0) {
+            throw new IllegalArgumentException("Regions must have four values each");
+        }
+
+        nativeSetRegionsOfInterest(mNative, rois);
+    }
+
+    /**
+     * Sets how far the scene moved since the previous frame, for use by the
+     * next call to {@link #detectText()} in streaming mode. Motion is
+     * typically obtained from {@link
+     * com.googlecode.eyesfree.opticflow.OpticalFlow#getAccumulatedDelta}.
+     *
+     * @param dx Horizontal scene motion in pixels.
+     * @param dy Vertical scene motion in pixels.
+     * @param areaDeltas Optional per-area motion of the previous text areas,
+     *            as interleaved x and y values in the order returned by
+     *            {@link #getTextAreas()}, or null to move every area by
+     *            (dx, dy).
+     */
+    public void setMotion(float dx, float dy, float[] areaDeltas) {
+        nativeSetMotion(mNative, dx, dy, areaDeltas);
+    }
+
+    /**
+     * Discards the previous frame kept by streaming mode, so that the next
+     * call to {@link #detectText()} processes the whole image.
+     */
+    public void resetStream() {
+        nativeResetStream(mNative);
+    }
+
     public void detectText() {
         nativeDetectText(mNative);
     }
@@ -122,6 +242,33 @@ public class HydrogenTextDetector {
 
         public String out_dir;
 
+        // Worker threads for parallel stages (1 = serial)
+        public int num_threads;
+
+        // Run the normal and inverted extraction passes concurrently
+        public boolean parallel_passes;
+
+        // Streaming mode for live video: reuse unchanged edge tiles and
+        // carry text areas forward while only the camera moves. When tiles
+        // change, text is only extracted again around them, unless that
+        // covers most of the frame or either frame was deskewed.
+        public boolean streaming;
+
+        // Largest mean pixel difference for an edge tile to be reused
+        public int stream_tile_diff;
+
+        // Frames in a row an edge tile can be reused before recomputing it
+        public int stream_max_reuse;
+
+        // Coarse-to-fine mode: find candidate blocks on a 2x or 4x reduced
+        // image (1 = off), then threshold only those at full resolution.
+        // Other values find no text.
+        public int coarse_reduction;
+
+        public int coarse_margin;
+
+        public int coarse_min_area;
+
         // Edge-based thresholding
         public int edge_tile_x;
 
@@ -146,6 +293,18 @@ public class HydrogenTextDetector {
 
         public float skew_search_min_delta;
 
+        // Largest scene change (percent) for reusing the last skew estimate,
+        // or -1 to sweep every frame
+        public int skew_reuse_max_diff;
+
+        // Frames in a row the last skew estimate can be reused before
+        // sweeping again
+        public int skew_reuse_max_count;
+
+        // Rotate only the region holding edges. Faster, but pixels near its
+        // edges may move a pixel or two from where a full rotation puts them
+        public boolean skew_rotate_region;
+
         // Singleton filter
         public float single_min_aspect;
 
@@ -155,6 +314,9 @@ public class HydrogenTextDetector {
 
         public float single_min_density;
 
+        // Score singletons with the learned confidence model instead of 1.0
+        public boolean single_confidence;
+
         // Quick pair filter
         public float pair_h_ratio;
 
@@ -188,6 +350,20 @@ public class HydrogenTextDetector {
             debug = false;
             out_dir = Environment.getExternalStorageDirectory().toString();
 
+            // Worker threads for parallel stages (1 = serial)
+            num_threads = 1;
+            parallel_passes = false;
+
+            // Streaming mode
+            streaming = false;
+            stream_tile_diff = 4;
+            stream_max_reuse = 30;
+
+            // Coarse-to-fine mode
+            coarse_reduction = 1;
+            coarse_margin = 32;
+            coarse_min_area = 16;
+
             // Edge-based thresholding
             edge_tile_x = 32;
             edge_tile_y = 64;
@@ -202,12 +378,16 @@ public class HydrogenTextDetector {
             skew_sweep_reduction = 8;
             skew_search_reduction = 4;
             skew_search_min_delta = 0.01f;
+            skew_reuse_max_diff = 5;
+            skew_reuse_max_count = 10;
+            skew_rotate_region = false;
 
             // Singleton filter
             single_min_aspect = 0.1f;
             single_max_aspect = 4.0f;
             single_min_area = 4;
             single_min_density = 0.2f;
+            single_confidence = false;
 
             // Quick pair filter
             pair_h_ratio = 1.0f;
@@ -230,6 +410,50 @@ public class HydrogenTextDetector {
         }
     }
 
+    public class Stats {
+        // Indices into wall_ms and cpu_ms
+        public static final int STAGE_EDGES = 0;
+        public static final int STAGE_SKEW = 1;
+        public static final int STAGE_CONNCOMP = 2;
+        public static final int STAGE_PAIRS = 3;
+        public static final int STAGE_CLUSTER = 4;
+        public static final int STAGE_MERGE = 5;
+        public static final int STAGE_TOTAL = 6;
+        public static final int NUM_STAGES = 7;
+
+        // Time per stage in milliseconds. Extraction stages are summed over
+        // the normal and inverted passes.
+        public float[] wall_ms;
+
+        public float[] cpu_ms;
+
+        // Edge tiles recomputed in streaming mode, or -1 if all were computed
+        public int edge_tiles_changed;
+
+        // Text areas were carried over from the previous frame
+        public boolean reused_areas;
+
+        // Regions around changed edge tiles extracted in streaming mode, or
+        // -1 if the whole frame was
+        public int extracted_regions;
+
+        public int components;
+
+        public int pairs_removed;
+
+        public int clusters;
+
+        public int fragments_merged;
+
+        // Scratch memory used by the extraction passes, in bytes
+        public int bytes_allocated;
+
+        public Stats() {
+            wall_ms = new float[NUM_STAGES];
+            cpu_ms = new float[NUM_STAGES];
+        }
+    }
+
     // ******************
     // * NATIVE METHODS *
     // ******************
@@ -250,10 +474,24 @@ public class HydrogenTextDetector {
 
     private static native float[] nativeGetTextConfs(int nativePtr);
 
+    private static native void nativeGetStats(int nativePtr, Stats stats);
+
+    private static native int nativeExportResults(int nativePtr, ByteBuffer buffer, int flags);
+
     private static native int nativeGetSourceImage(int nativePtr);
 
     private static native int nativeSetSourceImage(int nativePtr, int nativePix);
 
+    private static native void nativeSetSourceLuminance(int nativePtr, byte[] data, int width,
+            int height, int stride);
+
+    private static native void nativeSetRegionsOfInterest(int nativePtr, int[] rois);
+
+    private static native void nativeSetMotion(int nativePtr, float dx, float dy,
+            float[] areaDeltas);
+
+    private static native void nativeResetStream(int nativePtr);
+
     private static native void nativeDetectText(int nativePtr);
 
     private static native void nativeClear(int nativePtr);